@@ -27,9 +27,10 @@ TEST_SECTIONS=(
     "B1"
     "B2"
     "B3"
+    "B4"
 )
 
-TEST_DIRS=("kvstore_sequential_tests" "kvstore_parallel_tests" "kvstore_performance_tests" "shardcontroller_tests" "server_tests" "shardkv_client_tests")
+TEST_DIRS=("kvstore_sequential_tests" "kvstore_parallel_tests" "kvstore_performance_tests" "shardcontroller_tests" "server_tests" "shardkv_client_tests" "shardcontroller_performance_tests" "server_performance_tests" "shardkv_client_performance_tests")
 
 declare -A SECTION_DIRS
 SECTION_DIRS["A1"]="kvstore_sequential_tests"
@@ -40,6 +41,7 @@ SECTION_DIRS["A5"]="kvstore_performance_tests"
 SECTION_DIRS["B1"]="shardcontroller_tests"
 SECTION_DIRS["B2"]="server_tests"
 SECTION_DIRS["B3"]="shardkv_client_tests"
+SECTION_DIRS["B4"]="shardcontroller_performance_tests server_performance_tests shardkv_client_performance_tests"
 
 declare -A SECTION_ARGS
 SECTION_ARGS["A1"]="simple"
@@ -50,6 +52,7 @@ SECTION_ARGS["A5"]="concurrent"
 SECTION_ARGS["B1"]=""
 SECTION_ARGS["B2"]=""
 SECTION_ARGS["B3"]=""
+SECTION_ARGS["B4"]=""
 
 EXTENSION="cpp"
 TSAN=""
@@ -0,0 +1,182 @@
+#include "async_client.hpp"
+
+#include <unordered_map>
+
+AsyncClient::AsyncClient(const std::string& server_addr, std::size_t n_conns)
+    : server_addr(server_addr), engine(make_io_engine(IoBackend::EPOLL)) {
+  if (!this->engine) {
+    cerr_color(RED, "Failed to create an I/O engine for AsyncClient.");
+    return;
+  }
+  for (std::size_t i = 0; i < n_conns; i++) {
+    auto conn = std::make_unique<Conn>();
+    conn->conn = connect_to_server(server_addr);
+    if (!conn->conn || !this->engine->add(conn->conn->fd)) {
+      cerr_color(RED, "Failed to connect to KvServer at ", server_addr, '.');
+      conn->failed = true;
+    }
+    this->conns.push_back(std::move(conn));
+  }
+  this->loop_thread = std::thread(&AsyncClient::event_loop, this);
+}
+
+AsyncClient::~AsyncClient() {
+  this->is_stopped = true;
+  if (!this->engine) return;
+  this->engine->wake();
+  this->loop_thread.join();
+
+  for (auto&& conn : this->conns) {
+    if (conn->conn) conn->conn->shutdown();
+    fail(*conn);
+  }
+}
+
+bool AsyncClient::connected() const {
+  for (auto&& conn : this->conns) {
+    std::unique_lock lock(conn->pending_mtx);
+    if (!conn->failed) return true;
+  }
+  return false;
+}
+
+void AsyncClient::send(const Request& req, Callback done) {
+  // Round-robin over the connections, skipping failed ones
+  std::size_t start = this->next_conn++;
+  for (std::size_t i = 0; i < this->conns.size(); i++) {
+    Conn& conn = *this->conns[(start + i) % this->conns.size()];
+
+    std::unique_lock send_lock(conn.send_mtx);
+    {
+      std::unique_lock lock(conn.pending_mtx);
+      if (conn.failed) continue;
+      // Queue the callback before sending, so it's there for the response
+      conn.pending.push_back(std::move(done));
+    }
+    if (!conn.conn->send_request(req)) {
+      // The event loop sees the connection close, and fails its pending ops
+      // (including this one)
+      conn.conn->shutdown();
+    }
+    return;
+  }
+
+  done(std::nullopt);
+}
+
+void AsyncClient::event_loop() {
+  std::unordered_map<int, Conn*> fd_to_conn;
+  for (auto&& conn : this->conns) {
+    if (conn->conn) fd_to_conn[conn->conn->fd] = conn.get();
+  }
+
+  std::vector<int> ready;
+  Response res;
+  while (!this->is_stopped) {
+    ready.clear();
+    if (!this->engine->wait(&ready, 100ms)) break;
+
+    for (int fd : ready) {
+      auto it = fd_to_conn.find(fd);
+      if (it == fd_to_conn.end()) continue;
+      Conn& conn = *it->second;
+
+      Callback done;
+      bool ok = conn.conn->recv_response(&res);
+      if (ok) {
+        std::unique_lock lock(conn.pending_mtx);
+        // A response nobody asked for means we've lost track of the stream
+        ok = !conn.pending.empty();
+        if (ok) {
+          done = std::move(conn.pending.front());
+          conn.pending.pop_front();
+        }
+      }
+
+      if (!ok) {
+        this->engine->remove(fd);
+        fd_to_conn.erase(it);
+        fail(conn);
+        continue;
+      }
+      done(std::move(res));
+    }
+  }
+}
+
+void AsyncClient::fail(Conn& conn) {
+  std::deque<Callback> pending;
+  {
+    std::unique_lock lock(conn.pending_mtx);
+    conn.failed = true;
+    pending.swap(conn.pending);
+  }
+  for (auto&& done : pending) {
+    done(std::nullopt);
+  }
+}
+
+template <typename Result, typename ToResult>
+std::future<Result> AsyncClient::call(const Request& req, ToResult to_result) {
+  auto promise = std::make_shared<std::promise<Result>>();
+  std::future<Result> result = promise->get_future();
+  this->send(req, [promise, to_result](std::optional<Response> res) {
+    promise->set_value(res ? to_result(*res) : Result{});
+  });
+  return result;
+}
+
+std::future<std::optional<std::string>> AsyncClient::Get(
+    const std::string& key) {
+  return this->call<std::optional<std::string>>(
+      GetRequest{key}, [](Response& res) -> std::optional<std::string> {
+        if (auto* get_res = std::get_if<GetResponse>(&res)) {
+          return std::move(get_res->value);
+        }
+        return std::nullopt;
+      });
+}
+
+std::future<bool> AsyncClient::Put(const std::string& key,
+                                   const std::string& value) {
+  return this->call<bool>(PutRequest{key, value}, [](Response& res) {
+    return std::holds_alternative<PutResponse>(res);
+  });
+}
+
+std::future<bool> AsyncClient::Append(const std::string& key,
+                                      const std::string& value) {
+  return this->call<bool>(AppendRequest{key, value}, [](Response& res) {
+    return std::holds_alternative<AppendResponse>(res);
+  });
+}
+
+std::future<std::optional<std::string>> AsyncClient::Delete(
+    const std::string& key) {
+  return this->call<std::optional<std::string>>(
+      DeleteRequest{key}, [](Response& res) -> std::optional<std::string> {
+        if (auto* delete_res = std::get_if<DeleteResponse>(&res)) {
+          return std::move(delete_res->value);
+        }
+        return std::nullopt;
+      });
+}
+
+std::future<std::optional<std::vector<std::string>>> AsyncClient::MultiGet(
+    const std::vector<std::string>& keys) {
+  return this->call<std::optional<std::vector<std::string>>>(
+      MultiGetRequest{keys},
+      [](Response& res) -> std::optional<std::vector<std::string>> {
+        if (auto* multiget_res = std::get_if<MultiGetResponse>(&res)) {
+          return std::move(multiget_res->values);
+        }
+        return std::nullopt;
+      });
+}
+
+std::future<bool> AsyncClient::MultiPut(const std::vector<std::string>& keys,
+                                        const std::vector<std::string>& values) {
+  return this->call<bool>(MultiPutRequest{keys, values}, [](Response& res) {
+    return std::holds_alternative<MultiPutResponse>(res);
+  });
+}
@@ -0,0 +1,121 @@
+#ifndef ASYNC_CLIENT_HPP
+#define ASYNC_CLIENT_HPP
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/io_engine.hpp"
+#include "net/network_conn.hpp"
+
+/*
+ * An asynchronous client for a single KvServer. Operations return immediately,
+ * and complete later, so that a single application thread can keep many of
+ * them in flight.
+ *
+ * Requests are pipelined over a few persistent connections: each is written
+ * as soon as it's issued, without waiting for the responses to the ones before
+ * it. A KvServer answers the requests on a connection in order, so the client
+ * keeps a FIFO of pending operations per connection, and one event loop thread
+ * matches responses to them as they arrive.
+ *
+ * The ops may be issued from any number of threads. Connections aren't
+ * re-established: once one fails, the ops pending on it fail, and new ops go to
+ * the remaining connections.
+ */
+class AsyncClient {
+ public:
+  // Called with the server's response, or std::nullopt if the connection
+  // failed. An overloaded server's OverloadedResponse is passed on as is: it's
+  // up to the caller whether (and when) to resend.
+  using Callback = std::function<void(std::optional<Response>)>;
+
+  static constexpr std::size_t DEFAULT_CONNS = 4;
+
+  /*
+   * Connects to the server at `server_addr` over `n_conns` connections. If it
+   * can't set up its event loop, the client has no connections: it isn't
+   * connected(), and every op fails.
+   */
+  explicit AsyncClient(const std::string& server_addr,
+                       std::size_t n_conns = DEFAULT_CONNS);
+  /*
+   * Stops the event loop; ops still pending fail.
+   */
+  ~AsyncClient();
+
+  /*
+   * Returns whether at least one connection to the server is up.
+   */
+  bool connected() const;
+
+  /*
+   * Sends `req` to the server, and calls `done` when it completes. `done` runs
+   * on the event loop thread (or, if the request can't be sent at all, on the
+   * calling thread), so it must not block.
+   */
+  void send(const Request& req, Callback done);
+
+  // KvServer operations. The futures hold the same results as the
+  // corresponding SimpleClient functions.
+  std::future<std::optional<std::string>> Get(const std::string& key);
+
+  std::future<bool> Put(const std::string& key, const std::string& value);
+
+  std::future<bool> Append(const std::string& key, const std::string& value);
+
+  std::future<std::optional<std::string>> Delete(const std::string& key);
+
+  std::future<std::optional<std::vector<std::string>>> MultiGet(
+      const std::vector<std::string>& keys);
+
+  std::future<bool> MultiPut(const std::vector<std::string>& keys,
+                             const std::vector<std::string>& values);
+
+ private:
+  // A pipelined connection, and the ops waiting on its responses
+  struct Conn {
+    std::shared_ptr<ServerConn> conn;
+    // Keeps callbacks in the order their requests were written
+    std::mutex send_mtx;
+    // Guards pending and failed
+    std::mutex pending_mtx;
+    std::deque<Callback> pending;
+    bool failed = false;
+  };
+
+  /*
+   * Sends `req`, and returns a future holding `to_result` of its response.
+   */
+  template <typename Result, typename ToResult>
+  std::future<Result> call(const Request& req, ToResult to_result);
+
+  /*
+   * Receives responses and completes the pending ops they belong to, until the
+   * client is destroyed.
+   */
+  void event_loop();
+
+  /*
+   * Marks `conn` as failed, and fails the ops pending on it.
+   */
+  static void fail(Conn& conn);
+
+  std::string server_addr;
+  std::vector<std::unique_ptr<Conn>> conns;
+  // Round-robin counter for picking a connection for each request
+  std::atomic<std::size_t> next_conn = 0;
+
+  std::unique_ptr<IoEngine> engine;
+  std::atomic<bool> is_stopped = false;
+  std::thread loop_thread;
+};
+
+#endif /* end of include guard */
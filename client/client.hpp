@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "common/color.hpp"
+#include "net/server_commands.hpp"
 
 class Client {
  public:
@@ -23,9 +24,18 @@ class Client {
   virtual std::optional<std::vector<std::string>> MultiGet(
       const std::vector<std::string>& keys) = 0;
 
+  // Like MultiGet, but returns std::nullopt in place of each missing key's
+  // value, rather than failing altogether.
+  virtual std::optional<std::vector<std::optional<std::string>>>
+  PartialMultiGet(const std::vector<std::string>& keys) = 0;
+
   virtual bool MultiPut(const std::vector<std::string>& keys,
                         const std::vector<std::string>& values) = 0;
 
+  // Runs `ops` in order, returning one result per operation.
+  virtual std::optional<std::vector<BatchResult>> Batch(
+      const std::vector<BatchOp>& ops) = 0;
+
   virtual bool GDPRDelete(const std::string& user) = 0;
 };
 
@@ -19,11 +19,14 @@ void MoveCommand::handle(const std::string& s) {
     return;
   }
 
-  // Enforce that each shard's bounds are valid, and have the same
-  // granularity.
+  // Enforce that each shard's bounds are valid (key prefixes, or hashed
+  // slots, e.g. "#000"), and have the same granularity.
+  auto valid = [](const std::string& bound) {
+    return is_valid(bound) || RoutingTable::parse_slot_bound(bound);
+  };
   std::vector<Shard> shards((tokens.size() - 1) / 2);
   for (size_t i = 1; i < tokens.size(); i += 2) {
-    if (!is_valid(tokens[i]) || !is_valid(tokens[i + 1])) {
+    if (!valid(tokens[i]) || !valid(tokens[i + 1])) {
       cerr_color(RED,
                  "Invalid shard boundaries; valid characters "
                  "(case-insensitive): ",
@@ -1,143 +1,417 @@
 #include "shardkv_client.hpp"
 
-std::optional<std::string> ShardKvClient::Get(const std::string& key) {
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return std::nullopt;
+#include <atomic>
+#include <future>
+#include <thread>
+
+std::shared_ptr<const RoutingTable> ShardKvClient::get_config(
+    bool refresh) {
+  if (!refresh) {
+    std::shared_lock lock(this->config_mtx);
+    if (this->config) return this->config;
+  }
+
+  // Query updates the cached config
+  if (!this->Query()) return nullptr;
+  std::shared_lock lock(this->config_mtx);
+  return this->config;
+}
+
+std::optional<uint64_t> ShardKvClient::get_cached_config_version() {
+  std::shared_lock lock(this->config_mtx);
+  if (!this->config) return std::nullopt;
+  return this->config_version;
+}
+
+void ShardKvClient::cache_config(const ShardControllerConfig& config,
+                                 uint64_t version) {
+  // Compile the routing table before taking the lock
+  auto routes = std::make_shared<const RoutingTable>(config);
+  std::unique_lock lock(this->config_mtx);
+  if (this->config && version < this->config_version) return;
+  this->config = std::move(routes);
+  this->config_version = version;
+}
+
+void ShardKvClient::watch_loop() {
+  // The last config the shardcontroller told us about, which its Watch
+  // responses are deltas of
+  ShardControllerConfig config;
+  uint64_t version = 0;
+  std::shared_ptr<ServerConn> conn;
+  {
+    std::unique_lock lock(this->watch_mtx);
+    conn = this->watch_conn;
+  }
+  std::chrono::milliseconds retry_delay = WATCH_RETRY_DELAY;
+  while (!this->is_stopped) {
+    if (!conn) {
+      {
+        std::unique_lock lock(this->watch_mtx);
+        this->watch_cv.wait_for(lock, retry_delay,
+                                [this] { return this->is_stopped.load(); });
+      }
+      retry_delay = std::min(retry_delay * 2, MAX_WATCH_RETRY_DELAY);
+      conn = connect_to_server(this->shardcontroller_addr);
+      if (!conn) continue;
+      {
+        std::unique_lock lock(this->watch_mtx);
+        if (this->is_stopped) break;
+        this->watch_conn = conn;
+      }
+      // The shardcontroller may have restarted, with versions of its own, so
+      // start over from its whole config, and don't trust the cached one
+      config = ShardControllerConfig{};
+      version = 0;
+      std::unique_lock lock(this->config_mtx);
+      this->config = nullptr;
+    }
+
+    std::optional<Response> res;
+    if (conn->send_request(WatchRequest{version})) {
+      res = conn->recv_response();
+    }
+    auto* watch_res = res ? std::get_if<WatchResponse>(&*res) : nullptr;
+    if (!watch_res) {
+      if (this->is_stopped) break;
+      cerr_color(YELLOW, "Lost watch on shardcontroller; reconnecting.");
+      conn->shutdown();
+      conn = nullptr;
+      continue;
+    }
+    retry_delay = WATCH_RETRY_DELAY;
+    if (watch_res->version == version) continue;
+
+    apply_watch_response(*watch_res, &config);
+    version = watch_res->version;
+    this->cache_config(config, version);
+  }
+}
+
+bool ShardKvClient::with_routing(
+    const std::function<RouteStatus(const RoutingTable&)>& attempt) {
+  bool refresh = false;
+  for (int i = 0; i < MAX_ROUTE_ATTEMPTS; i++) {
+    std::shared_ptr<const RoutingTable> config = this->get_config(refresh);
+    if (!config) return false;
+
+    switch (attempt(*config)) {
+      case RouteStatus::DONE:
+        return true;
+      case RouteStatus::UNASSIGNED:
+        // If even the latest config doesn't assign a key, no server has it
+        if (refresh) return false;
+        break;
+      case RouteStatus::STALE:
+        // The servers may not have caught up with the latest config yet
+        if (refresh) std::this_thread::sleep_for(ROUTE_RETRY_DELAY);
+        break;
+    }
+    refresh = true;
+  }
+  return false;
+}
+
+std::optional<Response> ShardKvClient::request(const std::string& server,
+                                               const Request& req) {
+  bool rerouted = false;
+  std::optional<Response> res =
+      SimpleClient{server, this->pool}.request(req, &rerouted);
+  if (rerouted) {
+    std::unique_lock lock(this->config_mtx);
+    this->config = nullptr;
+  }
+  return res;
+}
+
+std::optional<Response> ShardKvClient::route(const std::string& key,
+                                             const Request& req) {
+  std::optional<Response> res;
+  this->with_routing([&](const RoutingTable& config) {
+    const std::string* server = config.get_server(key);
+    if (!server) return RouteStatus::UNASSIGNED;
+
+    // A server that can't be reached may still have applied the request, so
+    // only its explicit refusal means the config is stale
+    res = this->request(*server, req);
+    if (res && is_not_responsible(*res)) return RouteStatus::STALE;
+    return RouteStatus::DONE;
+  });
+  // If the attempts ran out, pass on the last server's error
+  return res;
+}
 
-  // find responsible server in config
-  std::optional<std::string> server = config->get_server(key);
-  if (!server) return std::nullopt;
+ShardKvClient::RouteStatus ShardKvClient::scatter(
+    const ServerGroups& groups,
+    const std::function<RouteStatus(const std::string&,
+                                    const std::vector<std::size_t>&)>& fn) {
+  // Hand all but one group to the pool, and do that one ourselves
+  std::vector<std::future<RouteStatus>> results;
+  for (auto it = std::next(groups.begin()); it != groups.end(); it++) {
+    results.push_back(this->scatter_pool.submit(
+        [&fn, it] { return fn(it->first, it->second); }));
+  }
 
-  return SimpleClient{*server}.Get(key);
+  RouteStatus status = RouteStatus::DONE;
+  if (!groups.empty() &&
+      fn(groups.begin()->first, groups.begin()->second) == RouteStatus::STALE) {
+    status = RouteStatus::STALE;
+  }
+  // Wait for every group, even once one is stale, since they reference `fn`
+  for (auto&& result : results) {
+    if (result.get() == RouteStatus::STALE) status = RouteStatus::STALE;
+  }
+  return status;
+}
+
+/*
+ * Groups the indices of `keys` by the server responsible for each key under
+ * `config`. Returns std::nullopt if some key isn't assigned to a server.
+ */
+static std::optional<std::map<std::string, std::vector<std::size_t>>>
+group_by_server(const RoutingTable& config,
+                const std::vector<std::string>& keys) {
+  std::map<std::string, std::vector<std::size_t>> groups;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    const std::string* server = config.get_server(keys[i]);
+    if (!server) return std::nullopt;
+    groups[*server].push_back(i);
+  }
+  return groups;
+}
+
+std::optional<std::string> ShardKvClient::Get(const std::string& key) {
+  std::optional<Response> res = this->route(key, GetRequest{key});
+  if (!res) return std::nullopt;
+  if (auto* get_res = std::get_if<GetResponse>(&*res)) {
+    return get_res->value;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to Get value from server: ", error_res->msg);
+  }
+
+  return std::nullopt;
 }
 
 bool ShardKvClient::Put(const std::string& key, const std::string& value) {
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return false;
+  std::optional<Response> res = this->route(key, PutRequest{key, value});
+  if (!res) return false;
+  if (std::get_if<PutResponse>(&*res)) {
+    return true;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to Put value to server: ", error_res->msg);
+  }
 
-  // find responsible server in config, then make Put request
-  std::optional<std::string> server = config->get_server(key);
-  if (!server) return false;
-  return SimpleClient{*server}.Put(key, value);
+  return false;
 }
 
 bool ShardKvClient::Append(const std::string& key, const std::string& value) {
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return false;
+  std::optional<Response> res = this->route(key, AppendRequest{key, value});
+  if (!res) return false;
+  if (std::get_if<AppendResponse>(&*res)) {
+    return true;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to Append value to server: ", error_res->msg);
+  }
 
-  // find responsible server in config, then make Append request
-  std::optional<std::string> server = config->get_server(key);
-  if (!server) return false;
-  return SimpleClient{*server}.Append(key, value);
+  return false;
 }
 
 std::optional<std::string> ShardKvClient::Delete(const std::string& key) {
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return std::nullopt;
+  std::optional<Response> res = this->route(key, DeleteRequest{key});
+  if (!res) return std::nullopt;
+  if (auto* delete_res = std::get_if<DeleteResponse>(&*res)) {
+    return delete_res->value;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to Delete value on server: ", error_res->msg);
+  }
 
-  // find responsible server in config, then make Delete request
-  std::optional<std::string> server = config->get_server(key);
-  if (!server) return std::nullopt;
-  return SimpleClient{*server}.Delete(key);
+  return std::nullopt;
+}
+
+bool ShardKvClient::multiget(const std::vector<std::string>& keys,
+                             bool partial, std::vector<std::string>* values,
+                             std::vector<char>* present) {
+  values->assign(keys.size(), std::string());
+  if (partial) present->assign(keys.size(), false);
+  std::atomic<bool> failed = false;
+
+  // Each server's MultiGet fills in the values at its own keys' indices
+  auto multiget = [&](const std::string& server,
+                      const std::vector<std::size_t>& indices) {
+    MultiGetRequest req;
+    req.keys.reserve(indices.size());
+    for (std::size_t i : indices) {
+      req.keys.push_back(keys[i]);
+    }
+    req.partial = partial;
+
+    std::optional<Response> res = this->request(server, req);
+    if (!res) {
+      failed = true;
+      return RouteStatus::DONE;
+    }
+    if (is_not_responsible(*res)) return RouteStatus::STALE;
+    auto* multiget_res = std::get_if<MultiGetResponse>(&*res);
+    if (!multiget_res ||
+        (partial ? multiget_res->present.size() != (indices.size() + 7) / 8
+                 : multiget_res->values.size() != indices.size())) {
+      if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+        cerr_color(YELLOW, "Failed to MultiGet values on server: ",
+                   error_res->msg);
+      }
+      failed = true;
+      return RouteStatus::DONE;
+    }
+
+    std::size_t next = 0;
+    for (std::size_t j = 0; j < indices.size(); j++) {
+      if (partial && !multiget_res->is_present(j)) continue;
+      if (next == multiget_res->values.size()) {
+        failed = true;
+        break;
+      }
+      (*values)[indices[j]] = std::move(multiget_res->values[next++]);
+      if (partial) (*present)[indices[j]] = true;
+    }
+    return RouteStatus::DONE;
+  };
+
+  bool routed = this->with_routing([&](const RoutingTable& config) {
+    auto groups = group_by_server(config, keys);
+    if (!groups) return RouteStatus::UNASSIGNED;
+    return this->scatter(*groups, multiget);
+  });
+
+  return routed && !failed;
 }
 
 std::optional<std::vector<std::string>> ShardKvClient::MultiGet(
     const std::vector<std::string>& keys) {
   std::vector<std::string> values;
-  values.resize(keys.size());
-  // TODO (Part B, Step 3): Implement!
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return std::nullopt;
-
-  // find responsible servers in config
-  std::map<std::string, std::pair<std::vector<int>, std::vector<std::string>>> serverGets; // server -> (key indices, keys to get)
-  for (size_t i = 0; i < keys.size();i++){
-    std::string key = keys[i];
-    // check if key's server is in serverGets
-    std::optional<std::string> server = config->get_server(key); // first get the key's server
-    if (!server) {// key doesn't have a server
-      return std::nullopt;
-    } 
-
-    if (serverGets.find(server.value()) == serverGets.end()) {
-      // server not in serverGets so add it
-      serverGets[server.value()] = std::pair<std::vector<int>, std::vector<std::string>>();
-    }
-    serverGets[server.value()].first.push_back(i);
-    serverGets[server.value()].second.push_back(key);
-  }
-
-  // do MultiGet for each server
-  for (std::map<std::string, std::pair<std::vector<int>, std::vector<std::string>>>::iterator it = serverGets.begin();it!=serverGets.end();it++){
-    std::string server_name = it->first;
-    std::vector<int> key_indices = it->second.first;
-    std::vector<std::string> keys_to_get = it->second.second;
-    std::optional<std::vector<std::string>> response = SimpleClient{it->first}.MultiGet(keys_to_get);
-    // add to values vector
-    if (!response){
-      return std::nullopt;
-    }
-    for (size_t i = 0; i < response.value().size(); i++){
-      std::string res = response.value()[i];
-      values[key_indices[i]] = res;
-    }
-  }
+  if (!this->multiget(keys, false, &values, nullptr)) return std::nullopt;
   return values;
 }
 
+std::optional<std::vector<std::optional<std::string>>>
+ShardKvClient::PartialMultiGet(const std::vector<std::string>& keys) {
+  std::vector<std::string> values;
+  std::vector<char> present;
+  if (!this->multiget(keys, true, &values, &present)) return std::nullopt;
+
+  std::vector<std::optional<std::string>> results(keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    if (present[i]) results[i] = std::move(values[i]);
+  }
+  return results;
+}
+
 bool ShardKvClient::MultiPut(const std::vector<std::string>& keys,
                              const std::vector<std::string>& values) {
-  // TODO (Part B, Step 3): Implement!
-  // Query shardcontroller for config
-  auto config = this->Query();
-  if (!config) return false;
+  if (keys.size() != values.size()) return false;
+  std::atomic<bool> failed = false;
 
-  // find responsible servers in config
-  std::map<std::string, std::pair<std::vector<std::string>, std::vector<std::string>>> serverPuts; // server -> (keys to put, values to put)
-  for (size_t i = 0; i < keys.size();i++){
-    std::string key = keys[i];
-    std::string value = values[i];
-    // check if key's server is in serverGets
-    std::optional<std::string> server = config->get_server(key); // first get the key's server
-    if (!server) {// key doesn't have a server
-      return false;
-    } 
+  auto multiput = [&](const std::string& server,
+                      const std::vector<std::size_t>& indices) {
+    MultiPutRequest req;
+    req.keys.reserve(indices.size());
+    req.values.reserve(indices.size());
+    for (std::size_t i : indices) {
+      req.keys.push_back(keys[i]);
+      req.values.push_back(values[i]);
+    }
 
-    if (serverPuts.find(server.value()) == serverPuts.end()) {
-      // server not in serverGets so add it
-      serverPuts[server.value()] = std::pair<std::vector<std::string>, std::vector<std::string>>();
+    std::optional<Response> res = this->request(server, req);
+    if (!res) {
+      failed = true;
+      return RouteStatus::DONE;
     }
-    serverPuts[server.value()].first.push_back(key);
-    serverPuts[server.value()].second.push_back(value);
-  }
+    if (is_not_responsible(*res)) return RouteStatus::STALE;
+    if (!std::get_if<MultiPutResponse>(&*res)) {
+      if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+        cerr_color(YELLOW, "Failed to MultiPut values on server: ",
+                   error_res->msg);
+      }
+      failed = true;
+    }
+    return RouteStatus::DONE;
+  };
 
-  // do MultiPut for each server
-  for (std::map<std::string, std::pair<std::vector<std::string>, std::vector<std::string>>>::iterator it = serverPuts.begin();it!=serverPuts.end();it++){
-    std::string server_name = it->first;
-    std::vector<std::string> keys_to_put = it->second.first;
-    std::vector<std::string> values_to_put = it->second.second;
-    bool response = SimpleClient{it->first}.MultiPut(keys_to_put,values_to_put);
-    // add to values vector
-    if (!response){
-      return false;
+  // MultiPut is idempotent, so on a stale config it's safe to redo the
+  // servers that already succeeded
+  bool routed = this->with_routing([&](const RoutingTable& config) {
+    auto groups = group_by_server(config, keys);
+    if (!groups) return RouteStatus::UNASSIGNED;
+    return this->scatter(*groups, multiput);
+  });
+
+  return routed && !failed;
+}
+
+std::optional<std::vector<BatchResult>> ShardKvClient::Batch(
+    const std::vector<BatchOp>& ops) {
+  std::vector<BatchResult> results(ops.size());
+  // Which operations a server has already run. Unlike MultiPut, a batch may
+  // not be idempotent (e.g. an Append), so on a stale config only the servers
+  // that rejected their part are retried.
+  std::vector<char> done(ops.size(), false);
+  std::atomic<bool> failed = false;
+
+  auto batch = [&](const std::string& server,
+                   const std::vector<std::size_t>& indices) {
+    BatchRequest req;
+    req.ops.reserve(indices.size());
+    for (std::size_t i : indices) {
+      req.ops.push_back(ops[i]);
     }
-  }
-  return true;
+
+    std::optional<Response> res = this->request(server, req);
+    if (!res) {
+      failed = true;
+      return RouteStatus::DONE;
+    }
+    if (is_not_responsible(*res)) return RouteStatus::STALE;
+    auto* batch_res = std::get_if<BatchResponse>(&*res);
+    if (!batch_res || batch_res->results.size() != indices.size()) {
+      if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+        cerr_color(YELLOW, "Failed to run Batch on server: ", error_res->msg);
+      }
+      failed = true;
+      return RouteStatus::DONE;
+    }
+    for (std::size_t j = 0; j < indices.size(); j++) {
+      results[indices[j]] = std::move(batch_res->results[j]);
+      done[indices[j]] = true;
+    }
+    return RouteStatus::DONE;
+  };
+
+  bool routed = this->with_routing([&](const RoutingTable& config) {
+    ServerGroups groups;
+    for (std::size_t i = 0; i < ops.size(); i++) {
+      if (done[i]) continue;
+      const std::string* server = config.get_server(ops[i].key);
+      if (!server) return RouteStatus::UNASSIGNED;
+      groups[*server].push_back(i);
+    }
+    return this->scatter(groups, batch);
+  });
+
+  if (!routed || failed) return std::nullopt;
+  return results;
 }
 
 // Shardcontroller functions
 std::optional<ShardControllerConfig> ShardKvClient::Query() {
   QueryRequest req;
-  if (!this->shardcontroller_conn->send_request(req)) return std::nullopt;
-
-  std::optional<Response> res = this->shardcontroller_conn->recv_response();
+  std::optional<Response> res;
+  {
+    std::unique_lock lock(this->shardcontroller_mtx);
+    if (!this->shardcontroller_conn->send_request(req)) return std::nullopt;
+    res = this->shardcontroller_conn->recv_response();
+  }
   if (!res) return std::nullopt;
   if (auto* query_res = std::get_if<QueryResponse>(&*res)) {
+    this->cache_config(query_res->config, query_res->version);
     return query_res->config;
   }
 
@@ -147,11 +421,17 @@ std::optional<ShardControllerConfig> ShardKvClient::Query() {
 bool ShardKvClient::Move(const std::string& dest_server,
                          const std::vector<Shard>& shards) {
   MoveRequest req{dest_server, shards};
-  if (!this->shardcontroller_conn->send_request(req)) return false;
-
-  std::optional<Response> res = this->shardcontroller_conn->recv_response();
+  std::optional<Response> res;
+  {
+    std::unique_lock lock(this->shardcontroller_mtx);
+    if (!this->shardcontroller_conn->send_request(req)) return false;
+    res = this->shardcontroller_conn->recv_response();
+  }
   if (!res) return false;
-  if (auto* move_res = std::get_if<MoveResponse>(&*res)) {
+  if (std::get_if<MoveResponse>(&*res)) {
+    // We know our cached config is out of date now
+    std::unique_lock lock(this->config_mtx);
+    this->config = nullptr;
     return true;
   }
 
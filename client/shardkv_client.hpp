@@ -2,16 +2,27 @@
 #define SHARDKV_CLIENT_HPP
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "client.hpp"
 #include "common/config.hpp"
+#include "net/connection_pool.hpp"
 #include "net/network_conn.hpp"
 #include "net/network_messages.hpp"
+#include "net/routing_table.hpp"
 #include "simple_client.hpp"
+#include "thread_pool.hpp"
 
 class ShardKvClient : public Client {
  public:
@@ -25,9 +36,23 @@ class ShardKvClient : public Client {
     }
     cout_color(BLUE, "Connected to shardcontroller at ",
                this->shardcontroller_addr, '.');
+
+    this->watch_conn = connect_to_server(this->shardcontroller_addr);
+    if (!this->watch_conn) {
+      cerr_color(YELLOW, "Failed to watch shardcontroller for config changes; ",
+                 "retrying.");
+    }
+    this->watcher = std::thread(&ShardKvClient::watch_loop, this);
   }
 
   ~ShardKvClient() {
+    {
+      std::unique_lock lock(this->watch_mtx);
+      this->is_stopped = true;
+      if (this->watch_conn) this->watch_conn->shutdown();
+    }
+    this->watch_cv.notify_all();
+    this->watcher.join();
     this->shardcontroller_conn->shutdown();
   }
 
@@ -43,9 +68,20 @@ class ShardKvClient : public Client {
   std::optional<std::vector<std::string>> MultiGet(
       const std::vector<std::string>& keys);
 
+  std::optional<std::vector<std::optional<std::string>>> PartialMultiGet(
+      const std::vector<std::string>& keys);
+
   bool MultiPut(const std::vector<std::string>& keys,
                 const std::vector<std::string>& values);
 
+  /*
+   * Splits `ops` up by server, keeping their order within each server. Each
+   * server runs its part atomically, but the batch as a whole is not atomic
+   * across servers.
+   */
+  std::optional<std::vector<BatchResult>> Batch(
+      const std::vector<BatchOp>& ops);
+
   bool GDPRDelete(const std::string& user) {
     assert(false);
   }
@@ -54,9 +90,129 @@ class ShardKvClient : public Client {
   std::optional<ShardControllerConfig> Query();
   bool Move(const std::string& dest_server, const std::vector<Shard>& shards);
 
+  // For testing purposes, get the version of the cached config, or
+  // std::nullopt if none is cached (e.g. since a request was rerouted).
+  std::optional<uint64_t> get_cached_config_version();
+
  private:
+  // How many times an operation is routed before giving up, while servers
+  // keep reporting that they're not responsible for its keys.
+  static constexpr int MAX_ROUTE_ATTEMPTS = 8;
+  // Delay between attempts once the config is fresh, to give the servers time
+  // to pick up the new config themselves.
+  static constexpr std::chrono::milliseconds ROUTE_RETRY_DELAY{50};
+  // Delay before reconnecting to the shardcontroller after losing the watch,
+  // doubling with each failed attempt up to MAX_WATCH_RETRY_DELAY.
+  static constexpr std::chrono::milliseconds WATCH_RETRY_DELAY{100};
+  static constexpr std::chrono::milliseconds MAX_WATCH_RETRY_DELAY{5000};
+
+  // Outcome of routing an operation once under some config
+  enum class RouteStatus {
+    DONE,        // the operation completed (successfully or not)
+    UNASSIGNED,  // some key isn't assigned to any server
+    STALE        // a server replied that it's not responsible for a key
+  };
+
+  // Number of threads sending a MultiGet/MultiPut's per-server requests
+  // concurrently (besides the calling thread).
+  static constexpr std::size_t SCATTER_THREADS = 8;
+
+  // Indices of an operation's keys, grouped by the server responsible for them
+  using ServerGroups = std::map<std::string, std::vector<std::size_t>>;
+
+  /*
+   * Returns the cached config (compiled into a routing table), first querying
+   * the shardcontroller for it if there is none or `refresh` is set. Returns
+   * nullptr if the query fails.
+   */
+  std::shared_ptr<const RoutingTable> get_config(bool refresh);
+
+  /*
+   * Caches `config`, the shardcontroller's config at `version`, unless a newer
+   * one is cached already.
+   */
+  void cache_config(const ShardControllerConfig& config, uint64_t version);
+
+  /*
+   * Keeps the cached config up to date by watching the shardcontroller for
+   * changes, so that a Move is picked up as soon as it happens rather than
+   * once a request is misrouted. If the watch fails (e.g. the shardcontroller
+   * restarted), reconnects with backoff, and drops the cached config, which
+   * may have missed changes meanwhile. Exits when the client is destroyed.
+   */
+  void watch_loop();
+
+  /*
+   * Runs `attempt` under the cached config, refreshing the config and retrying
+   * while `attempt` finds it stale (up to MAX_ROUTE_ATTEMPTS times). Returns
+   * false if the attempts run out, no config could be fetched, or a key is
+   * unassigned even under a fresh config.
+   */
+  bool with_routing(
+      const std::function<RouteStatus(const RoutingTable&)>& attempt);
+
+  /*
+   * Sends `req` to `server` over a pooled connection (see
+   * SimpleClient::request). If the server relayed it to the server owning its
+   * keys, the cached config is stale, so it's dropped, and the next operation
+   * fetches a fresh one.
+   */
+  std::optional<Response> request(const std::string& server,
+                                  const Request& req);
+
+  /*
+   * Sends `req` to the server responsible for `key`, retrying as in
+   * with_routing. Returns the server's response, or std::nullopt if it
+   * couldn't be routed or the server couldn't be reached. An unreachable
+   * server isn't retried, since it may have applied the request.
+   */
+  std::optional<Response> route(const std::string& key, const Request& req);
+
+  /*
+   * Gets `keys` from their servers, merging each server's values into
+   * `values` at the keys' positions. For a partial MultiGet, missing keys are
+   * allowed, and `present` records which keys exist; otherwise, it's unused.
+   * Returns false if any server's MultiGet failed, or it couldn't be routed.
+   */
+  bool multiget(const std::vector<std::string>& keys, bool partial,
+                std::vector<std::string>* values, std::vector<char>* present);
+
+  /*
+   * Calls `fn` on each server's group of keys concurrently, on scatter_pool and
+   * the calling thread, and waits for them all. Returns STALE if any call did,
+   * and DONE otherwise.
+   */
+  RouteStatus scatter(
+      const ServerGroups& groups,
+      const std::function<RouteStatus(const std::string&,
+                                      const std::vector<std::size_t>&)>& fn);
+
   std::string shardcontroller_addr;
   std::shared_ptr<ServerConn> shardcontroller_conn;
+  // Serializes request/response exchanges with the shardcontroller
+  std::mutex shardcontroller_mtx;
+
+  // The last config fetched from the shardcontroller, and its version, guarded
+  // by config_mtx; nullptr until the first query, or after a Move or a
+  // request that was rerouted
+  std::shared_ptr<const RoutingTable> config;
+  uint64_t config_version = 0;
+  std::shared_mutex config_mtx;
+
+  // Connection and thread watching the shardcontroller for config changes.
+  // watch_conn is guarded by watch_mtx, which the watcher waits on watch_cv
+  // with between reconnection attempts, for the destructor to wake it.
+  std::shared_ptr<ServerConn> watch_conn;
+  std::thread watcher;
+  std::atomic<bool> is_stopped = false;
+  std::mutex watch_mtx;
+  std::condition_variable watch_cv;
+
+  ThreadPool scatter_pool{SCATTER_THREADS};
+
+  // Persistent connections to KvServers, shared by the SimpleClients we make
+  // for each request
+  std::shared_ptr<ConnectionPool> pool = std::make_shared<ConnectionPool>();
 };
 
 #endif /* end of include guard */
@@ -1,17 +1,65 @@
 #include "simple_client.hpp"
 
-std::optional<std::string> SimpleClient::Get(const std::string& key) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
+#include <chrono>
+#include <random>
+#include <thread>
+
+std::optional<Response> SimpleClient::request(const Request& req,
+                                              bool* rerouted) {
+  thread_local std::minstd_rand rng{std::random_device{}()};
+  for (int attempt = 0;; attempt++) {
+    std::optional<Response> res = this->request_once(req, rerouted);
+    auto* overloaded = res ? std::get_if<OverloadedResponse>(&*res) : nullptr;
+    if (!overloaded || attempt == MAX_OVERLOAD_RETRIES) {
+      if (overloaded) {
+        cerr_color(YELLOW, "KvServer at ", this->server_addr,
+                   " is overloaded, giving up.");
+      }
+      return res;
+    }
+
+    // Full jitter, so that clients shed together don't all come back at once
+    uint64_t backoff = std::min<uint64_t>(
+        uint64_t(std::max(overloaded->retry_after_ms, 1u)) << attempt,
+        MAX_OVERLOAD_BACKOFF_MS);
+    uint64_t wait_ms = backoff / 2 + rng() % (backoff / 2 + 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
   }
+}
 
-  GetRequest req{key};
-  if (!conn->send_request(req)) return std::nullopt;
+std::optional<Response> SimpleClient::request_once(const Request& req,
+                                                   bool* rerouted) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = false;
+    std::shared_ptr<ServerConn> conn =
+        this->pool->acquire(this->server_addr, &reused);
+    if (!conn) {
+      cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
+                 '.');
+      return std::nullopt;
+    }
+
+    Response res;
+    uint8_t flags = 0;
+    bool sent = conn->send_request(req);
+    if (sent && conn->recv_response(&res, &flags)) {
+      this->pool->release(std::move(conn));
+      if (rerouted) *rerouted = flags & MESSAGE_REROUTED;
+      return res;
+    }
+    this->pool->discard(std::move(conn));
+
+    // A fresh connection failing means the server itself is in trouble. Once
+    // the request is sent, the server may have applied it, so only resend it
+    // if that's harmless.
+    if (!reused || (sent && !is_idempotent(req))) break;
+  }
+  return std::nullopt;
+}
 
-  std::optional<Response> res = conn->recv_response();
+std::optional<std::string> SimpleClient::Get(const std::string& key) {
+  GetRequest req{key};
+  std::optional<Response> res = this->request(req);
   if (!res) return std::nullopt;
   if (auto* get_res = std::get_if<GetResponse>(&*res)) {
     return get_res->value;
@@ -23,17 +71,8 @@ std::optional<std::string> SimpleClient::Get(const std::string& key) {
 }
 
 bool SimpleClient::Put(const std::string& key, const std::string& value) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
-  }
-
   PutRequest req{key, value};
-  if (!conn->send_request(req)) return false;
-
-  std::optional<Response> res = conn->recv_response();
+  std::optional<Response> res = this->request(req);
   if (!res) return false;
   if (auto* put_res = std::get_if<PutResponse>(&*res)) {
     return true;
@@ -45,17 +84,8 @@ bool SimpleClient::Put(const std::string& key, const std::string& value) {
 }
 
 bool SimpleClient::Append(const std::string& key, const std::string& value) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
-  }
-
   AppendRequest req{key, value};
-  if (!conn->send_request(req)) return false;
-
-  std::optional<Response> res = conn->recv_response();
+  std::optional<Response> res = this->request(req);
   if (!res) return false;
   if (auto* append_res = std::get_if<AppendResponse>(&*res)) {
     return true;
@@ -67,17 +97,8 @@ bool SimpleClient::Append(const std::string& key, const std::string& value) {
 }
 
 std::optional<std::string> SimpleClient::Delete(const std::string& key) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
-  }
-
   DeleteRequest req{key};
-  if (!conn->send_request(req)) return std::nullopt;
-
-  std::optional<Response> res = conn->recv_response();
+  std::optional<Response> res = this->request(req);
   if (!res) return std::nullopt;
   if (auto* delete_res = std::get_if<DeleteResponse>(&*res)) {
     return delete_res->value;
@@ -90,20 +111,35 @@ std::optional<std::string> SimpleClient::Delete(const std::string& key) {
 
 std::optional<std::vector<std::string>> SimpleClient::MultiGet(
     const std::vector<std::string>& keys) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return std::nullopt;
+  MultiGetRequest req{keys};
+  std::optional<Response> res = this->request(req);
+  if (!res) return std::nullopt;
+  if (auto* multiget_res = std::get_if<MultiGetResponse>(&*res)) {
+    return multiget_res->values;
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to MultiGet values on server: ", error_res->msg);
   }
 
-  MultiGetRequest req{keys};
-  if (!conn->send_request(req)) return std::nullopt;
+  return std::nullopt;
+}
 
-  std::optional<Response> res = conn->recv_response();
+std::optional<std::vector<std::optional<std::string>>>
+SimpleClient::PartialMultiGet(const std::vector<std::string>& keys) {
+  MultiGetRequest req{keys, true};
+  std::optional<Response> res = this->request(req);
   if (!res) return std::nullopt;
   if (auto* multiget_res = std::get_if<MultiGetResponse>(&*res)) {
-    return multiget_res->values;
+    if (multiget_res->present.size() != (keys.size() + 7) / 8) {
+      return std::nullopt;
+    }
+    std::vector<std::optional<std::string>> values(keys.size());
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      if (!multiget_res->is_present(i)) continue;
+      if (next == multiget_res->values.size()) return std::nullopt;
+      values[i] = std::move(multiget_res->values[next++]);
+    }
+    return values;
   } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
     cerr_color(YELLOW, "Failed to MultiGet values on server: ", error_res->msg);
   }
@@ -113,17 +149,8 @@ std::optional<std::vector<std::string>> SimpleClient::MultiGet(
 
 bool SimpleClient::MultiPut(const std::vector<std::string>& keys,
                             const std::vector<std::string>& values) {
-  std::shared_ptr<ServerConn> conn = connect_to_server(this->server_addr);
-  if (!conn) {
-    cerr_color(RED, "Failed to connect to KvServer at ", this->server_addr,
-               '.');
-    return false;
-  }
-
   MultiPutRequest req{keys, values};
-  if (!conn->send_request(req)) return false;
-
-  std::optional<Response> res = conn->recv_response();
+  std::optional<Response> res = this->request(req);
   if (!res) return false;
   if (auto* multiput_res = std::get_if<MultiPutResponse>(&*res)) {
     return true;
@@ -134,6 +161,20 @@ bool SimpleClient::MultiPut(const std::vector<std::string>& keys,
   return false;
 }
 
+std::optional<std::vector<BatchResult>> SimpleClient::Batch(
+    const std::vector<BatchOp>& ops) {
+  BatchRequest req{ops};
+  std::optional<Response> res = this->request(req);
+  if (!res) return std::nullopt;
+  if (auto* batch_res = std::get_if<BatchResponse>(&*res)) {
+    return std::move(batch_res->results);
+  } else if (auto* error_res = std::get_if<ErrorResponse>(&*res)) {
+    cerr_color(YELLOW, "Failed to run Batch on server: ", error_res->msg);
+  }
+
+  return std::nullopt;
+}
+
 bool SimpleClient::GDPRDelete(const std::string& user) {
   // My stakeholder pair is pair #1 where congressperson Kirby wants to delete
   // their account because of controversial tweets about a pandemic 10 years ago.
@@ -1,16 +1,26 @@
 #ifndef SIMPLE_CLIENT_HPP
 #define SIMPLE_CLIENT_HPP
 
+#include <memory>
 #include <optional>
 #include <string>
 
 #include "client.hpp"
+#include "net/connection_pool.hpp"
 #include "net/network_conn.hpp"
 
 class SimpleClient : public Client {
  public:
-  explicit SimpleClient(const std::string& server_addr)
-      : server_addr(server_addr) {
+  /*
+   * Connections to the server are kept open and reused across requests. Pass
+   * `pool` to share connections with other clients (e.g. ShardKvClient shares
+   * one across its per-server SimpleClients); otherwise, the client gets its
+   * own.
+   */
+  explicit SimpleClient(const std::string& server_addr,
+                        std::shared_ptr<ConnectionPool> pool = nullptr)
+      : server_addr(server_addr),
+        pool(pool ? std::move(pool) : std::make_shared<ConnectionPool>()) {
   }
   ~SimpleClient() = default;
 
@@ -26,13 +36,44 @@ class SimpleClient : public Client {
   std::optional<std::vector<std::string>> MultiGet(
       const std::vector<std::string>& keys);
 
+  std::optional<std::vector<std::optional<std::string>>> PartialMultiGet(
+      const std::vector<std::string>& keys);
+
   bool MultiPut(const std::vector<std::string>& keys,
                 const std::vector<std::string>& values);
 
+  std::optional<std::vector<BatchResult>> Batch(
+      const std::vector<BatchOp>& ops);
+
   bool GDPRDelete(const std::string& user);
 
+  /*
+   * Sends `req` to the server over a pooled connection, and returns its
+   * response (which may be an ErrorResponse), or std::nullopt if the server
+   * couldn't be reached. If a reused connection turns out to have gone stale
+   * (e.g. the server restarted), retries once on a new one, unless the request
+   * was sent and isn't idempotent (see is_idempotent).
+   *
+   * If the server is overloaded, backs off (exponentially, with jitter,
+   * starting from the server's retry-after hint) and retries, up to
+   * MAX_OVERLOAD_RETRIES times; the last OverloadedResponse is returned if it
+   * stays overloaded.
+   *
+   * Sets `*rerouted` (if given) to whether the server relayed the request to
+   * the server owning its keys (see KvServer::set_proxy_mode).
+   */
+  std::optional<Response> request(const Request& req,
+                                  bool* rerouted = nullptr);
+
+  static constexpr int MAX_OVERLOAD_RETRIES = 6;
+  static constexpr uint32_t MAX_OVERLOAD_BACKOFF_MS = 1000;
+
  private:
+  // Sends `req` once (retrying only on a stale connection), as above.
+  std::optional<Response> request_once(const Request& req, bool* rerouted);
+
   std::string server_addr;
+  std::shared_ptr<ConnectionPool> pool;
 };
 
 #endif /* end of include guard */
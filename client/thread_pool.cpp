@@ -0,0 +1,33 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(std::size_t n_threads) {
+  for (std::size_t i = 0; i < n_threads; i++) {
+    this->threads.emplace_back(&ThreadPool::work_loop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock lock(this->mtx);
+    this->stopping = true;
+  }
+  this->cv.notify_all();
+  for (auto&& thread : this->threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::work_loop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(this->mtx);
+      this->cv.wait(lock,
+                    [this] { return this->stopping || !this->tasks.empty(); });
+      if (this->tasks.empty()) return;
+      task = std::move(this->tasks.front());
+      this->tasks.pop();
+    }
+    task();
+  }
+}
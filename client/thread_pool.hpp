@@ -0,0 +1,56 @@
+#ifndef CLIENT_THREAD_POOL_HPP
+#define CLIENT_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * A fixed-size pool of worker threads, used by clients to send requests to
+ * several servers at once.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(std::size_t n_threads);
+  /*
+   * Finishes the tasks already submitted, then joins the workers.
+   */
+  ~ThreadPool();
+
+  /*
+   * Runs `fn` on a worker thread. The returned future is ready with its result
+   * (or exception) once it has run.
+   */
+  template <typename Fn>
+  std::future<std::invoke_result_t<Fn>> submit(Fn&& fn) {
+    // std::function must be copyable, and a packaged_task isn't
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn>()>>(
+        std::forward<Fn>(fn));
+    std::future<std::invoke_result_t<Fn>> result = task->get_future();
+    {
+      std::unique_lock lock(this->mtx);
+      this->tasks.emplace([task] { (*task)(); });
+    }
+    this->cv.notify_one();
+    return result;
+  }
+
+ private:
+  void work_loop();
+
+  // Pending tasks, and whether the pool is shutting down; guarded by mtx
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::queue<std::function<void()>> tasks;
+  bool stopping = false;
+
+  std::vector<std::thread> threads;
+};
+
+#endif /* end of include guard */
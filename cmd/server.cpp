@@ -24,7 +24,7 @@ int main(int argc, char* argv[]) {
 
   std::string addr = get_host_address(argv[1]);
   std::string shardcontroller_addr;
-  uint64_t n_workers = N_WORKERS;
+  uint64_t n_workers = default_n_workers();
 
   if (argc == 3) {
     // if second argument contains a colon, then it's a shardcontroller
@@ -43,12 +43,37 @@ int main(int argc, char* argv[]) {
     n_workers = std::stoi(argv[3]);
   }
 
+  // Workers multiplex their connections with epoll, unless io_uring is
+  // requested through the environment (KVSERVER_IO_BACKEND=uring)
+  IoBackend io_backend = IoBackend::EPOLL;
+  if (const char* backend_name = std::getenv("KVSERVER_IO_BACKEND")) {
+    auto backend = parse_io_backend(backend_name);
+    if (!backend) {
+      cerr_color(RED, "KVSERVER_IO_BACKEND must be \"epoll\" or \"uring\".");
+      return EXIT_FAILURE;
+    }
+    io_backend = *backend;
+  }
+
   // If no shardcontroller address specified, Concurrent Store; otherwise,
   // Distributed Store
   if (shardcontroller_addr.empty()) {
-    server = std::make_shared<KvServer>(addr, n_workers);
+    server = std::make_shared<KvServer>(addr, n_workers, io_backend);
   } else {
-    server = std::make_shared<KvServer>(addr, shardcontroller_addr, n_workers);
+    server = std::make_shared<KvServer>(addr, shardcontroller_addr, n_workers,
+                                        io_backend);
+  }
+
+  // Misrouted requests are relayed to their keys' owner, rather than
+  // rejected, if KVSERVER_PROXY is set to 1
+  if (const char* proxy = std::getenv("KVSERVER_PROXY")) {
+    server->set_proxy_mode(std::string(proxy) == "1");
+  }
+
+  // Load on the server's shards is reported to the shardcontroller, for it to
+  // rebalance them, every KVSERVER_LOAD_REPORT_MS milliseconds (if set)
+  if (const char* report_ms = std::getenv("KVSERVER_LOAD_REPORT_MS")) {
+    server->set_load_report_interval(milliseconds(std::stoull(report_ms)));
   }
 
   int ret = server->start();
@@ -56,6 +81,16 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  // Local clients can also connect through the Unix socket or shared-memory
+  // addresses listed in KVSERVER_LISTEN (e.g. "unix:/tmp/kv.sock,shm:/tmp/kv")
+  if (const char* extra_addrs = std::getenv("KVSERVER_LISTEN")) {
+    for (auto&& extra_addr : split(extra_addrs, ',')) {
+      if (!server->listen_on(extra_addr)) {
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
   Repl repl;
   if (argc == 4) {
     // if Distributed Store, add shardcontroller commands
@@ -6,14 +6,16 @@
 
 bool ConcurrentKvStore::Get(const GetRequest* req, GetResponse* res) {
   // TODO (Part A, Step 3 and Step 4): Implement!
-  store.mutexes[store.bucket(req->key)].lock_shared();
-  std::optional<DbItem> get_ret = store.getIfExists(store.bucket(req->key),req->key);
-  if (get_ret != std::nullopt){
-    res->value = get_ret->value;
-    store.mutexes[store.bucket(req->key)].unlock_shared();
+  size_t b = store.bucket(req->key);
+  store.mutexes[b].lock_shared();
+  // copy the value straight out of the bucket (reusing res->value's memory)
+  const DbItem* item = store.find(b, req->key);
+  if (item){
+    res->value = item->value;
+    store.mutexes[b].unlock_shared();
     return true;
   }
-  store.mutexes[store.bucket(req->key)].unlock_shared();
+  store.mutexes[b].unlock_shared();
   return false;
 }
 
@@ -64,8 +66,15 @@ bool ConcurrentKvStore::MultiGet(const MultiGetRequest* req,
     store.mutexes[bucket].lock_shared();
   }
   // do multiget
+  if (req->partial){
+    res->clear_present(req->keys.size());
+  }
   for (size_t i = 0; i < req->keys.size();i++){
     std::optional<DbItem> get_ret = store.getIfExists(store.bucket(req->keys[i]),req->keys[i]);
+    if (get_ret == std::nullopt && req->partial){
+      // leave the key's bit unset and move on
+      continue;
+    }
     if (get_ret == std::nullopt){
       // unlock mutexes
       for (size_t bucket : bucket_indices){
@@ -73,6 +82,9 @@ bool ConcurrentKvStore::MultiGet(const MultiGetRequest* req,
       }
       return false;
     }
+    if (req->partial){
+      res->set_present(i);
+    }
     res->values.push_back(get_ret->value);
   }
   // unlock mutexes
@@ -107,6 +119,74 @@ bool ConcurrentKvStore::MultiPut(const MultiPutRequest* req,
   return true;
 }
 
+bool ConcurrentKvStore::Batch(const BatchRequest* req, BatchResponse* res) {
+  // Each bucket the batch touches, and whether any operation writes to it.
+  // Buckets are locked in ascending order (like MultiGet/MultiPut), and only
+  // exclusively if they're written to.
+  std::map<size_t, bool> bucket_writes;
+  std::vector<size_t> op_buckets(req->ops.size());
+  for (size_t i = 0; i < req->ops.size(); i++){
+    op_buckets[i] = store.bucket(req->ops[i].key);
+    bool& writes = bucket_writes[op_buckets[i]];
+    writes = writes || req->ops[i].type != BatchOpType::GET;
+  }
+  for (auto [bucket, writes] : bucket_writes){
+    if (writes){
+      store.mutexes[bucket].lock();
+    } else {
+      store.mutexes[bucket].lock_shared();
+    }
+  }
+
+  // do the batch, in order
+  res->results.resize(req->ops.size());
+  for (size_t i = 0; i < req->ops.size(); i++){
+    const BatchOp& op = req->ops[i];
+    BatchResult& result = res->results[i];
+    size_t b = op_buckets[i];
+    result.ok = true;
+    result.value.clear();
+    DbItem* item = store.find(b, op.key);
+    switch (op.type){
+      case BatchOpType::GET:
+        if (item){
+          result.value = item->value;
+        } else {
+          result.ok = false;
+        }
+        break;
+      case BatchOpType::PUT:
+        store.insertItem(b, op.key, op.value);
+        break;
+      case BatchOpType::APPEND:
+        if (item){
+          item->value += op.value;
+        } else {
+          store.insertItem(b, op.key, op.value);
+        }
+        break;
+      case BatchOpType::DELETE:
+        if (item){
+          result.value = std::move(item->value);
+          store.removeItem(b, op.key);
+        } else {
+          result.ok = false;
+        }
+        break;
+    }
+  }
+
+  // unlock mutexes
+  for (auto [bucket, writes] : bucket_writes){
+    if (writes){
+      store.mutexes[bucket].unlock();
+    } else {
+      store.mutexes[bucket].unlock_shared();
+    }
+  }
+  return true;
+}
+
 std::vector<std::string> ConcurrentKvStore::AllKeys() {
   // lock mutexes
   for (size_t i = 0; i < store.mutexes.size(); i++){
@@ -127,3 +207,16 @@ std::vector<std::string> ConcurrentKvStore::AllKeys() {
   }
   return all_keys;
 }
+
+std::vector<std::pair<std::string, std::size_t>>
+ConcurrentKvStore::AllKeySizes() {
+  // One bucket at a time: the sizes needn't be a consistent snapshot
+  std::vector<std::pair<std::string, std::size_t>> sizes;
+  for (size_t i = 0; i < store.BUCKET_COUNT; i++) {
+    std::shared_lock lock(store.mutexes[i]);
+    for (auto&& item : store.buckets[i]) {
+      sizes.emplace_back(item.key, item.key.size() + item.value.size());
+    }
+  }
+  return sizes;
+}
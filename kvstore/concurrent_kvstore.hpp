@@ -22,9 +22,7 @@ struct DbItem {
   std::string key;
   std::string value;
 
-  DbItem(std::string& k, std::string& v) {
-    this->key = k;
-    this->value = v;
+  DbItem(const std::string& k, const std::string& v) : key(k), value(v) {
   }
 
   bool operator==(const DbItem& item) {
@@ -37,7 +35,7 @@ struct DbItem {
  */
 class DbMap {
  public:
-  DbMap(std::function<size_t(std::string)> hasher) : hasher(hasher) {
+  DbMap(std::function<size_t(const std::string&)> hasher) : hasher(hasher) {
   }
 
   static constexpr size_t BUCKET_COUNT = 60;
@@ -50,39 +48,46 @@ class DbMap {
   std::array<std::shared_mutex, BUCKET_COUNT> mutexes;
 
   // Return the index of the bucket to search for `key`.
-  size_t bucket(std::string key) const {
+  size_t bucket(const std::string& key) const {
     return hasher(key) % BUCKET_COUNT;
   }
 
   // Returns the DbItem with key 'key' in bucket `b` if it exists, std::nullopt
   // otherwise Assumes that `b` == this->bucket(key).
-  std::optional<DbItem> getIfExists(size_t b, std::string key) {
+  std::optional<DbItem> getIfExists(size_t b, const std::string& key) {
+    const DbItem* item = this->find(b, key);
+    if (!item) return std::nullopt;
+    return *item;
+  }
+
+  // Returns a pointer to the DbItem with key `key` in bucket `b`, or nullptr
+  // if it doesn't exist; unlike getIfExists, nothing is copied. The pointer is
+  // only valid while the bucket's lock is held. Assumes that
+  // `b` == this->bucket(key).
+  DbItem* find(size_t b, const std::string& key) {
     assert(b < BUCKET_COUNT);
-    for (const auto& item : this->buckets[b]) {
+    for (auto& item : this->buckets[b]) {
       if (item.key == key) {
-        return item;
+        return &item;
       }
     }
-    return std::nullopt;
+    return nullptr;
   }
 
   // Insert a new DbItem with key 'key' and value 'value' to bucket `b`.
   // If key already exists, updates value to `value`.
   // Assumes that `b` == this->bucket(key).
-  void insertItem(size_t b, std::string key, std::string value) {
-    assert(b < BUCKET_COUNT);
-    for (auto& item : this->buckets[b]) {
-      if (item.key == key) {
-        item.value = value;
-        return;
-      }
+  void insertItem(size_t b, const std::string& key, const std::string& value) {
+    if (DbItem* item = this->find(b, key)) {
+      item->value = value;
+      return;
     }
     this->buckets[b].emplace_back(key, value);
   }
 
   // Remove a DbItem with key `key` from bucket `b`.
   // Assumes that `b` == this->getBucketIndex(key).
-  bool removeItem(size_t b, std::string key) {
+  bool removeItem(size_t b, const std::string& key) {
     assert(b < BUCKET_COUNT);
     size_t num_removed = this->buckets[b].remove_if(
         [&](auto&& item) { 
@@ -92,7 +97,7 @@ class DbMap {
   }
 
  private:
-  std::function<size_t(std::string)> hasher;
+  std::function<size_t(const std::string&)> hasher;
 };
 
 class ConcurrentKvStore : public KvStore {
@@ -100,8 +105,8 @@ class ConcurrentKvStore : public KvStore {
   // The hasher is an *optional* argument used by the performance tests
   // See the performance test comments if you're interested in how it works,
   // otherwise, feel free to ignore!
-  ConcurrentKvStore(
-      std::function<size_t(std::string)> hasher = std::hash<std::string>())
+  ConcurrentKvStore(std::function<size_t(const std::string&)> hasher =
+                        std::hash<std::string>())
       : store(hasher) {
   }
   ~ConcurrentKvStore() = default;
@@ -112,8 +117,10 @@ class ConcurrentKvStore : public KvStore {
   bool Delete(const DeleteRequest* req, DeleteResponse* res) override;
   bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) override;
   bool MultiPut(const MultiPutRequest* req, MultiPutResponse* res) override;
+  bool Batch(const BatchRequest* req, BatchResponse* res) override;
 
   std::vector<std::string> AllKeys() override;
+  std::vector<std::pair<std::string, std::size_t>> AllKeySizes() override;
 
  private:
   // Your internal key-value store implementation!
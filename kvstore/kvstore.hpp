@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "net/server_commands.hpp"
@@ -15,10 +16,17 @@ class KvStore {
   virtual bool Put(const PutRequest* req, PutResponse*) = 0;
   virtual bool Append(const AppendRequest* req, AppendResponse*) = 0;
   virtual bool Delete(const DeleteRequest* req, DeleteResponse* res) = 0;
+  // Fails if any key is missing, unless `req->partial` is set
   virtual bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) = 0;
   virtual bool MultiPut(const MultiPutRequest* req, MultiPutResponse*) = 0;
+  // Runs the batch's operations in order, as one atomic step. Individual
+  // operations may fail (see BatchResult); the batch as a whole succeeds.
+  virtual bool Batch(const BatchRequest* req, BatchResponse* res) = 0;
 
   virtual std::vector<std::string> AllKeys() = 0;
+  // Every key, with the bytes it and its value take up, without copying the
+  // values
+  virtual std::vector<std::pair<std::string, std::size_t>> AllKeySizes() = 0;
 };
 
 #endif /* end of include guard */
@@ -52,11 +52,20 @@ bool SimpleKvStore::MultiGet(const MultiGetRequest* req,
                              MultiGetResponse* res) {
   // TODO (Part A, Step 1 and Step 2): Implement!
   mutex.lock();
+  if (req->partial){
+    res->clear_present(req->keys.size());
+  }
   for (size_t i = 0; i < req->keys.size(); i++){
     if (internal_map.find(req->keys[i]) == internal_map.end()){
+      if (req->partial){
+        continue;
+      }
       mutex.unlock();
       return false;
     }
+    if (req->partial){
+      res->set_present(i);
+    }
     res->values.push_back(internal_map[req->keys[i]]);
   }
   mutex.unlock();
@@ -77,6 +86,43 @@ bool SimpleKvStore::MultiPut(const MultiPutRequest* req, MultiPutResponse*) {
   return true;
 }
 
+bool SimpleKvStore::Batch(const BatchRequest* req, BatchResponse* res) {
+  mutex.lock();
+  res->results.resize(req->ops.size());
+  for (size_t i = 0; i < req->ops.size(); i++){
+    const BatchOp& op = req->ops[i];
+    BatchResult& result = res->results[i];
+    result.ok = true;
+    result.value.clear();
+    auto it = internal_map.find(op.key);
+    switch (op.type){
+      case BatchOpType::GET:
+        if (it == internal_map.end()){
+          result.ok = false;
+        } else {
+          result.value = it->second;
+        }
+        break;
+      case BatchOpType::PUT:
+        internal_map[op.key] = op.value;
+        break;
+      case BatchOpType::APPEND:
+        internal_map[op.key] += op.value;
+        break;
+      case BatchOpType::DELETE:
+        if (it == internal_map.end()){
+          result.ok = false;
+        } else {
+          result.value = std::move(it->second);
+          internal_map.erase(it);
+        }
+        break;
+    }
+  }
+  mutex.unlock();
+  return true;
+}
+
 std::vector<std::string> SimpleKvStore::AllKeys() {
   // TODO (Part A, Step 1 and Step 2): Implement!
   mutex.lock();
@@ -89,3 +135,12 @@ std::vector<std::string> SimpleKvStore::AllKeys() {
   mutex.unlock();
   return all_keys;
 }
+
+std::vector<std::pair<std::string, std::size_t>> SimpleKvStore::AllKeySizes() {
+  std::lock_guard lock(mutex);
+  std::vector<std::pair<std::string, std::size_t>> sizes;
+  for (auto&& [key, value] : internal_map) {
+    sizes.emplace_back(key, key.size() + value.size());
+  }
+  return sizes;
+}
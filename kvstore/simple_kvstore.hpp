@@ -19,8 +19,10 @@ class SimpleKvStore : public KvStore {
   bool Delete(const DeleteRequest* req, DeleteResponse* res) override;
   bool MultiGet(const MultiGetRequest* req, MultiGetResponse* res) override;
   bool MultiPut(const MultiPutRequest* req, MultiPutResponse*) override;
+  bool Batch(const BatchRequest* req, BatchResponse* res) override;
 
   std::vector<std::string> AllKeys() override;
+  std::vector<std::pair<std::string, std::size_t>> AllKeySizes() override;
 
  private:
   // TODO (Part A, Step 1 and Step 2): Implement your internal key-value store
@@ -0,0 +1,34 @@
+#include "net/checksum.hpp"
+
+#include <cstring>
+
+static constexpr uint64_t K1 = 0x9e3779b97f4a7c15ull;
+static constexpr uint64_t K2 = 0xc2b2ae3d27d4eb4full;
+
+static uint64_t rotl(uint64_t v, int bits) {
+  return (v << bits) | (v >> (64 - bits));
+}
+
+static uint64_t mix(uint64_t h, uint64_t word) {
+  return rotl(h ^ (word * K1), 31) * K2;
+}
+
+uint64_t checksum(const void* data, std::size_t n, uint64_t seed) {
+  auto* p = static_cast<const unsigned char*>(data);
+  uint64_t h = seed ^ (n * K2);
+  for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    h = mix(h, word);
+  }
+  if (n) {
+    uint64_t word = 0;
+    memcpy(&word, p, n);
+    h = mix(h, word);
+  }
+  // Finalize, so that every input bit affects every output bit
+  h ^= h >> 33;
+  h *= K1;
+  h ^= h >> 29;
+  return h;
+}
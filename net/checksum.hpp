@@ -0,0 +1,26 @@
+#ifndef NET_CHECKSUM_HPP
+#define NET_CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * A fast 64-bit checksum, for catching data corrupted or cut short in transit
+ * (e.g. the chunks of a shard transfer). It mixes the input 8 bytes at a time
+ * with multiplications and rotations, so it keeps up with a loopback link, but
+ * it isn't cryptographic: it doesn't protect against deliberate tampering.
+ *
+ * Checksums chain: pass a previous result as `seed` to extend it over more
+ * data.
+ */
+uint64_t checksum(const void* data, std::size_t n, uint64_t seed = 0);
+
+// Extends `seed` over a string, including its length (so that the boundaries
+// between consecutive strings count).
+inline uint64_t checksum(const std::string& s, uint64_t seed) {
+  uint64_t size = s.size();
+  return checksum(s.data(), s.size(), checksum(&size, sizeof(size), seed));
+}
+
+#endif /* end of include guard */
@@ -0,0 +1,67 @@
+#include "net/connection_pool.hpp"
+
+#include <sys/socket.h>
+
+#include <cerrno>
+
+std::shared_ptr<ServerConn> ConnectionPool::acquire(
+    const std::string& server_addr, bool* reused) {
+  {
+    std::unique_lock lock(this->mtx);
+    auto it = this->idle.find(server_addr);
+    while (it != this->idle.end() && !it->second.empty()) {
+      // Most recently released first, as it's the least likely to be stale
+      std::shared_ptr<ServerConn> conn = std::move(it->second.back());
+      it->second.pop_back();
+      if (is_healthy(*conn)) {
+        if (reused) *reused = true;
+        return conn;
+      }
+      conn->close();
+    }
+  }
+
+  if (reused) *reused = false;
+  std::shared_ptr<ServerConn> conn = connect_to_server(server_addr);
+  if (conn) this->n_connects++;
+  return conn;
+}
+
+void ConnectionPool::release(std::shared_ptr<ServerConn> conn) {
+  if (!conn) return;
+  {
+    std::unique_lock lock(this->mtx);
+    auto& conns = this->idle[conn->address];
+    if (conns.size() < this->max_idle_per_server) {
+      conns.push_back(std::move(conn));
+      return;
+    }
+  }
+  conn->close();
+}
+
+void ConnectionPool::discard(std::shared_ptr<ServerConn> conn) {
+  if (conn) conn->close();
+}
+
+void ConnectionPool::clear() {
+  std::unordered_map<std::string, std::vector<std::shared_ptr<ServerConn>>>
+      conns;
+  {
+    std::unique_lock lock(this->mtx);
+    conns.swap(this->idle);
+  }
+  for (auto&& [_, server_conns] : conns) {
+    for (auto&& conn : server_conns) {
+      conn->close();
+    }
+  }
+}
+
+bool ConnectionPool::is_healthy(const ServerConn& conn) {
+  // An idle connection should have nothing to read. recv returning 0 means the
+  // server closed it, and data means a stray response we'd misattribute.
+  char byte;
+  ssize_t n = ::recv(conn.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
@@ -0,0 +1,82 @@
+#ifndef NET_CONNECTION_POOL_HPP
+#define NET_CONNECTION_POOL_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net/network_conn.hpp"
+
+/*
+ * A thread-safe pool of persistent connections to servers, keyed by server
+ * address, so that clients don't pay for a new TCP connection (and the server
+ * for an accept) on every request.
+ *
+ * A connection is checked out with acquire(), used by one thread for a full
+ * request/response exchange, and then either handed back with release() or,
+ * if the exchange failed, dropped with discard().
+ */
+class ConnectionPool {
+ public:
+  // The most idle connections kept per server by default.
+  static constexpr std::size_t DEFAULT_MAX_IDLE = 16;
+
+  explicit ConnectionPool(std::size_t max_idle_per_server = DEFAULT_MAX_IDLE)
+      : max_idle_per_server(max_idle_per_server) {
+  }
+  ~ConnectionPool() {
+    this->clear();
+  }
+
+  /*
+   * Checks out a connection to the server at `server_addr`. An idle pooled
+   * connection is reused if one passes a health check (i.e. the server hasn't
+   * closed it); otherwise, a new connection is made. Sets `*reused` (if given)
+   * to whether the connection came from the pool. Returns a null pointer if a
+   * new connection couldn't be made.
+   */
+  std::shared_ptr<ServerConn> acquire(const std::string& server_addr,
+                                      bool* reused = nullptr);
+
+  /*
+   * Returns a connection to the pool after a successful exchange. The
+   * connection is closed instead if its server already has the maximum number
+   * of idle connections.
+   */
+  void release(std::shared_ptr<ServerConn> conn);
+
+  /*
+   * Closes a connection that failed, rather than returning it to the pool.
+   */
+  void discard(std::shared_ptr<ServerConn> conn);
+
+  /*
+   * Closes all idle connections.
+   */
+  void clear();
+
+  // Number of new connections the pool has made, for benchmarking.
+  uint64_t connects() const {
+    return this->n_connects.load();
+  }
+
+ private:
+  /*
+   * Returns whether a connection is still usable: the server hasn't closed it,
+   * and there's no unread data left over on it.
+   */
+  static bool is_healthy(const ServerConn& conn);
+
+  std::size_t max_idle_per_server;
+  std::atomic<uint64_t> n_connects = 0;
+
+  // Idle connections, by server address; guarded by mtx
+  std::mutex mtx;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<ServerConn>>>
+      idle;
+};
+
+#endif /* end of include guard */
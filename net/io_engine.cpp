@@ -0,0 +1,457 @@
+#include "net/io_engine.hpp"
+
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "common/color.hpp"
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+IoEngine::IoEngine() {
+  this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->wake_fd < 0) {
+    perror_color(RED, "eventfd");
+  }
+}
+
+IoEngine::~IoEngine() {
+  if (this->wake_fd >= 0) {
+    close(this->wake_fd);
+  }
+}
+
+void IoEngine::wake() {
+  uint64_t one = 1;
+  if (write(this->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    perror_color(RED, "eventfd write");
+  }
+}
+
+void IoEngine::drain_wake_fd() {
+  uint64_t count;
+  do {
+    this->n_syscalls++;
+  } while (read(this->wake_fd, &count, sizeof(count)) > 0);
+}
+
+/* ============================== epoll ============================== */
+
+class EpollEngine : public IoEngine {
+ public:
+  EpollEngine() {
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+      perror_color(RED, "epoll_create1");
+      return;
+    }
+    this->ctl(EPOLL_CTL_ADD, this->wake_fd, IO_READABLE);
+  }
+  ~EpollEngine() {
+    if (this->epoll_fd >= 0) close(this->epoll_fd);
+  }
+
+  bool ok() const {
+    return this->epoll_fd >= 0 && this->wake_fd >= 0;
+  }
+
+  bool add(int fd) override {
+    if (!this->ctl(EPOLL_CTL_ADD, fd, IO_READABLE)) return false;
+    this->watched[fd] = IO_READABLE;
+    return true;
+  }
+
+  bool remove(int fd) override {
+    auto it = this->watched.find(fd);
+    if (it == this->watched.end()) return false;
+    bool in_set = it->second != 0;
+    this->watched.erase(it);
+    // Fails harmlessly if the socket was already closed
+    return !in_set || this->ctl(EPOLL_CTL_DEL, fd, 0, false);
+  }
+
+  bool watch(int fd, int events) override {
+    auto it = this->watched.find(fd);
+    if (it == this->watched.end()) return false;
+    if (it->second == events) return true;
+    // Hang-ups are reported whatever the events, so a file descriptor watched
+    // for nothing is taken out of the set instead
+    int op = EPOLL_CTL_MOD;
+    if (it->second == 0) {
+      op = EPOLL_CTL_ADD;
+    } else if (events == 0) {
+      op = EPOLL_CTL_DEL;
+    }
+    if (!this->ctl(op, fd, events)) return false;
+    it->second = events;
+    return true;
+  }
+
+  bool wait(std::vector<int>* ready, milliseconds timeout) override {
+    struct epoll_event events[MAX_EVENTS];
+    this->n_syscalls++;
+    int n = epoll_wait(this->epoll_fd, events, MAX_EVENTS, timeout.count());
+    if (n < 0) {
+      if (errno == EINTR) return true;
+      perror_color(RED, "epoll_wait");
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.fd == this->wake_fd) {
+        this->drain_wake_fd();
+      } else {
+        ready->push_back(events[i].data.fd);
+      }
+    }
+    return true;
+  }
+
+  IoBackend backend() const override {
+    return IoBackend::EPOLL;
+  }
+
+ private:
+  static constexpr int MAX_EVENTS = 64;
+  int epoll_fd = -1;
+  // What each registered fd (other than wake_fd) is watched for
+  std::unordered_map<int, int> watched;
+
+  bool ctl(int op, int fd, int events, bool report = true) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & IO_READABLE) ? uint32_t(EPOLLIN) : 0) |
+                ((events & IO_WRITABLE) ? uint32_t(EPOLLOUT) : 0);
+    ev.data.fd = fd;
+    this->n_syscalls++;
+    if (epoll_ctl(this->epoll_fd, op, fd, &ev) < 0) {
+      if (report) perror_color(RED, "epoll_ctl");
+      return false;
+    }
+    return true;
+  }
+};
+
+/* ============================= io_uring ============================= */
+
+#ifdef HAVE_IO_URING
+
+/*
+ * io_uring engine, driven through the raw system calls so that no liburing
+ * dependency is needed. Like EpollEngine, it only reports readiness: workers
+ * still recv requests and send responses with their own system calls, and
+ * what io_uring saves is the epoll_ctl/epoll_wait traffic.
+ *
+ * Each registered fd watched for anything has a one-shot IORING_OP_POLL_ADD
+ * in flight. Once the fd is reported, its poll is re-armed lazily, at the
+ * start of the next wait(), so that the re-arms for a whole batch of requests
+ * ride along with the same io_uring_enter that waits for the next batch. A
+ * single system call therefore both submits and reaps, however many
+ * connections are active. (One-shot polls are used rather than multishot ones
+ * because multishot polls only fire on new wakeups; a request left in the
+ * socket buffer after a pipelined read would otherwise never be reported
+ * again.)
+ */
+class UringEngine : public IoEngine {
+ public:
+  UringEngine() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    this->ring_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (this->ring_fd < 0) {
+      return;
+    }
+    // We need a single mmap for both rings, and timeouts on io_uring_enter
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+      close(this->ring_fd);
+      this->ring_fd = -1;
+      return;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(__u32);
+    size_t cq_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    this->ring_size = std::max(sq_size, cq_size);
+    this->ring = mmap(nullptr, this->ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, this->ring_fd,
+                      IORING_OFF_SQ_RING);
+    this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sqes = (struct io_uring_sqe*)mmap(
+        nullptr, this->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
+    if (this->ring == MAP_FAILED || this->sqes == MAP_FAILED) {
+      perror_color(RED, "mmap");
+      this->teardown();
+      return;
+    }
+
+    char* base = (char*)this->ring;
+    this->sq_head = (unsigned*)(base + params.sq_off.head);
+    this->sq_tail = (unsigned*)(base + params.sq_off.tail);
+    this->sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+    this->sq_entries = params.sq_entries;
+    this->sq_array = (unsigned*)(base + params.sq_off.array);
+    this->cq_head = (unsigned*)(base + params.cq_off.head);
+    this->cq_tail = (unsigned*)(base + params.cq_off.tail);
+    this->cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+    this->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    this->queue_poll(this->wake_fd, WAKE_TAG, IO_READABLE);
+  }
+  ~UringEngine() {
+    this->teardown();
+  }
+
+  bool ok() const {
+    return this->ring_fd >= 0 && this->wake_fd >= 0;
+  }
+
+  bool add(int fd) override {
+    Poll& poll = this->polls[fd];
+    poll.tag = this->next_tag(fd);
+    poll.events = IO_READABLE;
+    poll.armed = this->queue_poll(fd, poll.tag, poll.events);
+    return poll.armed;
+  }
+
+  bool remove(int fd) override {
+    auto it = this->polls.find(fd);
+    if (it == this->polls.end()) return false;
+    Poll poll = it->second;
+    this->polls.erase(it);
+    if (!poll.armed) return true;
+
+    // Flush the cancellation right away, since the poll holds a reference to
+    // the socket that would otherwise keep it open after close
+    return this->cancel_poll(poll.tag) && this->enter(0, 0);
+  }
+
+  bool watch(int fd, int events) override {
+    auto it = this->polls.find(fd);
+    if (it == this->polls.end()) return false;
+    Poll& poll = it->second;
+    if (poll.events == events) return true;
+    poll.events = events;
+    if (poll.armed) {
+      // The poll in flight is for the old events; a new tag tells its
+      // completion apart, if it fires before the cancellation lands
+      if (!this->cancel_poll(poll.tag)) return false;
+      poll.tag = this->next_tag(fd);
+      poll.armed = false;
+    }
+    this->to_rearm.push_back(fd);
+    return true;
+  }
+
+  bool wait(std::vector<int>* ready, milliseconds timeout) override {
+    // Re-arm everything reported by the previous wait (or watched anew) that
+    // is still open, and watched for anything
+    for (int fd : this->to_rearm) {
+      auto it = this->polls.find(fd);
+      if (it == this->polls.end()) continue;
+      Poll& poll = it->second;
+      if (!poll.armed && poll.events != 0) {
+        poll.armed = this->queue_poll(fd, poll.tag, poll.events);
+      }
+    }
+    this->to_rearm.clear();
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)&ts;
+
+    if (this->cq_empty()) {
+      this->n_syscalls++;
+      int ret = syscall(__NR_io_uring_enter, this->ring_fd, this->pending, 1,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                        sizeof(arg));
+      if (ret < 0 && errno != ETIME && errno != EINTR) {
+        perror_color(RED, "io_uring_enter");
+        return false;
+      }
+      if (ret >= 0) this->pending -= std::min<unsigned>(ret, this->pending);
+    } else if (this->pending > 0 && !this->enter(0, 0)) {
+      return false;
+    }
+
+    this->reap(ready);
+    return true;
+  }
+
+  IoBackend backend() const override {
+    return IoBackend::URING;
+  }
+
+ private:
+  static constexpr unsigned RING_ENTRIES = 256;
+  static constexpr uint64_t WAKE_TAG = ~uint64_t(0);
+  static constexpr uint64_t REMOVE_TAG = ~uint64_t(0) - 1;
+
+  int ring_fd = -1;
+  void* ring = MAP_FAILED;
+  size_t ring_size = 0;
+  struct io_uring_sqe* sqes = (struct io_uring_sqe*)MAP_FAILED;
+  size_t sqes_size = 0;
+
+  unsigned *sq_head, *sq_tail, *sq_array, *cq_head, *cq_tail;
+  unsigned sq_mask, cq_mask, sq_entries;
+  struct io_uring_cqe* cqes;
+
+  // Number of SQEs queued but not yet submitted to the kernel.
+  unsigned pending = 0;
+
+  // The poll of each registered fd, tagged (generation << 32 | fd). The
+  // generation distinguishes a stale completion, for a closed connection or
+  // a cancelled poll, from one for a new connection that reused the same fd
+  // number, or the poll that replaced it.
+  struct Poll {
+    uint64_t tag;
+    int events;
+    // Whether the poll is in flight
+    bool armed;
+  };
+  std::unordered_map<int, Poll> polls;
+  uint64_t next_gen = 0;
+  std::vector<int> to_rearm;
+
+  uint64_t next_tag(int fd) {
+    return (++this->next_gen << 32) | uint32_t(fd);
+  }
+
+  void teardown() {
+    if (this->sqes != MAP_FAILED) munmap(this->sqes, this->sqes_size);
+    if (this->ring != MAP_FAILED) munmap(this->ring, this->ring_size);
+    if (this->ring_fd >= 0) close(this->ring_fd);
+    this->ring_fd = -1;
+  }
+
+  bool cq_empty() {
+    return *this->cq_head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+  }
+
+  // Submits queued SQEs (and optionally waits for `min_complete` CQEs).
+  bool enter(unsigned min_complete, unsigned flags) {
+    this->n_syscalls++;
+    int ret = syscall(__NR_io_uring_enter, this->ring_fd, this->pending,
+                      min_complete, flags, nullptr, 0);
+    if (ret < 0) {
+      if (errno == EINTR) return true;
+      perror_color(RED, "io_uring_enter");
+      return false;
+    }
+    this->pending -= std::min<unsigned>(ret, this->pending);
+    return true;
+  }
+
+  struct io_uring_sqe* get_sqe() {
+    unsigned tail = *this->sq_tail;
+    // If the submission queue is full, flush it to the kernel first
+    if (tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE) >=
+        this->sq_entries) {
+      if (!this->enter(0, 0)) return nullptr;
+    }
+    unsigned idx = tail & this->sq_mask;
+    struct io_uring_sqe* sqe = &this->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    this->sq_array[idx] = idx;
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->pending++;
+    return sqe;
+  }
+
+  bool queue_poll(int fd, uint64_t tag, int events) {
+    struct io_uring_sqe* sqe = this->get_sqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = ((events & IO_READABLE) ? POLLIN : 0) |
+                         ((events & IO_WRITABLE) ? POLLOUT : 0);
+    sqe->user_data = tag;
+    return true;
+  }
+
+  // Queues the cancellation of a poll in flight (if it already fired, this
+  // completes with -ENOENT, which is ignored).
+  bool cancel_poll(uint64_t tag) {
+    struct io_uring_sqe* sqe = this->get_sqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = tag;
+    sqe->user_data = REMOVE_TAG;
+    return true;
+  }
+
+  void reap(std::vector<int>* ready) {
+    unsigned head = *this->cq_head;
+    unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      struct io_uring_cqe* cqe = &this->cqes[head & this->cq_mask];
+      uint64_t tag = cqe->user_data;
+      if (tag == WAKE_TAG) {
+        this->drain_wake_fd();
+        this->queue_poll(this->wake_fd, WAKE_TAG, IO_READABLE);
+        continue;
+      }
+      if (tag == REMOVE_TAG || cqe->res == -ECANCELED) continue;
+
+      int fd = int(tag & 0xffffffff);
+      auto it = this->polls.find(fd);
+      if (it == this->polls.end() || it->second.tag != tag) continue;
+      it->second.armed = false;
+      // Errors (and POLLHUP/POLLERR) are reported as readable, so the
+      // following recv observes them and the connection gets closed.
+      ready->push_back(fd);
+      this->to_rearm.push_back(fd);
+    }
+    __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+  }
+};
+
+#endif
+
+std::unique_ptr<IoEngine> make_io_engine(IoBackend backend) {
+#ifdef HAVE_IO_URING
+  if (backend == IoBackend::URING) {
+    auto engine = std::make_unique<UringEngine>();
+    if (engine->ok()) return engine;
+    cerr_color(YELLOW, "io_uring unavailable; falling back to epoll.");
+  }
+#else
+  if (backend == IoBackend::URING) {
+    cerr_color(YELLOW, "io_uring not supported; falling back to epoll.");
+  }
+#endif
+  auto engine = std::make_unique<EpollEngine>();
+  if (!engine->ok()) return nullptr;
+  return engine;
+}
+
+std::optional<IoBackend> parse_io_backend(const std::string& name) {
+  if (name == "epoll") return IoBackend::EPOLL;
+  if (name == "uring") return IoBackend::URING;
+  return std::nullopt;
+}
+
+std::string io_backend_name(IoBackend backend) {
+  switch (backend) {
+    case IoBackend::EPOLL:
+      return "epoll";
+    case IoBackend::URING:
+      return "uring";
+  }
+  return "unknown";
+}
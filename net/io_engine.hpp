@@ -0,0 +1,89 @@
+#ifndef NET_IO_ENGINE_HPP
+#define NET_IO_ENGINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+// The I/O backends a KvServer worker can multiplex its connections with.
+enum class IoBackend { EPOLL, URING };
+
+// What a registered file descriptor is watched for
+#define IO_READABLE 0x1
+#define IO_WRITABLE 0x2
+
+/*
+ * A readiness-based I/O engine, used by server workers to wait on many client
+ * sockets from a single thread. Registered file descriptors are reported by
+ * wait() for as long as they're ready for what they're watched for (i.e.
+ * level-triggered), so a worker may consume a single request per wakeup.
+ *
+ * An engine must only be driven by one thread; wake() is the exception, and
+ * may be called from any thread to interrupt a blocked wait().
+ */
+class IoEngine {
+ public:
+  virtual ~IoEngine();
+
+  /*
+   * Starts/stops watching `fd` for readability. Returns false on error.
+   */
+  virtual bool add(int fd) = 0;
+  virtual bool remove(int fd) = 0;
+
+  /*
+   * Changes what a registered `fd` is watched for, to `events` (e.g.
+   * IO_WRITABLE while a response to it is still being sent, or 0 for nothing,
+   * e.g. while a request read from it is still being handled, so that the
+   * rest of its requests aren't reported over and over meanwhile).
+   * Returns false on error.
+   */
+  virtual bool watch(int fd, int events) = 0;
+
+  /*
+   * Waits up to `timeout` for registered file descriptors to become ready (for
+   * what they're watched for), appending them to `ready`. Returns true on
+   * success or timeout, and false if the engine failed.
+   */
+  virtual bool wait(std::vector<int>* ready, milliseconds timeout) = 0;
+
+  /*
+   * Interrupts a concurrent (or the next) call to wait().
+   */
+  void wake();
+
+  virtual IoBackend backend() const = 0;
+
+  // Number of system calls the engine itself has issued, for benchmarking.
+  uint64_t syscalls() const {
+    return this->n_syscalls.load();
+  }
+
+ protected:
+  IoEngine();
+
+  // Drains pending wake() notifications.
+  void drain_wake_fd();
+
+  // eventfd written to by wake(), and watched internally by each engine.
+  int wake_fd;
+  std::atomic<uint64_t> n_syscalls = 0;
+};
+
+/*
+ * Creates an I/O engine of the given backend. If io_uring was requested but
+ * is unavailable (e.g. old kernel, or blocked by a seccomp policy), falls back
+ * to epoll; check backend() on the result to see which one is in use.
+ */
+std::unique_ptr<IoEngine> make_io_engine(IoBackend backend);
+
+// Parses "epoll" or "uring" (case-sensitive); std::nullopt otherwise.
+std::optional<IoBackend> parse_io_backend(const std::string& name);
+std::string io_backend_name(IoBackend backend);
+
+#endif /* end of include guard */
@@ -0,0 +1,153 @@
+#include "net/lz_codec.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+// Matches are found through a table of 2^HASH_BITS recent positions, indexed
+// by a hash of the 4 bytes there.
+#define HASH_BITS 12
+#define MAX_OFFSET 0xffff
+
+static uint32_t read32(const std::byte* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Appends the part of a length past its nibble, 255 at a time.
+static void put_length(std::vector<std::byte>* out, std::size_t len) {
+  while (len >= 255) {
+    out->push_back(std::byte{255});
+    len -= 255;
+  }
+  out->push_back(std::byte(len));
+}
+
+static void put_sequence(std::vector<std::byte>* out, const std::byte* literals,
+                         std::size_t n_literals, std::size_t offset,
+                         std::size_t match_len) {
+  std::size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t token = uint8_t((n_literals < 15 ? n_literals : 15) << 4) |
+                  uint8_t(match_code < 15 ? match_code : 15);
+  out->push_back(std::byte(token));
+  if (n_literals >= 15) put_length(out, n_literals - 15);
+  out->insert(out->end(), literals, literals + n_literals);
+  if (!match_len) return;
+
+  out->push_back(std::byte(offset & 0xff));
+  out->push_back(std::byte(offset >> 8));
+  if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+bool lz_compress(const std::byte* in, std::size_t n,
+                 std::vector<std::byte>* out) {
+  out->clear();
+  // Uncompressed size, as a varint
+  for (uint64_t sz = n;; sz >>= 7) {
+    if (sz < 0x80) {
+      out->push_back(std::byte(sz));
+      break;
+    }
+    out->push_back(std::byte((sz & 0x7f) | 0x80));
+  }
+
+  // Positions are stored off by one, so that 0 means empty
+  uint32_t table[1 << HASH_BITS] = {};
+  std::size_t anchor = 0;  // start of the pending literals
+  std::size_t pos = 0;
+  while (n >= LZ_MIN_MATCH && pos <= n - LZ_MIN_MATCH) {
+    uint32_t v = read32(in + pos);
+    uint32_t& slot = table[hash32(v)];
+    std::size_t candidate = slot;
+    slot = uint32_t(pos + 1);
+    if (!candidate || pos + 1 - candidate > MAX_OFFSET ||
+        read32(in + candidate - 1) != v) {
+      pos++;
+      continue;
+    }
+
+    std::size_t match = candidate - 1;
+    std::size_t len = LZ_MIN_MATCH;
+    while (pos + len < n && in[match + len] == in[pos + len]) {
+      len++;
+    }
+    put_sequence(out, in + anchor, pos - anchor, pos - match, len);
+    pos += len;
+    anchor = pos;
+    // Give up as soon as we know it won't pay off
+    if (out->size() >= n) return false;
+  }
+
+  put_sequence(out, in + anchor, n - anchor, 0, 0);
+  return out->size() < n;
+}
+
+// Reads the rest of a length past its nibble. Returns false if `in` ends first.
+static bool get_length(const std::byte** in, const std::byte* end,
+                       std::size_t* len) {
+  uint8_t b;
+  do {
+    if (*in == end) return false;
+    b = uint8_t(*(*in)++);
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool lz_decompress(const std::byte* in, std::size_t n,
+                   std::vector<std::byte>* out) {
+  const std::byte* end = in + n;
+  uint64_t size = 0;
+  for (int shift = 0;; shift += 7) {
+    if (in == end || shift > 63) return false;
+    uint8_t b = uint8_t(*in++);
+    size |= uint64_t(b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+  }
+  // Each byte of input expands to at most 255 bytes of output
+  if (size > LZ_MAX_DECOMPRESSED_SIZE || size / 255 > n) return false;
+
+  out->resize(size);
+  std::byte* dst = out->data();
+  std::size_t written = 0;
+  while (in < end) {
+    uint8_t token = uint8_t(*in++);
+
+    std::size_t n_literals = token >> 4;
+    if (n_literals == 15 && !get_length(&in, end, &n_literals)) return false;
+    if (n_literals > std::size_t(end - in) || n_literals > size - written) {
+      return false;
+    }
+    memcpy(dst + written, in, n_literals);
+    in += n_literals;
+    written += n_literals;
+    // The last sequence has no match
+    if (in == end) break;
+
+    if (end - in < 2) return false;
+    std::size_t offset = std::size_t(uint8_t(in[0])) |
+                         std::size_t(uint8_t(in[1])) << 8;
+    in += 2;
+    std::size_t len = token & 0xf;
+    if (len == 15 && !get_length(&in, end, &len)) return false;
+    len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > written || len > size - written) return false;
+
+    // Matches may overlap the bytes they produce (e.g. runs), so copy forward
+    // one byte at a time unless they're far enough apart
+    std::byte* from = dst + written - offset;
+    if (offset >= len) {
+      memcpy(dst + written, from, len);
+    } else {
+      for (std::size_t i = 0; i < len; i++) {
+        dst[written + i] = from[i];
+      }
+    }
+    written += len;
+  }
+  return written == size;
+}
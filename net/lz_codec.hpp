@@ -0,0 +1,40 @@
+#ifndef NET_LZ_CODEC_HPP
+#define NET_LZ_CODEC_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * A small, fast LZ77 codec in the style of LZ4, used to compress large
+ * message bodies on the wire. It trades compression ratio for speed: matches
+ * are found through a single hash table probe, and there is no entropy coding.
+ *
+ * A compressed block starts with the uncompressed size (as a varint), followed
+ * by sequences of
+ *   token | [literal length bytes] | literals | offset | [match length bytes]
+ * where the token's high nibble is the number of literals and its low nibble
+ * the match length minus LZ_MIN_MATCH, either of which continues in extra
+ * bytes if it's 15. The last sequence has literals only.
+ */
+
+#define LZ_MIN_MATCH 4
+// Largest uncompressed size lz_decompress accepts, so that a corrupt (or
+// malicious) header can't make us allocate without bound.
+#define LZ_MAX_DECOMPRESSED_SIZE (size_t(1) << 32)
+
+/*
+ * Compresses `in` into `out` (replacing its contents, but reusing its
+ * capacity). Returns false, leaving `out` unspecified, if the result wouldn't
+ * be smaller than the input.
+ */
+bool lz_compress(const std::byte* in, std::size_t n,
+                 std::vector<std::byte>* out);
+
+/*
+ * Decompresses a block made by lz_compress into `out` (replacing its contents,
+ * but reusing its capacity). Returns false if the block is corrupt.
+ */
+bool lz_decompress(const std::byte* in, std::size_t n,
+                   std::vector<std::byte>* out);
+
+#endif /* end of include guard */
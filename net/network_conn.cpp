@@ -1,10 +1,63 @@
 #include "net/network_conn.hpp"
 
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include <mutex>
 
+// How long a client spins on its shared-memory ring for a response before
+// asking for a doorbell and sleeping.
+static constexpr microseconds SHM_SPIN_TIME{50};
+
+// How long a client streaming a request waits for the server's credit for its
+// next part before giving up on the server (see STREAM_WINDOW).
+static constexpr milliseconds STREAM_CREDIT_TIMEOUT{5000};
+
+// Each message over a shared-memory channel may be announced by a one-byte
+// doorbell on the connection's socket.
+static bool ring_doorbell(int fd) {
+  char doorbell = 0;
+  count_socket_syscall();
+  return send(fd, &doorbell, sizeof(doorbell), MSG_NOSIGNAL) ==
+         sizeof(doorbell);
+}
+
+static bool recv_doorbell(int fd) {
+  char doorbell;
+  return recvall(fd, &doorbell, sizeof(doorbell), 0) == sizeof(doorbell);
+}
+
+// Writes a message to the other side of a shared-memory channel. `announce`
+// rings the doorbell unconditionally (as clients do, since the server waits on
+// its sockets); otherwise, only if the reader asked for it.
+static bool send_shm_message(int fd, ShmChannel& shm, const Message& msg,
+                             bool announce) {
+  if (!shm.write(msg, 400ms)) return false;
+  if (announce || shm.take_peer_waiting()) return ring_doorbell(fd);
+  return true;
+}
+
+// Waits for a message on a shared-memory channel that doesn't announce each
+// message, spinning briefly before sleeping on the doorbell.
+static bool recv_shm_message(int fd, ShmChannel& shm, Message* msg) {
+  while (true) {
+    auto spin_until = steady_clock::now() + SHM_SPIN_TIME;
+    do {
+      if (shm.try_read(msg)) return true;
+    } while (steady_clock::now() < spin_until);
+
+    shm.set_waiting();
+    if (shm.try_read(msg)) {
+      // If the writer took our flag meanwhile, its doorbell is on the way, and
+      // must be consumed so it isn't mistaken for a later one
+      return shm.clear_waiting() || recv_doorbell(fd);
+    }
+    if (!recv_doorbell(fd)) return false;
+  }
+}
+
 bool ClientConn::close() {
   if (this->is_connected) {
     this->is_connected = false;
@@ -22,87 +75,375 @@ bool ClientConn::shutdown() {
 }
 
 std::optional<Request> ClientConn::recv_request() {
-  Message msg{};
+  Request req;
+  if (!this->recv_request(&req)) {
+    return std::nullopt;
+  }
+  return req;
+}
 
-  {
-    std::unique_lock lock(this->recv_mtx);
-    if (!recv_message(fd, &msg)) {
-      return std::nullopt;
+bool ClientConn::recv_request(Request* req, uint8_t* flags) {
+  std::unique_lock lock(this->recv_mtx);
+  bool first = true;
+  do {
+    if (!this->recv_part() || !this->take_request_part(req, flags, first)) {
+      return false;
     }
+    first = false;
+    if ((this->recv_buf.flags & MESSAGE_CONTINUED) && !this->send_credit()) {
+      return false;
+    }
+  } while (this->recv_buf.flags & MESSAGE_CONTINUED);
+  return true;
+}
+
+bool ClientConn::recv_part() {
+  if (this->shm) {
+    // Every request (part) is announced, so the connection is readable
+    // exactly when one is waiting
+    return recv_doorbell(fd) && this->shm->try_read(&this->recv_buf);
   }
+  return recv_message(fd, &this->recv_buf);
+}
 
-  auto req = deserialize_request(msg);
-  if (!req) {
+bool ClientConn::take_request_part(Request* req, uint8_t* flags, bool first) {
+  if (this->recv_buf.flags & MESSAGE_ACCEPTS_COMPRESSION) {
+    this->peer_accepts_compression = true;
+  }
+  bool ok = deserialize_request_part(this->recv_buf, req, first);
+  if (!ok) {
     perror_color(RED, "Error deserializing request.");
   }
-  return req;
+  recycle_message(&this->recv_buf);
+  if (!ok) return false;
+  if (first && flags) *flags = this->recv_buf.flags;
+  return true;
+}
+
+bool ClientConn::try_recv_request(Request* req, uint8_t* flags,
+                                  bool* received, bool* more) {
+  std::unique_lock lock(this->recv_mtx);
+  *received = false;
+  *more = false;
+  if (!this->nonblocking) {
+    if (!this->recv_part()) return false;
+  } else {
+    // Take at most a chunk per call, so that one client sending a large
+    // request doesn't hold up the others
+    size_t budget = FRAME_CHUNK_SIZE;
+    int status = recv_message_some(fd, &this->recv_buf, &this->recv_progress,
+                                   &budget);
+    if (status <= 0) return status == 0;
+  }
+
+  // Only MultiPuts are streamed, and each of their parts is handed over as it
+  // arrives; the previous part has been applied by now, so this one starts
+  // afresh, but for the piece of a split value the previous one ended in
+  bool first = this->recv_first;
+  auto* multiput = std::get_if<MultiPutRequest>(req);
+  if (!first && multiput) {
+    multiput->keys.clear();
+    multiput->values.clear();
+    if (this->recv_split) {
+      multiput->keys.push_back(std::move(this->split_key));
+      multiput->values.push_back(std::move(this->split_value));
+    }
+  }
+  if (!this->take_request_part(req, flags, first)) return false;
+
+  *received = true;
+  *more = this->recv_buf.flags & MESSAGE_CONTINUED;
+  this->recv_first = !*more;
+  this->recv_split = *more && (this->recv_buf.flags & MESSAGE_SPLIT_VALUE);
+  multiput = std::get_if<MultiPutRequest>(req);
+  if (this->recv_split && multiput && !multiput->keys.empty()) {
+    // Kept back until the rest of it arrives
+    this->split_key = std::move(multiput->keys.back());
+    this->split_value = std::move(multiput->values.back());
+    multiput->keys.pop_back();
+    multiput->values.pop_back();
+  }
+  return true;
+}
+
+bool ClientConn::send_credit() {
+  Message credit;
+  credit.type = MessageType::CREDIT;
+  return this->send_serialized(&credit);
+}
+
+bool ClientConn::send_response(const Response& response, uint8_t flags) {
+  std::unique_lock lock(this->send_mtx);
+  if (this->nonblocking) {
+    if (this->send_pending || this->send_res) {
+      cerr_color(RED, "Response to ", this->address,
+                 " sent before the last one was.");
+      return false;
+    }
+    // Its parts are serialized as the socket takes them
+    this->send_res = &response;
+    this->send_next = {};
+    this->send_flags = flags;
+    return this->flush_locked();
+  }
+
+  StreamPosition next;
+  do {
+    if (!serialize_response_part(response, &next, &this->send_buf)) {
+      perror_color(RED, "Error serializing response.");
+      return false;
+    }
+    this->send_buf.flags |= flags;
+    // Shared memory is as fast as copying, so compressing wouldn't pay
+    if (!this->shm && this->peer_accepts_compression) {
+      compress_message(&this->send_buf);
+    }
+
+    bool ok = this->shm
+                  ? send_shm_message(fd, *this->shm, this->send_buf, false)
+                  : send_message(fd, &this->send_buf);
+    recycle_message(&this->send_buf);
+    if (!ok) return false;
+  } while (this->send_buf.flags & MESSAGE_CONTINUED);
+  return true;
+}
+
+bool ClientConn::send_serialized(Message* msg) {
+  std::unique_lock lock(this->send_mtx);
+  if (this->shm) return send_shm_message(fd, *this->shm, *msg, false);
+  if (!this->nonblocking) return send_message(fd, msg);
+
+  if (this->send_pending || this->send_res) {
+    cerr_color(RED, "Response to ", this->address,
+               " sent before the last one was.");
+    return false;
+  }
+  size_t budget = FRAME_CHUNK_SIZE;
+  int status = send_message_some(fd, *msg, &this->send_progress, &budget);
+  if (status != 0) return status > 0;
+  // The rest is sent by flush, but `msg` may be reused before then
+  this->send_buf.type = msg->type;
+  this->send_buf.flags = msg->flags;
+  this->send_buf.sz = msg->sz;
+  this->send_buf.buf.assign(msg->buf.begin(), msg->buf.end());
+  this->send_pending = true;
+  return true;
 }
 
-bool ClientConn::send_response(Response response) {
-  std::optional<Message> msg = serialize_response(response);
-  if (!msg) {
-    perror_color(RED, "Error serializing response.");
+bool ClientConn::set_nonblocking() {
+  if (this->shm) return true;
+  count_socket_syscall();
+  int fl = fcntl(this->fd, F_GETFL);
+  if (fl >= 0) count_socket_syscall();
+  if (fl < 0 || fcntl(this->fd, F_SETFL, fl | O_NONBLOCK) < 0) {
+    perror_color(RED, "fcntl");
     return false;
   }
+  this->nonblocking = true;
+  return true;
+}
+
+bool ClientConn::has_pending_output() {
+  std::unique_lock lock(this->send_mtx);
+  return this->send_pending || this->send_res;
+}
 
+bool ClientConn::flush() {
   std::unique_lock lock(this->send_mtx);
-  return send_message(fd, &*msg);
+  return this->flush_locked();
+}
+
+bool ClientConn::flush_locked() {
+  // Send at most a chunk per call, as try_recv_request receives
+  size_t budget = FRAME_CHUNK_SIZE;
+  while (true) {
+    if (this->send_pending) {
+      int status = send_message_some(fd, this->send_buf, &this->send_progress,
+                                     &budget);
+      if (status == 0) return true;
+      this->send_pending = false;
+      if (!(this->send_buf.flags & MESSAGE_CONTINUED)) this->send_res = nullptr;
+      recycle_message(&this->send_buf);
+      if (status < 0) {
+        this->send_res = nullptr;
+        return false;
+      }
+    }
+    if (!this->send_res) return true;
+
+    if (!serialize_response_part(*this->send_res, &this->send_next,
+                                 &this->send_buf)) {
+      perror_color(RED, "Error serializing response.");
+      this->send_res = nullptr;
+      return false;
+    }
+    this->send_buf.flags |= this->send_flags;
+    if (this->peer_accepts_compression) compress_message(&this->send_buf);
+    this->send_pending = true;
+  }
 }
 
 bool ServerConn::close() {
-  ::close(this->fd);
+  if (this->is_connected.exchange(false)) {
+    ::close(this->fd);
+  }
   return true;
 }
 
 bool ServerConn::shutdown() {
-  ::shutdown(this->fd, SHUT_RDWR);
+  if (this->is_connected) {
+    ::shutdown(this->fd, SHUT_RDWR);
+  }
   return true;
 }
 
-bool ServerConn::send_request(Request req) {
-  std::optional<Message> msg = serialize_request(req);
-  if (!msg) {
-    perror_color(RED, "Error serializing request.");
-    return false;
-  }
-
+bool ServerConn::send_request(const Request& req, uint8_t flags) {
   std::unique_lock lock(this->send_mtx);
-  return send_message(fd, &*msg);
+  StreamPosition next;
+  bool more;
+  do {
+    if (!serialize_request_part(req, &next, &this->send_buf)) {
+      perror_color(RED, "Error serializing request.");
+      return false;
+    }
+    this->send_buf.flags |= flags;
+    if (!this->shm && this->peer_accepts_compression) {
+      compress_message(&this->send_buf);
+    }
+
+    // The server owes credit for each part of a streamed request but the
+    // last, which it answers instead
+    more = this->send_buf.flags & MESSAGE_CONTINUED;
+    if (more && !this->wait_for_credit()) return false;
+    {
+      std::unique_lock credit_lock(this->credit_mtx);
+      if (more) {
+        this->n_credited_parts++;
+      } else {
+        this->n_in_flight++;
+      }
+    }
+
+    bool ok = this->shm
+                  ? send_shm_message(fd, *this->shm, this->send_buf, true)
+                  : send_message(fd, &this->send_buf);
+    recycle_message(&this->send_buf);
+    if (!ok) return false;
+  } while (more);
+  return true;
 }
 
-std::optional<Response> ServerConn::recv_response() {
-  Message msg{};
+// Waits up to `timeout` for `fd` to become readable.
+static bool poll_readable(int fd, milliseconds timeout) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  count_socket_syscall();
+  return poll(&pfd, 1, std::max<int64_t>(timeout.count(), 0)) == 1;
+}
 
-  {
-    std::unique_lock lock(this->recv_mtx);
-    if (!recv_message(fd, &msg)) {
-      return std::nullopt;
+bool ServerConn::wait_for_credit() {
+  auto deadline = steady_clock::now() + STREAM_CREDIT_TIMEOUT;
+  std::unique_lock lock(this->credit_mtx);
+  while (this->n_credited_parts - this->n_credits >= STREAM_WINDOW) {
+    auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+    if (left <= 0ms) {
+      cerr_color(RED, "Timed out waiting for credit from ", this->address);
+      return false;
+    }
+    // With no responses due, whatever comes in next is a credit, so take it
+    // in here, unless another thread is receiving already (and will pass any
+    // credit on)
+    if (this->n_in_flight > 0 || !this->recv_mtx.try_lock()) {
+      this->credit_cv.wait_for(lock, std::min<milliseconds>(left, 10ms));
+      continue;
     }
+    std::unique_lock recv_lock(this->recv_mtx, std::adopt_lock);
+    lock.unlock();
+    bool received = this->shm ? recv_shm_message(fd, *this->shm,
+                                                 &this->recv_buf)
+                              : poll_readable(fd, left) &&
+                                    recv_message(fd, &this->recv_buf);
+    lock.lock();
+    if (!received || this->recv_buf.type != MessageType::CREDIT) {
+      cerr_color(RED, "Failed to receive credit from ", this->address);
+      return false;
+    }
+    this->n_credits++;
   }
+  return true;
+}
 
-  auto res = deserialize_response(msg);
-  if (!res) {
-    perror_color(RED, "Error deserializing response.");
+std::optional<Response> ServerConn::recv_response() {
+  Response res;
+  if (!this->recv_response(&res)) {
+    return std::nullopt;
   }
   return res;
 }
 
+bool ServerConn::recv_response(Response* res, uint8_t* flags) {
+  std::unique_lock lock(this->recv_mtx);
+  bool first = true;
+  while (true) {
+    bool received = this->shm
+                        ? recv_shm_message(fd, *this->shm, &this->recv_buf)
+                        : recv_message(fd, &this->recv_buf);
+    if (!received) {
+      return false;
+    }
+
+    if (this->recv_buf.flags & MESSAGE_ACCEPTS_COMPRESSION) {
+      this->peer_accepts_compression = true;
+    }
+    if (this->recv_buf.type == MessageType::CREDIT) {
+      // For a request being streamed (see send_request), whose response
+      // comes after its credits
+      {
+        std::unique_lock credit_lock(this->credit_mtx);
+        this->n_credits++;
+      }
+      this->credit_cv.notify_all();
+      continue;
+    }
+    bool ok = deserialize_response_part(this->recv_buf, res, first);
+    if (!ok) {
+      perror_color(RED, "Error deserializing response.");
+    }
+    recycle_message(&this->recv_buf);
+    if (!ok) return false;
+    if (first && flags) *flags = this->recv_buf.flags;
+    first = false;
+    if (!(this->recv_buf.flags & MESSAGE_CONTINUED)) break;
+  }
+  std::unique_lock credit_lock(this->credit_mtx);
+  if (this->n_in_flight > 0) this->n_in_flight--;
+  return true;
+}
+
 std::shared_ptr<ClientConn> accept_client(int listener_fd) {
-  // NOTE: ideally, we should use a sockaddr_storage and handle INET vs INET6,
-  // but since we're only supporting IPv4 here, this should be fine.
-  struct sockaddr_in client_addr;
+  // NOTE: ideally, we should handle INET vs INET6, but since we're only
+  // supporting IPv4 (and Unix domain sockets) here, this should be fine.
+  struct sockaddr_storage client_addr;
   socklen_t sin_size = sizeof(client_addr);
+  count_socket_syscall();
   int cfd = accept(listener_fd, (struct sockaddr*)&client_addr, &sin_size);
   if (cfd < 0) {
     // perror_color(RED, "accept");
     return nullptr;
   }
 
-  // get hostname:port for presentability.
+  // Clients of Unix domain sockets are unnamed
+  if (client_addr.ss_family == AF_UNIX) {
+    return std::make_shared<ClientConn>(cfd, "unix");
+  }
+
+  // get ip:port for presentability; numeric, so that accepting a client never
+  // waits on a (reverse) DNS lookup
   char hostbuf[NI_MAXHOST], servbuf[NI_MAXSERV];
   if (getnameinfo((struct sockaddr*)&client_addr, sin_size, hostbuf,
                   sizeof(hostbuf), servbuf, sizeof(servbuf),
-                  NI_NUMERICSERV) != 0) {
+                  NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
     perror_color(RED, "getnameinfo");
     return nullptr;
   }
@@ -112,11 +453,28 @@ std::shared_ptr<ClientConn> accept_client(int listener_fd) {
   return std::make_shared<ClientConn>(cfd, std::string(s));
 }
 
+bool accept_shm_channel(ClientConn* client) {
+  int memfd = recv_fd(client->fd, 1000ms);
+  if (memfd < 0) {
+    cerr_color(RED, "Failed to receive shared memory from ", client->address);
+    return false;
+  }
+  client->shm = ShmChannel::attach(memfd);
+  return client->shm != nullptr;
+}
+
 std::shared_ptr<ServerConn> connect_to_server(const std::string& server_addr) {
   int sfd = connect_to_address(server_addr);
   if (sfd < 0) {
     return nullptr;
   }
 
-  return std::make_shared<ServerConn>(sfd, server_addr);
+  auto conn = std::make_shared<ServerConn>(sfd, server_addr);
+  if (is_shm_address(server_addr)) {
+    conn->shm = ShmChannel::create();
+    if (!conn->shm || !send_fd(sfd, conn->shm->memfd())) {
+      return nullptr;
+    }
+  }
+  return conn;
 }
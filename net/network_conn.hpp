@@ -4,8 +4,12 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <memory>
+
 #include "net/network_messages.hpp"
 #include "net/server_commands.hpp"
+#include "net/shm_channel.hpp"
 #include "net/shardcontroller_commands.hpp"
 
 /*
@@ -34,6 +38,10 @@ struct ClientConn {
   // Whether the client is still connected
   std::atomic<bool> is_connected = true;
 
+  // For clients connected through a "shm:" address, the shared-memory channel
+  // carrying the connection's messages; the socket then only carries doorbells
+  std::unique_ptr<ShmChannel> shm;
+
   /*
    * Shuts down communication over the socket associated with the connection and
    * destroys it.
@@ -51,14 +59,106 @@ struct ClientConn {
    */
   std::optional<Request> recv_request();
   /*
-   * Sends a given response to the client, returning true on success.
+   * Same as above, but deserializes the request into `req` in place, reusing
+   * its memory (see deserialize_request), and sets `*flags` (if given) to the
+   * flags it was sent with. Returns true on success. A streamed request is
+   * received whole, granting the client credit for each part as it arrives.
+   */
+  bool recv_request(Request* req, uint8_t* flags = nullptr);
+  /*
+   * Sends a given response to the client, with any message `flags` (e.g.
+   * MESSAGE_REROUTED), returning true on success. On a non-blocking
+   * connection, what the socket doesn't take is left for flush, and
+   * `response` must be kept until it's all been sent.
+   */
+  bool send_response(const Response& response, uint8_t flags = 0);
+  /*
+   * Sends a response already serialized by serialize_response (in one part),
+   * e.g. one shared by several clients, returning true on success. On a
+   * non-blocking connection, what the socket doesn't take is copied, so `msg`
+   * may be reused straight away.
    */
-  bool send_response(Response response);
+  bool send_serialized(Message* msg);
+
+  /*
+   * Puts the connection's socket in non-blocking mode, for a server that waits
+   * on many connections at once (see IoEngine), so that a slow client can't
+   * hold it up: requests are then received with try_recv_request, and
+   * responses are sent as far as the socket takes them, the rest by flush.
+   * Connections over shared memory stay blocking. Returns false on failure.
+   */
+  bool set_nonblocking();
+  /*
+   * Receives as much of the client's next request as has arrived, and sets
+   * `*received` once all of it has, deserializing it into `req` and setting
+   * `*flags` as recv_request does. A streamed MultiPut is instead received a
+   * part at a time, so that it can be applied as it arrives: `*received` is
+   * set once a part has arrived, and `*more` while more parts follow it, with
+   * `req` holding just the part's keys and values (less any value that
+   * continues in the next part, which is kept back until all of it has
+   * arrived). The client must then be granted credit for the part (see
+   * send_credit). Returns false if the client has disconnected or an error
+   * occurs. On a blocking connection, waits for the whole request (or part).
+   */
+  bool try_recv_request(Request* req, uint8_t* flags, bool* received,
+                        bool* more);
+  /*
+   * Grants the client credit for another part of the request it's streaming
+   * (see STREAM_WINDOW), returning true on success.
+   */
+  bool send_credit();
+  /*
+   * Whether some of a response is still waiting to be sent. A non-blocking
+   * connection sends one response at a time, so until it's all been sent,
+   * the client's next request shouldn't be received.
+   */
+  bool has_pending_output();
+  /*
+   * Sends as much of the pending response as the socket takes, returning true
+   * on success.
+   */
+  bool flush();
 
  private:
+  // Deserializes the request part in recv_buf into `req` (see recv_request).
+  bool take_request_part(Request* req, uint8_t* flags, bool first);
+  // Receives a whole message into recv_buf, on a blocking connection.
+  bool recv_part();
+  // Sends pending output, while holding send_mtx.
+  bool flush_locked();
+
+  // Whether set_nonblocking was called
+  bool nonblocking = false;
+  // For non-blocking connections, how much of the message in recv_buf has
+  // arrived
+  MessageProgress recv_progress;
+  // Whether the next message is the first part of a request, and, for a
+  // MultiPut received a part at a time, whether its last part ended in a
+  // split value, which is kept back here until the rest of it has arrived
+  bool recv_first = true;
+  bool recv_split = false;
+  std::string split_key;
+  std::string split_value;
+  // For non-blocking connections, how much of the message in send_buf has
+  // been sent (if send_pending), and the response whose parts follow it, if
+  // any, with their flags; guarded by send_mtx
+  MessageProgress send_progress;
+  bool send_pending = false;
+  const Response* send_res = nullptr;
+  StreamPosition send_next;
+  uint8_t send_flags = 0;
+
   // Mutexes to prevent sending/receiving from multiple threads at once
   std::mutex send_mtx;
   std::mutex recv_mtx;
+
+  // Message buffers recycled across the requests and responses on this
+  // connection, guarded by recv_mtx and send_mtx respectively.
+  Message recv_buf;
+  Message send_buf;
+
+  // Whether the client advertised that it accepts compressed responses
+  std::atomic<bool> peer_accepts_compression = false;
 };
 
 /*
@@ -66,12 +166,17 @@ struct ClientConn {
  */
 struct ServerConn {
   // for make_shared to work
-  explicit ServerConn(int fd, std::string addr) : fd(fd), address(addr) {
+  explicit ServerConn(int fd, std::string addr)
+      : fd(fd), address(addr), is_connected(true) {
   }
   ~ServerConn() {
     // cerr_color(YELLOW, "in ServerConn destructor");  // in case if there's a
     // spurious error
-    ::shutdown(this->fd, SHUT_RDWR);
+    if (this->is_connected) {
+      this->is_connected = false;
+      ::shutdown(this->fd, SHUT_RDWR);
+      ::close(this->fd);
+    }
   }
 
   // The file descriptor for the socket associated with the connection
@@ -79,6 +184,14 @@ struct ServerConn {
   // The address (hostname:port) server-client communication occurs over
   std::string address;
 
+  // Whether the socket is still open. Once closed, the fd may be reused by
+  // another connection, so it mustn't be touched again.
+  std::atomic<bool> is_connected = true;
+
+  // For "shm:" server addresses, the shared-memory channel carrying the
+  // connection's messages; the socket then only carries doorbells
+  std::unique_ptr<ShmChannel> shm;
+
   /*
    * Shuts down communication over the socket associated with the connection and
    * destroys it.
@@ -90,20 +203,52 @@ struct ServerConn {
   bool shutdown();
 
   /*
-   * Sends a given request to the server, returning true on success.
+   * Sends a given request to the server, with any message `flags` (e.g.
+   * MESSAGE_FORWARDED), returning true on success. A streamed request waits
+   * for the server's credit whenever it's STREAM_WINDOW parts ahead of it;
+   * with responses to earlier requests still due, another thread must be
+   * receiving them meanwhile, since the credit comes in after them.
    */
-  bool send_request(Request request);
+  bool send_request(const Request& request, uint8_t flags = 0);
   /*
    * Receives a response from the server, if one has been sent. Otherwise, if
    * the server has disconnected, no request has been sent, or an error occurs,
    * the std::optional returned contains no value.
    */
   std::optional<Response> recv_response();
+  /*
+   * Same as above, but deserializes the response into `res` in place, reusing
+   * its memory (see deserialize_response), and sets `*flags` (if given) to the
+   * flags it was sent with. Returns true on success.
+   */
+  bool recv_response(Response* res, uint8_t* flags = nullptr);
 
  private:
   // Mutexes to prevent sending/receiving from multiple threads at once
   std::mutex send_mtx;
   std::mutex recv_mtx;
+
+  // Message buffers recycled across the requests and responses on this
+  // connection, guarded by send_mtx and recv_mtx respectively.
+  Message send_buf;
+  Message recv_buf;
+
+  // Whether the server advertised that it accepts compressed requests
+  std::atomic<bool> peer_accepts_compression = false;
+
+  // Waits for the server's credit for another part of a streamed request
+  // (see send_request), returning false if it doesn't come.
+  bool wait_for_credit();
+
+  // Flow control of streamed requests: the parts sent that the server owes
+  // credit for, and the credits received, over the connection's lifetime;
+  // and the requests sent whose responses are still due. Guarded by
+  // credit_mtx.
+  std::mutex credit_mtx;
+  std::condition_variable credit_cv;
+  uint64_t n_credited_parts = 0;
+  uint64_t n_credits = 0;
+  uint64_t n_in_flight = 0;
 };
 
 /*
@@ -113,6 +258,12 @@ struct ServerConn {
  */
 std::shared_ptr<ClientConn> accept_client(int listener_fd);
 
+/*
+ * Completes the handshake of a client accepted on a "shm:" listener, by
+ * receiving and attaching its shared-memory channel. Returns false on failure.
+ */
+bool accept_shm_channel(ClientConn* client);
+
 /*
  * Establishes a connection to a server at the specified address.
  * On success, returns a shared pointer to a ServerConn wrapper of the server
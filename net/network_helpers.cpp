@@ -1,5 +1,17 @@
 #include "net/network_helpers.hpp"
 
+#include <poll.h>
+
+static thread_local uint64_t n_socket_syscalls = 0;
+
+uint64_t thread_socket_syscalls() {
+  return n_socket_syscalls;
+}
+
+void count_socket_syscall() {
+  n_socket_syscalls++;
+}
+
 int sendall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
   size_t n_sent = 0, n_to_send = len;
   char* data = (char*)buf;
@@ -11,6 +23,7 @@ int sendall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
       return ETIMEOUT;
     }
 
+    count_socket_syscall();
     int curr = send(fd, data + n_sent, n_to_send - n_sent, flags);
     if (curr <= 0) {
       return curr;
@@ -37,6 +50,7 @@ int recvall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
       return ETIMEOUT;
     }
 
+    count_socket_syscall();
     int curr = recv(fd, data + n_recvd, n_to_recv - n_recvd, flags);
     if (curr <= 0) {
       return curr;
@@ -52,7 +66,118 @@ int recvall(int fd, void* buf, size_t len, int flags, milliseconds timeout) {
   return n_recvd;
 }
 
-int open_listener_socket(const std::string& address) {
+int sendallv(int fd, struct iovec* iov, int iovcnt, int flags,
+             milliseconds timeout) {
+  size_t n_sent = 0;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+  auto begin = system_clock::now();
+  while (msg.msg_iovlen > 0) {
+    // If desired, check if timed out
+    if (timeout > 0ms &&
+        duration_cast<milliseconds>(system_clock::now() - begin) > timeout) {
+      return ETIMEOUT;
+    }
+
+    count_socket_syscall();
+    int curr = sendmsg(fd, &msg, flags);
+    if (curr <= 0) {
+      return curr;
+    }
+    n_sent += curr;
+
+    // skip past the buffers that were sent completely, then trim the first
+    // partially-sent one
+    size_t n = curr;
+    while (msg.msg_iovlen > 0 && n >= msg.msg_iov->iov_len) {
+      n -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + n;
+      msg.msg_iov->iov_len -= n;
+      // not completed, so network is likely saturated; wait
+      if (timeout > 0ms) std::this_thread::sleep_for(timeout / 10);
+    }
+  }
+  return n_sent;
+}
+
+std::optional<std::string> unix_socket_path(const std::string& address) {
+  for (const char* scheme : {"unix:", "shm:"}) {
+    if (address.starts_with(scheme)) {
+      return address.substr(strlen(scheme));
+    }
+  }
+  return std::nullopt;
+}
+
+bool is_shm_address(const std::string& address) {
+  return address.starts_with("shm:");
+}
+
+// Fills in `addr` for the Unix domain socket at `path`; false if it's too long.
+static bool make_unix_sockaddr(const std::string& path,
+                               struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    cerr_color(RED, "Invalid Unix socket path: ", path);
+    return false;
+  }
+  memcpy(addr->sun_path, path.c_str(), path.size());
+  return true;
+}
+
+static int open_unix_listener_socket(const std::string& path) {
+  struct sockaddr_un addr;
+  if (!make_unix_sockaddr(path, &addr)) return -1;
+
+  int listener_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener_fd == -1) {
+    perror_color(RED, "socket");
+    return -1;
+  }
+  // A socket file left behind by a previous server would make bind fail
+  unlink(path.c_str());
+  if (bind(listener_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(listener_fd);
+    perror_color(RED, "bind");
+    return -1;
+  }
+  if (listen(listener_fd, BACKLOG) < 0) {
+    close(listener_fd);
+    perror_color(RED, "listen");
+    return -1;
+  }
+  return listener_fd;
+}
+
+static int connect_to_unix_socket(const std::string& path) {
+  struct sockaddr_un addr;
+  if (!make_unix_sockaddr(path, &addr)) return -1;
+
+  int cfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (cfd == -1) {
+    perror_color(YELLOW, "socket");
+    return -1;
+  }
+  if (connect(cfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(cfd);
+    perror_color(YELLOW, "connect");
+    return -1;
+  }
+  return cfd;
+}
+
+int open_listener_socket(const std::string& address, bool reuse_port) {
+  if (auto path = unix_socket_path(address)) {
+    return open_unix_listener_socket(*path);
+  }
+
   size_t splitIdx = address.find(':');
   if (splitIdx == std::string::npos) {
     cerr_color(RED, "Invalid address: ", address);
@@ -97,6 +222,12 @@ int open_listener_socket(const std::string& address) {
       perror_color(YELLOW, "setsockopt");
       continue;
     }
+    if (reuse_port && setsockopt(listener_fd, SOL_SOCKET, SO_REUSEPORT, &yes,
+                                 sizeof(yes)) == -1) {
+      close(listener_fd);
+      perror_color(YELLOW, "setsockopt");
+      continue;
+    }
 
     // assign name to the desired socket
     if ((ret = bind(listener_fd, cur->ai_addr, cur->ai_addrlen)) == -1) {
@@ -126,6 +257,10 @@ int open_listener_socket(const std::string& address) {
 };
 
 int connect_to_address(const std::string& address) {
+  if (auto path = unix_socket_path(address)) {
+    return connect_to_unix_socket(*path);
+  }
+
   size_t splitIdx = address.find(':');
   if (splitIdx == std::string::npos) {
     cerr_color(RED, "Invalid address: ", address);
@@ -172,6 +307,73 @@ int connect_to_address(const std::string& address) {
   return cfd;
 }
 
+bool send_fd(int sock, int fd) {
+  // At least one byte of regular data must accompany the descriptor
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = sizeof(byte);
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  count_socket_syscall();
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(byte)) {
+    perror_color(RED, "sendmsg");
+    return false;
+  }
+  return true;
+}
+
+int recv_fd(int sock, milliseconds timeout) {
+  struct pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+  count_socket_syscall();
+  if (poll(&pfd, 1, timeout.count()) != 1) {
+    return -1;
+  }
+
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = sizeof(byte);
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  count_socket_syscall();
+  if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(byte)) {
+    return -1;
+  }
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+    return -1;
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
 std::string get_host_address(const char* port) {
   // Get our hostname for readability
   char hostnamebuf[256] = {0};
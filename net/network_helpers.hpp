@@ -7,11 +7,14 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <chrono>
 #include <iostream>
 #include <optional>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -23,6 +26,14 @@ using namespace std::chrono;
 
 #define ETIMEOUT -2
 
+/*
+ * Number of socket system calls (sends, receives, accepts and the like) the
+ * calling thread has made through the functions here and in net/, for
+ * benchmarking. count_socket_syscall counts another.
+ */
+uint64_t thread_socket_syscalls();
+void count_socket_syscall();
+
 /*
  * Sends/receives all of the bytes in buf, according to len. Times out after the
  * specified amount if timeout > 0 (in this case, returns ETIMEOUT. Otherwise,
@@ -33,12 +44,36 @@ int sendall(int fd, void* buf, size_t len, int flags,
 int recvall(int fd, void* buf, size_t len, int flags,
             milliseconds timeout = 0ms);
 
+/*
+ * Like sendall, but gathers the bytes to send from the `iovcnt` buffers in
+ * `iov` (as in writev), so that they go out in a single system call when the
+ * socket has room. Modifies `iov` as bytes are sent.
+ */
+int sendallv(int fd, struct iovec* iov, int iovcnt, int flags,
+             milliseconds timeout = 0ms);
+
+/*
+ * Besides hostname:port, addresses may name a Unix domain socket, for clients
+ * on the same host as the server: "unix:<path>", or "shm:<path>" to also carry
+ * the connection's messages over shared memory (see net/shm_channel.hpp).
+ * Returns the socket path of such an address, and std::nullopt otherwise.
+ */
+std::optional<std::string> unix_socket_path(const std::string& address);
+bool is_shm_address(const std::string& address);
+
 /*
  * Opens a listener socket on the specified address (hostname:port).
  * On success, a file descriptor for the new socket is returned.  On error, -1
  * is returned.
+ *
+ * If `reuse_port` is set, a TCP socket is bound with SO_REUSEPORT, so that
+ * several listeners can share the port and the kernel balances incoming
+ * connections across them. Binding then succeeds even if another process
+ * (of the same user) already listens on the port with SO_REUSEPORT, so check
+ * that the port is free first, e.g. by opening and closing a listener
+ * without it.
  */
-int open_listener_socket(const std::string& address);
+int open_listener_socket(const std::string& address, bool reuse_port = false);
 
 /*
  * Establishes a connection to the specified address.
@@ -47,6 +82,14 @@ int open_listener_socket(const std::string& address);
  */
 int connect_to_address(const std::string& address);
 
+/*
+ * Passes the file descriptor `fd` over the Unix domain socket `sock`, or
+ * receives one (waiting up to `timeout`). send_fd returns false on failure;
+ * recv_fd returns the received descriptor, or -1.
+ */
+bool send_fd(int sock, int fd);
+int recv_fd(int sock, milliseconds timeout);
+
 /*
  * Creates an address string of hostname:port, from the current host and given
  * port.
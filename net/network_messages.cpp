@@ -1,54 +1,85 @@
 #include "net/network_messages.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <type_traits>
 
+#include "net/lz_codec.hpp"
 #include "net/network_helpers.hpp"
 
+// Prints the error behind a failed sendall/recvall, unless it was just the
+// result of the socket closing.
+static void report_io_error(int fd, int curr, bool sending) {
+  if (curr == ETIMEOUT) {
+    cerr_color(RED, sending ? "Send" : "Recv", " on ", fd, " timed out.");
+  } else if (curr < 0 && errno != EBADF && errno != EPIPE) {
+    perror_color(RED, sending ? "send" : "recv");
+  }
+}
+
+// Lays out the header of `msg` (see Message) in `header`.
+static void encode_header(const Message& msg, std::byte* header) {
+  uint32_t size_nbo = htonl(uint32_t(msg.sz));
+  uint8_t flags = msg.flags | MESSAGE_ACCEPTS_COMPRESSION;
+  memset(header, 0, MESSAGE_HEADER_SIZE);
+  memcpy(header, &msg.type, sizeof(msg.type));
+  memcpy(header + sizeof(msg.type), &size_nbo, sizeof(size_nbo));
+  memcpy(header + sizeof(msg.type) + sizeof(size_nbo), &flags, sizeof(flags));
+}
+
+// Reads the type, size and flags of `msg` from its header.
+static void decode_header(const std::byte* header, Message* msg) {
+  uint32_t size_nbo;
+  memcpy(&msg->type, header, sizeof(msg->type));
+  memcpy(&size_nbo, header + sizeof(msg->type), sizeof(size_nbo));
+  memcpy(&msg->flags, header + sizeof(msg->type) + sizeof(size_nbo),
+         sizeof(msg->flags));
+  // Convert to host order
+  msg->sz = ntohl(size_nbo);
+}
+
 bool send_message(int fd, Message* msg, milliseconds timeout) {
   // must specify non-zero timeout
   assert(timeout > 0ms);
   assert(msg->sz == msg->buf.size());
 
-  // First, send message type
-  int curr = sendall(fd, &msg->type, sizeof(msg->type), MSG_NOSIGNAL);
-  if (curr < 0) {
-    if (curr == ETIMEOUT) {
-      // Print if timed out
-      cerr_color(RED, "Send on ", fd, " timed out.");
-    } else if (errno != EBADF && errno != EPIPE) {
-      // Only emit errors if it wasn't the result of the socket closing
-      perror_color(RED, "send");
-    }
+  if (msg->sz > UINT32_MAX) {
+    cerr_color(RED, "Message of ", msg->sz, " bytes is too large to send.");
     return false;
   }
-  assert(curr == sizeof(msg->type));
 
-  // Convert size to network order, then send
-  size_t size_nbo = htonl(msg->sz);
-  curr = sendall(fd, &size_nbo, sizeof(size_nbo), MSG_NOSIGNAL);
+  // Lay out the header, so that it goes out in the same system call as the
+  // body
+  std::byte header[MESSAGE_HEADER_SIZE];
+  encode_header(*msg, header);
+
+  // The header goes out with the body's first chunk
+  size_t first_chunk = std::min<size_t>(msg->sz, FRAME_CHUNK_SIZE);
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = msg->buf.data();
+  iov[1].iov_len = first_chunk;
+  int curr = sendallv(fd, iov, first_chunk > 0 ? 2 : 1, MSG_NOSIGNAL, timeout);
   if (curr < 0) {
-    if (curr == ETIMEOUT) {
-      cerr_color(RED, "Send on ", fd, " timed out.");
-    } else if (errno != EBADF && errno != EPIPE) {
-      perror_color(RED, "send");
-    }
+    report_io_error(fd, curr, true);
     return false;
   }
-  assert(curr == sizeof(size_nbo));
+  assert(size_t(curr) == sizeof(header) + first_chunk);
 
-  if (msg->sz > 0) {
-    std::byte* data = &msg->buf[0];
-    curr = sendall(fd, data, msg->sz, 0, timeout);
+  // Then the rest, one chunk at a time, so that the timeout bounds how long
+  // each chunk takes rather than the whole (arbitrarily large) message
+  for (size_t sent = first_chunk; sent < msg->sz; sent += FRAME_CHUNK_SIZE) {
+    size_t len = std::min<size_t>(msg->sz - sent, FRAME_CHUNK_SIZE);
+    curr = sendall(fd, msg->buf.data() + sent, len, MSG_NOSIGNAL, timeout);
     if (curr < 0) {
-      if (curr == ETIMEOUT) {
-        cerr_color(RED, "Send on ", fd, " timed out.");
-      } else if (errno != EBADF && errno != EPIPE) {
-        perror_color(RED, "send");
-      }
+      report_io_error(fd, curr, true);
       return false;
     }
-    assert(size_t(curr) == msg->sz);
+    assert(size_t(curr) == len);
   }
 
   return true;
@@ -58,310 +89,609 @@ bool recv_message(int fd, Message* msg, milliseconds timeout) {
   // must specify non-zero timeout
   assert(timeout > 0ms);
 
-  // get message type
-  int curr = recvall(fd, &msg->type, sizeof(msg->type), 0);
+  // get message type, size and flags together; need the size to inform how
+  // much to read into the vector
+  std::byte header[MESSAGE_HEADER_SIZE];
+  int curr = recvall(fd, header, sizeof(header), 0);
   if (curr == 0) {
     // In this case, recv got an EOF, so other end closed the connection.
     return false;
   } else if (curr < 0) {
-    if (curr == ETIMEOUT) {
-      // Print if timed out
-      cerr_color(RED, "Recv on ", fd, " timed out.");
-    } else if (errno != EBADF) {
-      // Only emit errors if it wasn't the result of the socket closing
-      perror_color(RED, "recv");
-    }
+    report_io_error(fd, curr, false);
     return false;
   }
-  assert(curr == sizeof(msg->type));
+  assert(curr == sizeof(header));
+  decode_header(header, msg);
 
-  // get size; need this to inform how much to read into the vector
-  curr = recvall(fd, &msg->sz, sizeof(msg->sz), 0);
-  if (curr == 0) {
-    return false;
-  } else if (curr < 0) {
-    if (curr == ETIMEOUT) {
-      cerr_color(RED, "Recv on ", fd, " timed out.");
-    } else if (errno != EBADF) {
-      perror_color(RED, "recv");
+  // Read the body a chunk at a time, each with its own timeout, growing the
+  // buffer as the data arrives (rather than trusting the size up front)
+  msg->buf.clear();
+  while (msg->buf.size() < msg->sz) {
+    size_t received = msg->buf.size();
+    size_t len = std::min<size_t>(msg->sz - received, FRAME_CHUNK_SIZE);
+    msg->buf.resize(received + len);
+    curr = recvall(fd, msg->buf.data() + received, len, 0, timeout);
+    if (curr <= 0) {
+      report_io_error(fd, curr, false);
+      return false;
     }
-    return false;
+    assert(size_t(curr) == len);
   }
-  // Convert to host order
-  msg->sz = ntohl(msg->sz);
-  assert(curr == sizeof(msg->sz));
 
-  if (msg->sz > 0) {
-    msg->buf.resize(msg->sz);
-    std::byte* data = &msg->buf[0];
-    curr = recvall(fd, data, msg->sz, 0, timeout);
+  return true;
+}
+
+// Whether a failed send/recv on a non-blocking socket only found it not ready.
+static bool would_block() {
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+int send_message_some(int fd, const Message& msg, MessageProgress* progress,
+                      size_t* budget) {
+  assert(msg.sz == msg.buf.size());
+  if (msg.sz > UINT32_MAX) {
+    cerr_color(RED, "Message of ", msg.sz, " bytes is too large to send.");
+    return -1;
+  }
+  if (progress->done == 0) encode_header(msg, progress->header);
+
+  size_t total = MESSAGE_HEADER_SIZE + msg.sz;
+  while (progress->done < total) {
+    if (*budget == 0) return 0;
+    // What's left of the header, then up to `*budget` bytes of the body
+    struct iovec iov[2];
+    int iovcnt = 0;
+    size_t body_sent = 0;
+    if (progress->done < MESSAGE_HEADER_SIZE) {
+      iov[iovcnt].iov_base = progress->header + progress->done;
+      iov[iovcnt++].iov_len = MESSAGE_HEADER_SIZE - progress->done;
+    } else {
+      body_sent = progress->done - MESSAGE_HEADER_SIZE;
+    }
+    size_t len = std::min(msg.sz - body_sent, *budget);
+    if (len > 0) {
+      iov[iovcnt].iov_base = (void*)(msg.buf.data() + body_sent);
+      iov[iovcnt++].iov_len = len;
+    }
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = iovcnt;
+    count_socket_syscall();
+    ssize_t curr = sendmsg(fd, &hdr, MSG_NOSIGNAL);
+    if (curr < 0) {
+      if (errno == EINTR) continue;
+      if (would_block()) return 0;
+      report_io_error(fd, curr, true);
+      return -1;
+    }
+    progress->done += curr;
+    *budget -= std::min(size_t(curr), *budget);
+  }
+  progress->done = 0;
+  return 1;
+}
+
+int recv_message_some(int fd, Message* msg, MessageProgress* progress,
+                      size_t* budget) {
+  // The header first, since the body's size is in it
+  while (progress->done < MESSAGE_HEADER_SIZE) {
+    count_socket_syscall();
+    ssize_t curr = recv(fd, progress->header + progress->done,
+                        MESSAGE_HEADER_SIZE - progress->done, 0);
     if (curr == 0) {
-      return false;
+      // EOF: the other end closed the connection
+      return -1;
     } else if (curr < 0) {
-      if (curr == ETIMEOUT) {
-        cerr_color(RED, "Recv on ", fd, " timed out.");
-      } else if (errno != EBADF) {
-        perror_color(RED, "recv");
-      }
-      return false;
+      if (errno == EINTR) continue;
+      if (would_block()) return 0;
+      report_io_error(fd, curr, false);
+      return -1;
+    }
+    progress->done += curr;
+    if (progress->done == MESSAGE_HEADER_SIZE) {
+      decode_header(progress->header, msg);
+      msg->buf.clear();
     }
-    assert(size_t(curr) == msg->sz);
   }
 
-  return true;
+  // Then the body, growing the buffer as it arrives (as recv_message does)
+  while (msg->buf.size() < msg->sz) {
+    if (*budget == 0) return 0;
+    size_t received = msg->buf.size();
+    size_t len = std::min<size_t>(
+        {msg->sz - received, FRAME_CHUNK_SIZE, *budget});
+    msg->buf.resize(received + len);
+    count_socket_syscall();
+    ssize_t curr = recv(fd, msg->buf.data() + received, len, 0);
+    msg->buf.resize(received + std::max<ssize_t>(curr, 0));
+    if (curr == 0) {
+      cerr_color(RED, "Connection on ", fd, " closed mid-message.");
+      return -1;
+    } else if (curr < 0) {
+      if (errno == EINTR) continue;
+      if (would_block()) return 0;
+      report_io_error(fd, curr, false);
+      return -1;
+    }
+    *budget -= std::min(size_t(curr), *budget);
+  }
+  progress->done = 0;
+  return 1;
+}
+
+static void recycle_buffer(std::vector<std::byte>* buf) {
+  if (buf->capacity() > MAX_RECYCLED_BUFFER_SIZE) {
+    std::vector<std::byte>().swap(*buf);
+  }
+}
+
+void recycle_message(Message* msg) {
+  recycle_buffer(&msg->buf);
+}
+
+static std::atomic<size_t> compression_threshold =
+    DEFAULT_COMPRESSION_THRESHOLD;
+
+void set_compression_threshold(size_t bytes) {
+  compression_threshold.store(bytes);
+}
+
+size_t get_compression_threshold() {
+  return compression_threshold.load();
+}
+
+// Per-thread scratch space for (de)compressing message bodies
+static thread_local std::vector<std::byte> codec_buf;
+
+void compress_message(Message* msg) {
+  // Small, latency-bound messages (e.g. Get responses) are never worth it
+  bool bulk = msg->type == MessageType::MULTI_GET ||
+              msg->type == MessageType::MULTI_PUT ||
+              msg->type == MessageType::TRANSFER;
+  size_t threshold = compression_threshold.load(std::memory_order_relaxed);
+  if (!bulk || threshold == 0 || msg->buf.size() < threshold ||
+      (msg->flags & MESSAGE_COMPRESSED)) {
+    return;
+  }
+
+  if (lz_compress(msg->buf.data(), msg->buf.size(), &codec_buf)) {
+    // The compressed body is smaller, so it fits in the buffer we have
+    memcpy(msg->buf.data(), codec_buf.data(), codec_buf.size());
+    msg->buf.resize(codec_buf.size());
+    msg->sz = msg->buf.size();
+    msg->flags |= MESSAGE_COMPRESSED;
+  }
+  recycle_buffer(&codec_buf);
 }
 
 #include "common/zpp_bits.hpp"
 
-std::optional<Message> serialize_request(Request request) {
-  Message msg{};
+// Serializes `value` into msg->buf (reusing its capacity), tagged with `type`.
+template <typename T>
+static bool serialize_into(MessageType type, const T& value, Message* msg) {
+  msg->type = type;
+  msg->flags = 0;
+  msg->buf.clear();
+  {
+    auto out = zpp::bits::output(msg->buf);
+    if (!success(out(value))) return false;
+  }
+  // Set size, for easier network parsing
+  msg->sz = msg->buf.size();
+  return true;
+}
+
+// Deserializes msg.buf into the T alternative of `v`, reusing it if present.
+template <typename T, typename Variant>
+static bool deserialize_into(const Message& msg, Variant* v) {
+  if (!(msg.flags & MESSAGE_COMPRESSED)) {
+    auto in = zpp::bits::input(msg.buf);
+    return success(in(reuse_alternative<T>(v)));
+  }
+
+  if (!lz_decompress(msg.buf.data(), msg.buf.size(), &codec_buf)) {
+    cerr_color(RED, "Failed to decompress message.");
+    return false;
+  }
+  bool ok;
+  {
+    auto in = zpp::bits::input(codec_buf);
+    ok = success(in(reuse_alternative<T>(v)));
+  }
+  recycle_buffer(&codec_buf);
+  return ok;
+}
 
+bool serialize_request(const Request& request, Message* msg) {
   // Serialize into message, depending on type
-  auto out = zpp::bits::output(msg.buf);
   if (auto* req = std::get_if<JoinRequest>(&request)) {
-    msg.type = MessageType::JOIN;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::JOIN, *req, msg);
   } else if (auto* req = std::get_if<LeaveRequest>(&request)) {
-    msg.type = MessageType::LEAVE;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::LEAVE, *req, msg);
   } else if (auto* req = std::get_if<MoveRequest>(&request)) {
-    msg.type = MessageType::MOVE;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::MOVE, *req, msg);
   } else if (auto* req = std::get_if<QueryRequest>(&request)) {
-    msg.type = MessageType::QUERY;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::QUERY, *req, msg);
+  } else if (auto* req = std::get_if<WatchRequest>(&request)) {
+    return serialize_into(MessageType::WATCH, *req, msg);
+  } else if (auto* req = std::get_if<ReportRequest>(&request)) {
+    return serialize_into(MessageType::REPORT, *req, msg);
   } else if (auto* req = std::get_if<GetRequest>(&request)) {
-    msg.type = MessageType::GET;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::GET, *req, msg);
   } else if (auto* req = std::get_if<PutRequest>(&request)) {
-    msg.type = MessageType::PUT;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::PUT, *req, msg);
   } else if (auto* req = std::get_if<AppendRequest>(&request)) {
-    msg.type = MessageType::APPEND;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::APPEND, *req, msg);
   } else if (auto* req = std::get_if<DeleteRequest>(&request)) {
-    msg.type = MessageType::DELETE;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::DELETE, *req, msg);
   } else if (auto* req = std::get_if<MultiGetRequest>(&request)) {
-    msg.type = MessageType::MULTI_GET;
-    if (!success(out(*req))) return std::nullopt;
+    return serialize_into(MessageType::MULTI_GET, *req, msg);
   } else if (auto* req = std::get_if<MultiPutRequest>(&request)) {
-    msg.type = MessageType::MULTI_PUT;
-    if (!success(out(*req))) return std::nullopt;
-  } else {
-    throw std::logic_error{
-        "Invalid request variant! Please post privately on Edstem if this "
-        "occurs."};
+    return serialize_into(MessageType::MULTI_PUT, *req, msg);
+  } else if (auto* req = std::get_if<BatchRequest>(&request)) {
+    return serialize_into(MessageType::BATCH, *req, msg);
+  } else if (auto* req = std::get_if<TransferRequest>(&request)) {
+    return serialize_into(MessageType::TRANSFER, *req, msg);
   }
-
-  // Set size, for easier network parsing
-  msg.sz = msg.buf.size();
-
-  return msg;
+  throw std::logic_error{
+      "Invalid request variant! Please post privately on Edstem if this "
+      "occurs."};
 }
 
-std::optional<Request> deserialize_request(Message message) {
-  Request request;
+bool deserialize_request(const Message& message, Request* request) {
   // Deserialize from message, depending on type
-  auto in = zpp::bits::input(message.buf);
   switch (message.type) {
-    case MessageType::JOIN: {
-      JoinRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::LEAVE: {
-      LeaveRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::MOVE: {
-      MoveRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::QUERY: {
-      QueryRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::GET: {
-      GetRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::PUT: {
-      PutRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::APPEND: {
-      AppendRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::DELETE: {
-      DeleteRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::MULTI_GET: {
-      MultiGetRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
-    case MessageType::MULTI_PUT: {
-      MultiPutRequest req{};
-      if (!success(in(req))) return std::nullopt;
-      request = req;
-      break;
-    }
+    case MessageType::JOIN:
+      return deserialize_into<JoinRequest>(message, request);
+    case MessageType::LEAVE:
+      return deserialize_into<LeaveRequest>(message, request);
+    case MessageType::MOVE:
+      return deserialize_into<MoveRequest>(message, request);
+    case MessageType::QUERY:
+      return deserialize_into<QueryRequest>(message, request);
+    case MessageType::WATCH:
+      return deserialize_into<WatchRequest>(message, request);
+    case MessageType::REPORT:
+      return deserialize_into<ReportRequest>(message, request);
+    case MessageType::GET:
+      return deserialize_into<GetRequest>(message, request);
+    case MessageType::PUT:
+      return deserialize_into<PutRequest>(message, request);
+    case MessageType::APPEND:
+      return deserialize_into<AppendRequest>(message, request);
+    case MessageType::DELETE:
+      return deserialize_into<DeleteRequest>(message, request);
+    case MessageType::MULTI_GET:
+      return deserialize_into<MultiGetRequest>(message, request);
+    case MessageType::MULTI_PUT:
+      return deserialize_into<MultiPutRequest>(message, request);
+    case MessageType::BATCH:
+      return deserialize_into<BatchRequest>(message, request);
+    case MessageType::TRANSFER:
+      return deserialize_into<TransferRequest>(message, request);
     default:
       throw std::logic_error{
           "Invalid message type! Please post privately on Edstem if this "
           "occurs."};
-      break;
   };
-
-  return request;
 }
 
-std::optional<Message> serialize_response(Response response) {
-  Message msg{};
-
+bool serialize_response(const Response& response, Message* msg) {
   // Serialize into message, depending on type
-  auto out = zpp::bits::output(msg.buf);
   if (auto* res = std::get_if<JoinResponse>(&response)) {
-    msg.type = MessageType::JOIN;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::JOIN, *res, msg);
   } else if (auto* res = std::get_if<LeaveResponse>(&response)) {
-    msg.type = MessageType::LEAVE;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::LEAVE, *res, msg);
   } else if (auto* res = std::get_if<MoveResponse>(&response)) {
-    msg.type = MessageType::MOVE;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::MOVE, *res, msg);
   } else if (auto* res = std::get_if<QueryResponse>(&response)) {
-    msg.type = MessageType::QUERY;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::QUERY, *res, msg);
+  } else if (auto* res = std::get_if<WatchResponse>(&response)) {
+    return serialize_into(MessageType::WATCH, *res, msg);
+  } else if (auto* res = std::get_if<ReportResponse>(&response)) {
+    return serialize_into(MessageType::REPORT, *res, msg);
   } else if (auto* res = std::get_if<GetResponse>(&response)) {
-    msg.type = MessageType::GET;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::GET, *res, msg);
   } else if (auto* res = std::get_if<PutResponse>(&response)) {
-    msg.type = MessageType::PUT;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::PUT, *res, msg);
   } else if (auto* res = std::get_if<AppendResponse>(&response)) {
-    msg.type = MessageType::APPEND;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::APPEND, *res, msg);
   } else if (auto* res = std::get_if<DeleteResponse>(&response)) {
-    msg.type = MessageType::DELETE;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::DELETE, *res, msg);
   } else if (auto* res = std::get_if<MultiGetResponse>(&response)) {
-    msg.type = MessageType::MULTI_GET;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::MULTI_GET, *res, msg);
   } else if (auto* res = std::get_if<MultiPutResponse>(&response)) {
-    msg.type = MessageType::MULTI_PUT;
-    if (!success(out(*res))) return std::nullopt;
+    return serialize_into(MessageType::MULTI_PUT, *res, msg);
+  } else if (auto* res = std::get_if<BatchResponse>(&response)) {
+    return serialize_into(MessageType::BATCH, *res, msg);
+  } else if (auto* res = std::get_if<TransferResponse>(&response)) {
+    return serialize_into(MessageType::TRANSFER, *res, msg);
   } else if (auto* res = std::get_if<ErrorResponse>(&response)) {
-    msg.type = MessageType::ERROR;
-    if (!success(out(*res))) return std::nullopt;
-  } else {
-    throw std::logic_error{
-        "Invalid response variant! Please post privately on Edstem if this "
-        "occurs."};
+    return serialize_into(MessageType::ERROR, *res, msg);
+  } else if (auto* res = std::get_if<OverloadedResponse>(&response)) {
+    return serialize_into(MessageType::OVERLOADED, *res, msg);
   }
+  throw std::logic_error{
+      "Invalid response variant! Please post privately on Edstem if this "
+      "occurs."};
+}
 
-  // Set size, for easier network parsing
-  msg.sz = msg.buf.size();
+bool deserialize_response(const Message& message, Response* response) {
+  // Deserialize from message, depending on type
+  switch (message.type) {
+    case MessageType::JOIN:
+      return deserialize_into<JoinResponse>(message, response);
+    case MessageType::LEAVE:
+      return deserialize_into<LeaveResponse>(message, response);
+    case MessageType::MOVE:
+      return deserialize_into<MoveResponse>(message, response);
+    case MessageType::QUERY:
+      return deserialize_into<QueryResponse>(message, response);
+    case MessageType::WATCH:
+      return deserialize_into<WatchResponse>(message, response);
+    case MessageType::REPORT:
+      return deserialize_into<ReportResponse>(message, response);
+    case MessageType::GET:
+      return deserialize_into<GetResponse>(message, response);
+    case MessageType::PUT:
+      return deserialize_into<PutResponse>(message, response);
+    case MessageType::APPEND:
+      return deserialize_into<AppendResponse>(message, response);
+    case MessageType::DELETE:
+      return deserialize_into<DeleteResponse>(message, response);
+    case MessageType::MULTI_GET:
+      return deserialize_into<MultiGetResponse>(message, response);
+    case MessageType::MULTI_PUT:
+      return deserialize_into<MultiPutResponse>(message, response);
+    case MessageType::BATCH:
+      return deserialize_into<BatchResponse>(message, response);
+    case MessageType::TRANSFER:
+      return deserialize_into<TransferResponse>(message, response);
+    case MessageType::ERROR:
+      return deserialize_into<ErrorResponse>(message, response);
+    case MessageType::OVERLOADED:
+      return deserialize_into<OverloadedResponse>(message, response);
+    default:
+      throw std::logic_error{
+          "Invalid message type! Please post privately on Edstem if this "
+          "occurs."};
+  };
+}
+
+bool is_idempotent(const Request& request) {
+  // Appends and batches (which may append) apply again, deletes answer
+  // differently the second time, and transfer chunks are sequenced
+  return std::holds_alternative<GetRequest>(request) ||
+         std::holds_alternative<PutRequest>(request) ||
+         std::holds_alternative<MultiGetRequest>(request) ||
+         std::holds_alternative<MultiPutRequest>(request) ||
+         std::holds_alternative<QueryRequest>(request) ||
+         std::holds_alternative<WatchRequest>(request) ||
+         std::holds_alternative<ReportRequest>(request);
+}
+
+std::optional<Message> serialize_request(const Request& request) {
+  Message msg{};
+  if (!serialize_request(request, &msg)) return std::nullopt;
+  return msg;
+}
+
+std::optional<Request> deserialize_request(const Message& message) {
+  Request request;
+  if (!deserialize_request(message, &request)) return std::nullopt;
+  return request;
+}
 
+std::optional<Message> serialize_response(const Response& response) {
+  Message msg{};
+  if (!serialize_response(response, &msg)) return std::nullopt;
   return msg;
 }
 
-std::optional<Response> deserialize_response(Message message) {
+std::optional<Response> deserialize_response(const Message& message) {
   Response response;
-  // Deserialize from message, depending on type
-  auto in = zpp::bits::input(message.buf);
-  switch (message.type) {
-    case MessageType::JOIN: {
-      JoinResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::LEAVE: {
-      LeaveResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::MOVE: {
-      MoveResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::QUERY: {
-      QueryResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::GET: {
-      GetResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::PUT: {
-      PutResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::APPEND: {
-      AppendResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
-    }
-    case MessageType::DELETE: {
-      DeleteResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
+  if (!deserialize_response(message, &response)) return std::nullopt;
+  return response;
+}
+
+/*
+ * The body of each part of a streamed MultiPutRequest or MultiGetResponse (see
+ * serialize_request_part). A split value's first piece is the last value of
+ * its part, and each following piece is the first value of the next part,
+ * under the same key.
+ */
+struct StreamPart {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  // The presence bitmap of a partial MultiGet (in its first part)
+  std::vector<uint8_t> present;
+  // If the first value is a later piece of a split value, how much of the
+  // value came before it; 0 otherwise
+  uint64_t value_offset = 0;
+  // The total size of the split value that the part holds a piece of, if any
+  uint64_t value_size = 0;
+};
+
+// Calls `take(item, offset, len)` on each item (or piece of a split value) of
+// the part of a streamed message starting at `*pos`, and advances `*pos` past
+// them. `keys` may be null, for messages with only values.
+template <typename Take>
+static void walk_part(const std::vector<std::string>* keys,
+                      const std::vector<std::string>& values,
+                      StreamPosition* pos, Take take) {
+  size_t part_size = 0;
+  bool empty = true;
+  while (pos->item < values.size() && part_size < STREAM_PART_SIZE) {
+    size_t left = values[pos->item].size() - pos->offset;
+    // A value too large for a part goes in parts of its own, a piece at a
+    // time; other items are never split, so a part may overshoot by one
+    if (left > STREAM_PART_SIZE && !empty) break;
+    size_t len = std::min<size_t>(left, STREAM_PART_SIZE);
+    take(pos->item, pos->offset, len);
+    part_size += (keys ? (*keys)[pos->item].size() : 0) + len;
+    empty = false;
+    if (len < left) {
+      pos->offset += len;
       break;
     }
-    case MessageType::MULTI_GET: {
-      MultiGetResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
+    pos->item++;
+    pos->offset = 0;
+  }
+}
+
+// Serializes the part of a streamed message starting at `*next` (of type
+// `type`, with the given keys and values) into `msg`, and advances `*next`.
+static bool serialize_stream_part(MessageType type,
+                                  const std::vector<std::string>* keys,
+                                  const std::vector<std::string>& values,
+                                  const std::vector<uint8_t>* present,
+                                  StreamPosition* next, Message* msg) {
+  static thread_local StreamPart part;
+  part.keys.clear();
+  part.values.clear();
+  part.present.clear();
+  if (present && next->item == 0 && next->offset == 0) part.present = *present;
+  part.value_offset = next->offset;
+  part.value_size = 0;
+  walk_part(keys, values, next, [&](size_t item, size_t offset, size_t len) {
+    if (keys) part.keys.push_back((*keys)[item]);
+    part.values.emplace_back(values[item], offset, len);
+    if (len < values[item].size()) part.value_size = values[item].size();
+  });
+  if (!serialize_into(type, part, msg)) return false;
+  if (next->item < values.size()) msg->flags |= MESSAGE_CONTINUED;
+  if (next->offset > 0) msg->flags |= MESSAGE_SPLIT_VALUE;
+  return true;
+}
+
+// Whether a message with the given keys and values fits in a single part, in
+// which case it's sent whole, without copying.
+static bool fits_in_part(const std::vector<std::string>* keys,
+                         const std::vector<std::string>& values) {
+  StreamPosition end;
+  walk_part(keys, values, &end, [](size_t, size_t, size_t) {});
+  return end.item == values.size();
+}
+
+static bool serialize_part(const MultiPutRequest& req, StreamPosition* next,
+                           Message* msg) {
+  // Small (or malformed) requests go out whole
+  if (req.values.size() != req.keys.size() ||
+      (next->item == 0 && fits_in_part(&req.keys, req.values))) {
+    next->item = req.values.size();
+    return serialize_into(MessageType::MULTI_PUT, req, msg);
+  }
+  return serialize_stream_part(MessageType::MULTI_PUT, &req.keys, req.values,
+                               nullptr, next, msg);
+}
+
+static bool serialize_part(const MultiGetResponse& res, StreamPosition* next,
+                           Message* msg) {
+  if (next->item == 0 && fits_in_part(nullptr, res.values)) {
+    next->item = res.values.size();
+    return serialize_into(MessageType::MULTI_GET, res, msg);
+  }
+  return serialize_stream_part(MessageType::MULTI_GET, nullptr, res.values,
+                               &res.present, next, msg);
+}
+
+// Appends the keys (if `keys` isn't null) and values of a part of a streamed
+// message to those received so far, joining a split value's pieces back up.
+static bool append_part(StreamPart* part, std::vector<std::string>* keys,
+                        std::vector<std::string>* values) {
+  size_t n = part->values.size();
+  if (keys && part->keys.size() != n) return false;
+  size_t i = 0;
+  if (part->value_offset > 0) {
+    // The first value is the next piece of the last one received
+    if (n == 0 || values->empty() ||
+        values->back().size() != part->value_offset ||
+        (keys && (keys->empty() || keys->back() != part->keys[0]))) {
+      return false;
     }
-    case MessageType::MULTI_PUT: {
-      MultiPutResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
+    values->back() += part->values[0];
+    i = 1;
+  }
+  for (; i < n; i++) {
+    if (keys) keys->push_back(std::move(part->keys[i]));
+    values->push_back(std::move(part->values[i]));
+  }
+  // A split value never grows past the size it was sent with
+  return part->value_size == 0 ||
+         (!values->empty() && values->back().size() <= part->value_size);
+}
+
+// Deserializes a part of a streamed T into the T in `v`, appending it to the
+// parts before it, or starting over if it's the first.
+template <typename T, typename Variant>
+static bool deserialize_part(const Message& msg, Variant* v, bool first) {
+  T* whole = first ? &reuse_alternative<T>(v) : std::get_if<T>(v);
+  if (!whole) return false;
+  static thread_local std::variant<StreamPart> part;
+  if (!deserialize_into<StreamPart>(msg, &part)) return false;
+  StreamPart& p = std::get<StreamPart>(part);
+  if constexpr (std::is_same_v<T, MultiPutRequest>) {
+    if (first) {
+      whole->keys.clear();
+      whole->values.clear();
     }
-    case MessageType::ERROR: {
-      ErrorResponse res{};
-      if (!success(in(res))) return std::nullopt;
-      response = res;
-      break;
+    return append_part(&p, &whole->keys, &whole->values);
+  } else {
+    if (first) {
+      whole->values.clear();
+      whole->present = std::move(p.present);
     }
+    return append_part(&p, nullptr, &whole->values);
+  }
+}
+
+bool serialize_request_part(const Request& request, StreamPosition* next,
+                            Message* msg) {
+  if (auto* req = std::get_if<MultiPutRequest>(&request)) {
+    return serialize_part(*req, next, msg);
+  }
+  return serialize_request(request, msg);
+}
+
+bool deserialize_request_part(const Message& message, Request* request,
+                              bool first) {
+  // A message sent whole
+  if (first && !(message.flags & MESSAGE_CONTINUED)) {
+    return deserialize_request(message, request);
+  }
+  switch (message.type) {
+    case MessageType::MULTI_PUT:
+      return deserialize_part<MultiPutRequest>(message, request, first);
     default:
-      throw std::logic_error{
-          "Invalid message type! Please post privately on Edstem if this "
-          "occurs."};
-      break;
-  };
+      // No other requests are streamed
+      return false;
+  }
+}
 
-  return response;
+bool serialize_response_part(const Response& response, StreamPosition* next,
+                             Message* msg) {
+  if (auto* res = std::get_if<MultiGetResponse>(&response)) {
+    return serialize_part(*res, next, msg);
+  }
+  return serialize_response(response, msg);
+}
+
+bool deserialize_response_part(const Message& message, Response* response,
+                               bool first) {
+  if (first && !(message.flags & MESSAGE_CONTINUED)) {
+    return deserialize_response(message, response);
+  }
+  switch (message.type) {
+    case MessageType::MULTI_GET:
+      return deserialize_part<MultiGetResponse>(message, response, first);
+    default:
+      // No other responses are streamed
+      return false;
+  }
+}
+
+bool is_not_responsible(const Response& res) {
+  auto* error_res = std::get_if<ErrorResponse>(&res);
+  return error_res && error_res->msg.starts_with(NOT_RESPONSIBLE_ERROR);
 }
@@ -29,47 +29,229 @@ enum class MessageType {
   MOVE,
   QUERY,
   // Error
-  ERROR
+  ERROR,
+  // KvServer batches (added after the others, to keep their wire values)
+  BATCH,
+  // KvServer load shedding
+  OVERLOADED,
+  // Shardcontroller config change notifications
+  WATCH,
+  // KvServer shard migrations
+  TRANSFER,
+  // KvServer load reports to the shardcontroller
+  REPORT,
+  // Flow control of streamed requests (see STREAM_WINDOW)
+  CREDIT
 };
 
+// Message flags, carried in the header
+#define MESSAGE_COMPRESSED 0x1  // buf was compressed with lz_compress
+#define MESSAGE_CONTINUED 0x2   // more parts of the same message follow
+// A request a KvServer relays to another on a client's behalf (which isn't
+// relayed again), and the relayed response, which tells the client that it
+// routed the request with a stale config
+#define MESSAGE_FORWARDED 0x4
+#define MESSAGE_REROUTED 0x8
+// Set on every message this version sends, to tell the peer that it may send
+// compressed bodies back (see compress_message)
+#define MESSAGE_ACCEPTS_COMPRESSION 0x10
+// Set on a part of a streamed message whose last value continues in the next
+// part (see serialize_request_part)
+#define MESSAGE_SPLIT_VALUE 0x20
+
+/*
+ * On the wire, a message is a header, then its body. The header holds the
+ * message type (in host order), the body's size (32 bits, in network order),
+ * the flags, and three reserved zero bytes: laid out the same as before it
+ * had flags, where the size took up 64 bits but only its low 32 were read, so
+ * that peers that predate the flags still read messages that don't need them.
+ */
+#define MESSAGE_HEADER_SIZE (sizeof(MessageType) + 8)
+
 struct Message {
   MessageType type;
+  uint8_t flags = 0;
   size_t sz = 0;
   std::vector<std::byte> buf;
 
   size_t size() {
-    return sizeof(type) + sizeof(sz) + buf.size();
+    return MESSAGE_HEADER_SIZE + buf.size();
   }
 };
 
-// Generic send/receive message helper functions.
+// Message bodies are sent and received this many bytes at a time, and the
+// timeout of send_message/recv_message applies to each chunk.
+#define FRAME_CHUNK_SIZE (1 << 20)
+
+// Generic send/receive message helper functions. recv_message reuses the
+// capacity already held by msg->buf, and grows it as the body arrives.
 bool send_message(int fd, Message* msg, milliseconds timeout = 400ms);
 bool recv_message(int fd, Message* msg, milliseconds timeout = 400ms);
 
+/*
+ * Non-blocking versions of the above, for sockets with O_NONBLOCK set, which
+ * send/receive as much of a message as the socket allows (but no more than
+ * `*budget` bytes, which they count down), picking up where the last call on
+ * the same `progress` left off. They return 1 once the whole message has been
+ * sent/received, 0 if the socket isn't ready (or the budget ran out) before
+ * then, and -1 on failure, or if the other end closed the connection. The
+ * message being sent mustn't change until it's been sent in full.
+ */
+struct MessageProgress {
+  // The message's header (read or written so far)
+  std::byte header[MESSAGE_HEADER_SIZE] = {};
+  // Bytes of the header and body sent/received so far
+  size_t done = 0;
+};
+int send_message_some(int fd, const Message& msg, MessageProgress* progress,
+                      size_t* budget);
+int recv_message_some(int fd, Message* msg, MessageProgress* progress,
+                      size_t* budget);
+
+// Largest buffer a connection keeps around to reuse for its next message.
+#define MAX_RECYCLED_BUFFER_SIZE (1 << 20)
+
+// Releases msg's buffer if it grew past MAX_RECYCLED_BUFFER_SIZE, so that one
+// large message doesn't pin its memory for the lifetime of a connection.
+void recycle_message(Message* msg);
+
+/*
+ * Bulk messages (MultiPuts, MultiGets and transfers) with serialized bodies at
+ * least this large are compressed, if that makes them smaller, but only to
+ * peers that advertised MESSAGE_ACCEPTS_COMPRESSION on a message of the same
+ * connection; older peers only ever see uncompressed bodies. Receivers
+ * decompress any message flagged MESSAGE_COMPRESSED, so each sender may
+ * choose its own threshold.
+ */
+#define DEFAULT_COMPRESSION_THRESHOLD 4096
+
+// Sets this process's compression threshold; 0 turns compression off.
+void set_compression_threshold(size_t bytes);
+size_t get_compression_threshold();
+
+/*
+ * Compresses the body of a serialized message in place (and flags it
+ * MESSAGE_COMPRESSED), if it's a bulk message past the threshold that
+ * compresses well. Only for peers that accept compression (see above).
+ */
+void compress_message(Message* msg);
+
 // define a generic Error response message.
 struct ErrorResponse {
   std::string msg;
 };
 
+// Response of a KvServer too busy to process a request: the request wasn't
+// run, and the client should back off for about `retry_after_ms` before
+// sending it again.
+struct OverloadedResponse {
+  uint32_t retry_after_ms;
+};
+
+// Error message a KvServer replies with when, under its current config, it
+// isn't responsible for (some of) the keys in a request.
+#define NOT_RESPONSIBLE_ERROR "server not responsible for key"
+
 using Request = std::variant<
     // Shardcontroller requests
-    JoinRequest, LeaveRequest, MoveRequest, QueryRequest,
+    JoinRequest, LeaveRequest, MoveRequest, QueryRequest, WatchRequest,
+    ReportRequest,
     // KvServer requests
     GetRequest, PutRequest, AppendRequest, DeleteRequest, MultiGetRequest,
-    MultiPutRequest>;
+    MultiPutRequest, BatchRequest, TransferRequest>;
 using Response = std::variant<
     // Shardcontroller responses
-    JoinResponse, LeaveResponse, MoveResponse, QueryResponse,
+    JoinResponse, LeaveResponse, MoveResponse, QueryResponse, WatchResponse,
+    ReportResponse,
     // KvServer responses
     GetResponse, PutResponse, AppendResponse, DeleteResponse, MultiGetResponse,
-    MultiPutResponse,
-    // Error response
-    ErrorResponse>;
+    MultiPutResponse, BatchResponse, TransferResponse,
+    // Error responses
+    ErrorResponse, OverloadedResponse>;
+
+/*
+ * Returns whether applying `request` twice leaves the same state, and answers
+ * the same, as applying it once, so that a request that may or may not have
+ * been applied (e.g. its response timed out) can safely be resent.
+ */
+bool is_idempotent(const Request& request);
+
+std::optional<Message> serialize_request(const Request& request);
+std::optional<Request> deserialize_request(const Message& message);
+
+std::optional<Message> serialize_response(const Response& response);
+std::optional<Response> deserialize_response(const Message& message);
+
+// In-place versions of the above, which reuse the memory already held by their
+// output (msg->buf, or the strings and vectors of the request/response
+// alternative, if it's of the same type). Return false on failure.
+bool serialize_request(const Request& request, Message* msg);
+bool deserialize_request(const Message& message, Request* request);
+
+bool serialize_response(const Response& response, Message* msg);
+bool deserialize_response(const Message& message, Response* response);
+
+// MultiPutRequests and MultiGetResponses whose keys and values add up to more
+// than this many bytes are streamed in parts.
+#define STREAM_PART_SIZE (256 << 10)
+
+// Where the next part of a streamed message starts: at byte `offset` of the
+// value of item `item` (0 unless a value is split across parts).
+struct StreamPosition {
+  size_t item = 0;
+  size_t offset = 0;
+};
+
+/*
+ * Streaming versions of the in-place (de)serializers, which split a large
+ * message into a sequence of parts, each its own Message holding a bounded
+ * slice of the keys/values, so that neither side need buffer the whole
+ * message. A value too large for a part is itself split into pieces of up to
+ * STREAM_PART_SIZE, in parts of their own, each tagged with the value's
+ * (64-bit) total size; the part a value starts in is flagged
+ * MESSAGE_SPLIT_VALUE. Other messages are sent in a single part.
+ *
+ * To send, call serialize_*_part with `*next` initially {}, and send each part
+ * it produces, until one comes back without the MESSAGE_CONTINUED flag. To
+ * receive, pass each part to deserialize_*_part in turn (with `first` set for
+ * the first), which appends the part's keys/values to the output, joining the
+ * pieces of a split value back up. A receiver that consumes each part as it
+ * arrives (see ClientConn::try_recv_request) should clear the output between
+ * parts, all but for a value that continues in the next part.
+ */
+bool serialize_request_part(const Request& request, StreamPosition* next,
+                            Message* msg);
+bool deserialize_request_part(const Message& message, Request* request,
+                              bool first);
+
+bool serialize_response_part(const Response& response, StreamPosition* next,
+                             Message* msg);
+bool deserialize_response_part(const Message& message, Response* response,
+                               bool first);
+
+/*
+ * The receiver of a streamed request grants its sender a credit, a CREDIT
+ * message with no body, for each part but the last once it has taken it in,
+ * and the sender keeps at most this many parts ahead of its credits, so that
+ * a receiver that applies each part as it arrives sets the pace, rather than
+ * having them pile up in its socket buffers.
+ */
+#define STREAM_WINDOW 4
 
-std::optional<Message> serialize_request(Request request);
-std::optional<Request> deserialize_request(Message message);
+/*
+ * Returns whether `res` is a KvServer's NOT_RESPONSIBLE_ERROR, meaning the
+ * sender routed the request with a stale config.
+ */
+bool is_not_responsible(const Response& res);
 
-std::optional<Message> serialize_response(Response response);
-std::optional<Response> deserialize_response(Message message);
+/*
+ * Returns the T held by `v`, first constructing one if `v` holds a different
+ * alternative. Reusing an existing T keeps the capacity of its members.
+ */
+template <typename T, typename Variant>
+T& reuse_alternative(Variant* v) {
+  if (T* t = std::get_if<T>(v)) return *t;
+  return v->template emplace<T>();
+}
 
 #endif /* end of include guard */
@@ -0,0 +1,266 @@
+#include "net/routing_table.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <optional>
+#include <utility>
+
+RoutingTable::RoutingTable(ShardControllerConfig config)
+    : config(std::move(config)) {
+  std::size_t n_shards = 0;
+  bool mixed = false;
+  for (auto&& [server, shards] : this->config.server_to_shards) {
+    this->servers.push_back(server);
+    for (auto&& shard : shards) {
+      if (n_shards++ == 0) {
+        this->granularity = shard.granularity();
+      } else if (shard.granularity() != this->granularity) {
+        mixed = true;
+      }
+    }
+  }
+  if (this->servers.size() >= NO_SERVER) {
+    this->scheme = Scheme::SCAN;
+    return;
+  }
+
+  // Every shard, sorted by lower bound, for finding the shard holding a key
+  std::vector<std::pair<const Shard*, uint16_t>> sorted;
+  for (uint16_t i = 0; i < this->servers.size(); i++) {
+    for (auto&& shard : this->config.server_to_shards[this->servers[i]]) {
+      sorted.emplace_back(&shard, i);
+    }
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [](auto&& a, auto&& b) {
+    return a.first->lower < b.first->lower;
+  });
+  for (auto&& [shard, owner] : sorted) {
+    this->shards.push_back(*shard);
+    this->shard_owners.push_back(owner);
+  }
+
+  if (mixed) {
+    this->scheme = Scheme::SCAN;
+    return;
+  }
+  if (n_shards > 0 && this->build_hashed()) {
+    this->scheme = Scheme::HASHED;
+    return;
+  }
+
+  if (this->granularity <= 1) {
+    // A key's first byte is all get_server looks at, so ask it once per byte
+    this->scheme = Scheme::FIRST_BYTE;
+    for (std::size_t b = 0; b < this->by_first_byte.size(); b++) {
+      std::string key(1, char(b));
+      this->by_first_byte[b] = this->scan(key);
+      this->by_first_byte_shard[b] =
+          this->scan_shard(key, this->by_first_byte[b]);
+    }
+    this->empty_key_server = this->scan("");
+    return;
+  }
+
+  // Overlapping shards go to whichever server get_server finds first, and
+  // bounds that aren't upper-case compare differently than we expect, so
+  // check our routes against get_server's at every bound
+  this->scheme = Scheme::SORTED;
+  for (std::size_t i = 0; i < this->shards.size(); i++) {
+    if (i + 1 < this->shards.size() &&
+        this->shards[i].upper >= this->shards[i + 1].lower) {
+      this->scheme = Scheme::SCAN;
+      return;
+    }
+    for (std::string probe : {this->shards[i].lower, this->shards[i].upper}) {
+      for (int lowered = 0; lowered < 2; lowered++) {
+        if (this->search(probe) != this->scan(probe)) {
+          this->scheme = Scheme::SCAN;
+          return;
+        }
+        for (auto& c : probe) c = char(std::tolower(uint8_t(c)));
+      }
+    }
+  }
+}
+
+uint16_t RoutingTable::route(const std::string& key) const {
+  switch (this->scheme) {
+    case Scheme::FIRST_BYTE:
+      return key.empty() ? this->empty_key_server
+                         : this->by_first_byte[uint8_t(key[0])];
+    case Scheme::SORTED:
+      return key.size() >= this->granularity ? this->search(key)
+                                             : this->scan(key);
+    case Scheme::HASHED:
+      return this->by_slot[hash_slot(key)];
+    case Scheme::SCAN:
+      break;
+  }
+  return this->scan(key);
+}
+
+uint32_t RoutingTable::shard_of(const std::string& key) const {
+  switch (this->scheme) {
+    case Scheme::FIRST_BYTE:
+      return key.empty() ? NO_SHARD
+                         : this->by_first_byte_shard[uint8_t(key[0])];
+    case Scheme::SORTED:
+      if (key.size() < this->granularity) break;
+      return this->search_shard(key);
+    case Scheme::HASHED: {
+      uint16_t server = this->route(key);
+      if (server == NO_SERVER) return NO_SHARD;
+      // The bounds sort like the slots, so find the slot's bound among them
+      std::string bound = slot_bound(hash_slot(key));
+      auto it = std::upper_bound(
+          this->shards.begin(), this->shards.end(), bound,
+          [](const std::string& b, const Shard& s) { return b < s.lower; });
+      // Overlapping shards may hold the slot; the route's is the one
+      while (it != this->shards.begin()) {
+        --it;
+        std::size_t i = it - this->shards.begin();
+        if (this->shard_owners[i] == server && bound <= it->upper) {
+          return uint32_t(i);
+        }
+      }
+      return NO_SHARD;
+    }
+    case Scheme::SCAN:
+      break;
+  }
+  return this->scan_shard(key, this->route(key));
+}
+
+std::string RoutingTable::bound_of(const std::string& key) const {
+  if (this->scheme == Scheme::HASHED) return slot_bound(hash_slot(key));
+  std::string bound = key.substr(0, this->granularity);
+  for (auto& c : bound) c = char(std::toupper(uint8_t(c)));
+  return bound;
+}
+
+uint16_t RoutingTable::index_of(const std::string& address) const {
+  // Servers come from a std::map, so they're sorted
+  auto it = std::lower_bound(this->servers.begin(), this->servers.end(),
+                             address);
+  if (it == this->servers.end() || *it != address) return NO_SERVER;
+  return uint16_t(it - this->servers.begin());
+}
+
+// Digits of hashed shard bounds, the characters ordinary bounds are made of
+static constexpr char kSlotDigits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+uint32_t RoutingTable::hash_slot(const std::string& key) {
+  // 64-bit FNV-1a: cheap for short keys, and mixes well enough that keys
+  // sharing a long prefix still spread across slots
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : key) {
+    hash = (hash ^ uint8_t(c)) * 0x100000001b3;
+  }
+  return uint32_t(hash % HASH_SLOTS);
+}
+
+std::string RoutingTable::slot_bound(uint32_t slot) {
+  std::string bound(1 + HASH_SLOT_DIGITS, HASH_SHARD_PREFIX);
+  for (std::size_t i = HASH_SLOT_DIGITS; i > 0; i--) {
+    bound[i] = kSlotDigits[slot % 36];
+    slot /= 36;
+  }
+  return bound;
+}
+
+std::optional<uint32_t> RoutingTable::parse_slot_bound(
+    const std::string& bound) {
+  if (bound.size() != 1 + HASH_SLOT_DIGITS || bound[0] != HASH_SHARD_PREFIX) {
+    return std::nullopt;
+  }
+  uint32_t slot = 0;
+  for (std::size_t i = 1; i < bound.size(); i++) {
+    char c = char(std::toupper(uint8_t(bound[i])));
+    const char* digit = std::find(kSlotDigits, kSlotDigits + 36, c);
+    if (digit == kSlotDigits + 36) return std::nullopt;
+    slot = slot * 36 + uint32_t(digit - kSlotDigits);
+  }
+  return slot;
+}
+
+bool RoutingTable::build_hashed() {
+  std::vector<uint16_t> slots(HASH_SLOTS, NO_SERVER);
+  for (uint16_t i = 0; i < this->servers.size(); i++) {
+    for (auto&& shard : this->config.server_to_shards[this->servers[i]]) {
+      std::optional<uint32_t> lower = parse_slot_bound(shard.lower);
+      std::optional<uint32_t> upper = parse_slot_bound(shard.upper);
+      if (!lower || !upper) return false;
+      // Where shards overlap, the first server's wins, as in get_server
+      for (uint32_t slot = *lower; slot <= *upper; slot++) {
+        if (slots[slot] == NO_SERVER) slots[slot] = i;
+      }
+    }
+  }
+  this->by_slot = std::move(slots);
+  return true;
+}
+
+std::vector<Shard> split_hashed(std::size_t n) {
+  std::vector<Shard> shards;
+  for (std::size_t i = 0; i < n; i++) {
+    uint32_t lower = uint32_t(i * RoutingTable::HASH_SLOTS / n);
+    uint32_t upper = uint32_t((i + 1) * RoutingTable::HASH_SLOTS / n) - 1;
+    shards.push_back({RoutingTable::slot_bound(lower),
+                      RoutingTable::slot_bound(upper)});
+  }
+  return shards;
+}
+
+uint16_t RoutingTable::scan(const std::string& key) const {
+  std::optional<std::string> server = this->config.get_server(key);
+  return server ? this->index_of(*server) : NO_SERVER;
+}
+
+// Compares the first bound.size() bytes of `key`, upper-cased (as shard bounds
+// are), with `bound`.
+static int compare_prefix(const std::string& key, const std::string& bound) {
+  for (std::size_t i = 0; i < bound.size(); i++) {
+    int k = std::toupper(uint8_t(key[i]));
+    int b = uint8_t(bound[i]);
+    if (k != b) return k < b ? -1 : 1;
+  }
+  return 0;
+}
+
+uint16_t RoutingTable::search(const std::string& key) const {
+  uint32_t shard = this->search_shard(key);
+  return shard == NO_SHARD ? NO_SERVER : this->shard_owners[shard];
+}
+
+uint32_t RoutingTable::search_shard(const std::string& key) const {
+  // Find the last shard whose lower bound is at most the key's prefix
+  std::size_t lo = 0, hi = this->shards.size();
+  while (lo < hi) {
+    std::size_t mid = lo + (hi - lo) / 2;
+    if (compare_prefix(key, this->shards[mid].lower) >= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0 || compare_prefix(key, this->shards[lo - 1].upper) > 0) {
+    return NO_SHARD;
+  }
+  return uint32_t(lo - 1);
+}
+
+uint32_t RoutingTable::scan_shard(const std::string& key,
+                                  uint16_t server) const {
+  if (server == NO_SERVER) return NO_SHARD;
+  for (std::size_t i = 0; i < this->shards.size(); i++) {
+    const Shard& shard = this->shards[i];
+    if (this->shard_owners[i] == server &&
+        key.size() >= shard.lower.size() &&
+        key.size() >= shard.upper.size() &&
+        compare_prefix(key, shard.lower) >= 0 &&
+        compare_prefix(key, shard.upper) <= 0) {
+      return uint32_t(i);
+    }
+  }
+  return NO_SHARD;
+}
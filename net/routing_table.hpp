@@ -0,0 +1,150 @@
+#ifndef NET_ROUTING_TABLE_HPP
+#define NET_ROUTING_TABLE_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/shard.hpp"
+
+/*
+ * A ShardControllerConfig compiled for fast key routing. Built once when a
+ * config is installed (by a KvServer or a ShardKvClient), then only read, so
+ * it can be shared freely between threads.
+ *
+ * ShardControllerConfig::get_server scans every server's shards for each key.
+ * Instead, servers are numbered, and:
+ *  - when every shard has granularity 1 (i.e. keys are routed by their first
+ *    character), a 256-entry array maps a key's first byte straight to its
+ *    server;
+ *  - for finer shards, their (upper-cased) bounds are kept sorted, and a key's
+ *    prefix is binary searched for among them.
+ * Shards of mixed granularities fall back to get_server. Routing always agrees
+ * with get_server: the sorted bounds are checked against it when the table is
+ * built, and it's used for keys too short to have a full prefix.
+ *
+ * Configs may instead shard a hashed keyspace, so that keys spread evenly
+ * however they're named (e.g. when they all start with "user_"): a key's hash
+ * picks one of HASH_SLOTS virtual shards, and a hashed shard's bounds are
+ * HASH_SHARD_PREFIX then the first and last slots it covers, as base-36
+ * numbers of HASH_SLOT_DIGITS digits (in the characters of ordinary bounds).
+ * E.g. {"#000", "#ZZZ"} is the whole keyspace. The bounds sort like the slots,
+ * so the shardcontroller moves and splits hashed shards like any others; only
+ * routing differs, through a table indexed by slot.
+ *
+ * The table also finds which of the config's shards holds a key (shard_of),
+ * for servers to count the load on each shard they own.
+ */
+class RoutingTable {
+ public:
+  // Route of keys that no server is responsible for
+  static constexpr uint16_t NO_SERVER = UINT16_MAX;
+  // Shard of keys that no shard holds
+  static constexpr uint32_t NO_SHARD = UINT32_MAX;
+
+  // Hashed shards (see above)
+  static constexpr char HASH_SHARD_PREFIX = '#';
+  static constexpr std::size_t HASH_SLOT_DIGITS = 3;
+  static constexpr uint32_t HASH_SLOTS = 36 * 36 * 36;
+
+  // Returns the virtual shard `key` hashes to.
+  static uint32_t hash_slot(const std::string& key);
+  // Returns the bound of a hashed shard starting or ending at `slot`.
+  static std::string slot_bound(uint32_t slot);
+  // Returns the slot of a hashed shard's bound, or std::nullopt if `bound`
+  // isn't one.
+  static std::optional<uint32_t> parse_slot_bound(const std::string& bound);
+
+  RoutingTable() : RoutingTable(ShardControllerConfig{}) {
+  }
+  explicit RoutingTable(ShardControllerConfig config);
+
+  // Returns the index (into servers()) of the server responsible for `key`,
+  // or NO_SERVER if there is none.
+  uint16_t route(const std::string& key) const;
+
+  // Returns the address of the server responsible for `key`, or nullptr if
+  // there is none.
+  const std::string* get_server(const std::string& key) const {
+    uint16_t server = this->route(key);
+    return server == NO_SERVER ? nullptr : &this->servers[server];
+  }
+
+  // Returns the index (into get_shards()) of the shard holding `key`, or
+  // NO_SHARD if there is none. The shard is one of route(key)'s.
+  uint32_t shard_of(const std::string& key) const;
+
+  // Returns the finest bound a shard holding `key` can start or end at: its
+  // upper-cased prefix of the shards' granularity, or its slot's bound, for
+  // hashed shards.
+  std::string bound_of(const std::string& key) const;
+
+  // Returns the index of the server at `address`, or NO_SERVER if it isn't in
+  // the config.
+  uint16_t index_of(const std::string& address) const;
+
+  // The servers in the config, in its order.
+  const std::vector<std::string>& get_servers() const {
+    return this->servers;
+  }
+  // Every shard in the config, sorted by lower bound.
+  const std::vector<Shard>& get_shards() const {
+    return this->shards;
+  }
+  // The server (index into get_servers()) of each of get_shards().
+  const std::vector<uint16_t>& get_shard_owners() const {
+    return this->shard_owners;
+  }
+  // The config the table was built from.
+  const ShardControllerConfig& get_config() const {
+    return this->config;
+  }
+
+ private:
+  enum class Scheme { FIRST_BYTE, SORTED, HASHED, SCAN };
+
+  ShardControllerConfig config;
+  std::vector<std::string> servers;
+  Scheme scheme = Scheme::FIRST_BYTE;
+
+  // Every shard, sorted by lower bound, and their servers. SORTED searches
+  // these; the other schemes use them only for shard_of
+  std::vector<Shard> shards;
+  std::vector<uint16_t> shard_owners;
+
+  // FIRST_BYTE: the server and shard for each first byte, and the server for
+  // the empty key
+  std::array<uint16_t, 256> by_first_byte;
+  std::array<uint32_t, 256> by_first_byte_shard;
+  uint16_t empty_key_server = NO_SERVER;
+
+  // SORTED: the shards' granularity
+  std::size_t granularity = 0;
+
+  // HASHED: the server for each slot
+  std::vector<uint16_t> by_slot;
+
+  // Builds the HASHED table, if every shard is hashed. Returns whether it is.
+  bool build_hashed();
+
+  // Routes `key` through the config's get_server.
+  uint16_t scan(const std::string& key) const;
+  // Routes `key` (of at least `granularity` bytes) through the sorted bounds.
+  uint16_t search(const std::string& key) const;
+  // Returns the index of the shard holding `key` (of at least `granularity`
+  // bytes) through the sorted bounds.
+  uint32_t search_shard(const std::string& key) const;
+  // Returns the index of the shard of `server` holding `key`, checking each.
+  uint32_t scan_shard(const std::string& key, uint16_t server) const;
+};
+
+/*
+ * Returns `n` hashed shards of (nearly) equal numbers of slots, which together
+ * cover the whole keyspace: the hashed counterpart of split_into.
+ */
+std::vector<Shard> split_hashed(std::size_t n);
+
+#endif /* end of include guard */
@@ -1,6 +1,8 @@
 #ifndef NET_SERVER_COMMANDS_HPP
 #define NET_SERVER_COMMANDS_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <variant>
 #include <vector>
@@ -26,6 +28,9 @@ struct DeleteRequest {
 
 struct MultiGetRequest {
   std::vector<std::string> keys;
+  // By default, a MultiGet fails if any key doesn't exist. A partial MultiGet
+  // instead returns the values of the keys that do (see MultiGetResponse).
+  bool partial = false;
 };
 
 struct MultiPutRequest {
@@ -33,6 +38,39 @@ struct MultiPutRequest {
   std::vector<std::string> values;
 };
 
+// An ordered list of mixed single-key operations, executed atomically: all of
+// the buckets the batch touches stay locked until every operation has run.
+enum class BatchOpType { GET, PUT, APPEND, DELETE };
+struct BatchOp {
+  BatchOpType type;
+  std::string key;
+  // Only used by PUT and APPEND
+  std::string value;
+};
+struct BatchRequest {
+  std::vector<BatchOp> ops;
+};
+
+// A chunk of a shard migration: keys a KvServer (the source) hands off to the
+// server now responsible for them, with their values, and keys deleted since
+// an earlier chunk. Applied without forwarding (see KvServer::Handoff).
+struct TransferRequest {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  std::vector<std::string> deleted;
+  // The source's address, and the shardcontroller's version of the config it
+  // is migrating to
+  std::string source;
+  uint64_t version = 0;
+  // The chunk's position in the source's stream to this server (from 0, for
+  // each migration), so that chunks are applied in order, and only once
+  uint64_t seq = 0;
+  // Checksum of the chunk's keys, values and sequence number
+  uint64_t checksum = 0;
+  // Set on the source's last chunk, sent once it has cut over
+  bool last = false;
+};
+
 // Responses
 struct GetResponse {
   std::string value;
@@ -45,7 +83,34 @@ struct DeleteResponse {
 };
 struct MultiGetResponse {
   std::vector<std::string> values;
+  // Only used by partial MultiGets: a bitmap with bit i set iff the request's
+  // i-th key exists, in which case `values` only holds the existing keys'
+  // values, in request order.
+  std::vector<uint8_t> present;
+
+  // Sizes `present` for `n_keys` keys, none of them present
+  void clear_present(std::size_t n_keys) {
+    this->present.assign((n_keys + 7) / 8, 0);
+  }
+  void set_present(std::size_t i) {
+    this->present[i / 8] |= uint8_t(1) << (i % 8);
+  }
+  bool is_present(std::size_t i) const {
+    return (this->present[i / 8] >> (i % 8)) & 1;
+  }
 };
 struct MultiPutResponse {};
 
+// Result of one operation in a batch: whether it succeeded (a GET or DELETE
+// fails if its key doesn't exist), and, for a GET or DELETE, the value.
+struct BatchResult {
+  bool ok;
+  std::string value;
+};
+// One result per operation in the request, in the same order
+struct BatchResponse {
+  std::vector<BatchResult> results;
+};
+struct TransferResponse {};
+
 #endif /* end of include guard */
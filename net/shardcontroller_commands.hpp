@@ -1,6 +1,8 @@
 #ifndef NET_SHARDCONTROLLER_COMMANDS_HPP
 #define NET_SHARDCONTROLLER_COMMANDS_HPP
 
+#include <cstdint>
+#include <map>
 #include <optional>
 #include <string>
 #include <vector>
@@ -20,6 +22,32 @@ struct MoveRequest {
   std::vector<Shard> shards;
 };
 struct QueryRequest {};
+// Waits for the config to change from `version`, for up to `timeout_ms`
+// milliseconds (or indefinitely, if 0)
+struct WatchRequest {
+  uint64_t version;
+  uint32_t timeout_ms = 0;
+};
+// The load on one of a server's shards, since its last report
+struct ShardLoad {
+  Shard shard;
+  double ops_per_sec = 0;
+  // Bytes of keys and values the server stores in the shard
+  uint64_t bytes = 0;
+  // Where to split the shard so that each half has about half of its ops
+  // (or bytes), from the keys the server sampled: the lower bound of the
+  // upper half. Empty if the shard can't be split that way.
+  std::string ops_split;
+  std::string bytes_split;
+};
+// A server's periodic report of the load on its shards, under the config of
+// `version`. `migrating` is set while it's handing shards off.
+struct ReportRequest {
+  std::string server;
+  uint64_t version = 0;
+  bool migrating = false;
+  std::vector<ShardLoad> loads;
+};
 
 // Responses
 struct JoinResponse {};
@@ -27,6 +55,33 @@ struct LeaveResponse {};
 struct MoveResponse {};
 struct QueryResponse {
   ShardControllerConfig config;
+  // Incremented on every change to the config
+  uint64_t version = 0;
+};
+// The current config's version, and how it differs from the watcher's. If the
+// watcher's version is too old for the shardcontroller to know the
+// difference, `full` is set, and `changed` holds the whole config instead.
+// A Watch that timed out has the watcher's version, and no changes.
+struct WatchResponse {
+  uint64_t version;
+  bool full = false;
+  // Servers that joined or whose shards changed, with their current shards
+  std::map<std::string, std::vector<Shard>> changed;
+  // Servers that left
+  std::vector<std::string> removed;
 };
+struct ReportResponse {};
+
+// Applies the changes in a WatchResponse to the watcher's config.
+inline void apply_watch_response(const WatchResponse& res,
+                                 ShardControllerConfig* config) {
+  if (res.full) config->server_to_shards.clear();
+  for (auto&& server : res.removed) {
+    config->server_to_shards.erase(server);
+  }
+  for (auto&& [server, shards] : res.changed) {
+    config->server_to_shards[server] = shards;
+  }
+}
 
 #endif /* end of include guard */
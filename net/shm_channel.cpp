@@ -0,0 +1,218 @@
+#include "net/shm_channel.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <thread>
+
+#include "common/color.hpp"
+
+struct ShmChannel::Ring {
+  // Total bytes ever written to and read from the ring; the bytes between them
+  // are the messages not yet read
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) std::atomic<uint64_t> head;
+  // Whether the reader is asleep on the socket, waiting for a doorbell
+  alignas(64) std::atomic<uint32_t> reader_waiting;
+};
+
+struct ShmChannel::Header {
+  uint64_t magic;
+  uint64_t ring_size;
+  // rings[0] carries messages from the client to the server; rings[1] back
+  Ring rings[2];
+};
+
+// "kvshm", then the layout version
+static constexpr uint64_t SHM_MAGIC = 0x6b7673686d000001;
+
+// Each message in a ring is its type, flags and size, then its body
+struct FrameHeader {
+  uint32_t type;
+  uint32_t flags;
+  uint64_t sz;
+};
+
+std::size_t ShmChannel::data_offset() {
+  // The ring data starts after the header, on its own cache line
+  return (sizeof(Header) + 63) / 64 * 64;
+}
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "rings must be lock-free to be shared between processes");
+
+std::unique_ptr<ShmChannel> ShmChannel::create(std::size_t ring_size) {
+  if (ring_size == 0 || (ring_size & (ring_size - 1)) != 0) {
+    cerr_color(RED, "Shared memory ring size must be a power of two.");
+    return nullptr;
+  }
+
+  int fd = memfd_create("kvstore-shm", MFD_CLOEXEC);
+  if (fd < 0) {
+    perror_color(RED, "memfd_create");
+    return nullptr;
+  }
+  std::size_t mem_size = data_offset() + 2 * ring_size;
+  if (ftruncate(fd, mem_size) < 0) {
+    perror_color(RED, "ftruncate");
+    close(fd);
+    return nullptr;
+  }
+  void* mem =
+      mmap(nullptr, mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    perror_color(RED, "mmap");
+    close(fd);
+    return nullptr;
+  }
+
+  // The memory starts zeroed, so the rings start empty
+  auto* header = new (mem) Header{};
+  header->magic = SHM_MAGIC;
+  header->ring_size = ring_size;
+  return std::unique_ptr<ShmChannel>(
+      new ShmChannel(fd, mem, mem_size, /*is_client=*/true));
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::attach(int memfd) {
+  struct stat st;
+  if (fstat(memfd, &st) < 0 || std::size_t(st.st_size) < data_offset()) {
+    close(memfd);
+    return nullptr;
+  }
+  std::size_t mem_size = st.st_size;
+  void* mem =
+      mmap(nullptr, mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (mem == MAP_FAILED) {
+    perror_color(RED, "mmap");
+    close(memfd);
+    return nullptr;
+  }
+
+  // Don't trust the client's layout any further than we can check it
+  auto* header = static_cast<Header*>(mem);
+  std::size_t ring_size = header->ring_size;
+  if (header->magic != SHM_MAGIC || ring_size == 0 ||
+      (ring_size & (ring_size - 1)) != 0 ||
+      mem_size != data_offset() + 2 * ring_size) {
+    cerr_color(RED, "Invalid shared memory channel.");
+    munmap(mem, mem_size);
+    close(memfd);
+    return nullptr;
+  }
+  return std::unique_ptr<ShmChannel>(
+      new ShmChannel(memfd, mem, mem_size, /*is_client=*/false));
+}
+
+ShmChannel::ShmChannel(int fd, void* mem, std::size_t mem_size,
+                       bool is_client)
+    : fd(fd), mem(mem), mem_size(mem_size) {
+  auto* header = static_cast<Header*>(mem);
+  this->ring_size = header->ring_size;
+
+  std::byte* data = static_cast<std::byte*>(mem) + data_offset();
+  Ring* to_server = &header->rings[0];
+  Ring* to_client = &header->rings[1];
+  std::byte* to_server_data = data;
+  std::byte* to_client_data = data + this->ring_size;
+
+  this->tx = is_client ? to_server : to_client;
+  this->tx_data = is_client ? to_server_data : to_client_data;
+  this->rx = is_client ? to_client : to_server;
+  this->rx_data = is_client ? to_client_data : to_server_data;
+}
+
+ShmChannel::~ShmChannel() {
+  munmap(this->mem, this->mem_size);
+  close(this->fd);
+}
+
+// Copies n bytes into/out of a ring of the given size, starting at (absolute)
+// position pos and wrapping around its end.
+static void copy_in(std::byte* data, std::size_t ring_size, uint64_t pos,
+                    const void* src, std::size_t n) {
+  std::size_t start = pos & (ring_size - 1);
+  std::size_t first = std::min(n, ring_size - start);
+  memcpy(data + start, src, first);
+  memcpy(data, static_cast<const std::byte*>(src) + first, n - first);
+}
+
+static void copy_out(const std::byte* data, std::size_t ring_size,
+                     uint64_t pos, void* dst, std::size_t n) {
+  std::size_t start = pos & (ring_size - 1);
+  std::size_t first = std::min(n, ring_size - start);
+  memcpy(dst, data + start, first);
+  memcpy(static_cast<std::byte*>(dst) + first, data, n - first);
+}
+
+bool ShmChannel::write(const Message& msg, milliseconds timeout) {
+  std::size_t frame_size = sizeof(FrameHeader) + msg.sz;
+  if (frame_size > this->ring_size) {
+    cerr_color(RED, "Message of ", msg.sz,
+               " bytes is too large for the shared memory ring.");
+    return false;
+  }
+
+  // We're the only writer, so the tail can't move under us
+  uint64_t tail = this->tx->tail.load(std::memory_order_relaxed);
+  auto begin = steady_clock::now();
+  while (tail - this->tx->head.load(std::memory_order_acquire) + frame_size >
+         this->ring_size) {
+    if (steady_clock::now() - begin > timeout) {
+      cerr_color(RED, "Write to shared memory ring timed out.");
+      return false;
+    }
+    std::this_thread::yield();
+  }
+
+  FrameHeader header{static_cast<uint32_t>(msg.type), msg.flags, msg.sz};
+  copy_in(this->tx_data, this->ring_size, tail, &header, sizeof(header));
+  copy_in(this->tx_data, this->ring_size, tail + sizeof(header),
+          msg.buf.data(), msg.sz);
+  // Sequentially consistent, so that either we see the reader's waiting flag
+  // afterwards, or it sees this message before it sleeps
+  this->tx->tail.store(tail + frame_size, std::memory_order_seq_cst);
+  return true;
+}
+
+bool ShmChannel::try_read(Message* msg) {
+  uint64_t head = this->rx->head.load(std::memory_order_relaxed);
+  uint64_t tail = this->rx->tail.load(std::memory_order_seq_cst);
+  uint64_t available = tail - head;
+  if (available == 0) return false;
+  if (available < sizeof(FrameHeader) || available > this->ring_size) {
+    cerr_color(RED, "Corrupt shared memory ring.");
+    return false;
+  }
+
+  FrameHeader header;
+  copy_out(this->rx_data, this->ring_size, head, &header, sizeof(header));
+  if (header.sz > available - sizeof(FrameHeader)) {
+    cerr_color(RED, "Corrupt shared memory ring.");
+    return false;
+  }
+
+  msg->type = static_cast<MessageType>(header.type);
+  msg->flags = static_cast<uint8_t>(header.flags);
+  msg->sz = header.sz;
+  msg->buf.resize(header.sz);
+  copy_out(this->rx_data, this->ring_size, head + sizeof(header),
+           msg->buf.data(), header.sz);
+  this->rx->head.store(head + sizeof(header) + header.sz,
+                       std::memory_order_release);
+  return true;
+}
+
+void ShmChannel::set_waiting() {
+  this->rx->reader_waiting.store(1, std::memory_order_seq_cst);
+}
+
+bool ShmChannel::clear_waiting() {
+  return this->rx->reader_waiting.exchange(0) == 1;
+}
+
+bool ShmChannel::take_peer_waiting() {
+  return this->tx->reader_waiting.exchange(0) == 1;
+}
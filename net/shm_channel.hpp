@@ -0,0 +1,101 @@
+#ifndef NET_SHM_CHANNEL_HPP
+#define NET_SHM_CHANNEL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "net/network_messages.hpp"
+
+using namespace std::chrono;
+
+/*
+ * A shared-memory message channel between a client and a server on the same
+ * host: two single-producer, single-consumer byte rings, one per direction,
+ * in a memfd that the client creates and passes to the server over a Unix
+ * domain socket (see connect_to_server and accept_shm_channel).
+ *
+ * The socket stays open alongside the channel as a doorbell. Each message
+ * written to the server is followed by a one-byte write on the socket, so that
+ * the server's I/O engine sees the connection as readable exactly when it has
+ * requests waiting. The other way around, the client first spins on its ring
+ * for a short while, and only asks for a doorbell (through a flag in the
+ * shared memory) before going to sleep on the socket.
+ */
+class ShmChannel {
+ public:
+  static constexpr std::size_t DEFAULT_RING_SIZE = 1 << 20;
+
+  /*
+   * Creates the shared memory of a new channel, for the client side. The ring
+   * size must be a power of two; it bounds the size of a message. Returns
+   * nullptr on failure.
+   */
+  static std::unique_ptr<ShmChannel> create(
+      std::size_t ring_size = DEFAULT_RING_SIZE);
+  /*
+   * Maps the shared memory of a channel a client created, for the server side.
+   * Takes ownership of `memfd`. Returns nullptr on failure, including if the
+   * memory doesn't hold a valid channel.
+   */
+  static std::unique_ptr<ShmChannel> attach(int memfd);
+
+  ~ShmChannel();
+
+  ShmChannel(const ShmChannel&) = delete;
+  ShmChannel& operator=(const ShmChannel&) = delete;
+
+  // The memfd backing the channel, to pass to the server.
+  int memfd() const {
+    return this->fd;
+  }
+
+  /*
+   * Writes `msg` to the other side, waiting up to `timeout` for room if the
+   * ring is full. Returns false if it times out, or the message could never
+   * fit in the ring.
+   */
+  bool write(const Message& msg, milliseconds timeout);
+  /*
+   * Reads the next message from the other side into `msg` (reusing the
+   * capacity of msg->buf), if one has been written. Returns false if there's
+   * none, or it's malformed.
+   */
+  bool try_read(Message* msg);
+
+  /*
+   * Doorbell flag, set by a reader before it sleeps on the socket. The writer
+   * clears it (take_peer_waiting) after writing a message, and rings the
+   * doorbell if it was set; the reader clears it itself on waking up
+   * (clear_waiting), and must consume the doorbell if it finds it already
+   * taken.
+   */
+  void set_waiting();
+  bool clear_waiting();
+  bool take_peer_waiting();
+
+ private:
+  // Control block of one ring, and of the whole channel, in the shared memory
+  struct Ring;
+  struct Header;
+
+  ShmChannel(int fd, void* mem, std::size_t mem_size, bool is_client);
+
+  // Offset of the ring data from the start of the shared memory
+  static std::size_t data_offset();
+
+  int fd;
+  void* mem;
+  std::size_t mem_size;
+  std::size_t ring_size;
+
+  // The rings we write to and read from, and their data
+  Ring* tx;
+  std::byte* tx_data;
+  Ring* rx;
+  std::byte* rx_data;
+};
+
+#endif /* end of include guard */
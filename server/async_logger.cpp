@@ -0,0 +1,58 @@
+#include "server/async_logger.hpp"
+
+#include <utility>
+
+void AsyncLogger::start() {
+  std::unique_lock lock(this->mtx);
+  if (this->printer.joinable()) return;
+  this->stopping = false;
+  this->printer = std::thread(&AsyncLogger::print_loop, this);
+}
+
+void AsyncLogger::stop() {
+  {
+    std::unique_lock lock(this->mtx);
+    if (!this->printer.joinable()) return;
+    this->stopping = true;
+  }
+  this->cv.notify_one();
+  this->printer.join();
+}
+
+void AsyncLogger::push(const char* color, std::string text) {
+  {
+    std::unique_lock lock(this->mtx);
+    if (this->queue.size() >= MAX_QUEUED) {
+      this->n_dropped++;
+      return;
+    }
+    this->queue.push_back({color, std::move(text)});
+  }
+  this->cv.notify_one();
+}
+
+void AsyncLogger::print_loop() {
+  std::deque<Line> lines;
+  while (true) {
+    std::size_t dropped;
+    bool stopping;
+    {
+      std::unique_lock lock(this->mtx);
+      this->cv.wait(lock,
+                    [this] { return this->stopping || !this->queue.empty(); });
+      // Take the whole queue, and print it without holding the lock
+      lines.swap(this->queue);
+      dropped = std::exchange(this->n_dropped, 0);
+      stopping = this->stopping;
+    }
+
+    for (auto&& line : lines) {
+      cout_color(line.color, line.text);
+    }
+    lines.clear();
+    if (dropped > 0) {
+      cout_color(YELLOW, "(", dropped, " log lines dropped)");
+    }
+    if (stopping) return;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef SERVER_ASYNC_LOGGER_HPP
+#define SERVER_ASYNC_LOGGER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "common/color.hpp"
+
+/*
+ * Prints log lines from a background thread, so that hot paths (e.g. a worker
+ * accepting a burst of connections) only pay for formatting the line and a
+ * queue push, rather than for writing to the terminal.
+ *
+ * Lines are printed in the order they're logged. If the queue reaches
+ * MAX_QUEUED lines, further lines are dropped (and counted) until it drains.
+ */
+class AsyncLogger {
+ public:
+  static constexpr std::size_t MAX_QUEUED = 10'000;
+
+  AsyncLogger() = default;
+  ~AsyncLogger() {
+    this->stop();
+  }
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  // Starts the printing thread. Lines logged before then are queued.
+  void start();
+  // Prints the lines still queued, then joins the printing thread.
+  void stop();
+
+  /*
+   * Queues a line made of `args` (formatted as by cout_color) to be printed
+   * in `color`.
+   */
+  template <typename... Args>
+  void log(const char* color, Args&&... args) {
+    std::ostringstream line;
+    (line << ... << args);
+    this->push(color, line.str());
+  }
+
+ private:
+  struct Line {
+    const char* color;
+    std::string text;
+  };
+
+  void push(const char* color, std::string text);
+  void print_loop();
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Line> queue;
+  std::size_t n_dropped = 0;
+  bool stopping = false;
+  std::thread printer;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,32 @@
+#include "server/get_coalescer.hpp"
+
+#include <functional>
+
+GetCoalescer::Slot& GetCoalescer::slot_for(const std::string& key) {
+  return this->slots[std::hash<std::string>{}(key) % N_SLOTS];
+}
+
+Message* GetCoalescer::find(const std::string& key) {
+  Slot& slot = this->slot_for(key);
+  if (slot.round != this->round || slot.key != key) {
+    return nullptr;
+  }
+  this->n_hits.fetch_add(1, std::memory_order_relaxed);
+  return &slot.msg;
+}
+
+Message* GetCoalescer::insert(const std::string& key) {
+  Slot& slot = this->slot_for(key);
+  // Reuses the capacity of the slot's key and buffer
+  slot.key.assign(key);
+  recycle_message(&slot.msg);
+  slot.round = this->round;
+  return &slot.msg;
+}
+
+void GetCoalescer::erase(const std::string& key) {
+  Slot& slot = this->slot_for(key);
+  if (slot.key == key) {
+    slot.round = 0;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef SERVER_GET_COALESCER_HPP
+#define SERVER_GET_COALESCER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "net/network_messages.hpp"
+
+/*
+ * Coalesces identical Gets a worker has in flight at once (single-flight), so
+ * that when a key is hot, the Gets for it that arrive together are served
+ * from one store lookup and one serialized response, rather than each taking
+ * the bucket lock, copying the value and serializing it again.
+ *
+ * A worker starts a new round each time it picks up the requests its clients
+ * have ready, and only reuses responses within a round. Every Get served in a
+ * round was sent before the round started, and so before the lookup that
+ * served it: the lookup falls within each of those Gets, which keeps them
+ * linearizable even if the key is written in the meantime.
+ *
+ * Responses are cached in a fixed number of slots, indexed by a hash of the
+ * key, whose buffers are recycled across rounds so that steady-state Gets
+ * don't allocate. Keys that collide on a slot just evict each other.
+ */
+class GetCoalescer {
+ public:
+  static constexpr std::size_t N_SLOTS = 256;
+
+  GetCoalescer() : slots(N_SLOTS) {
+  }
+
+  // Starts a new round: responses cached in earlier rounds are no longer used.
+  void next_round() {
+    this->round++;
+  }
+
+  /*
+   * Returns the response cached this round for a Get of `key`, or nullptr if
+   * there isn't one.
+   */
+  Message* find(const std::string& key);
+
+  /*
+   * Returns the message to serialize the response to a Get of `key` into,
+   * cached until the end of this round.
+   */
+  Message* insert(const std::string& key);
+
+  // Drops the response cached for `key`, e.g. if serializing it failed.
+  void erase(const std::string& key);
+
+  // Number of Gets served from a cached response (readable from any thread).
+  uint64_t hits() const {
+    return this->n_hits.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::string key;
+    Message msg;
+    // Round the response was cached in (0 for none)
+    uint64_t round = 0;
+  };
+  std::vector<Slot> slots;
+  uint64_t round = 1;
+  std::atomic<uint64_t> n_hits = 0;
+
+  Slot& slot_for(const std::string& key);
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,76 @@
+#include "server/load_tracker.hpp"
+
+#include <functional>
+#include <thread>
+
+LoadTracker::LoadTracker(std::size_t n_shards)
+    : n_shards(n_shards),
+      lines_per_stripe((n_shards + 7) / 8),
+      lines(N_STRIPES * this->lines_per_stripe),
+      since(std::chrono::steady_clock::now()) {
+}
+
+std::vector<double> LoadTracker::take() {
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - this->since).count();
+  this->since = now;
+
+  std::vector<double> rates(this->n_shards);
+  for (std::size_t shard = 0; shard < this->n_shards; shard++) {
+    uint64_t ops = 0;
+    for (std::size_t s = 0; s < N_STRIPES; s++) {
+      Line& line = this->lines[s * this->lines_per_stripe + shard / 8];
+      ops += line.ops[shard % 8].exchange(0, std::memory_order_relaxed);
+    }
+    rates[shard] = seconds > 0 ? double(ops) / seconds : 0;
+  }
+  return rates;
+}
+
+void LoadTracker::sample(uint32_t shard, std::string bound) {
+  Samples& stripe = this->samples[LoadTracker::stripe()];
+  std::lock_guard lock(stripe.mtx);
+  if (stripe.samples.size() < MAX_STRIPE_SAMPLES) {
+    stripe.samples.emplace_back(shard, std::move(bound));
+  }
+}
+
+std::vector<std::pair<uint32_t, std::string>> LoadTracker::take_samples() {
+  std::vector<std::pair<uint32_t, std::string>> taken;
+  for (auto& stripe : this->samples) {
+    std::lock_guard lock(stripe.mtx);
+    for (auto& sample : stripe.samples) taken.push_back(std::move(sample));
+    stripe.samples.clear();
+  }
+  return taken;
+}
+
+std::string find_split(const Shard& shard,
+                       const std::map<std::string, uint64_t>& weights) {
+  uint64_t total = 0;
+  for (auto&& [bound, weight] : weights) total += weight;
+
+  // Bounds in the shard past its lower bound can start an upper half; pick
+  // the one with the weight before it closest to half
+  std::string split;
+  uint64_t before = 0, best_gap = UINT64_MAX;
+  for (auto&& [bound, weight] : weights) {
+    if (bound > shard.lower && bound <= shard.upper && before > 0 &&
+        before < total) {
+      uint64_t gap = before * 2 > total ? before * 2 - total
+                                        : total - before * 2;
+      if (gap < best_gap) {
+        best_gap = gap;
+        split = bound;
+      }
+    }
+    before += weight;
+  }
+  return split;
+}
+
+std::size_t LoadTracker::stripe() {
+  thread_local std::size_t stripe =
+      std::hash<std::thread::id>{}(std::this_thread::get_id()) % N_STRIPES;
+  return stripe;
+}
@@ -0,0 +1,99 @@
+#ifndef SERVER_LOAD_TRACKER_HPP
+#define SERVER_LOAD_TRACKER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/shard.hpp"
+
+/*
+ * Counts the key operations on each shard of a config (indexed as in its
+ * RoutingTable::get_shards), for the server's periodic load reports to the
+ * shardcontroller.
+ *
+ * Every request records its keys, so the counters are striped: each thread
+ * adds to one of N_STRIPES copies, picked by its thread id, and each stripe's
+ * counters start on their own cache line, so workers on different stripes
+ * don't contend. take() sums the stripes.
+ *
+ * One in SAMPLE_EVERY operations also samples the bound of its key (see
+ * RoutingTable::bound_of), up to MAX_STRIPE_SAMPLES per stripe between
+ * reports, for the shardcontroller to split a hot shard where its load is.
+ */
+class LoadTracker {
+ public:
+  static constexpr std::size_t N_STRIPES = 8;
+  static constexpr uint32_t SAMPLE_EVERY = 16;
+  static constexpr std::size_t MAX_STRIPE_SAMPLES = 1024;
+
+  explicit LoadTracker(std::size_t n_shards);
+
+  // Records one operation on `shard`.
+  void record(uint32_t shard) {
+    Line& line =
+        this->lines[this->stripe() * this->lines_per_stripe + shard / 8];
+    line.ops[shard % 8].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /*
+   * Returns the operations per second on each shard since the last call (or
+   * since the tracker was created), and resets the counts. Only one thread
+   * may call it.
+   */
+  std::vector<double> take();
+
+  // Returns whether the calling thread should sample its next operation.
+  static bool should_sample() {
+    thread_local uint32_t countdown = 0;
+    if (countdown-- > 0) return false;
+    countdown = SAMPLE_EVERY - 1;
+    return true;
+  }
+  // Samples an operation on `shard`, on a key of bound `bound`.
+  void sample(uint32_t shard, std::string bound);
+  // Returns the samples (as shard and bound) since the last call, and clears
+  // them.
+  std::vector<std::pair<uint32_t, std::string>> take_samples();
+
+  std::size_t size() const {
+    return this->n_shards;
+  }
+
+ private:
+  // A cache line of counters
+  struct alignas(64) Line {
+    std::atomic<uint64_t> ops[8] = {};
+  };
+
+  std::size_t n_shards;
+  std::size_t lines_per_stripe;
+  std::vector<Line> lines;
+  std::chrono::steady_clock::time_point since;
+
+  struct alignas(64) Samples {
+    std::mutex mtx;
+    std::vector<std::pair<uint32_t, std::string>> samples;
+  };
+  std::array<Samples, N_STRIPES> samples;
+
+  // Returns the calling thread's stripe.
+  static std::size_t stripe();
+};
+
+/*
+ * Returns where to split `shard` (the lower bound of its upper half) so that
+ * its halves weigh about the same, given the weight (e.g. sampled ops, or
+ * bytes) of each bound in it, or an empty string if no split leaves weight on
+ * both sides.
+ */
+std::string find_split(const Shard& shard,
+                       const std::map<std::string, uint64_t>& weights);
+
+#endif /* end of include guard */
@@ -1,5 +1,9 @@
 #include "server.hpp"
 
+#include <fcntl.h>
+
+#include "net/checksum.hpp"
+
 int KvServer::start() {
   this->is_stopped = false;
 
@@ -8,18 +12,54 @@ int KvServer::start() {
   // ConcurrentKvStore!
   this->store = std::make_unique<ConcurrentKvStore>();
 
-  // Create listener socket, and start client listener
-  this->listener_fd = open_listener_socket(address);
-  if (this->listener_fd < 0) {
-    return -1;
+  // Listeners sharing the port through SO_REUSEPORT would just as well share
+  // it with another server already listening there, so first make sure that
+  // the port is free by binding it without
+  int probe_fd = open_listener_socket(address);
+  if (probe_fd < 0) return -1;
+  close(probe_fd);
+
+  // Create a listener socket for each worker. They're non-blocking, since
+  // workers accept from them whenever their I/O engine finds them readable
+  for (size_t i = 0; i < this->n_workers; i++) {
+    int fd = open_listener_socket(address, true);
+    if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+      if (fd >= 0) close(fd);
+      this->close_listeners();
+      return -1;
+    }
+    this->listener_fds.push_back(fd);
   }
-  this->client_listener = std::thread(&KvServer::accept_clients_loop, this);
-  cout_color(BLUE, "Listening on: ", this->address);
 
-  // Initialize worker threads
-  this->workers.resize(this->n_workers);
+  // Initialize worker I/O engines before accepting any clients
+  this->engines.resize(this->n_workers);
+  for (auto&& engine : this->engines) {
+    engine = make_io_engine(this->io_backend);
+    if (!engine) {
+      this->close_listeners();
+      return -1;
+    }
+  }
+  this->coalescers.resize(this->n_workers);
+  for (auto&& coalescer : this->coalescers) {
+    coalescer = std::make_unique<GetCoalescer>();
+  }
   this->conn_queues.resize(this->n_workers);
   this->conn_queue_mtxs.resize(this->n_workers);
+
+  this->logger.start();
+  cout_color(BLUE, "Listening on: ", this->address, " (",
+             io_backend_name(this->engines[0]->backend()), ", ",
+             this->n_workers, " listeners)");
+
+  // Relay threads, for the workers to hand round trips to other servers to
+  this->relays_stopped = false;
+  for (size_t j = 0; j < N_RELAY_THREADS; j++) {
+    this->relay_threads.emplace_back(&KvServer::relay_loop, this);
+  }
+
+  // Initialize worker threads
+  this->workers.resize(this->n_workers);
   size_t i = 0;
   for (auto&& worker : this->workers) {
     worker = std::thread(&KvServer::work_loop, this, i);
@@ -33,14 +73,21 @@ int KvServer::start() {
     this->shardcontroller_conn =
         connect_to_server(this->shardcontroller_address);
     if (!this->shardcontroller_conn) {
-      close(this->listener_fd);
+      this->close_listeners();
       return -1;
     }
 
     this->shardcontroller_querier_conn =
         connect_to_server(this->shardcontroller_address);
     if (!this->shardcontroller_querier_conn) {
-      close(this->listener_fd);
+      this->close_listeners();
+      return -1;
+    }
+
+    this->shardcontroller_watch_conn =
+        connect_to_server(this->shardcontroller_address);
+    if (!this->shardcontroller_watch_conn) {
+      this->close_listeners();
       return -1;
     }
 
@@ -51,6 +98,9 @@ int KvServer::start() {
 
     this->shardcontroller_querier =
         std::thread(&KvServer::process_config_loop, this);
+    if (this->load_report_ms > 0) {
+      this->load_reporter = std::thread(&KvServer::report_load_loop, this);
+    }
     cout_color(BLUE, "Shardcontroller on: ", this->shardcontroller_address);
   }
 
@@ -60,10 +110,19 @@ int KvServer::start() {
 void KvServer::stop() {
   this->is_stopped = true;
 
-  // Close client listener
-  shutdown(this->listener_fd, SHUT_RDWR);
-  cout_color(BLUE, "Joining client listener thread...");
-  this->client_listener.join();
+  // Close the listen_on listeners (the workers' own are closed once the
+  // workers have stopped using them)
+  for (int fd : this->extra_listener_fds) {
+    shutdown(fd, SHUT_RDWR);
+  }
+  cout_color(BLUE, "Joining client listener threads...");
+  for (auto&& thr : this->extra_client_listeners) thr.join();
+  for (int fd : this->extra_listener_fds) {
+    close(fd);
+  }
+  for (auto&& path : this->unix_socket_paths) {
+    unlink(path.c_str());
+  }
 
   // Stop connection queue, and close & join workers
   for (size_t i = 0; i < this->n_workers; i++) {
@@ -74,8 +133,19 @@ void KvServer::stop() {
       client->shutdown();
     }
     this->conn_queue_mtxs[i].unlock();
+    this->engines[i]->wake();
   }
   for (auto&& thr : this->workers) thr.join();
+  this->close_listeners();
+  // The workers waited for their relays, so none are left
+  {
+    std::lock_guard lock(this->relay_mtx);
+    this->relays_stopped = true;
+  }
+  this->relay_cv.notify_all();
+  for (auto&& thr : this->relay_threads) thr.join();
+  this->relay_threads.clear();
+  this->logger.stop();
 
   // If shardcontroller exists, tell shardcontroller the server is leaving,
   // join shardcontroller querier thread, and close shardcontroller connection
@@ -83,14 +153,66 @@ void KvServer::stop() {
     // TODO (Part B, Step 2): Send a leave request to the shardcontroller
     // Take a look at the functions provided in this file to see if any of
     // them will help you!
+    if (this->load_reporter.joinable()) {
+      // Under the lock, so that the reporter doesn't miss the wakeup
+      { std::lock_guard lock(this->report_mtx); }
+      this->report_cv.notify_all();
+      this->load_reporter.join();
+    }
     this->Leave();
 
+    // Unblock the querier thread's Watch, if it's still waiting, or its wait
+    // to reconnect
+    {
+      std::unique_lock lock(this->watch_mtx);
+      if (this->shardcontroller_watch_conn) {
+        this->shardcontroller_watch_conn->shutdown();
+      }
+    }
+    this->watch_cv.notify_all();
     cout_color(BLUE, "Joining query shardcontroller thread...");
     this->shardcontroller_querier.join();
     this->shardcontroller_conn->shutdown();
   }
 }
 
+bool KvServer::listen_on(const std::string& address) {
+  int fd = open_listener_socket(address);
+  if (fd < 0) {
+    return false;
+  }
+  if (auto path = unix_socket_path(address)) {
+    this->unix_socket_paths.push_back(*path);
+  }
+  this->extra_listener_fds.push_back(fd);
+  this->extra_client_listeners.emplace_back(&KvServer::accept_clients_loop,
+                                            this, fd, is_shm_address(address));
+  cout_color(BLUE, "Listening on: ", address);
+  return true;
+}
+
+void KvServer::set_proxy_mode(bool enabled) {
+  this->proxy_mode = enabled;
+}
+
+void KvServer::set_load_report_interval(milliseconds interval) {
+  this->load_report_ms = interval.count();
+  {
+    // Start (or stop) counting load on the current config's shards
+    std::lock_guard lock(this->snapshot_mtx);
+    ConfigSnapshot next = *this->config.load();
+    next.load = interval.count() > 0 ? std::make_shared<LoadTracker>(
+                                           next.routes.get_shards().size())
+                                     : nullptr;
+    this->publish_snapshot(std::move(next));
+  }
+  this->report_cv.notify_all();
+  if (interval.count() > 0 && !this->load_reporter.joinable() &&
+      this->shardcontroller_conn && !this->is_stopped) {
+    this->load_reporter = std::thread(&KvServer::report_load_loop, this);
+  }
+}
+
 bool KvServer::Join() {
   JoinRequest req{this->address};
   if (!this->shardcontroller_conn->send_request(req)) return false;
@@ -139,139 +261,749 @@ std::optional<QueryResponse> KvServer::query_shardcontroller(
 bool KvServer::process_config() {
   // TODO (Part B, Step 2): Implement!
 
-  std::unique_lock lock(this->config_mtx);
-
+  // Queried without any lock: install_config serializes the update itself,
+  // and ignores the config if a newer one was installed meanwhile
   auto res = this->query_shardcontroller(this->shardcontroller_querier_conn);
   if (!res) {
     cerr_color(RED, "Failed to receive query response from shardcontroller.");
     return false;
   }
 
-  // TODO: Update this->config to reflect the result from querying the
-  // shardcontroller
-  if (!res.has_value()){
-    return 0;
-  }
-  this->config = res.value().config;
-
-  // to_transfer maps server --> [<vector of keys to transfer to server>,
-  // <vector of values to transfer to server>]
-  // You're free to use a different data structure if you'd
-  // like, although note you'll have to change our transferring code if you do
-  std::map<std::string, std::array<std::vector<std::string>, 2>> to_transfer;
-
-  // TODO:
-  //  1. Get all of the server's key-value pairs (which KvStore functions
-  //  might help you with this?)
-  //  2. For each pair, check if the server is still responsible for it.
-  //  If the server is no longer responsible for the pair,
-  //  add the pair to_transfer under the key of the newly-responsible (i.e.,
-  //  destination) server and delete the pair from this server's store.
-  for (std::string key : store->AllKeys()){
-    std::optional<std::string> actual_server = this->config.get_server(key);
-    if (!actual_server.has_value()){
-      continue; // key doesn't exist on any server
-    }
-    if (this->address != actual_server.value()){ // check if key/value needs to be transfered
-      // check if the key exists
-      if (to_transfer.find(actual_server.value()) == to_transfer.end()){
-        // create new mapping array
-        to_transfer[actual_server.value()] = { std::vector<std::string>{}, std::vector<std::string>{} };
+  return this->install_config(std::move(res->config), res->version);
+}
+
+// Whether two shards share a key. Their bounds may be of different lengths,
+// and an upper bound covers every key it's a prefix of.
+static bool overlaps(const Shard& a, const Shard& b) {
+  return a.lower <= b.upper + '\xff' && b.lower <= a.upper + '\xff';
+}
+
+static bool overlaps(const std::vector<Shard>& a, const std::vector<Shard>& b) {
+  for (auto&& shard_a : a) {
+    for (auto&& shard_b : b) {
+      if (overlaps(shard_a, shard_b)) return true;
+    }
+  }
+  return false;
+}
+
+bool KvServer::install_config(ShardControllerConfig config, uint64_t version) {
+  // Held for the whole migration, but only other config updates wait on it:
+  // requests keep being served (under the old config, then the new one), and
+  // the snapshot is only locked briefly, to publish it
+  std::unique_lock lock(this->config_mtx);
+  std::unique_lock snapshot_lock(this->snapshot_mtx);
+  std::shared_ptr<const ConfigSnapshot> previous = this->config.load();
+  if (version < previous->shardcontroller_version) {
+    return true;
+  }
+  if (version == previous->shardcontroller_version) {
+    snapshot_lock.unlock();
+    // Retry the handoff of this config, if it was given up on
+    if (previous->handoff && !previous->handoff->done) {
+      return this->migrate(*previous);
+    }
+    return true;
+  }
+
+  ConfigSnapshot next;
+  next.routes = RoutingTable(std::move(config));
+  next.own_route = next.routes.index_of(this->address);
+  next.shardcontroller_version = version;
+  // Count load on the new config's shards, which the reports are about
+  if (this->load_report_ms > 0) {
+    next.load = std::make_shared<LoadTracker>(next.routes.get_shards().size());
+  }
+
+  // Keep forwarding to the servers we're taking keys over from that haven't
+  // cut over yet
+  auto now = steady_clock::now();
+  for (auto&& takeover : previous->takeovers) {
+    if (!takeover->done && now < takeover->deadline) {
+      next.takeovers.push_back(takeover);
+    }
+  }
+
+  // Compare our shards before and after with the other servers' to find
+  // whether we're handing keys off, and which servers we're taking keys over
+  // from
+  const auto& old_shards = previous->routes.get_config().server_to_shards;
+  const auto& new_shards = next.routes.get_config().server_to_shards;
+  auto old_own = old_shards.find(this->address);
+  auto new_own = new_shards.find(this->address);
+  auto previous_routes = std::make_shared<const RoutingTable>(previous->routes);
+  if (old_own != old_shards.end()) {
+    for (auto&& [server, shards] : new_shards) {
+      if (server != this->address && overlaps(old_own->second, shards)) {
+        if (!next.handoff) {
+          next.handoff = std::make_shared<Handoff>();
+          next.handoff->previous = previous_routes;
+          next.handoff->previous_route = previous->own_route;
+        }
+        next.handoff->destinations.push_back(server);
       }
-      // add to to_transfer
-      to_transfer[actual_server.value()][0].push_back(key);
-      GetRequest request = GetRequest{key};
-      GetResponse response = GetResponse{};
-      this->store->Get(&request, &response);
-      std::string value = response.value;
-      to_transfer[actual_server.value()][1].push_back(value);
-      // remove from this store
-      DeleteRequest delReq = DeleteRequest{key};
-      DeleteResponse delRes = DeleteResponse{key};
-      this->store->Delete(&delReq, &delRes);
-    }
-  }
-
-  // NOTE: Comment this in to transfer the keys!
-  // for each server responsible for moved keys:
-  for (auto&& [s, responsible_pairs] : to_transfer) {
-      while (true) {
-          // connect to server
-          std::shared_ptr<ServerConn> conn = connect_to_server(s);
-          if (!conn) {
-              cerr_color(RED, "Failed to connect to server ", s);
-              continue;
-          }
-          // make MultiPut request
-          MultiPutRequest req{responsible_pairs[0], responsible_pairs[1]};
-          if (!conn->send_request(req)) continue;
-
-          // receive response, and check for success
-          std::optional<Response> res = conn->recv_response();
-          if (!res) continue;
-          if (std::get_if<ErrorResponse>(&*res)) continue;
-          break;
+    }
+  }
+  if (new_own != new_shards.end()) {
+    for (auto&& [server, shards] : old_shards) {
+      if (server != this->address && overlaps(shards, new_own->second)) {
+        auto takeover = std::make_shared<Takeover>();
+        takeover->from = server;
+        takeover->previous = previous_routes;
+        takeover->from_route = previous->routes.index_of(server);
+        takeover->version = version;
+        takeover->deadline = now + MIGRATION_TIMEOUT;
+        next.takeovers.push_back(std::move(takeover));
       }
+    }
+  }
+
+  bool handing_off = bool(next.handoff);
+  this->publish_snapshot(std::move(next));
+  std::shared_ptr<const ConfigSnapshot> current = this->config.load();
+  snapshot_lock.unlock();
+  return !handing_off || this->migrate(*current);
+}
+
+bool KvServer::migrate(const ConfigSnapshot& snapshot) {
+  Handoff& handoff = *snapshot.handoff;
+  auto handed_off = [&](const std::string& key) {
+    uint16_t route = snapshot.routes.route(key);
+    return route != RoutingTable::NO_SERVER && route != snapshot.own_route &&
+           handoff.previous->route(key) == handoff.previous_route;
+  };
+  auto take_dirty = [&] {
+    std::unique_lock lock(handoff.dirty_mtx);
+    std::vector<std::string> dirty(handoff.dirty.begin(), handoff.dirty.end());
+    handoff.dirty.clear();
+    return dirty;
+  };
+  // Keys whose transfer failed are dirty again, so the next round resends
+  // them; returns whether every key was acknowledged
+  auto transfer = [&](const std::vector<std::string>& keys, int attempts) {
+    std::vector<std::string> failed =
+        this->transfer(snapshot, keys, false, attempts);
+    std::unique_lock lock(handoff.dirty_mtx);
+    handoff.dirty.insert(failed.begin(), failed.end());
+    return failed.empty();
+  };
+  // Waits to retry a failed round, twice as long each time; returns false
+  // once the destinations have stopped waiting for us
+  auto deadline = steady_clock::now() + MIGRATION_TIMEOUT;
+  milliseconds retry_delay = TRANSFER_RETRY_DELAY;
+  auto back_off = [&] {
+    if (this->is_stopped || steady_clock::now() + retry_delay >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(retry_delay);
+    retry_delay = std::min(retry_delay * 2, MAX_HANDOFF_RETRY_DELAY);
+    return true;
+  };
+  auto give_up = [&] {
+    cerr_color(RED, "Failed to hand off keys to ",
+               handoff.destinations.size(), " server(s); still serving them.");
+    return false;
+  };
+
+  // Copy every key we're handing off, while still serving them
+  std::vector<std::string> keys;
+  for (auto&& key : this->store->AllKeys()) {
+    if (handed_off(key)) keys.push_back(key);
+  }
+  bool sent = transfer(keys, MAX_TRANSFER_ATTEMPTS);
+
+  // Catch up with the writes made during the copy, until few enough are left
+  // to send during the cutover
+  for (int round = 0; !sent || round < MAX_CATCHUP_ROUNDS;) {
+    if (sent) {
+      std::unique_lock lock(handoff.dirty_mtx);
+      if (handoff.dirty.size() <= CUTOVER_DIRTY_KEYS) break;
+      round++;
+    } else if (!back_off()) {
+      return give_up();
+    }
+    sent = transfer(take_dirty(), MAX_TRANSFER_ATTEMPTS);
+  }
+
+  // Cut over: requests for the keys are shed while the last writes are sent,
+  // in a single attempt, then find the handoff done. Until every destination
+  // has acknowledged them, the keys are still ours, so we serve them again
+  // while backing off before the next attempt
+  while (true) {
+    {
+      std::unique_lock lock(handoff.mtx);
+      if (transfer(take_dirty(), 1)) {
+        handoff.done = true;
+        break;
+      }
+    }
+    if (!back_off()) return give_up();
+  }
+  // Only now tell the destinations that they have all of our keys, so that
+  // none stops forwarding to us while another may still be missing some. One
+  // that doesn't hear it finds out from the next request it forwards, which
+  // we answer as not responsible
+  this->transfer(snapshot, {}, true, 1);
+  {
+    // The current snapshot may have changed since (e.g. its takeovers, or
+    // its load tracker), but not its config, which only we update
+    std::lock_guard lock(this->snapshot_mtx);
+    ConfigSnapshot next = *this->config.load();
+    next.handoff = nullptr;
+    this->publish_snapshot(std::move(next));
   }
 
+  // Nothing reads the keys handed off anymore, so they can go
+  for (auto&& key : this->store->AllKeys()) {
+    if (handed_off(key)) {
+      DeleteRequest del_req{key};
+      DeleteResponse del_res;
+      this->store->Delete(&del_req, &del_res);
+    }
+  }
+  this->n_migrations++;
   return true;
 }
 
+std::vector<std::string> KvServer::transfer(
+    const ConfigSnapshot& snapshot, const std::vector<std::string>& keys,
+    bool last, int attempts) {
+  Handoff& handoff = *snapshot.handoff;
+  std::map<std::string, std::vector<std::string>> by_server;
+  for (auto&& server : handoff.destinations) {
+    // Every destination hears that the handoff is over, keys or not, and
+    // every one with chunks left unacknowledged is sent them again
+    if (last || !handoff.streams[server].unacked.empty()) {
+      by_server[server];
+    }
+  }
+  for (auto&& key : keys) {
+    if (const std::string* server = snapshot.routes.get_server(key)) {
+      by_server[*server].push_back(key);
+    }
+  }
+
+  // Stream to every destination at once. Each stream numbers its chunks with
+  // its own counter, so the map is only written to before they start
+  std::vector<std::vector<std::string>> failed(by_server.size());
+  std::vector<std::thread> streams;
+  size_t i = 0;
+  for (auto it = by_server.begin(); it != by_server.end(); it++, i++) {
+    TransferStream* stream = &handoff.streams[it->first];
+    streams.emplace_back([&, it, i, stream] {
+      failed[i] = this->stream_transfer(it->first, it->second,
+                                        snapshot.shardcontroller_version, last,
+                                        attempts, stream);
+    });
+  }
+  std::vector<std::string> all_failed;
+  for (i = 0; i < streams.size(); i++) {
+    streams[i].join();
+    all_failed.insert(all_failed.end(), failed[i].begin(), failed[i].end());
+  }
+  return all_failed;
+}
+
+// Checksum of a transfer chunk's contents and sequence number.
+static uint64_t transfer_checksum(const TransferRequest& req) {
+  uint64_t sum = checksum(&req.seq, sizeof(req.seq));
+  for (auto&& key : req.keys) sum = checksum(key, sum);
+  for (auto&& value : req.values) sum = checksum(value, sum);
+  for (auto&& key : req.deleted) sum = checksum(key, sum);
+  return sum;
+}
+
+std::vector<std::string> KvServer::stream_transfer(
+    const std::string& server, const std::vector<std::string>& keys,
+    uint64_t version, bool last, int attempts, TransferStream* stream) {
+  // Chunks sent but not acknowledged yet, oldest first, each with the end of
+  // its keys in `keys`. The ones the last transfer left unacknowledged come
+  // first, in order, since the destination won't apply the chunks after them
+  // without them; they don't end the stream (a new last chunk will)
+  std::deque<std::pair<Request, size_t>> in_flight;
+  for (auto&& chunk : stream->unacked) {
+    std::get<TransferRequest>(chunk).last = false;
+    in_flight.emplace_back(std::move(chunk), 0);
+  }
+  stream->unacked.clear();
+  // The keys up to `chunked` are in chunks, and up to `acked` acknowledged
+  size_t chunked = 0;
+  size_t acked = 0;
+  bool sent_last = false;
+
+  // Reads the values of the next keys into a chunk of about
+  // TRANSFER_CHUNK_BYTES
+  auto next_chunk = [&] {
+    Request chunk = TransferRequest{};
+    auto& req = std::get<TransferRequest>(chunk);
+    size_t bytes = 0;
+    while (chunked < keys.size() && bytes < TRANSFER_CHUNK_BYTES) {
+      const std::string& key = keys[chunked++];
+      GetRequest get_req{key};
+      GetResponse get_res;
+      bytes += key.size();
+      if (this->store->Get(&get_req, &get_res)) {
+        bytes += get_res.value.size();
+        req.keys.push_back(key);
+        req.values.push_back(std::move(get_res.value));
+      } else {
+        req.deleted.push_back(key);
+      }
+    }
+    req.source = this->address;
+    req.version = version;
+    req.seq = stream->next_seq++;
+    req.last = last && chunked == keys.size();
+    req.checksum = transfer_checksum(req);
+    sent_last = req.last;
+    in_flight.emplace_back(std::move(chunk), chunked);
+  };
+
+  std::shared_ptr<ServerConn> conn;
+  Response res;
+  int failures = 0;
+  while (true) {
+    // Keep up to TRANSFER_WINDOW chunks in flight, so the destination always
+    // has the next one queued while it applies the last
+    while (in_flight.size() < TRANSFER_WINDOW &&
+           (chunked < keys.size() || (last && !sent_last))) {
+      next_chunk();
+      if (conn && !conn->send_request(in_flight.back().first)) {
+        this->peers.discard(conn);
+        conn = nullptr;
+      }
+    }
+    if (in_flight.empty()) break;
+
+    if (!conn) {
+      // Resume from the oldest chunk not acknowledged yet; the destination
+      // skips any it has applied already
+      if (failures >= attempts) break;
+      if (failures > 0) std::this_thread::sleep_for(TRANSFER_RETRY_DELAY);
+      conn = this->peers.acquire(server);
+      for (auto&& [chunk, _] : in_flight) {
+        if (!conn) break;
+        if (!conn->send_request(chunk)) {
+          this->peers.discard(conn);
+          conn = nullptr;
+        }
+      }
+      if (!conn) {
+        failures++;
+        continue;
+      }
+    }
+
+    // Otherwise, the destination hasn't installed the config yet, or a chunk
+    // was corrupted, so the chunks after it were refused too
+    if (!conn->recv_response(&res) ||
+        !std::holds_alternative<TransferResponse>(res)) {
+      this->peers.discard(conn);
+      conn = nullptr;
+      failures++;
+      continue;
+    }
+    failures = 0;
+    acked = in_flight.front().second;
+    in_flight.pop_front();
+  }
+
+  if (conn) this->peers.release(conn);
+  if (in_flight.empty()) return {};
+  // Their sequence numbers are taken, so the next transfer resends them as
+  // they are, rather than reusing the numbers for other keys
+  for (auto&& [chunk, _] : in_flight) {
+    stream->unacked.push_back(std::move(chunk));
+  }
+  cerr_color(RED, "Failed to transfer keys to server ", server);
+  return std::vector<std::string>(keys.begin() + acked, keys.end());
+}
+
+void KvServer::receive_transfer(const Request& req, Response* res) {
+  const auto& transfer_req = std::get<TransferRequest>(req);
+  if (transfer_checksum(transfer_req) != transfer_req.checksum) {
+    *res = ErrorResponse{"transfer chunk failed its checksum"};
+    return;
+  }
+
+  std::shared_ptr<TransferProgress> progress;
+  {
+    std::unique_lock lock(this->transfers_mtx);
+    auto& entry = this->transfers[transfer_req.source];
+    if (!entry) entry = std::make_shared<TransferProgress>();
+    progress = entry;
+  }
+  std::unique_lock lock(progress->mtx);
+  if (transfer_req.version > progress->version) {
+    // The source's next migration
+    progress->version = transfer_req.version;
+    progress->next_seq = 0;
+  }
+  if (transfer_req.version < progress->version ||
+      transfer_req.seq < progress->next_seq) {
+    // Resent after its acknowledgement was lost, so it's applied already
+    *res = TransferResponse{};
+    return;
+  }
+  if (transfer_req.seq > progress->next_seq) {
+    *res = ErrorResponse{"transfer chunk out of order"};
+    return;
+  }
+
+  this->execute_request(req, res, this->responsible_for(req));
+  if (!std::holds_alternative<TransferResponse>(*res)) return;
+  progress->next_seq++;
+  if (transfer_req.last) {
+    this->finish_takeovers(transfer_req.source, transfer_req.version);
+  }
+}
+
+void KvServer::finish_takeovers(const std::string& source, uint64_t version) {
+  std::shared_ptr<const ConfigSnapshot> snapshot = this->config.load();
+  for (auto&& takeover : snapshot->takeovers) {
+    if (takeover->from == source && takeover->version <= version) {
+      takeover->done = true;
+    }
+  }
+  this->retire_takeovers();
+}
+
 /* ==================================================*/
 /* === INTERNALS: DO NOT MODIFY BELOW THIS LINE ===  */
 /* ==================================================*/
 
-void KvServer::accept_clients_loop() {
-  size_t next_worker = 0;
+void KvServer::accept_clients_loop(int listener_fd, bool shm) {
   // While the server is not stopped, accept clients from the listener socket,
   // then add them to the work queue.
   while (!this->is_stopped.load()) {
-    std::shared_ptr<ClientConn> client = accept_client(this->listener_fd);
+    std::shared_ptr<ClientConn> client = accept_client(listener_fd);
     if (!client) {
       return;
     }
-    cout_color(BLUE, "Received client connection from ", client->address,
-               " on socket ", client->fd);
-    this->conn_queue_mtxs[next_worker].lock();
-    this->conn_queues[next_worker].push_back(client);
-    this->conn_queue_mtxs[next_worker].unlock();
-    next_worker = (next_worker + 1) % this->n_workers;
+    if (shm && !accept_shm_channel(client.get())) {
+      continue;
+    }
+    this->logger.log(BLUE, "Received client connection from ", client->address,
+                     " on socket ", client->fd);
+    size_t worker = this->next_worker++ % this->n_workers;
+    this->conn_queue_mtxs[worker].lock();
+    bool queued = this->conn_queues[worker].size() < MAX_QUEUED_CONNECTIONS;
+    if (queued) {
+      this->conn_queues[worker].push_back(client);
+    }
+    this->conn_queue_mtxs[worker].unlock();
+    if (!queued) {
+      // The worker is falling behind on connections already; turn this one
+      // away rather than let the queue grow without bound
+      this->logger.log(RED, "Worker ", worker, " overloaded, closing ",
+                       client->address);
+      client->close();
+      continue;
+    }
+    this->engines[worker]->wake();
   }
 }
 
+void KvServer::close_listeners() {
+  for (int fd : this->listener_fds) {
+    close(fd);
+  }
+  this->listener_fds.clear();
+}
+
 void KvServer::work_loop(size_t worker_id) {
   // Each worker thread will run this function. While the server is not
-  // stopped, pop an accepted connection off of the work queue, and process
-  // client requests until the client closes the connection.
-  while (!this->is_stopped) {
-    std::shared_ptr<ClientConn> client;
-    // if this returns false, queue stopped
-    this->conn_queue_mtxs[worker_id].lock();
-    if (!this->conn_queues[worker_id].empty()) {
-      client = this->conn_queues[worker_id].front();
-      this->conn_queues[worker_id].pop_front();
-      this->conn_queue_mtxs[worker_id].unlock();
+  // stopped, register newly accepted connections with the worker's I/O engine,
+  // then start handling one request from each connection that has one ready.
+  // Many clients can thus share a worker, without any one of them holding it
+  // for as long as it stays connected, or for as long as a large request takes.
+  IoEngine& engine = *this->engines[worker_id];
+  GetCoalescer& gets = *this->coalescers[worker_id];
+  // Tasks relayed on a relay thread wake the worker once they're done
+  Scheduler scheduler([&engine] { engine.wake(); });
+  std::unordered_map<int, std::shared_ptr<Client>> clients;
+  std::vector<int> ready;
+  uint64_t socket_syscalls = thread_socket_syscalls();
+
+  auto add_client = [&](std::shared_ptr<ClientConn> conn) {
+    if (clients.size() >= MAX_WORKER_CONNECTIONS) {
+      this->logger.log(RED, "Worker ", worker_id, " at connection limit, ",
+                       "closing ", conn->address);
+      conn->close();
+    } else if (conn->set_nonblocking() && engine.add(conn->fd)) {
+      auto client = std::make_shared<Client>();
+      client->conn = conn;
+      client->engine = &engine;
+      clients[conn->fd] = std::move(client);
     } else {
-      this->conn_queue_mtxs[worker_id].unlock();
-      continue;
+      conn->close();
     }
+  };
 
-    while (true) {
-      std::optional<Request> req = client->recv_request();
-      if (!req) {
-        client->close();
-        break;
+  // The worker accepts connections on its own listener
+  int listener_fd = this->listener_fds[worker_id];
+  if (!engine.add(listener_fd)) {
+    cerr_color(RED, "Worker ", worker_id, " failed to watch its listener.");
+  }
+
+  while (!this->is_stopped) {
+    {
+      // Connections accepted on the listen_on addresses
+      std::unique_lock lock(this->conn_queue_mtxs[worker_id]);
+      for (auto&& conn : this->conn_queues[worker_id]) {
+        add_client(conn);
+      }
+      this->conn_queues[worker_id].clear();
+    }
+
+    ready.clear();
+    // Don't block while there are suspended tasks ready to resume
+    if (!engine.wait(&ready, scheduler.empty() ? 100ms : 0ms)) {
+      break;
+    }
+    // Requests served inline delay the ones after them in the round, so past
+    // the delay budget, the rest are shed
+    auto round_start = steady_clock::now();
+    gets.next_round();
+
+    for (int fd : ready) {
+      if (fd == listener_fd) {
+        // Accept every connection pending on the (non-blocking) listener
+        while (std::shared_ptr<ClientConn> conn = accept_client(listener_fd)) {
+          this->logger.log(BLUE, "Received client connection from ",
+                           conn->address, " on socket ", conn->fd);
+          add_client(std::move(conn));
+        }
+        continue;
       }
-      Response res = this->process_request(*req);
-      if (auto* error_res = std::get_if<ErrorResponse>(&res)) {
-        cerr_color(RED, "Request on server ", this->address,
-                   " failed: ", error_res->msg);
+
+      auto it = clients.find(fd);
+      if (it == clients.end()) continue;
+      std::shared_ptr<Client>& client = it->second;
+      bool ok = !client->failed;
+      if (ok && client->conn->has_pending_output()) {
+        // The client is slow to take its last response; send what it will
+        // take of the rest, and only then read its next request
+        ok = client->conn->flush();
+      } else if (ok && !client->busy) {
+        bool shed = scheduler.size() >= MAX_WORKER_TASKS ||
+                    steady_clock::now() - round_start > ADMISSION_DELAY_BUDGET;
+        ok = this->serve_request(client, scheduler, gets, shed);
       }
-      if (!client->send_response(res)) {
-        client->close();
-        break;
+      if (!ok) {
+        engine.remove(fd);
+        client->conn->close();
+        clients.erase(it);
+        continue;
       }
+      // A request still being handled holds back the client's next ones, so
+      // there's no point hearing about them until it's done
+      this->watch_client(*client);
     }
+
+    scheduler.run();
+    uint64_t n = thread_socket_syscalls();
+    this->n_socket_syscalls += n - socket_syscalls;
+    socket_syscalls = n;
+  }
+
+  // Let the tasks still suspended (or being relayed) finish before closing
+  // their connections
+  while (!scheduler.idle()) {
+    if (scheduler.empty()) std::this_thread::sleep_for(1ms);
+    scheduler.run();
+  }
+  for (auto&& [fd, client] : clients) {
+    // Whatever the socket takes of the responses still being sent
+    if (!client->failed) client->conn->flush();
+    engine.remove(fd);
+    client->conn->close();
+  }
+  engine.remove(listener_fd);
+}
+
+bool KvServer::serve_request(std::shared_ptr<Client> client,
+                             Scheduler& scheduler, GetCoalescer& gets,
+                             bool shed) {
+  bool received, more;
+  if (!client->conn->try_recv_request(&client->req, &client->flags,
+                                      &received, &more)) {
+    return false;
+  }
+  if (!received) {
+    // The rest of it hasn't arrived yet
+    return true;
+  }
+  // A part of a streamed request that's been admitted already isn't shed
+  bool continued = client->more;
+  client->in_stream = continued || more;
+  client->more = more;
+  if (client->stream_res) {
+    // A part of a streamed request that's failed already, which is only
+    // received
+    return this->respond(*client, false);
+  }
+  if (shed && !continued) {
+    // Cheap to send, and the client retries later, so the request needn't be
+    // kept around
+    this->n_shed++;
+    client->res = OverloadedResponse{OVERLOAD_RETRY_AFTER_MS};
+    return this->respond(*client, false);
+  }
+  this->record_load(client->req);
+  if (std::holds_alternative<GetRequest>(client->req)) {
+    // Gets never yield, so there's no need for a task
+    return this->serve_get(client, gets, scheduler);
+  }
+  this->handle_request(std::move(client), scheduler);
+  return true;
+}
+
+bool KvServer::serve_get(std::shared_ptr<Client>& client_ptr,
+                         GetCoalescer& gets, Scheduler& scheduler) {
+  Client& client = *client_ptr;
+  const std::string& key = std::get<GetRequest>(client.req).key;
+  bool forwarded = client.flags & MESSAGE_FORWARDED;
+  // A forwarded Get isn't relayed on, so its response mustn't stand in for
+  // a client's, nor the other way around
+  Message* msg = forwarded ? nullptr : gets.find(key);
+  if (!msg) {
+    std::optional<Relay> relay;
+    bool rerouted =
+        this->process_request(client.req, &client.res, forwarded, &relay);
+    if (relay) {
+      // It's for another server to answer, so it can't be served inline
+      // (nor its response coalesced)
+      this->handle_request(std::move(client_ptr), scheduler);
+      return true;
+    }
+    if (auto* error_res = std::get_if<ErrorResponse>(&client.res)) {
+      cerr_color(RED, "Request on server ", this->address,
+                 " failed: ", error_res->msg);
+    }
+    if (forwarded) return client.conn->send_response(client.res);
+    msg = gets.insert(key);
+    if (!serialize_response(client.res, msg)) {
+      perror_color(RED, "Error serializing response.");
+      gets.erase(key);
+      return false;
+    }
+    if (rerouted) msg->flags |= MESSAGE_REROUTED;
+  }
+  return client.conn->send_serialized(msg);
+}
+
+// Number of keys above which a MultiGet/MultiPut (or operations above which a
+// Batch) yields to other clients' requests before being processed.
+#define LARGE_REQUEST_KEYS 64
+
+static bool is_large_request(const Request& req) {
+  if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
+    return multiget_req->keys.size() > LARGE_REQUEST_KEYS;
+  } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
+    return multiput_req->keys.size() > LARGE_REQUEST_KEYS;
+  } else if (auto* batch_req = std::get_if<BatchRequest>(&req)) {
+    return batch_req->ops.size() > LARGE_REQUEST_KEYS;
+  } else if (auto* transfer_req = std::get_if<TransferRequest>(&req)) {
+    return transfer_req->keys.size() > LARGE_REQUEST_KEYS;
+  }
+  return false;
+}
+
+// Calls `f` on each key a KvServer request reads or writes.
+template <typename F>
+static void for_each_key(const Request& req, F&& f) {
+  if (auto* get_req = std::get_if<GetRequest>(&req)) {
+    f(get_req->key);
+  } else if (auto* put_req = std::get_if<PutRequest>(&req)) {
+    f(put_req->key);
+  } else if (auto* append_req = std::get_if<AppendRequest>(&req)) {
+    f(append_req->key);
+  } else if (auto* delete_req = std::get_if<DeleteRequest>(&req)) {
+    f(delete_req->key);
+  } else if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
+    for (auto&& key : multiget_req->keys) f(key);
+  } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
+    for (auto&& key : multiput_req->keys) f(key);
+  } else if (auto* batch_req = std::get_if<BatchRequest>(&req)) {
+    for (auto&& op : batch_req->ops) f(op.key);
+  } else if (auto* transfer_req = std::get_if<TransferRequest>(&req)) {
+    for (auto&& key : transfer_req->keys) f(key);
+    for (auto&& key : transfer_req->deleted) f(key);
+  }
+}
+
+void KvServer::record_load(const Request& req) {
+  // Transfers are a migration's, not clients' load
+  if (std::holds_alternative<TransferRequest>(req)) return;
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  if (!snapshot.load) return;
+  for_each_key(req, [&](const std::string& key) {
+    uint32_t shard = snapshot.routes.shard_of(key);
+    if (shard == RoutingTable::NO_SHARD) return;
+    snapshot.load->record(shard);
+    if (LoadTracker::should_sample()) {
+      snapshot.load->sample(shard, snapshot.routes.bound_of(key));
+    }
+  });
+}
+
+Task KvServer::handle_request(std::shared_ptr<Client> client,
+                              Scheduler& scheduler) {
+  client->busy = true;
+  if (is_large_request(client->req)) {
+    co_await scheduler.yield();
+  }
+
+  std::optional<Relay> relay;
+  bool rerouted = this->process_request(
+      client->req, &client->res, client->flags & MESSAGE_FORWARDED, &relay);
+  if (relay) {
+    // Wait for the other server on a relay thread, rather than hold up the
+    // worker's other clients
+    co_await scheduler.send_away([&](std::coroutine_handle<> task) {
+      this->start_relay(*relay, *client, &rerouted, scheduler, task);
+    });
+  }
+  if (auto* error_res = std::get_if<ErrorResponse>(&client->res)) {
+    cerr_color(RED, "Request on server ", this->address,
+               " failed: ", error_res->msg);
+  }
+  if (!this->respond(*client, rerouted)) {
+    client->failed = true;
+  }
+  client->busy = false;
+  this->watch_client(*client);
+}
+
+bool KvServer::respond(Client& client, bool rerouted) {
+  if (client.in_stream) {
+    // The first failure stands for the whole request, whose other parts are
+    // then only received
+    if (!client.stream_res &&
+        !std::holds_alternative<MultiPutResponse>(client.res)) {
+      client.stream_res = std::move(client.res);
+    }
+    client.stream_rerouted |= rerouted;
+    if (client.more) return client.conn->send_credit();
+
+    if (client.stream_res) {
+      client.res = std::move(*client.stream_res);
+      client.stream_res.reset();
+    }
+    rerouted = std::exchange(client.stream_rerouted, false);
+  }
+  return client.conn->send_response(client.res,
+                                    rerouted ? MESSAGE_REROUTED : 0);
+}
+
+void KvServer::watch_client(Client& client) {
+  int events = client.conn->has_pending_output() ? IO_WRITABLE
+               : client.busy                     ? 0
+                                                 : IO_READABLE;
+  if (events != client.events &&
+      client.engine->watch(client.conn->fd, events)) {
+    client.events = events;
   }
 }
 
@@ -279,114 +1011,593 @@ bool KvServer::responsible_for(const std::string& key) {
   // For Concurrent Store, no shardcontroller exists, so no-op
   if (this->shardcontroller_address.empty()) return true;
 
-  std::shared_lock lock(this->config_mtx);
-  auto server = this->config.get_server(key);
-  if (!server) return false;
-  return *server == this->address;
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  return snapshot.own_route != RoutingTable::NO_SERVER &&
+         snapshot.routes.route(key) == snapshot.own_route;
 }
 
 bool KvServer::responsible_for(const std::vector<std::string>& keys) {
   // For Concurrent Store, no shardcontroller exists, so no-op
   if (this->shardcontroller_address.empty()) return true;
 
-  std::shared_lock lock(this->config_mtx);
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  if (snapshot.own_route == RoutingTable::NO_SERVER) return false;
   for (auto&& k : keys) {
-    auto server = this->config.get_server(k);
-    if (!server) return false;
-    if (*server != this->address) return false;
+    if (snapshot.routes.route(k) != snapshot.own_route) return false;
   }
   return true;
 }
 
-Response KvServer::process_request(Request req) {
+bool KvServer::responsible_for(const Request& req) {
+  // For Concurrent Store, no shardcontroller exists, so no-op
+  if (this->shardcontroller_address.empty()) return true;
+
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  if (snapshot.own_route == RoutingTable::NO_SERVER) return false;
+  bool responsible = true;
+  for_each_key(req, [&](const std::string& key) {
+    responsible =
+        responsible && snapshot.routes.route(key) == snapshot.own_route;
+  });
+  return responsible;
+}
+
+// Versions of the config snapshots published by every server in the process
+static std::atomic<uint64_t> next_config_version = 1;
+
+void KvServer::publish_config(ShardControllerConfig config,
+                              uint64_t version) {
+  ConfigSnapshot snapshot;
+  snapshot.routes = RoutingTable(std::move(config));
+  snapshot.own_route = snapshot.routes.index_of(this->address);
+  snapshot.shardcontroller_version = version;
+  if (this->load_report_ms > 0) {
+    snapshot.load =
+        std::make_shared<LoadTracker>(snapshot.routes.get_shards().size());
+  }
+  this->publish_snapshot(std::move(snapshot));
+}
+
+void KvServer::publish_snapshot(ConfigSnapshot snapshot) {
+  snapshot.version = next_config_version++;
+  uint64_t snapshot_version = snapshot.version;
+  this->config.store(
+      std::make_shared<const ConfigSnapshot>(std::move(snapshot)));
+  this->config_version.store(snapshot_version);
+}
+
+void KvServer::retire_takeovers() {
+  std::unique_lock lock(this->snapshot_mtx, std::try_to_lock);
+  if (!lock.owns_lock()) return;
+  std::shared_ptr<const ConfigSnapshot> current = this->config.load();
+  ConfigSnapshot next = *current;
+  std::erase_if(next.takeovers, [](auto&& takeover) {
+    return takeover->done.load();
+  });
+  if (next.takeovers.size() != current->takeovers.size()) {
+    this->publish_snapshot(std::move(next));
+  }
+}
+
+const KvServer::ConfigSnapshot& KvServer::config_snapshot() {
+  // Versions are unique across servers, so a thread serving several servers
+  // (e.g. in tests) can't mistake one's snapshot for another's
+  thread_local std::shared_ptr<const ConfigSnapshot> cached;
+  uint64_t version = this->config_version.load();
+  if (!cached || cached->version != version) {
+    cached = this->config.load();
+  }
+  return *cached;
+}
+
+Response KvServer::process_request(const Request& req) {
   Response res;
-  if (auto* get_req = std::get_if<GetRequest>(&req)) {
-    bool responsible = this->responsible_for(get_req->key);
-    GetResponse get_res;
-    if (responsible && this->store->Get(get_req, &get_res)) {
-      res = get_res;
+  this->process_request(req, &res);
+  return res;
+}
+
+bool KvServer::process_request(const Request& req, Response* res,
+                               bool forwarded, std::optional<Relay>* relay) {
+  if (std::holds_alternative<TransferRequest>(req)) {
+    // Transfers are part of a migration already, so they're never forwarded
+    this->receive_transfer(req, res);
+    return false;
+  }
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  std::optional<Relay> pending;
+  if (snapshot.migrating()) {
+    this->process_migrating_request(snapshot, req, res, &pending);
+  } else {
+    this->execute_request(req, res, this->responsible_for(req));
+  }
+  // Relaying a request only once keeps servers with different configs from
+  // bouncing it between them
+  if (!pending && !forwarded && this->proxy_mode && is_not_responsible(*res)) {
+    if (const std::string* owner = this->proxy_owner(req)) {
+      pending = Relay{*owner, nullptr};
+    }
+  }
+  if (!pending) return false;
+  if (relay) {
+    *relay = std::move(pending);
+    return false;
+  }
+  return this->finish_relay(*pending, req, res);
+}
+
+const std::string* KvServer::proxy_owner(const Request& req) {
+  const ConfigSnapshot& snapshot = this->config_snapshot();
+  const std::string* owner = nullptr;
+  bool one_owner = true;
+  for_each_key(req, [&](const std::string& key) {
+    const std::string* server = snapshot.routes.get_server(key);
+    if (!server || *server == this->address || (owner && *owner != *server)) {
+      one_owner = false;
+    }
+    owner = server;
+  });
+  return one_owner ? owner : nullptr;
+}
+
+void KvServer::start_relay(const Relay& relay, Client& client,
+                           bool* rerouted, Scheduler& scheduler,
+                           std::coroutine_handle<> task) {
+  {
+    std::lock_guard lock(this->relay_mtx);
+    this->relay_queue.push_back(
+        [this, &relay, &client, rerouted, &scheduler, task] {
+          *rerouted = this->finish_relay(relay, client.req, &client.res);
+          scheduler.post(task);
+        });
+  }
+  this->relay_cv.notify_one();
+}
+
+void KvServer::relay_loop() {
+  std::unique_lock lock(this->relay_mtx);
+  while (true) {
+    this->relay_cv.wait(lock, [this] {
+      return this->relays_stopped || !this->relay_queue.empty();
+    });
+    if (this->relay_queue.empty()) return;
+    std::function<void()> relay = std::move(this->relay_queue.front());
+    this->relay_queue.pop_front();
+    lock.unlock();
+    relay();
+    lock.lock();
+  }
+}
+
+bool KvServer::finish_relay(const Relay& relay, const Request& req,
+                            Response* res) {
+  if (relay.takeover) {
+    this->forward_request(*relay.takeover, req, res);
+    return false;
+  }
+  return this->proxy_request(relay.server, req, res);
+}
+
+bool KvServer::proxy_request(const std::string& owner, const Request& req,
+                             Response* res) {
+  std::shared_ptr<ServerConn> conn = this->peers.acquire(owner);
+  if (!conn) return false;
+  if (!conn->send_request(req, MESSAGE_FORWARDED)) {
+    this->peers.discard(conn);
+    return false;
+  }
+  Response relayed;
+  if (!conn->recv_response(&relayed)) {
+    // The owner may have applied the request already, so the client mustn't
+    // retry it elsewhere as if it had been refused
+    this->peers.discard(conn);
+    *res = ErrorResponse{"failed to receive the response to a request relayed "
+                         "to " +
+                         owner};
+    return false;
+  }
+  this->peers.release(conn);
+  // The owner hasn't installed the config yet, so the client should retry
+  if (is_not_responsible(relayed)) return false;
+  *res = std::move(relayed);
+  this->n_proxied++;
+  return true;
+}
+
+void KvServer::process_migrating_request(const ConfigSnapshot& snapshot,
+                                         const Request& req, Response* res,
+                                         std::optional<Relay>* relay) {
+  auto handed_off = [&](const std::string& key, uint16_t route) {
+    return snapshot.handoff && route != RoutingTable::NO_SERVER &&
+           snapshot.handoff->previous->route(key) ==
+               snapshot.handoff->previous_route;
+  };
+  // The takeover whose source still serves `key`, if any
+  bool expired = false;
+  auto pending_takeover =
+      [&](const std::string& key) -> const std::shared_ptr<Takeover>* {
+    for (auto&& takeover : snapshot.takeovers) {
+      if (takeover->done ||
+          takeover->previous->route(key) != takeover->from_route) {
+        continue;
+      }
+      if (steady_clock::now() < takeover->deadline) return &takeover;
+      takeover->done = true;
+      expired = true;
+    }
+    return nullptr;
+  };
+
+  // Every key must be ours: owned (possibly still being taken over from
+  // another server) or being handed off
+  bool ours = true;
+  bool has_handoff_keys = false;
+  // Whether every key is being taken over, from the same server
+  bool forward = true;
+  const std::shared_ptr<Takeover>* takeover = nullptr;
+  for_each_key(req, [&](const std::string& key) {
+    uint16_t route = snapshot.routes.route(key);
+    if (route != RoutingTable::NO_SERVER && route == snapshot.own_route) {
+      const std::shared_ptr<Takeover>* pending = pending_takeover(key);
+      if (!pending || (takeover && takeover != pending)) forward = false;
+      if (pending) takeover = pending;
+    } else if (handed_off(key, route)) {
+      has_handoff_keys = true;
+      forward = false;
     } else {
-      res = ErrorResponse{
-          !responsible ? std::string("server not responsible for key")
+      ours = false;
+    }
+  });
+  if (expired) this->retire_takeovers();
+
+  if (!ours) {
+    this->execute_request(req, res, false);
+    return;
+  }
+  if (takeover) {
+    if (forward) {
+      *relay = Relay{(*takeover)->from, *takeover};
+    } else {
+      // Some keys are here and some aren't yet, so the request can't be
+      // served anywhere until the migration finishes
+      this->n_shed++;
+      *res = OverloadedResponse{OVERLOAD_RETRY_AFTER_MS};
+    }
+    return;
+  }
+  if (!has_handoff_keys) {
+    this->execute_request(req, res,
+                          snapshot.own_route != RoutingTable::NO_SERVER);
+    return;
+  }
+
+  // Never block on a cutover in progress: the request may have been
+  // forwarded by the destination, whose worker would then be stuck waiting
+  // for us while the cutover waits for it
+  Handoff& handoff = *snapshot.handoff;
+  std::shared_lock lock(handoff.mtx, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    this->n_shed++;
+    *res = OverloadedResponse{OVERLOAD_RETRY_AFTER_MS};
+    return;
+  }
+  if (handoff.done) {
+    this->execute_request(req, res, false);
+    return;
+  }
+  this->execute_request(req, res, true);
+  if (!std::holds_alternative<GetRequest>(req) &&
+      !std::holds_alternative<MultiGetRequest>(req)) {
+    std::unique_lock dirty_lock(handoff.dirty_mtx);
+    for_each_key(req, [&](const std::string& key) {
+      if (handed_off(key, snapshot.routes.route(key))) {
+        handoff.dirty.insert(key);
+      }
+    });
+  }
+}
+
+void KvServer::forward_request(Takeover& takeover, const Request& req,
+                               Response* res) {
+  // A source we can't reach may still be serving the keys, and may not have
+  // sent them all yet, so the client retries, by when it may have recovered
+  // (or the takeover's deadline passed)
+  std::shared_ptr<ServerConn> conn = this->peers.acquire(takeover.from);
+  if (!conn || !conn->send_request(req, MESSAGE_FORWARDED)) {
+    if (conn) this->peers.discard(conn);
+    this->n_shed++;
+    *res = OverloadedResponse{OVERLOAD_RETRY_AFTER_MS};
+    return;
+  }
+  if (!conn->recv_response(res)) {
+    // The source may have applied the request already, so the client mustn't
+    // retry it as if it had been refused
+    this->peers.discard(conn);
+    *res = ErrorResponse{"failed to receive the response to a request "
+                         "forwarded to " +
+                         takeover.from};
+    return;
+  }
+  this->peers.release(conn);
+  if (!is_not_responsible(*res)) {
+    this->n_forwarded++;
+    return;
+  }
+  // The source has cut over, so the keys are here
+  takeover.done = true;
+  this->retire_takeovers();
+  this->execute_request(req, res, true);
+}
+
+void KvServer::execute_request(const Request& req, Response* res,
+                               bool responsible) {
+  if (auto* get_req = std::get_if<GetRequest>(&req)) {
+    // Get is the hot path, so reuse the previous GetResponse's value buffer
+    GetResponse& get_res = reuse_alternative<GetResponse>(res);
+    if (!responsible || !this->store->Get(get_req, &get_res)) {
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
                        : std::string("key does not exist in the KVStore")};
     }
   } else if (auto* put_req = std::get_if<PutRequest>(&req)) {
-    bool responsible = this->responsible_for(put_req->key);
     PutResponse put_res;
     if (responsible && this->store->Put(put_req, &put_res)) {
-      res = put_res;
+      *res = put_res;
     } else {
       // Put should never fail
-      res = ErrorResponse{!responsible
-                              ? std::string("server not responsible for key")
-                              : std::string("internal KVStore error")};
+      *res = ErrorResponse{!responsible
+                               ? std::string(NOT_RESPONSIBLE_ERROR)
+                               : std::string("internal KVStore error")};
     }
   } else if (auto* append_req = std::get_if<AppendRequest>(&req)) {
-    bool responsible = this->responsible_for(append_req->key);
     AppendResponse append_res;
     if (responsible && this->store->Append(append_req, &append_res)) {
-      res = append_res;
+      *res = append_res;
     } else {
-      res = ErrorResponse{!responsible
-                              ? std::string("server not responsible for key")
-                              : std::string("internal KVStore error")};
+      *res = ErrorResponse{!responsible
+                               ? std::string(NOT_RESPONSIBLE_ERROR)
+                               : std::string("internal KVStore error")};
     }
   } else if (auto* delete_req = std::get_if<DeleteRequest>(&req)) {
-    bool responsible = this->responsible_for(delete_req->key);
     DeleteResponse delete_res;
     if (responsible && this->store->Delete(delete_req, &delete_res)) {
-      res = delete_res;
+      *res = std::move(delete_res);
     } else {
-      res = ErrorResponse{
-          !responsible ? std::string("server not responsible for key")
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR)
                        : std::string("key does not exist in the KVStore")};
     }
   } else if (auto* multiget_req = std::get_if<MultiGetRequest>(&req)) {
-    bool responsible = this->responsible_for(multiget_req->keys);
     MultiGetResponse multiget_res;
     if (responsible && this->store->MultiGet(multiget_req, &multiget_res)) {
-      res = multiget_res;
+      *res = std::move(multiget_res);
     } else {
-      res = ErrorResponse{
-          !responsible ? std::string("server not responsible for key(s)")
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
                        : std::string("key(s) do not exist in the KVStore")};
     }
   } else if (auto* multiput_req = std::get_if<MultiPutRequest>(&req)) {
-    bool responsible = this->responsible_for(multiput_req->keys);
     MultiPutResponse multiput_res;
     if (responsible && this->store->MultiPut(multiput_req, &multiput_res)) {
-      res = multiput_res;
+      *res = multiput_res;
+    } else {
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
+                       : std::string("internal KVStore error")};
+    }
+  } else if (auto* batch_req = std::get_if<BatchRequest>(&req)) {
+    // The whole batch is rejected if any key has moved, so that it still runs
+    // atomically once the client re-routes it
+    BatchResponse batch_res;
+    if (responsible && this->store->Batch(batch_req, &batch_res)) {
+      *res = std::move(batch_res);
     } else {
-      res = ErrorResponse{!responsible
-                              ? std::string("server not responsible for key(s)")
-                              : std::string("internal KVStore error")};
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
+                       : std::string("internal KVStore error")};
+    }
+  } else if (auto* transfer_req = std::get_if<TransferRequest>(&req)) {
+    // A server migrating keys here; it retries until we've installed the
+    // config that makes us responsible for them
+    MultiPutRequest multiput_req{transfer_req->keys, transfer_req->values};
+    MultiPutResponse multiput_res;
+    if (responsible && (multiput_req.keys.empty() ||
+                        this->store->MultiPut(&multiput_req, &multiput_res))) {
+      for (auto&& key : transfer_req->deleted) {
+        DeleteRequest delete_req{key};
+        DeleteResponse delete_res;
+        this->store->Delete(&delete_req, &delete_res);
+      }
+      *res = TransferResponse{};
+    } else {
+      *res = ErrorResponse{
+          !responsible ? std::string(NOT_RESPONSIBLE_ERROR "(s)")
+                       : std::string("internal KVStore error")};
     }
   } else {
     throw std::logic_error{"invalid variant!"};
   }
-  return res;
 }
 
 void KvServer::process_config_loop() {
-  int failure_count = 0;
+  // The last config the shardcontroller told us about, which its Watch
+  // responses are deltas of
+  ShardControllerConfig config;
+  uint64_t version = 0;
+  std::shared_ptr<ServerConn> conn;
+  {
+    std::unique_lock lock(this->watch_mtx);
+    conn = this->shardcontroller_watch_conn;
+  }
+  milliseconds watch_retry_delay = WATCH_RETRY_DELAY;
   while (!this->is_stopped) {
-    if (this->process_config()) {
-      failure_count = 0;
-    } else {
-      failure_count += 1;
-      // process_config can fail if the destination server for a move
-      // hasn't queried the shardcontroller yet so we tolerate some
-      // failures before breaking
-      if (failure_count > 100) {
-        break;
+    if (!conn) {
+      {
+        std::unique_lock lock(this->watch_mtx);
+        this->watch_cv.wait_for(lock, watch_retry_delay,
+                                [this] { return this->is_stopped.load(); });
+      }
+      watch_retry_delay =
+          std::min(watch_retry_delay * 2, MAX_WATCH_RETRY_DELAY);
+      conn = connect_to_server(this->shardcontroller_address);
+      if (!conn) continue;
+      {
+        std::unique_lock lock(this->watch_mtx);
+        if (this->is_stopped) break;
+        this->shardcontroller_watch_conn = conn;
+      }
+      // The shardcontroller may have restarted, so start over from its whole
+      // config rather than applying deltas to ours
+      config = ShardControllerConfig{};
+      version = 0;
+    }
+
+    auto res = this->watch_shardcontroller(conn, version);
+    if (this->is_stopped) break;
+    if (!res) {
+      cerr_color(YELLOW, "Lost watch on shardcontroller; reconnecting.");
+      conn->shutdown();
+      conn = nullptr;
+      continue;
+    }
+    watch_retry_delay = WATCH_RETRY_DELAY;
+    if (res->version == version) continue;
+
+    apply_watch_response(*res, &config);
+    version = res->version;
+    if (this->install_config(config, version)) continue;
+
+    // The handoff was given up on, and its keys are still served here: retry
+    // it, or install a newer config if there's one by then, before watching
+    // for the next one
+    cerr_color(RED, "Failed to install config version ", version,
+               "; retrying.");
+    milliseconds retry_delay = TRANSFER_RETRY_DELAY;
+    while (!this->is_stopped && !this->process_config()) {
+      std::this_thread::sleep_for(retry_delay);
+      retry_delay = std::min(retry_delay * 2, MAX_HANDOFF_RETRY_DELAY);
+    }
+  }
+}
+
+void KvServer::report_load_loop() {
+  // Bytes stored in each shard of the config counted last (and where to split
+  // them), and the reports since then
+  uint64_t bytes_version = 0;
+  std::vector<uint64_t> bytes;
+  std::vector<std::string> bytes_splits;
+  uint64_t n_reports = 0;
+
+  std::unique_lock lock(this->report_mtx);
+  while (!this->is_stopped) {
+    uint64_t ms = this->load_report_ms;
+    if (ms == 0) {
+      this->report_cv.wait(lock, [this] {
+        return this->is_stopped || this->load_report_ms > 0;
+      });
+      continue;
+    }
+    this->report_cv.wait_for(lock, milliseconds(ms),
+                             [this] { return this->is_stopped.load(); });
+    if (this->is_stopped) break;
+    lock.unlock();
+
+    std::shared_ptr<const ConfigSnapshot> snapshot = this->config.load();
+    if (snapshot->load && snapshot->own_route != RoutingTable::NO_SERVER) {
+      const RoutingTable& routes = snapshot->routes;
+      if (bytes_version != snapshot->shardcontroller_version ||
+          bytes.size() != routes.get_shards().size() ||
+          n_reports % LOAD_BYTES_REPORTS == 0) {
+        std::size_t n_shards = routes.get_shards().size();
+        bytes.assign(n_shards, 0);
+        std::vector<std::map<std::string, uint64_t>> by_bound(n_shards);
+        for (auto&& [key, size] : this->store->AllKeySizes()) {
+          uint32_t shard = routes.shard_of(key);
+          if (shard == RoutingTable::NO_SHARD) continue;
+          bytes[shard] += size;
+          by_bound[shard][routes.bound_of(key)] += size;
+        }
+        bytes_splits.assign(n_shards, "");
+        for (std::size_t i = 0; i < n_shards; i++) {
+          bytes_splits[i] = find_split(routes.get_shards()[i], by_bound[i]);
+        }
+        bytes_version = snapshot->shardcontroller_version;
+      }
+      std::vector<double> ops = snapshot->load->take();
+      std::vector<std::map<std::string, uint64_t>> sampled(ops.size());
+      for (auto&& [shard, bound] : snapshot->load->take_samples()) {
+        sampled[shard][bound]++;
+      }
+
+      ReportRequest req{this->address, snapshot->shardcontroller_version,
+                        snapshot->migrating(), {}};
+      for (std::size_t i = 0; i < ops.size(); i++) {
+        if (routes.get_shard_owners()[i] != snapshot->own_route) continue;
+        const Shard& shard = routes.get_shards()[i];
+        req.loads.push_back({shard, ops[i], bytes[i],
+                             find_split(shard, sampled[i]), bytes_splits[i]});
       }
+      // A failed report is just skipped: the next one has fresher numbers
+      if (this->shardcontroller_conn->send_request(req)) {
+        this->shardcontroller_conn->recv_response();
+      }
+      n_reports++;
     }
-    std::this_thread::sleep_for(250ms);
+    lock.lock();
+  }
+}
+
+std::optional<WatchResponse> KvServer::watch_shardcontroller(
+    std::shared_ptr<ServerConn> conn, uint64_t version) {
+  if (!conn->send_request(WatchRequest{version})) {
+    return std::nullopt;
   }
+
+  auto res = conn->recv_response();
+  if (!res) {
+    return std::nullopt;
+  }
+  auto* watch_res = std::get_if<WatchResponse>(&*res);
+  if (!watch_res) {
+    return std::nullopt;
+  }
+  return std::move(*watch_res);
 }
 
 ShardControllerConfig KvServer::get_config() {
-  return this->config;
+  return this->config.load()->routes.get_config();
+}
+
+IoBackend KvServer::get_io_backend() {
+  if (this->engines.empty()) return this->io_backend;
+  return this->engines[0]->backend();
+}
+
+uint64_t KvServer::get_io_syscalls() {
+  uint64_t total = 0;
+  for (auto&& engine : this->engines) total += engine->syscalls();
+  return total + this->n_socket_syscalls.load();
+}
+
+uint64_t KvServer::get_shed_requests() {
+  return this->n_shed.load();
+}
+
+uint64_t KvServer::get_coalesced_gets() {
+  uint64_t total = 0;
+  for (auto&& coalescer : this->coalescers) total += coalescer->hits();
+  return total;
+}
+
+uint64_t KvServer::get_forwarded_requests() {
+  return this->n_forwarded.load();
+}
+
+uint64_t KvServer::get_finished_migrations() {
+  return this->n_migrations.load();
+}
+
+uint64_t KvServer::get_proxied_requests() {
+  return this->n_proxied.load();
 }
 
 std::map<std::string, std::string> KvServer::all_kvpairs() {
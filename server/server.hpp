@@ -1,9 +1,12 @@
 #ifndef KVSERVER_HPP
 #define KVSERVER_HPP
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -11,29 +14,53 @@
 #include <shared_mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include "kvstore/concurrent_kvstore.hpp"
 #include "kvstore/kvstore.hpp"
 #include "kvstore/simple_kvstore.hpp"
+#include "net/connection_pool.hpp"
+#include "net/io_engine.hpp"
 #include "net/network_conn.hpp"
 #include "net/network_helpers.hpp"
 #include "net/network_messages.hpp"
-
-#define N_WORKERS 5
+#include "net/routing_table.hpp"
+#include "server/async_logger.hpp"
+#include "server/get_coalescer.hpp"
+#include "server/load_tracker.hpp"
+#include "server/task.hpp"
+
+/*
+ * Default number of worker threads: one per core. Workers multiplex their
+ * connections and handle requests as tasks, so more threads than cores don't
+ * add concurrency.
+ */
+inline uint64_t default_n_workers() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
 
 using namespace std::chrono;
 
 class KvServer {
  public:
-  explicit KvServer(const std::string& address, uint64_t n_workers)
-      : address(address), shardcontroller_address(), n_workers(n_workers) {
+  explicit KvServer(const std::string& address, uint64_t n_workers,
+                    IoBackend io_backend = IoBackend::EPOLL)
+      : address(address),
+        shardcontroller_address(),
+        n_workers(n_workers),
+        io_backend(io_backend) {
+    this->publish_config(ShardControllerConfig{});
   }
   explicit KvServer(const std::string& address,
-                    const std::string& shardcontroller_addr, uint64_t n_workers)
+                    const std::string& shardcontroller_addr, uint64_t n_workers,
+                    IoBackend io_backend = IoBackend::EPOLL)
       : address(address),
         shardcontroller_address(shardcontroller_addr),
-        n_workers(n_workers) {
+        n_workers(n_workers),
+        io_backend(io_backend) {
+    this->publish_config(ShardControllerConfig{});
   }
   ~KvServer() {
     if (!this->is_stopped) {
@@ -45,6 +72,30 @@ class KvServer {
   int start();
   void stop();
 
+  /*
+   * Accepts clients on an additional address, once the server has started:
+   * typically "unix:<path>" or "shm:<path>", for clients on the same host.
+   * Returns false if the address can't be listened on.
+   */
+  bool listen_on(const std::string& address);
+
+  /*
+   * Turns proxy mode on or off (it's off by default). In proxy mode, a client
+   * request for keys that another server owns (all the same one) is relayed
+   * to that server over a pooled connection, rather than rejected as not
+   * responsible, and its response is flagged MESSAGE_REROUTED, so that the
+   * client refreshes its config.
+   */
+  void set_proxy_mode(bool enabled);
+
+  /*
+   * Reports the load on this server's shards (key operations per second, and
+   * bytes stored) to the shardcontroller every `interval`, for it to
+   * rebalance shards between servers; 0 (the default) turns reporting off.
+   * Not thread-safe with itself, or with start/stop.
+   */
+  void set_load_report_interval(milliseconds interval);
+
   // Shardcontroller functions
   bool Join();
 
@@ -58,6 +109,28 @@ class KvServer {
   // For debugging purposes, get the shardcontroller config from the server.
   ShardControllerConfig get_config();
 
+  // For benchmarking purposes, get the I/O backend the workers run on (after
+  // any fallback), and the number of system calls the workers made serving
+  // connections: their I/O engines', and their sockets' sends and receives.
+  IoBackend get_io_backend();
+  uint64_t get_io_syscalls();
+
+  // For benchmarking purposes, get the number of requests the workers have
+  // turned away with an OverloadedResponse, and the number of Gets they served
+  // from an identical Get's response.
+  uint64_t get_shed_requests();
+  uint64_t get_coalesced_gets();
+
+  // For benchmarking purposes, get the number of requests forwarded to a
+  // server migrating keys to this one, and the number of migrations of keys
+  // away from this server that have finished.
+  uint64_t get_forwarded_requests();
+  uint64_t get_finished_migrations();
+
+  // For benchmarking purposes, get the number of client requests relayed to
+  // the server owning their keys in proxy mode.
+  uint64_t get_proxied_requests();
+
   // For testing purposes, make ServerTest a friend of KvServer
   // so that ServerTest can access KvServer's private fields
   friend class ServerTest;
@@ -81,11 +154,106 @@ class KvServer {
   // Persistent shardcontroller connection.
   std::shared_ptr<ServerConn> shardcontroller_conn;
 
-  // Shardcontroller configuration.
-  ShardControllerConfig config;
-
-  // mutex to synchronize access to the config
-  std::shared_mutex config_mtx;
+  /*
+   * Live shard migration. When a config moves keys from this server (the
+   * source) to another (the destination), install_config:
+   *  1. publishes the new config with a Handoff: until the cutover, this
+   *     server keeps serving the keys it's handing off, and records the ones
+   *     written to as dirty;
+   *  2. copies the keys to their destinations in the background, in batches
+   *     of TransferRequests, then re-sends the dirty keys for a few rounds;
+   *  3. cuts over: holding the Handoff's lock exclusively (which sheds only
+   *     requests for the keys being handed off), makes one attempt at sending
+   *     the last dirty keys, and if every destination acknowledges them,
+   *     marks the Handoff done and publishes the config without it;
+   *  4. tells every destination that it has all of the keys (in a last
+   *     chunk), so it can stop forwarding.
+   * Keys whose transfer fails are resent, with backoff, and a failed cutover
+   * attempt releases the lock before backing off, so the keys are served
+   * meanwhile. No destination is sent a last chunk before all of them have
+   * every key, so none takes over keys the source may keep. If that takes
+   * longer than MIGRATION_TIMEOUT, the handoff is given up on: the source
+   * keeps serving the keys, and install_config fails, to be retried.
+   * Meanwhile, the destination installs the config with a Takeover of the
+   * source's keys, and forwards requests for them to the source, until the
+   * last chunk arrives or the source answers one as not responsible (i.e. it
+   * has cut over, so the keys are here). No request fails for being sent
+   * mid-migration.
+   */
+  // A stream of transfer chunks to one destination: the sequence number of
+  // the next chunk, and the chunks sent but not acknowledged by the end of the
+  // last transfer. Those are resent first, unchanged, since the destination
+  // may have applied them (only their acknowledgement lost), and it only
+  // applies chunks in order.
+  struct TransferStream {
+    uint64_t next_seq = 0;
+    std::deque<Request> unacked;
+  };
+  struct Handoff {
+    // The config the keys are handed off from, and this server's index in it
+    std::shared_ptr<const RoutingTable> previous;
+    uint16_t previous_route;
+    // The servers the keys are handed off to, and the stream to each
+    std::vector<std::string> destinations;
+    std::map<std::string, TransferStream> streams;
+    // Requests for the keys hold mtx shared, and check `done` first
+    std::shared_mutex mtx;
+    bool done = false;
+    // Keys written to since the copy started, guarded by dirty_mtx
+    std::mutex dirty_mtx;
+    std::unordered_set<std::string> dirty;
+  };
+  struct Takeover {
+    // The server keys are taken over from, and its index in `previous`, the
+    // config it owned them in
+    std::string from;
+    std::shared_ptr<const RoutingTable> previous;
+    uint16_t from_route;
+    // The shardcontroller's version of the config the keys moved in
+    uint64_t version;
+    // Forwarding stops once set (when the source's last transfer arrives, or
+    // it answers a forwarded request as not responsible), or after
+    // MIGRATION_TIMEOUT
+    std::atomic<bool> done = false;
+    steady_clock::time_point deadline;
+  };
+
+  // Shardcontroller configuration, compiled for routing keys, with this
+  // server's index in it.
+  struct ConfigSnapshot {
+    RoutingTable routes;
+    uint16_t own_route = RoutingTable::NO_SERVER;
+    // Unique across servers (see config_snapshot)
+    uint64_t version = 0;
+    // The shardcontroller's version of the config
+    uint64_t shardcontroller_version = 0;
+    // The migration of keys away from this server, if one is in progress
+    std::shared_ptr<Handoff> handoff;
+    // Migrations of keys to this server that haven't finished
+    std::vector<std::shared_ptr<Takeover>> takeovers;
+    // Operations on each of the config's shards, if load reporting is on
+    std::shared_ptr<LoadTracker> load;
+
+    bool migrating() const {
+      return this->handoff || !this->takeovers.empty();
+    }
+  };
+
+  // The current config, published as an immutable snapshot and swapped
+  // atomically on each update. Requests route through a snapshot without
+  // taking any lock, and the snapshot stays alive for as long as it's used.
+  std::atomic<std::shared_ptr<const ConfigSnapshot>> config;
+  // Version of the current snapshot, so that threads can tell whether their
+  // cached copy is stale without touching the shared_ptr's reference count.
+  std::atomic<uint64_t> config_version = 0;
+
+  // mutex to serialize config updates, held for the whole of each one,
+  // migration included (the request path never takes it)
+  std::mutex config_mtx;
+  // mutex to serialize changes to the current snapshot, each published as a
+  // modified copy of it; held only while the copy is made. Taken after
+  // config_mtx, if both are.
+  std::mutex snapshot_mtx;
 
   // END of fields you need for process_config
 
@@ -93,44 +261,278 @@ class KvServer {
   // stopped.
   std::atomic<bool> is_stopped;
 
-  // Listener socket for incoming client connections.
-  int listener_fd;
-  // Thread that listens for client connections and accepts them.
-  std::thread client_listener;
+  // Listener sockets for incoming client connections: one per worker, all
+  // bound to the server's port with SO_REUSEPORT, so that the kernel balances
+  // new connections across the workers and each worker accepts its own.
+  std::vector<int> listener_fds;
+
+  // Listener sockets and threads for the addresses added by listen_on, and
+  // the Unix socket paths to clean up on stop.
+  std::vector<int> extra_listener_fds;
+  std::vector<std::thread> extra_client_listeners;
+  std::vector<std::string> unix_socket_paths;
+  // Round-robin counter for handing accepted connections to workers.
+  std::atomic<size_t> next_worker = 0;
+
+  // Logs client connections off the accept path.
+  AsyncLogger logger;
 
   // Thread that periodically queries the shardcontroller for the current
   // configuration.
   std::thread shardcontroller_querier;  // bro this name goofy
   std::shared_ptr<ServerConn> shardcontroller_querier_conn;
+  // Connection the querier thread watches for config changes on (separate,
+  // since a Watch holds its connection until the config changes). The thread
+  // replaces it when the watch is lost, under watch_mtx; watch_cv wakes the
+  // thread from its wait to reconnect on stop.
+  std::shared_ptr<ServerConn> shardcontroller_watch_conn;
+  std::mutex watch_mtx;
+  std::condition_variable watch_cv;
+  // Delay before reconnecting to the shardcontroller after losing the watch,
+  // doubling with each failed attempt up to MAX_WATCH_RETRY_DELAY.
+  static constexpr milliseconds WATCH_RETRY_DELAY = 100ms;
+  static constexpr milliseconds MAX_WATCH_RETRY_DELAY = 5s;
 
   // Vector of worker threads.
   std::vector<std::thread> workers;
 
-  // Per-worker queues of client connections to handle.
+  // Per-worker queues of newly accepted client connections, which the
+  // worker registers with its I/O engine.
   std::vector<std::deque<std::shared_ptr<ClientConn>>> conn_queues;
   std::deque<std::mutex> conn_queue_mtxs;
 
+  // Per-worker I/O engines, multiplexing each worker's client connections.
+  std::vector<std::unique_ptr<IoEngine>> engines;
+
+  // Per-worker coalescing of identical Gets.
+  std::vector<std::unique_ptr<GetCoalescer>> coalescers;
+
   // The address on which the shardcontroller is listening.
   std::string shardcontroller_address;
 
   // Number of worker threads.
   uint64_t n_workers;
 
+  // I/O backend requested for the worker engines.
+  IoBackend io_backend;
+
+  /*
+   * Admission control. Past these bounds a worker sheds load quickly rather
+   * than queueing it, so that the requests it does take on still finish in
+   * time, and clients back off instead of piling on:
+   *  - connections beyond MAX_WORKER_CONNECTIONS per worker (or beyond
+   *    MAX_QUEUED_CONNECTIONS waiting in its queue) are closed on accept;
+   *  - requests that arrive while MAX_WORKER_TASKS tasks are suspended, or
+   *    once the worker has spent ADMISSION_DELAY_BUDGET on its current round,
+   *    are answered with an OverloadedResponse, asking the client to retry
+   *    after OVERLOAD_RETRY_AFTER_MS.
+   * Each connection has at most one request in flight (see Client::busy), so
+   * a client pipelining requests is held back by TCP flow control.
+   */
+  static constexpr size_t MAX_WORKER_CONNECTIONS = 4096;
+  static constexpr size_t MAX_QUEUED_CONNECTIONS = 256;
+  static constexpr size_t MAX_WORKER_TASKS = 64;
+  static constexpr milliseconds ADMISSION_DELAY_BUDGET = 10ms;
+  static constexpr uint32_t OVERLOAD_RETRY_AFTER_MS = 5;
+
+  // Number of requests shed so far, across workers.
+  std::atomic<uint64_t> n_shed = 0;
+  // Number of socket system calls the workers have made, as of the end of
+  // their last round (see get_io_syscalls).
+  std::atomic<uint64_t> n_socket_syscalls = 0;
+
+  /*
+   * Migration bounds: keys are streamed to each destination in checksummed
+   * TransferRequest chunks of about TRANSFER_CHUNK_BYTES, with up to
+   * TRANSFER_WINDOW of them unacknowledged; a stream resumes from its oldest
+   * unacknowledged chunk up to MAX_TRANSFER_ATTEMPTS times in a row,
+   * TRANSFER_RETRY_DELAY apart (but only once during the cutover, since
+   * requests for the keys are shed meanwhile);
+   * dirty keys are re-sent for up to MAX_CATCHUP_ROUNDS before the cutover,
+   * or until at most CUTOVER_DIRTY_KEYS are left for it, and rounds with
+   * keys that failed are retried after TRANSFER_RETRY_DELAY, doubling up to
+   * MAX_HANDOFF_RETRY_DELAY. A destination stops forwarding to a source that
+   * hasn't cut over after MIGRATION_TIMEOUT.
+   */
+  static constexpr size_t TRANSFER_CHUNK_BYTES = 1 << 20;
+  static constexpr size_t TRANSFER_WINDOW = 8;
+  static constexpr int MAX_TRANSFER_ATTEMPTS = 50;
+  static constexpr milliseconds TRANSFER_RETRY_DELAY = 100ms;
+  static constexpr int MAX_CATCHUP_ROUNDS = 4;
+  static constexpr size_t CUTOVER_DIRTY_KEYS = 64;
+  static constexpr milliseconds MAX_HANDOFF_RETRY_DELAY = 2s;
+  static constexpr seconds MIGRATION_TIMEOUT = 30s;
+
+  // Connections to other servers, for transfers and forwarded (or proxied)
+  // requests.
+  ConnectionPool peers;
+
+  // Whether misrouted client requests are relayed to their keys' owner, and
+  // the number relayed so far.
+  std::atomic<bool> proxy_mode = false;
+  std::atomic<uint64_t> n_proxied = 0;
+
+  /*
+   * A round trip to another server that a request needs before it can be
+   * answered: forwarding it to the source of `takeover`, or, if that's null,
+   * proxying it to its keys' owner, `server`. Workers never make one
+   * themselves, since it would hold up all of their other clients: the
+   * request's task is sent away to one of N_RELAY_THREADS relay threads,
+   * which make the round trip, then post the task back to its worker. The
+   * threads take relays off relay_queue until relays_stopped (both guarded by
+   * relay_mtx) is set, once the workers are done.
+   */
+  struct Relay {
+    std::string server;
+    std::shared_ptr<Takeover> takeover;
+  };
+  static constexpr size_t N_RELAY_THREADS = 8;
+  std::vector<std::thread> relay_threads;
+  std::deque<std::function<void()>> relay_queue;
+  bool relays_stopped = false;
+  std::mutex relay_mtx;
+  std::condition_variable relay_cv;
+
+  /*
+   * Load reports: every load_report_ms (if not 0), the load reporter thread
+   * sends the shardcontroller the ops/sec on each of this server's shards,
+   * from the current snapshot's LoadTracker, and their bytes, which it counts
+   * every LOAD_BYTES_REPORTS reports (or when the config changes), since that
+   * walks the whole store; with where to split each shard to halve its ops
+   * (from the tracker's samples) or bytes. It waits on report_cv, for stop to
+   * wake it.
+   */
+  static constexpr uint64_t LOAD_BYTES_REPORTS = 10;
+  std::atomic<uint64_t> load_report_ms = 0;
+  std::thread load_reporter;
+  std::mutex report_mtx;
+  std::condition_variable report_cv;
+
+  // Number of requests forwarded so far, across workers, and of migrations
+  // finished.
+  std::atomic<uint64_t> n_forwarded = 0;
+  std::atomic<uint64_t> n_migrations = 0;
+
+  // Progress of the transfers from each source server: the shardcontroller's
+  // version of the config it's migrating to, and the next chunk expected.
+  struct TransferProgress {
+    std::mutex mtx;
+    uint64_t version = 0;
+    uint64_t next_seq = 0;
+  };
+  std::unordered_map<std::string, std::shared_ptr<TransferProgress>> transfers;
+  std::mutex transfers_mtx;
+
   /**
-   * In a loop, accept client connections, then pass each connection into the
-   * work queue of client connections to process.
+   * In a loop, accept client connections on one of the listen_on addresses,
+   * then pass each connection into the work queue of client connections to
+   * process. If `shm` is set, clients first hand over their shared-memory
+   * channel.
    *
    * Exits when the server has been stopped.
    */
-  void accept_clients_loop();
+  void accept_clients_loop(int listener_fd, bool shm);
+
+  // Closes the worker listener sockets.
+  void close_listeners();
+
+  // A client connection served by a worker, with the request and response
+  // recycled across its requests, so that serving one needn't allocate.
+  struct Client {
+    std::shared_ptr<ClientConn> conn;
+    Request req;
+    Response res;
+    // Message flags the request was sent with (e.g. MESSAGE_FORWARDED)
+    uint8_t flags = 0;
+    // Whether a task is handling a request from the client. The client's next
+    // request isn't read until it finishes, so responses go out in order.
+    bool busy = false;
+    // Whether sending a response failed, so the connection should be closed.
+    bool failed = false;
+    // Whether `req` is a part of a streamed MultiPut, applied as it arrives
+    // (see ClientConn::try_recv_request), and whether more parts follow it;
+    // then, the response to the whole request, once a part has failed, and
+    // whether any part was rerouted.
+    bool in_stream = false;
+    bool more = false;
+    std::optional<Response> stream_res;
+    bool stream_rerouted = false;
+    // The worker's I/O engine, and what it watches the connection for
+    IoEngine* engine = nullptr;
+    int events = IO_READABLE;
+  };
+
+  /*
+   * Sends the response to the client's current request, in `client.res`
+   * (rerouted if `rerouted` is set). For a part of a streamed request, grants
+   * the client credit for another part instead, until the last, which is
+   * answered for the whole request. Returns false on failure.
+   */
+  bool respond(Client& client, bool rerouted);
+
+  // Watches the client's connection for what it's waiting on: room for the
+  // rest of its response, nothing while it's busy, and its next request
+  // otherwise.
+  void watch_client(Client& client);
 
   /**
-   * In a loop, pop a client connection from the work queue and process a
-   * request from it. The argument specifies the worker thread ID running the
+   * In a loop, register newly accepted (or queued) client connections with the
+   * worker's I/O engine (in non-blocking mode), wait for any of its
+   * connections to become ready, and start a task handling a request from
+   * each that has sent one in full, or send more of a response to each that
+   * hasn't taken all of its last one yet; then resume the worker's
+   * suspended tasks. The argument specifies the worker thread ID running the
    * loop. Exits when the server has been stopped.
    */
   void work_loop(size_t worker_id);
 
+  /**
+   * Receive what has arrived of a single request from the client and, once
+   * all of it has, start a task on `scheduler` that processes it and
+   * responds; or, if `shed` is set, respond right away with an
+   * OverloadedResponse instead. Gets are served right away too, through
+   * `gets`. Returns false if the connection should be closed.
+   */
+  bool serve_request(std::shared_ptr<Client> client, Scheduler& scheduler,
+                     GetCoalescer& gets, bool shed);
+
+  /**
+   * Respond to the client's current request, a Get, with the response to an
+   * identical Get served this round if there is one; otherwise look the key
+   * up, and cache the serialized response in `gets`. A Get that must be
+   * relayed to another server is handled as a task on `scheduler` instead.
+   * Returns false if the response couldn't be sent.
+   */
+  bool serve_get(std::shared_ptr<Client>& client, GetCoalescer& gets,
+                 Scheduler& scheduler);
+
+  /**
+   * Process the client's current request and send the response. Large
+   * requests first yield to `scheduler`, so that the requests other clients
+   * have ready aren't stuck behind them, and requests relayed to another
+   * server are sent away to a relay thread until it responds.
+   */
+  Task handle_request(std::shared_ptr<Client> client, Scheduler& scheduler);
+
+  /**
+   * Queue `relay` of the client's current request for a relay thread, which
+   * writes the response into the client's, and whether it's rerouted into
+   * `*rerouted`, then posts `task` back to `scheduler`.
+   */
+  void start_relay(const Relay& relay, Client& client, bool* rerouted,
+                   Scheduler& scheduler, std::coroutine_handle<> task);
+
+  // Makes the relays queued by start_relay, until relays_stopped is set.
+  void relay_loop();
+
+  // Records the keys of a client request in the current snapshot's
+  // LoadTracker, if load reporting is on.
+  void record_load(const Request& req);
+
+  // Sends the shardcontroller a load report every load_report_ms, until the
+  // server stops.
+  void report_load_loop();
+
   /**
    * Check whether this server is responsible for a key.
    *
@@ -149,24 +551,164 @@ class KvServer {
    */
   bool responsible_for(const std::vector<std::string>& keys);
 
+  // Check whether this server is responsible for every key in a request.
+  bool responsible_for(const Request& req);
+
   /**
    * Query the shardcontroller, then update the config and move outdated pairs
    * to updated servers.
    */
   bool process_config();
 
+  /**
+   * Update the config to `config`, the shardcontroller's config at `version`,
+   * and migrate outdated pairs to updated servers (see Handoff), returning
+   * once they've been handed off. A config older than the current one is
+   * ignored, as is the current one, unless its handoff was given up on, in
+   * which case it's retried. Returns false if the handoff is given up on.
+   */
+  bool install_config(ShardControllerConfig config, uint64_t version);
+
+  /**
+   * Hand off the keys `snapshot` moves away from this server, then cut over
+   * to `snapshot` without its Handoff. Called by install_config, once
+   * `snapshot` is published. Returns false, without cutting over, if not
+   * every key could be handed off before MIGRATION_TIMEOUT.
+   */
+  bool migrate(const ConfigSnapshot& snapshot);
+
+  /**
+   * Send the current values of `keys` (or, for keys since deleted, their
+   * deletion) to the servers now responsible for them under `snapshot`,
+   * streaming to all of them concurrently, in up to `attempts` attempts each
+   * (see stream_transfer). Destinations with chunks left unacknowledged are
+   * sent those again. If `last` is set, the handoff is done, so every
+   * destination is sent a last chunk. Returns the keys whose transfer failed.
+   */
+  std::vector<std::string> transfer(const ConfigSnapshot& snapshot,
+                                    const std::vector<std::string>& keys,
+                                    bool last, int attempts);
+
+  /**
+   * Stream `keys` to `server` over a pooled connection, in chunks numbered
+   * from `stream`'s next sequence number, after the chunks its last transfer
+   * left unacknowledged, keeping up to TRANSFER_WINDOW of them in flight. If
+   * the connection fails, or the server refuses a chunk (e.g. it hasn't
+   * installed the config yet), the stream resumes from the oldest
+   * unacknowledged chunk, up to `attempts` times in a row. Returns the keys
+   * that weren't acknowledged, and leaves their chunks in `stream` for the
+   * next transfer.
+   */
+  std::vector<std::string> stream_transfer(const std::string& server,
+                                           const std::vector<std::string>& keys,
+                                           uint64_t version, bool last,
+                                           int attempts,
+                                           TransferStream* stream);
+
+  /**
+   * Apply a chunk of a transfer to this server, if it's intact and the next
+   * one in its stream. Chunks seen before are acknowledged without being
+   * applied again.
+   */
+  void receive_transfer(const Request& req, Response* res);
+
+  /**
+   * Process a request under a config with a migration in progress: serve it
+   * here, under the Handoff's lock, if this server owns or is handing off its
+   * keys; leave it in `relay` to be forwarded, if it's for keys being taken
+   * over from one server; or reject it.
+   */
+  void process_migrating_request(const ConfigSnapshot& snapshot,
+                                 const Request& req, Response* res,
+                                 std::optional<Relay>* relay);
+
+  // Marks the takeovers from `source`, up to its config `version`, done.
+  void finish_takeovers(const std::string& source, uint64_t version);
+
+  // Returns the server owning every key of a request under the current
+  // config, or nullptr if they aren't all owned by one other server.
+  const std::string* proxy_owner(const Request& req);
+
+  // Makes the round trip of `relay` for `req`, writing the response into
+  // `res`; returns whether the client should be told it was rerouted.
+  bool finish_relay(const Relay& relay, const Request& req, Response* res);
+
+  /**
+   * Relay a client's request, which this server isn't responsible for, to
+   * `owner`, the server owning its keys, writing the owner's response into
+   * `res`. Returns false, leaving `res` alone, if the owner can't be reached
+   * or isn't responsible for the keys either; or, if the owner may have
+   * applied the request but its response was lost, with an error in `res`.
+   */
+  bool proxy_request(const std::string& owner, const Request& req,
+                     Response* res);
+
+  /**
+   * Forward a request to the source of `takeover`, writing its response into
+   * `res`. Once the source answers that it no longer serves the keys, the
+   * takeover is done, and the request is served here. If the source can't be
+   * reached, the request is shed; if its response is lost, after it may have
+   * applied the request, `res` is an error.
+   */
+  void forward_request(Takeover& takeover, const Request& req, Response* res);
+
+  /**
+   * Execute a request on the store, once process_request has established
+   * whether this server is `responsible` for its keys, and write the response
+   * into `res`.
+   */
+  void execute_request(const Request& req, Response* res, bool responsible);
+
   /**
    * Process an incoming request: parse its request type, call its appropriate
    * handler (Get, Put, etc.), then get a response.
    */
-  Response process_request(Request req);
+  Response process_request(const Request& req);
+  /**
+   * Same as above, but writes the response into `res`, reusing its memory
+   * where the response type matches. In proxy mode, a request this server
+   * isn't responsible for is relayed to its keys' owner, unless it was
+   * `forwarded` by another server already; returns whether it was. If
+   * `relay` is set, a request that must be relayed (or forwarded) is left in
+   * it instead, for the caller to finish_relay off the worker.
+   */
+  bool process_request(const Request& req, Response* res,
+                       bool forwarded = false,
+                       std::optional<Relay>* relay = nullptr);
+
+  // Compiles `config` (the shardcontroller's config at `version`) into a
+  // snapshot, and publishes it as the current one.
+  void publish_config(ShardControllerConfig config, uint64_t version = 0);
+  // Publishes a modified copy of the current snapshot, under a new version.
+  void publish_snapshot(ConfigSnapshot snapshot);
+
+  // Drops finished takeovers from the current snapshot, unless another change
+  // to it is being published (a later call drops them instead).
+  void retire_takeovers();
+
+  /*
+   * Returns the current config snapshot. Each thread caches the last snapshot
+   * it used, so this only touches shared state when a newer one has been
+   * published. The reference stays valid until the thread's next call.
+   */
+  const ConfigSnapshot& config_snapshot();
 
   // Extracts a query response from the shardcontroller, or an std::nullopt if
   // one doesn't exist. You might need this when implementing process_config!
   std::optional<QueryResponse> query_shardcontroller(
       std::shared_ptr<ServerConn> conn);
 
-  // Wrapper function that calls process_config periodically.
+  // Waits for the shardcontroller's config to change from `version`, and
+  // returns the changes, or std::nullopt if the Watch fails.
+  std::optional<WatchResponse> watch_shardcontroller(
+      std::shared_ptr<ServerConn> conn, uint64_t version);
+
+  // Wrapper function that installs each new config as the shardcontroller
+  // announces it. Idle clusters send no traffic: the shardcontroller only
+  // answers a Watch once the config changes. A config whose handoff is given
+  // up on is retried, with backoff, until it (or a newer one) installs. A
+  // lost watch is reconnected, with backoff, starting over from the whole
+  // config.
   void process_config_loop();
 };
 
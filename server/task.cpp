@@ -0,0 +1,80 @@
+#include "task.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <unordered_map>
+
+namespace {
+
+// Freed coroutine frames on this thread, by size. All Tasks of one coroutine
+// function have the same frame size, so frames are reused almost perfectly.
+struct FrameCache {
+  std::unordered_map<std::size_t, std::vector<void*>> frames;
+
+  ~FrameCache() {
+    for (auto&& [_, free_frames] : this->frames) {
+      for (void* frame : free_frames) {
+        std::free(frame);
+      }
+    }
+  }
+};
+
+thread_local FrameCache frame_cache;
+
+// Largest number of free frames of one size kept around per thread.
+constexpr std::size_t MAX_CACHED_FRAMES = 1024;
+
+}  // namespace
+
+void* Task::promise_type::operator new(std::size_t sz) {
+  auto it = frame_cache.frames.find(sz);
+  if (it != frame_cache.frames.end() && !it->second.empty()) {
+    void* frame = it->second.back();
+    it->second.pop_back();
+    return frame;
+  }
+  if (void* frame = std::malloc(sz)) return frame;
+  throw std::bad_alloc{};
+}
+
+void Task::promise_type::operator delete(void* ptr, std::size_t sz) noexcept {
+  std::vector<void*>& free_frames = frame_cache.frames[sz];
+  if (free_frames.size() < MAX_CACHED_FRAMES) {
+    try {
+      free_frames.push_back(ptr);
+      return;
+    } catch (...) {
+    }
+  }
+  std::free(ptr);
+}
+
+void Scheduler::post(std::coroutine_handle<> task) {
+  // Once unlocked, the worker may resume the task and be done with the
+  // Scheduler, so wake it with a copy
+  std::function<void()> wake;
+  {
+    std::lock_guard lock(this->posted_mtx);
+    this->posted.push_back(task);
+    this->n_posted++;
+    wake = this->wake;
+  }
+  if (wake) wake();
+}
+
+void Scheduler::run() {
+  if (this->n_posted > 0) {
+    std::lock_guard lock(this->posted_mtx);
+    this->ready.insert(this->ready.end(), this->posted.begin(),
+                       this->posted.end());
+    this->n_away -= this->posted.size();
+    this->posted.clear();
+    this->n_posted = 0;
+  }
+  this->running.swap(this->ready);
+  for (std::coroutine_handle<> task : this->running) {
+    task.resume();
+  }
+  this->running.clear();
+}
@@ -0,0 +1,135 @@
+#ifndef SERVER_TASK_HPP
+#define SERVER_TASK_HPP
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * A fire-and-forget coroutine, used by KvServer workers to handle requests.
+ * A Task starts running as soon as it's called, and runs until it first
+ * suspends; whoever it suspends on (e.g. a Scheduler) resumes it later. Its
+ * frame is freed when it finishes.
+ *
+ * Frames are recycled through a per-thread free list, so that steady-state
+ * request handling doesn't allocate.
+ */
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept {
+      return {};
+    }
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+    void return_void() noexcept {
+    }
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+
+    static void* operator new(std::size_t sz);
+    static void operator delete(void* ptr, std::size_t sz) noexcept;
+  };
+};
+
+/*
+ * A run queue of suspended tasks, driven by a single worker thread from its
+ * event loop. Tasks may also be sent away to another thread (e.g. to make a
+ * blocking call there), which posts them back once done; `wake`, if set, is
+ * called after each post, to interrupt the worker if it's waiting for I/O.
+ */
+class Scheduler {
+ public:
+  explicit Scheduler(std::function<void()> wake = nullptr)
+      : wake(std::move(wake)) {
+  }
+
+  /*
+   * Awaitable that suspends the current task, and queues it to be resumed on
+   * the next call to run(), after the other work the worker has ready.
+   */
+  auto yield() noexcept {
+    struct Awaiter {
+      Scheduler* scheduler;
+      bool await_ready() noexcept {
+        return false;
+      }
+      void await_suspend(std::coroutine_handle<> task) {
+        scheduler->ready.push_back(task);
+      }
+      void await_resume() noexcept {
+      }
+    };
+    return Awaiter{this};
+  }
+
+  /*
+   * Awaitable that suspends the current task, and passes it to `send`, which
+   * hands it to another thread; that thread must post() it back.
+   */
+  template <typename Send>
+  auto send_away(Send send) {
+    struct Awaiter {
+      Scheduler* scheduler;
+      Send send;
+      bool await_ready() noexcept {
+        return false;
+      }
+      void await_suspend(std::coroutine_handle<> task) {
+        scheduler->n_away++;
+        send(task);
+      }
+      void await_resume() noexcept {
+      }
+    };
+    return Awaiter{this, std::move(send)};
+  }
+
+  /*
+   * Queues a task sent away to be resumed on the next call to run(). Unlike
+   * the rest of the Scheduler, may be called from any thread.
+   */
+  void post(std::coroutine_handle<> task);
+
+  /*
+   * Resumes every task queued when called. Tasks that suspend on the scheduler
+   * again are left for the next call.
+   */
+  void run();
+
+  // Whether any tasks are waiting to be resumed, and how many tasks are
+  // suspended, including those sent away.
+  bool empty() const {
+    return this->ready.empty() && this->n_posted == 0;
+  }
+  std::size_t size() const {
+    return this->ready.size() + this->n_away;
+  }
+  // Whether no task is waiting to be resumed, or away.
+  bool idle() const {
+    return this->ready.empty() && this->n_away == 0;
+  }
+
+ private:
+  // Double-buffered so that run() doesn't allocate in the steady state
+  std::vector<std::coroutine_handle<>> ready;
+  std::vector<std::coroutine_handle<>> running;
+
+  // Tasks sent away, and those of them posted back, guarded by posted_mtx
+  std::size_t n_away = 0;
+  std::mutex posted_mtx;
+  std::vector<std::coroutine_handle<>> posted;
+  std::atomic<std::size_t> n_posted = 0;
+  std::function<void()> wake;
+};
+
+#endif /* end of include guard */
@@ -0,0 +1,176 @@
+#include "shardcontroller/placement.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+
+#include "net/routing_table.hpp"
+
+// Returns the base-36 value of `bound`, in the characters of shard bounds.
+static double bound_value(const std::string& bound) {
+  double value = 0;
+  for (char c : bound) {
+    int digit = std::isdigit(uint8_t(c)) ? c - '0'
+                                         : std::toupper(uint8_t(c)) - 'A' + 10;
+    value = value * 36 + digit;
+  }
+  return value;
+}
+
+double shard_size(const Shard& shard) {
+  auto lower = RoutingTable::parse_slot_bound(shard.lower);
+  auto upper = RoutingTable::parse_slot_bound(shard.upper);
+  if (lower && upper) return double(*upper) - double(*lower) + 1;
+
+  // A shorter bound covers every longer one it starts
+  std::size_t length = std::max(shard.lower.size(), shard.upper.size());
+  std::string low = shard.lower, high = shard.upper;
+  low.resize(length, '0');
+  high.resize(length, 'Z');
+  return bound_value(high) - bound_value(low) + 1;
+}
+
+double rendezvous_score(const std::string& server, const Shard& shard,
+                        double weight) {
+  // FNV-1a of both, then a finalizer (splitmix64's), since FNV-1a alone
+  // leaves the hashes of similar strings correlated
+  uint64_t hash = 0xcbf29ce484222325;
+  auto add = [&](const std::string& s) {
+    for (char c : s) hash = (hash ^ uint8_t(c)) * 0x100000001b3;
+    hash = (hash ^ 0xff) * 0x100000001b3;
+  };
+  add(server);
+  add(shard.lower);
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111eb;
+  hash ^= hash >> 31;
+
+  // Weighted rendezvous: with u uniform in (0, 1), -weight / ln(u) is the
+  // highest of all servers' scores with probability weight / total weight
+  double u = (double(hash >> 11) + 0.5) / double(uint64_t(1) << 53);
+  return -weight / std::log(u);
+}
+
+// Returns the total size of each server's shards, and of all of them.
+static std::map<std::string, double> server_loads(
+    const std::map<std::string, std::vector<Shard>>& config, double* total) {
+  std::map<std::string, double> loads;
+  *total = 0;
+  for (auto&& [server, shards] : config) {
+    double load = 0;
+    for (auto&& shard : shards) load += shard_size(shard);
+    loads[server] = load;
+    *total += load;
+  }
+  return loads;
+}
+
+std::vector<PlannedMove> plan_leave(
+    const std::map<std::string, std::vector<Shard>>& config,
+    const std::string& leaving, const PlacementPolicy& policy) {
+  std::vector<PlannedMove> moves;
+  auto it = config.find(leaving);
+  if (it == config.end()) return moves;
+
+  double total;
+  std::map<std::string, double> loads = server_loads(config, &total);
+  loads.erase(leaving);
+  double total_weight = 0;
+  for (auto&& [server, _] : loads) total_weight += policy.weight(server);
+  if (loads.empty() || total_weight <= 0) return moves;
+
+  // Largest first, so that the small shards even out what the large ones
+  // leave
+  std::vector<Shard> shards = it->second;
+  std::sort(shards.begin(), shards.end(), [](auto&& a, auto&& b) {
+    double size_a = shard_size(a), size_b = shard_size(b);
+    return size_a != size_b ? size_a > size_b : a.lower < b.lower;
+  });
+  for (auto&& shard : shards) {
+    double size = shard_size(shard);
+    const std::string* best = nullptr;
+    double best_score = 0;
+    for (auto&& [server, load] : loads) {
+      double weight = policy.weight(server);
+      if (load + size > (1 + policy.slack) * total * weight / total_weight) {
+        continue;
+      }
+      double score = rendezvous_score(server, shard, weight);
+      if (!best || score > best_score) {
+        best = &server;
+        best_score = score;
+      }
+    }
+    if (!best) {
+      // The shard puts every server out of bounds
+      for (auto&& [server, load] : loads) {
+        double relative = (load + size) / policy.weight(server);
+        if (!best || relative < best_score) {
+          best = &server;
+          best_score = relative;
+        }
+      }
+    }
+    loads[*best] += size;
+    moves.push_back({shard, leaving, *best});
+  }
+  return moves;
+}
+
+std::vector<PlannedMove> plan_join(
+    const std::map<std::string, std::vector<Shard>>& config,
+    const std::string& joining, const PlacementPolicy& policy) {
+  std::vector<PlannedMove> moves;
+  if (!config.count(joining)) return moves;
+
+  double total;
+  std::map<std::string, double> loads = server_loads(config, &total);
+  double total_weight = 0;
+  for (auto&& [server, _] : loads) total_weight += policy.weight(server);
+  if (total <= 0 || total_weight <= 0) return moves;
+  auto share = [&](const std::string& server) {
+    return total * policy.weight(server) / total_weight;
+  };
+
+  struct Candidate {
+    Shard shard;
+    std::string from;
+    double size;
+    // How much more the joining server scores the shard than its server
+    double preference;
+  };
+  std::vector<Candidate> candidates;
+  double joining_weight = policy.weight(joining);
+  for (auto&& [server, shards] : config) {
+    if (server == joining) continue;
+    double weight = policy.weight(server);
+    for (auto&& shard : shards) {
+      candidates.push_back(
+          {shard, server, shard_size(shard),
+           rendezvous_score(joining, shard, joining_weight) /
+               rendezvous_score(server, shard, weight)});
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [](auto&& a, auto&& b) {
+    return a.preference > b.preference;
+  });
+
+  double target = share(joining);
+  double bound = (1 + policy.slack) * target;
+  for (auto&& candidate : candidates) {
+    if (loads[joining] >= target) break;
+    // Only from servers above their share, and not past the joining server's
+    // bound
+    if (loads[candidate.from] <= share(candidate.from) ||
+        loads[joining] + candidate.size > bound) {
+      continue;
+    }
+    loads[candidate.from] -= candidate.size;
+    loads[joining] += candidate.size;
+    moves.push_back({candidate.shard, candidate.from, joining});
+  }
+  return moves;
+}
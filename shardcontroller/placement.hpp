@@ -0,0 +1,70 @@
+#ifndef SHARDCONTROLLER_PLACEMENT_HPP
+#define SHARDCONTROLLER_PLACEMENT_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/shard.hpp"
+#include "shardcontroller/rebalancer.hpp"
+
+/*
+ * How the shardcontroller places shards when servers join and leave. Without
+ * a placement policy, a leaving server's shards all go to the first server
+ * left, and a joining server gets none until shards are moved to it.
+ *
+ * With one, shards move whole, and no more of them than it takes to keep
+ * each server near its share of the keyspace (its weight over the total): a
+ * leaving server's shards are spread over the servers left, and a joining
+ * server takes shards from the servers above their share until it has its
+ * own. Which shards go where is decided by weighted rendezvous hashing: each
+ * server scores each shard by a hash of the two, scaled by its weight, so a
+ * shard prefers the same servers whatever else is in the cluster. Loads are
+ * bounded, though: a server only takes a shard that leaves it within
+ * (1 + `slack`) times its share, so placement stays even where the hash
+ * isn't.
+ *
+ * A shard's size is the number of bounds (or slots, if hashed) it covers,
+ * which stands in for its data when keys spread evenly. Placement can't be
+ * more even than the shards are small, so it wants several shards per server,
+ * e.g. hashed ones (see split_hashed).
+ */
+struct PlacementPolicy {
+  double slack = 0.1;
+  // Weight of each server, e.g. its capacity; servers not in it weigh 1
+  std::map<std::string, double> weights;
+
+  double weight(const std::string& server) const {
+    auto it = this->weights.find(server);
+    return it == this->weights.end() ? 1 : it->second;
+  }
+};
+
+/*
+ * Plans where the shards of `leaving` go when it leaves `config`: largest
+ * first, each to the server left that scores it highest among those it stays
+ * within bounds on, or else to the one it leaves least loaded for its weight.
+ * Returns no moves if no server is left.
+ */
+std::vector<PlannedMove> plan_leave(
+    const std::map<std::string, std::vector<Shard>>& config,
+    const std::string& leaving, const PlacementPolicy& policy);
+
+/*
+ * Plans the shards `joining` (in `config`, without shards) takes from the
+ * servers above their share when it joins: first the shards that score it
+ * highest relative to their current server, while they keep it within
+ * bounds, until it has its share.
+ */
+std::vector<PlannedMove> plan_join(
+    const std::map<std::string, std::vector<Shard>>& config,
+    const std::string& joining, const PlacementPolicy& policy);
+
+// Returns the number of bounds `shard` covers (or slots, if it's hashed).
+double shard_size(const Shard& shard);
+
+// Returns the rendezvous score of `server` for `shard`, given its weight.
+double rendezvous_score(const std::string& server, const Shard& shard,
+                        double weight);
+
+#endif /* end of include guard */
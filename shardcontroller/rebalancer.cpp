@@ -0,0 +1,146 @@
+#include "shardcontroller/rebalancer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "net/routing_table.hpp"
+
+double shard_load(const ShardLoad& shard, const RebalancePolicy& policy) {
+  return shard.ops_per_sec + policy.bytes_weight * double(shard.bytes);
+}
+
+std::vector<PlannedMove> plan_rebalance(const std::vector<ServerLoad>& servers,
+                                        const RebalancePolicy& policy) {
+  struct Planned {
+    ShardLoad shard;
+    double load;
+    // Moved already, so it isn't moved again
+    bool pinned = false;
+  };
+  std::vector<std::vector<Planned>> shards(servers.size());
+  std::vector<double> totals(servers.size(), 0);
+  double sum = 0;
+  for (std::size_t i = 0; i < servers.size(); i++) {
+    for (auto&& shard : servers[i].shards) {
+      double load = shard_load(shard, policy);
+      shards[i].push_back({shard, load});
+      totals[i] += load;
+    }
+    sum += totals[i];
+  }
+
+  std::vector<PlannedMove> moves;
+  if (servers.size() < 2 || sum <= 0) return moves;
+  double mean = sum / double(servers.size());
+  while (moves.size() < policy.max_moves) {
+    auto [coolest, hottest] = std::minmax_element(totals.begin(), totals.end());
+    if (*hottest <= (1 + policy.threshold) * mean) break;
+    std::size_t from = hottest - totals.begin();
+    std::size_t to = coolest - totals.begin();
+    double gap = *hottest - *coolest;
+
+    // Moving a shard of load l leaves the two servers at hottest - l and
+    // coolest + l, both below hottest if 0 < l < gap; closest to even at gap/2
+    std::optional<std::size_t> best;
+    for (std::size_t i = 0; i < shards[from].size(); i++) {
+      const Planned& candidate = shards[from][i];
+      if (candidate.pinned || candidate.load <= 0 || candidate.load >= gap) {
+        continue;
+      }
+      if (!best || std::abs(candidate.load - gap / 2) <
+                       std::abs(shards[from][*best].load - gap / 2)) {
+        best = i;
+      }
+    }
+    if (!best) break;
+
+    Planned moved = shards[from][*best];
+    shards[from].erase(shards[from].begin() + *best);
+    totals[from] -= moved.load;
+    totals[to] += moved.load;
+    moved.pinned = true;
+    shards[to].push_back(moved);
+    moves.push_back(
+        {moved.shard.shard, servers[from].server, servers[to].server});
+  }
+  return moves;
+}
+
+// Digits of shard bounds, in order
+static constexpr char kBoundDigits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// Returns the bound right after `bound`, of the same length (e.g. "A0Z" ->
+// "A10", or "#0ZZ" -> "#100"), or std::nullopt if there's none.
+static std::optional<std::string> next_bound(std::string bound) {
+  for (std::size_t i = bound.size(); i > 0; i--) {
+    const char* digit =
+        std::find(kBoundDigits, kBoundDigits + 36, bound[i - 1]);
+    if (digit == kBoundDigits + 36) return std::nullopt;
+    if (*digit != 'Z') {
+      bound[i - 1] = digit[1];
+      return bound;
+    }
+    bound[i - 1] = '0';
+    // A hashed bound's digits follow its prefix
+    if (i == 2 && bound[0] == RoutingTable::HASH_SHARD_PREFIX) break;
+  }
+  return std::nullopt;
+}
+
+std::vector<PlannedMove> plan_reshard(const std::vector<ServerLoad>& servers,
+                                      const RebalancePolicy& policy) {
+  // Whether a shard's ops or bytes are under the merge threshold (if set),
+  // and under the split threshold (if set), so that it isn't split right back
+  auto mergeable = [](auto value, auto merge, auto split) {
+    return (merge == 0 || value < merge) && (split == 0 || value < split);
+  };
+  bool merging = policy.merge_ops > 0 || policy.merge_bytes > 0;
+
+  std::vector<PlannedMove> moves;
+  for (auto&& server : servers) {
+    std::vector<ShardLoad> shards = server.shards;
+    std::sort(shards.begin(), shards.end(), [](auto&& a, auto&& b) {
+      return a.shard.lower < b.shard.lower;
+    });
+    std::vector<bool> used(shards.size());
+    auto plan = [&](Shard shard) {
+      moves.push_back({std::move(shard), server.server, server.server});
+    };
+
+    for (std::size_t i = 0; i < shards.size(); i++) {
+      if (moves.size() >= policy.max_moves) return moves;
+      const ShardLoad& load = shards[i];
+      std::string split;
+      if (policy.split_ops > 0 && load.ops_per_sec > policy.split_ops) {
+        split = load.ops_split;
+      }
+      if (split.empty() && policy.split_bytes > 0 &&
+          load.bytes > policy.split_bytes) {
+        split = load.bytes_split;
+      }
+      if (split.empty()) continue;
+      used[i] = true;
+      plan({split, load.shard.upper});
+    }
+
+    for (std::size_t i = 0; merging && i + 1 < shards.size(); i++) {
+      if (moves.size() >= policy.max_moves) return moves;
+      const ShardLoad& a = shards[i];
+      const ShardLoad& b = shards[i + 1];
+      if (used[i] || used[i + 1] ||
+          next_bound(a.shard.upper) != b.shard.lower) {
+        continue;
+      }
+      if (!mergeable(a.ops_per_sec + b.ops_per_sec, policy.merge_ops,
+                     policy.split_ops) ||
+          !mergeable(a.bytes + b.bytes, policy.merge_bytes,
+                     policy.split_bytes)) {
+        continue;
+      }
+      used[i] = used[i + 1] = true;
+      plan({a.shard.lower, b.shard.upper});
+    }
+  }
+  return moves;
+}
@@ -0,0 +1,82 @@
+#ifndef SHARDCONTROLLER_REBALANCER_HPP
+#define SHARDCONTROLLER_REBALANCER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/shard.hpp"
+#include "net/shardcontroller_commands.hpp"
+
+/*
+ * How the shardcontroller rebalances shards between servers, from the loads
+ * they report. A shard's load is its ops/sec, plus `bytes_weight` per byte it
+ * stores; a server's is the sum of its shards'.
+ *
+ * Every `interval`, once every server with shards has reported under the
+ * current config and none is migrating, the shardcontroller plans up to
+ * `max_moves` moves (so at most that many migrations run at once), if the
+ * most loaded server is more than `threshold` (e.g. 0.25 for 25%) above the
+ * mean. Below that, small imbalances are left alone, so shards don't
+ * ping-pong between servers whose loads fluctuate.
+ *
+ * A shard too hot to move whole can be split first. Before balancing, a
+ * shard with more than `split_ops` ops/sec or `split_bytes` bytes (0 turns
+ * either off) is split in place, at the point its server reports halves its
+ * ops or bytes; later rounds place the halves. Adjacent shards on one server
+ * whose combined ops/sec and bytes are both below `merge_ops` and
+ * `merge_bytes` (and below the split thresholds, so that they aren't split
+ * right back) are merged, to keep the routing tables small. Merging is off
+ * unless one of the two is set.
+ */
+struct RebalancePolicy {
+  std::chrono::milliseconds interval{1000};
+  double threshold = 0.25;
+  std::size_t max_moves = 4;
+  // A MiB stored weighs as much as an op/sec
+  double bytes_weight = 1.0 / (1 << 20);
+
+  double split_ops = 0;
+  uint64_t split_bytes = 0;
+  double merge_ops = 0;
+  uint64_t merge_bytes = 0;
+};
+
+// The load a server reported on each of its shards
+struct ServerLoad {
+  std::string server;
+  std::vector<ShardLoad> shards;
+};
+
+// A planned move of `shard` from server `from` to server `to`. Splits and
+// merges are moves of the new shard to its own server.
+struct PlannedMove {
+  Shard shard;
+  std::string from;
+  std::string to;
+};
+
+/*
+ * Plans moves that even out the load between `servers`, following `policy`:
+ * greedily, while the most loaded server is above the threshold, moves to the
+ * least loaded one the shard whose load is closest to half the gap between
+ * them, as long as that leaves both below the most loaded server's current
+ * load. Each shard moves at most once. Returns no moves for a cluster within
+ * the threshold.
+ */
+std::vector<PlannedMove> plan_rebalance(const std::vector<ServerLoad>& servers,
+                                        const RebalancePolicy& policy);
+
+/*
+ * Plans the splits and merges of `servers`' shards that `policy` calls for
+ * (see above), up to `policy.max_moves` of them. Each shard takes part in at
+ * most one.
+ */
+std::vector<PlannedMove> plan_reshard(const std::vector<ServerLoad>& servers,
+                                      const RebalancePolicy& policy);
+
+// Returns the load of `shard` under `policy`.
+double shard_load(const ShardLoad& shard, const RebalancePolicy& policy);
+
+#endif /* end of include guard */
@@ -15,6 +15,11 @@ class Shardcontroller {
   virtual bool Leave(const LeaveRequest* req, LeaveResponse* res) = 0;
   virtual bool Move(const MoveRequest* req, MoveResponse* res) = 0;
   virtual bool Query(const QueryRequest* req, QueryResponse* res) = 0;
+  // Blocks until the config changes from the request's version (or the
+  // request times out), then returns what changed.
+  virtual bool Watch(const WatchRequest* req, WatchResponse* res) = 0;
+  // Records the load a server reports on its shards.
+  virtual bool Report(const ReportRequest* req, ReportResponse* res) = 0;
 
   virtual int start() = 0;
   virtual void stop() = 0;
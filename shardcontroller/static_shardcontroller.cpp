@@ -1,10 +1,163 @@
 #include "static_shardcontroller.hpp"
 
+#include <algorithm>
+#include <optional>
+#include <set>
+
 bool StaticShardController::Query(const QueryRequest*, QueryResponse* res) {
+  std::shared_lock lock(this->config_mtx);
   res->config = config;
+  res->version = this->version;
+  return true;
+}
+
+void StaticShardController::config_changed() {
+  this->version++;
+  this->history.emplace_back(this->version, this->config);
+  if (this->history.size() > WATCH_HISTORY) {
+    this->history.pop_front();
+  }
+  this->config_cv.notify_all();
+}
+
+bool StaticShardController::Watch(const WatchRequest* req,
+                                  WatchResponse* res) {
+  std::unique_lock lock(this->config_mtx);
+  auto changed = [&] {
+    return this->is_stopped || this->version != req->version;
+  };
+  if (req->timeout_ms) {
+    this->config_cv.wait_for(lock, milliseconds(req->timeout_ms), changed);
+  } else {
+    this->config_cv.wait(lock, changed);
+  }
+  if (this->is_stopped) return false;
+
+  res->version = this->version;
+  res->full = false;
+  res->changed.clear();
+  res->removed.clear();
+  if (this->version == req->version) return true;
+
+  auto old = std::find_if(this->history.begin(), this->history.end(),
+                          [&](auto&& entry) {
+                            return entry.first == req->version;
+                          });
+  if (old == this->history.end()) {
+    res->full = true;
+    res->changed = this->config.server_to_shards;
+    return true;
+  }
+
+  const auto& old_shards = old->second.server_to_shards;
+  for (auto&& [server, shards] : this->config.server_to_shards) {
+    auto it = old_shards.find(server);
+    if (it == old_shards.end() || it->second != shards) {
+      res->changed[server] = shards;
+    }
+  }
+  for (auto&& [server, _] : old_shards) {
+    if (!this->config.server_to_shards.count(server)) {
+      res->removed.push_back(server);
+    }
+  }
   return true;
 }
 
+bool StaticShardController::Report(const ReportRequest* req,
+                                   ReportResponse*) {
+  {
+    std::shared_lock lock(this->config_mtx);
+    if (!this->config.server_to_shards.count(req->server)) return false;
+  }
+  std::lock_guard lock(this->load_mtx);
+  this->reports[req->server] = *req;
+  return true;
+}
+
+void StaticShardController::set_rebalance_policy(
+    const RebalancePolicy& policy) {
+  {
+    std::lock_guard lock(this->load_mtx);
+    this->rebalance_policy = policy;
+  }
+  if (!this->rebalancer.joinable()) {
+    this->rebalancer =
+        std::thread(&StaticShardController::rebalance_loop, this);
+  }
+}
+
+void StaticShardController::set_placement_policy(
+    const PlacementPolicy& policy) {
+  std::unique_lock lock(this->config_mtx);
+  this->placement_policy = policy;
+}
+
+void StaticShardController::rebalance_loop() {
+  while (true) {
+    milliseconds interval;
+    {
+      std::lock_guard lock(this->load_mtx);
+      interval = this->rebalance_policy->interval;
+    }
+    {
+      std::unique_lock lock(this->config_mtx);
+      this->config_cv.wait_for(lock, interval,
+                               [this] { return this->is_stopped.load(); });
+      if (this->is_stopped) return;
+    }
+    this->rebalance();
+  }
+}
+
+std::size_t StaticShardController::rebalance() {
+  // The moves are issued under the same lock they're planned under, so that
+  // a Join, Leave or Move in between can't leave them planned for a config
+  // that's gone (e.g. moving a shard to a server that has just left)
+  std::unique_lock config_lock(this->config_mtx);
+  std::vector<ServerLoad> loads;
+  RebalancePolicy policy;
+  {
+    std::lock_guard lock(this->load_mtx);
+    policy = *this->rebalance_policy;
+    for (auto&& [server, shards] : this->config.server_to_shards) {
+      auto report = this->reports.find(server);
+      if (shards.empty()) {
+        // Servers without shards needn't report to be moved to
+        loads.push_back({server, {}});
+        continue;
+      }
+      if (report == this->reports.end() ||
+          report->second.version != this->version ||
+          report->second.migrating) {
+        return 0;
+      }
+      loads.push_back({server, report->second.loads});
+    }
+  }
+
+  // Splits and merges change the shards the loads are reported for, so
+  // balancing waits for the next round
+  std::vector<PlannedMove> moves = plan_reshard(loads, policy);
+  if (moves.empty()) moves = plan_rebalance(loads, policy);
+  // One Move per destination, so that each server migrates once
+  std::map<std::string, std::vector<Shard>> by_destination;
+  for (auto&& move : moves) {
+    if (move.from == move.to) {
+      cout_color(DIM, "Resharding ", move.shard, " on ", move.to);
+    } else {
+      cout_color(DIM, "Rebalancing ", move.shard, " from ", move.from, " to ",
+                 move.to);
+    }
+    by_destination[move.to].push_back(move.shard);
+  }
+  for (auto&& [server, shards] : by_destination) {
+    MoveRequest req{server, shards};
+    this->move_shards(&req);
+  }
+  return moves.size();
+}
+
 bool StaticShardController::Join(const JoinRequest* req, JoinResponse*) {
   config_mtx.lock();
   // check if server already joined
@@ -16,6 +169,17 @@ bool StaticShardController::Join(const JoinRequest* req, JoinResponse*) {
   config.server_to_shards[req->server] = std::vector<Shard>();
   cout_color(BLUE, "Added server ", req->server,
              " to shardcontroller configuration.");
+  if (this->placement_policy) {
+    for (auto&& move : plan_join(this->config.server_to_shards, req->server,
+                                 *this->placement_policy)) {
+      std::vector<Shard>& from = this->config.server_to_shards[move.from];
+      from.erase(std::find(from.begin(), from.end(), move.shard));
+      this->config.server_to_shards[move.to].push_back(move.shard);
+      cout_color(DIM, "Placing ", move.shard, " from ", move.from, " on ",
+                 move.to);
+    }
+  }
+  config_changed();
   config_mtx.unlock();
   return true;
 }
@@ -28,8 +192,16 @@ bool StaticShardController::Leave(const LeaveRequest* req, LeaveResponse*) {
     return 0;
   }
 
-  // if there is another server, add keys to that server
-  if (config.server_to_shards.size() > 1){
+  if (this->placement_policy) {
+    for (auto&& move : plan_leave(this->config.server_to_shards, req->server,
+                                  *this->placement_policy)) {
+      this->config.server_to_shards[move.to].push_back(move.shard);
+      cout_color(DIM, "Placing ", move.shard, " from ", move.from, " on ",
+                 move.to);
+    }
+    this->config.server_to_shards.erase(req->server);
+  } else if (config.server_to_shards.size() > 1){
+    // if there is another server, add keys to that server
     // make sure the second server isn't the same as the the leaving server
     if (config.server_to_shards.begin()->first != req->server){
       for (Shard shard : config.server_to_shards[req->server]){
@@ -51,15 +223,19 @@ bool StaticShardController::Leave(const LeaveRequest* req, LeaveResponse*) {
 
   cout_color(BLUE, "Deleted server ", req->server,
              " on shardcontroller configuration.");
+  config_changed();
   config_mtx.unlock();
   return true;
 }
 
 bool StaticShardController::Move(const MoveRequest* req, MoveResponse*) {
-  config_mtx.lock();
+  std::unique_lock lock(this->config_mtx);
+  return this->move_shards(req);
+}
+
+bool StaticShardController::move_shards(const MoveRequest* req) {
   // check if request moves to a server that doesn't exist
   if (config.server_to_shards.find(req->server) == config.server_to_shards.end()) {
-    config_mtx.unlock();
     return 0;
   }
 
@@ -68,52 +244,81 @@ bool StaticShardController::Move(const MoveRequest* req, MoveResponse*) {
   // compute the modified shard and insert it into 'new_shards.' Once the loop
   // ends, we replace the server's shards with 'new_shards.' You'll find the
   // 'split_shard' function helpful (c.f. shard.hpp).
-  for (Shard moved : req->shards) {
-    for (auto&& [server, shards] : this->config.server_to_shards) {
-      std::vector<Shard> new_shards;
-      for (Shard shard : shards) {
-        // If the moved shard doesn't have the same granularity as the
-        // current shard, emit an error and return
-        if (moved.granularity() != shard.granularity()) {
-          cerr_color(RED,
-                     "Moving differing shard granularities not "
-                     "currently supported.");
-          config_mtx.unlock();
-          return false;
-        }
+  //
+  // With many small shards (e.g. hashed ones), comparing every moved shard
+  // with every shard is slow, so the moved shards are sorted, and each shard
+  // is only cut by the ones whose range reaches it.
+  //
+  // If a moved shard doesn't have the same granularity as every current
+  // shard, emit an error and return
+  std::set<std::size_t> granularities, moved_granularities;
+  for (auto&& [server, shards] : this->config.server_to_shards) {
+    for (auto&& shard : shards) granularities.insert(shard.granularity());
+  }
+  for (auto&& moved : req->shards) {
+    moved_granularities.insert(moved.granularity());
+  }
+  if (!granularities.empty() && !moved_granularities.empty()) {
+    granularities.merge(moved_granularities);
+    if (granularities.size() > 1) {
+      cerr_color(RED,
+                 "Moving differing shard granularities not "
+                 "currently supported.");
+      return false;
+    }
+  }
+  std::vector<Shard> moved = req->shards;
+  std::sort(moved.begin(), moved.end(),
+            [](auto&& a, auto&& b) { return a.lower < b.lower; });
+  // The highest upper bound of the moved shards up to each one, so that the
+  // first one that can reach a shard is found by binary search even if the
+  // moved shards overlap
+  std::vector<std::string> reach;
+  for (auto&& shard : moved) {
+    reach.push_back(reach.empty() ? shard.upper
+                                  : std::max(reach.back(), shard.upper));
+  }
+
+  for (auto&& [server, shards] : this->config.server_to_shards) {
+    std::vector<Shard> new_shards;
+    for (Shard shard : shards) {
+      // What's left of the shard, once the moved shards before it are cut out
+      std::optional<Shard> rest = shard;
+      std::size_t i = std::lower_bound(reach.begin(), reach.end(),
+                                       shard.lower) -
+                      reach.begin();
+      for (; rest && i < moved.size() && moved[i].lower <= rest->upper; i++) {
         // Using overlap status, determine whether shards need to be
         // modified
-        OverlapStatus os = get_overlap(shard, moved);
-        
-        switch (os) {
-          case OverlapStatus::NO_OVERLAP: {
+        switch (get_overlap(*rest, moved[i])) {
+          case OverlapStatus::NO_OVERLAP:
             // keep entire shard
-            new_shards.push_back(shard);
-            continue;
-          }
-          case OverlapStatus::OVERLAP_START: {
+            break;
+          case OverlapStatus::OVERLAP_START:
             // move from start of A to right of B
-            new_shards.push_back(split_shard(shard, moved.upper, true).second);
-            continue;
-          }
-          case OverlapStatus::OVERLAP_END: {
+            rest = split_shard(*rest, moved[i].upper, true).second;
+            break;
+          case OverlapStatus::OVERLAP_END:
             // move from start of B to end of A
-            new_shards.push_back(split_shard(shard, moved.lower, false).first);
-            continue;
-          }
-          case OverlapStatus::COMPLETELY_CONTAINS: {
+            new_shards.push_back(
+                split_shard(*rest, moved[i].lower, false).first);
+            rest = std::nullopt;
+            break;
+          case OverlapStatus::COMPLETELY_CONTAINS:
             // move from start of B to end of B
-            new_shards.push_back(split_shard(shard, moved.lower, false).first);
-            new_shards.push_back(split_shard(shard, moved.upper, true).second);
-            continue;
-          }
+            new_shards.push_back(
+                split_shard(*rest, moved[i].lower, false).first);
+            rest = split_shard(*rest, moved[i].upper, true).second;
+            break;
           case OverlapStatus::COMPLETELY_CONTAINED:
             // move all of A so there are no shards
-            continue;
+            rest = std::nullopt;
+            break;
         }
       }
-      shards = std::move(new_shards);
+      if (rest) new_shards.push_back(*rest);
     }
+    shards = std::move(new_shards);
   }
 
   // Now, actually move the shard onto the target server!
@@ -124,7 +329,7 @@ bool StaticShardController::Move(const MoveRequest* req, MoveResponse*) {
   cout_color(DIM, "Moved the following shards to server ", req->server, ":");
   for (auto&& s : req->shards) print_color(std::cout, DIM, s, " ");
   std::cout << '\n';
-  config_mtx.unlock();
+  config_changed();
   return true;
 }
 
@@ -148,12 +353,18 @@ int StaticShardController::start() {
 }
 
 void StaticShardController::stop() {
-  this->is_stopped = true;
+  {
+    // Under the lock, so that no watcher misses the wakeup
+    std::unique_lock lock(this->config_mtx);
+    this->is_stopped = true;
+  }
+  this->config_cv.notify_all();
 
   // Shutdown listener, and stop accepting clients
   shutdown(this->listener_fd, SHUT_RDWR);
   cout_color(BLUE, "Joining listener thread...");
   this->client_listener.join();
+  if (this->rebalancer.joinable()) this->rebalancer.join();
 
   // Close all connections
   cout_color(BLUE, "Closing all connections...");
@@ -254,6 +465,20 @@ Response StaticShardController::process_request(Request req) {
     } else {
       res = ErrorResponse{"Failed to process Query request."};
     }
+  } else if (auto* watch_req = std::get_if<WatchRequest>(&req)) {
+    WatchResponse watch_res{};
+    if (this->Watch(watch_req, &watch_res)) {
+      res = std::move(watch_res);
+    } else {
+      res = ErrorResponse{"Failed to process Watch request."};
+    }
+  } else if (auto* report_req = std::get_if<ReportRequest>(&req)) {
+    ReportResponse report_res{};
+    if (this->Report(report_req, &report_res)) {
+      res = report_res;
+    } else {
+      res = ErrorResponse{"Failed to process Report request."};
+    }
   } else {
     throw std::logic_error{"invalid request variant!"};
   }
@@ -2,6 +2,7 @@
 #define STATIC_SHARDCONTROLLER_HPP
 
 #include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <shared_mutex>
@@ -13,6 +14,8 @@
 #include "net/network_helpers.hpp"
 #include "net/network_messages.hpp"
 #include "shardcontroller.hpp"
+#include "shardcontroller/placement.hpp"
+#include "shardcontroller/rebalancer.hpp"
 
 class StaticShardController : public Shardcontroller {
  public:
@@ -28,6 +31,20 @@ class StaticShardController : public Shardcontroller {
   bool Join(const JoinRequest* req, JoinResponse*) override;
   bool Leave(const LeaveRequest* req, LeaveResponse*) override;
   bool Move(const MoveRequest* req, MoveResponse*) override;
+  bool Watch(const WatchRequest* req, WatchResponse* res) override;
+  bool Report(const ReportRequest* req, ReportResponse*) override;
+
+  /*
+   * Turns on rebalancing shards between servers by the load they report (see
+   * RebalancePolicy); it's off by default. Servers must report their load
+   * (see KvServer::set_load_report_interval) for any shards to move.
+   */
+  void set_rebalance_policy(const RebalancePolicy& policy);
+  /*
+   * Turns on spreading shards over the servers as they join and leave (see
+   * PlacementPolicy); it's off by default.
+   */
+  void set_placement_policy(const PlacementPolicy& policy);
 
   int start() override;
   void stop() override;
@@ -37,6 +54,42 @@ class StaticShardController : public Shardcontroller {
   ShardControllerConfig config;
   std::shared_mutex config_mtx;
 
+  // Number of past configs kept, to send watchers only what changed since
+  // the version they have. Watchers further behind get the whole config.
+  static constexpr std::size_t WATCH_HISTORY = 32;
+
+  // Version of the config, incremented on every change, and the most recent
+  // configs by version (including the current one), all guarded by
+  // config_mtx. Watchers wait on config_cv for the version to change.
+  uint64_t version = 0;
+  std::deque<std::pair<uint64_t, ShardControllerConfig>> history = {{0, {}}};
+  std::condition_variable_any config_cv;
+
+  // Records a change to the config, with config_mtx held: bumps its version,
+  // keeps it in the history, and wakes up watchers.
+  void config_changed();
+
+  // How Join and Leave place shards, if they do, guarded by config_mtx
+  std::optional<PlacementPolicy> placement_policy;
+
+  // The latest load report of each server, and the rebalancing policy, if
+  // rebalancing is on, guarded by load_mtx. The rebalancer thread plans and
+  // issues moves every policy interval, waiting on config_cv in between.
+  std::map<std::string, ReportRequest> reports;
+  std::optional<RebalancePolicy> rebalance_policy;
+  std::mutex load_mtx;
+  std::thread rebalancer;
+
+  void rebalance_loop();
+  // Plans splits and merges, or else moves, from the servers' reports and
+  // issues them, if every server with shards has reported under the current
+  // config and isn't migrating; all under config_mtx, so the config can't
+  // change between planning and moving. Returns the number of shards moved.
+  std::size_t rebalance();
+
+  // Move's body, with config_mtx held.
+  bool move_shards(const MoveRequest* req);
+
   /* ==================================================*/
   /* === INTERNALS: DO NOT MODIFY BELOW THIS LINE ===  */
   /* ==================================================*/
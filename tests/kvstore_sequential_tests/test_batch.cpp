@@ -0,0 +1,70 @@
+#include "test_utils/test_utils.hpp"
+
+constexpr std::size_t kRandStringLength = 12;
+constexpr std::size_t kNumKVPairs = 1 << 8;  // 2^8
+
+void test_batch_ops_in_order(std::unique_ptr<KvStore> store) {
+  auto key = random_string(kRandStringLength);
+  auto missing_key = random_string(kRandStringLength);
+
+  // Later operations see the effects of earlier ones in the same batch
+  auto batch_req = BatchRequest{.ops = {
+                                    {BatchOpType::GET, key, ""},
+                                    {BatchOpType::PUT, key, "a"},
+                                    {BatchOpType::APPEND, key, "b"},
+                                    {BatchOpType::GET, key, ""},
+                                    {BatchOpType::DELETE, key, ""},
+                                    {BatchOpType::DELETE, missing_key, ""},
+                                    {BatchOpType::APPEND, missing_key, "c"},
+                                    {BatchOpType::GET, missing_key, ""},
+                                }};
+  auto batch_res = BatchResponse{};
+  ASSERT(store->Batch(&batch_req, &batch_res));
+  ASSERT_EQ(batch_res.results.size(), batch_req.ops.size());
+
+  // A failed Get or Delete doesn't stop the rest of the batch
+  std::vector<bool> oks = {false, true, true, true, true, false, true, true};
+  std::vector<std::string> values = {"", "", "", "ab", "ab", "", "", "c"};
+  for (std::size_t i = 0; i < oks.size(); i++) {
+    ASSERT_EQ(batch_res.results[i].ok, oks[i]);
+    ASSERT_EQ(batch_res.results[i].value, values[i]);
+  }
+
+  auto get_req = GetRequest{.key = key};
+  auto get_res = GetResponse{};
+  ASSERT(!store->Get(&get_req, &get_res));
+}
+
+void test_big_batch(std::unique_ptr<KvStore> store) {
+  auto keys = make_rand_strs(kNumKVPairs, kRandStringLength);
+  auto vals = make_rand_strs(kNumKVPairs, kRandStringLength);
+
+  // Puts and Gets interleaved over many buckets
+  auto batch_req = BatchRequest{};
+  for (std::size_t i = 0; i < kNumKVPairs; i++) {
+    batch_req.ops.push_back({BatchOpType::PUT, keys[i], vals[i]});
+    batch_req.ops.push_back({BatchOpType::GET, keys[i], ""});
+  }
+  auto batch_res = BatchResponse{};
+  ASSERT(store->Batch(&batch_req, &batch_res));
+  ASSERT_EQ(batch_res.results.size(), batch_req.ops.size());
+  for (std::size_t i = 0; i < kNumKVPairs; i++) {
+    ASSERT(batch_res.results[2 * i + 1].ok);
+    ASSERT_EQ(batch_res.results[2 * i + 1].value, vals[i]);
+  }
+
+  auto multiget_req = MultiGetRequest{.keys = keys};
+  auto multiget_res = MultiGetResponse{};
+  ASSERT(store->MultiGet(&multiget_req, &multiget_res));
+  ASSERT_EQ_VECS(multiget_res.values, vals);
+}
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+  TEST(test_batch_ops_in_order, std::move(store));
+
+  store = make_kvstore(argc, argv);
+  TEST(test_big_batch, std::move(store));
+
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include "test_utils/test_utils.hpp"
+
+constexpr std::size_t kRandStringLength = 12;
+constexpr std::size_t kNumKVPairs = 20;
+
+int main(int argc, char* argv[]) {
+  auto store = make_kvstore(argc, argv);
+
+  auto keys = make_rand_strs(kNumKVPairs, kRandStringLength);
+  auto vals = make_rand_strs(kNumKVPairs, kRandStringLength);
+
+  // insert every other key-value pair
+  auto put_req = PutRequest{};
+  auto put_res = PutResponse{};
+  std::vector<std::string> present_vals;
+  for (std::size_t i = 0; i < kNumKVPairs; i += 2) {
+    put_req.key = keys[i];
+    put_req.value = vals[i];
+    ASSERT(store->Put(&put_req, &put_res));
+    present_vals.push_back(vals[i]);
+  }
+
+  // A partial MultiGet succeeds anyway, and reports which keys exist
+  auto multiget_req = MultiGetRequest{.keys = keys, .partial = true};
+  auto multiget_res = MultiGetResponse{};
+  ASSERT(store->MultiGet(&multiget_req, &multiget_res));
+  ASSERT_EQ(multiget_res.present.size(), (kNumKVPairs + 7) / 8);
+  for (std::size_t i = 0; i < kNumKVPairs; i++) {
+    ASSERT_EQ(multiget_res.is_present(i), i % 2 == 0);
+  }
+  ASSERT_EQ_VECS(multiget_res.values, present_vals);
+
+  // A regular MultiGet still fails
+  multiget_req.partial = false;
+  multiget_res = MultiGetResponse{};
+  ASSERT(!store->MultiGet(&multiget_req, &multiget_res));
+}
@@ -0,0 +1,172 @@
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "net/lz_codec.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_VALUES = 64;
+static constexpr std::size_t VALUE_SIZE = 16 * 1024;
+static constexpr std::size_t N_CODEC_ROUNDS = 20;
+static constexpr std::size_t N_MULTIPUTS = 50;
+static constexpr std::size_t kRandStringLength = 10;
+
+// JSON records like the ones our clients store
+static std::string make_json_value(std::mt19937& rng) {
+  std::string value = "[";
+  while (value.size() < VALUE_SIZE) {
+    value += "{\"user_id\":" + std::to_string(rng() % 100000) +
+             ",\"name\":\"user" + std::to_string(rng() % 1000) +
+             "\",\"active\":" + (rng() % 2 ? "true" : "false") +
+             ",\"tags\":[\"a\",\"b\"],\"score\":" +
+             std::to_string(rng() % 100) + "},";
+  }
+  value.back() = ']';
+  return value;
+}
+
+// Incompressible bytes
+static std::string make_random_value(std::mt19937& rng) {
+  std::string value(VALUE_SIZE, '\0');
+  for (auto& c : value) {
+    c = static_cast<char>(rng());
+  }
+  return value;
+}
+
+// English-ish text, drawn from a small vocabulary
+static std::string make_text_value(std::mt19937& rng) {
+  static const std::vector<std::string> words = {
+      "the",  "shard",   "server", "moves",  "keys", "to",
+      "a",    "new",     "group",  "while",  "the",  "client",
+      "its",  "request", "on",     "stale",  "and",  "config",
+      "then", "retries", "until",  "it",     "succeeds"};
+  std::string value;
+  while (value.size() < VALUE_SIZE) {
+    value += words[rng() % words.size()];
+    value += ' ';
+  }
+  return value;
+}
+
+/*
+ * Reports the codec's compression ratio and throughput on N_VALUES values of
+ * one type, and checks that every value round-trips.
+ */
+static void bench_codec(const std::string& name,
+                        const std::vector<std::string>& values) {
+  std::vector<std::byte> compressed, decompressed;
+  std::size_t in_bytes = 0, out_bytes = 0;
+  for (auto&& value : values) {
+    auto* data = reinterpret_cast<const std::byte*>(value.data());
+    in_bytes += value.size();
+    if (lz_compress(data, value.size(), &compressed)) {
+      out_bytes += compressed.size();
+      ASSERT(
+          lz_decompress(compressed.data(), compressed.size(), &decompressed));
+      ASSERT(decompressed.size() == value.size() &&
+             memcmp(decompressed.data(), data, value.size()) == 0);
+    } else {
+      // Sent uncompressed
+      out_bytes += value.size();
+    }
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < N_CODEC_ROUNDS; i++) {
+    for (auto&& value : values) {
+      lz_compress(reinterpret_cast<const std::byte*>(value.data()),
+                  value.size(), &compressed);
+    }
+  }
+  auto mid = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < N_CODEC_ROUNDS; i++) {
+    for (auto&& value : values) {
+      if (lz_compress(reinterpret_cast<const std::byte*>(value.data()),
+                      value.size(), &compressed)) {
+        lz_decompress(compressed.data(), compressed.size(), &decompressed);
+      }
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+
+  double mb = double(in_bytes) * N_CODEC_ROUNDS / (1 << 20);
+  double compress_secs = std::chrono::duration<double>(mid - start).count();
+  // The second loop compresses too, so take that back out
+  double decompress_secs =
+      std::chrono::duration<double>(end - mid).count() - compress_secs;
+  cout_color(BLUE, name, ": ratio ", double(in_bytes) / out_bytes,
+             ", compress ", mb / compress_secs, " MB/s, decompress ",
+             decompress_secs > 0 ? mb / decompress_secs : 0, " MB/s");
+}
+
+/*
+ * Loopback MultiPut throughput with the given compression threshold (0 for
+ * none), followed by a MultiGet to check the values made it intact.
+ */
+static void bench_multiput(const std::string& addr, const std::string& name,
+                           const std::vector<std::string>& values,
+                           size_t threshold) {
+  set_compression_threshold(threshold);
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 4);
+  std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+  ASSERT(conn);
+
+  std::vector<std::string> keys =
+      make_rand_strs(values.size(), kRandStringLength);
+  MultiPutRequest req{keys, values};
+  auto start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < N_MULTIPUTS; i++) {
+    ASSERT(conn->send_request(req));
+    auto res = conn->recv_response();
+    ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+
+  ASSERT(conn->send_request(MultiGetRequest{keys}));
+  auto res = conn->recv_response();
+  ASSERT(res);
+  auto* multiget = std::get_if<MultiGetResponse>(&*res);
+  ASSERT(multiget);
+  ASSERT_EQ_VECS(multiget->values, values);
+
+  double mb = 0;
+  for (auto&& value : values) {
+    mb += value.size();
+  }
+  mb = mb * N_MULTIPUTS / (1 << 20);
+  double secs = std::chrono::duration<double>(end - start).count();
+  cout_color(BLUE, name, " MultiPut, compression ",
+             threshold ? "on" : "off", ": ", mb / secs, " MB/s");
+
+  conn->shutdown();
+  server->stop();
+}
+
+int main() {
+  std::mt19937 rng(42);
+  using ValueMaker = std::function<std::string(std::mt19937&)>;
+  std::vector<std::pair<std::string, ValueMaker>> types = {
+      {"json", make_json_value},
+      {"text", make_text_value},
+      {"random", make_random_value}};
+
+  std::vector<std::string> addresses = make_server_addresses(2 * types.size());
+  std::size_t next_addr = 0;
+  for (auto&& [name, make_value] : types) {
+    std::vector<std::string> values;
+    for (std::size_t i = 0; i < N_VALUES; i++) {
+      values.push_back(make_value(rng));
+    }
+    bench_codec(name, values);
+    bench_multiput(addresses[next_addr++], name, values, 0);
+    bench_multiput(addresses[next_addr++], name, values,
+                   DEFAULT_COMPRESSION_THRESHOLD);
+  }
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
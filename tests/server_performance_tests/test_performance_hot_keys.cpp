@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_WORKERS = 2;
+static constexpr std::size_t N_CLIENTS = 32;
+static constexpr std::size_t N_OPS_PER_CLIENT = 2'000;
+static constexpr std::size_t N_KEYS = 10'000;
+static constexpr std::size_t VALUE_SIZE = 1024;
+static constexpr double ZIPF_EXPONENT = 0.99;
+static constexpr std::size_t kRandStringLength = 10;
+
+/*
+ * Draws key indices in [0, n) with P(i) proportional to 1 / (i + 1)^s, as
+ * YCSB does for its hot-key workloads: with s = 0.99 and 10'000 keys, the
+ * hottest key gets ~10% of requests.
+ */
+class Zipfian {
+ public:
+  Zipfian(std::size_t n, double s) : cdf(n) {
+    double sum = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      sum += 1 / std::pow(double(i + 1), s);
+      this->cdf[i] = sum;
+    }
+    for (auto& c : this->cdf) c /= sum;
+  }
+
+  std::size_t operator()(std::mt19937& rng) {
+    double u = std::uniform_real_distribution<double>{}(rng);
+    auto it = std::lower_bound(this->cdf.begin(), this->cdf.end(), u);
+    return std::min<std::size_t>(it - this->cdf.begin(), this->cdf.size() - 1);
+  }
+
+ private:
+  std::vector<double> cdf;
+};
+
+/*
+ * Loopback benchmark of Gets under a hot-key (zipfian) and a uniform key
+ * distribution. N_CLIENTS clients each keep a connection to the server and
+ * issue back-to-back Gets; we report throughput, and the share of Gets the
+ * workers served from an identical, concurrent Get's response.
+ */
+void run_benchmark(const std::string& addr, bool zipfian) {
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(
+          addr, uint64_t{N_WORKERS});
+
+  auto keys = make_rand_strs(N_KEYS, kRandStringLength);
+  std::vector<std::string> vals;
+  for (std::size_t i = 0; i < N_KEYS; i++) {
+    vals.push_back(std::string(VALUE_SIZE, char('a' + i % 26)));
+  }
+  {
+    std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+    ASSERT(conn);
+    ASSERT(conn->send_request(MultiPutRequest{keys, vals}));
+    auto res = conn->recv_response();
+    ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+  }
+
+  Zipfian zipf(N_KEYS, ZIPF_EXPONENT);
+  auto client = [&](std::size_t i) {
+    std::mt19937 rng(i);
+    std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+    ASSERT(conn);
+    Response res;
+    for (std::size_t op = 0; op < N_OPS_PER_CLIENT; op++) {
+      std::size_t k = zipfian ? zipf(rng) : rng() % N_KEYS;
+      ASSERT(conn->send_request(GetRequest{keys[k]}));
+      ASSERT(conn->recv_response(&res));
+      auto* get = std::get_if<GetResponse>(&res);
+      ASSERT(get);
+      ASSERT_EQ(get->value, vals[k]);
+    }
+  };
+
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < N_CLIENTS; i++) {
+      threads.emplace_back(client, i);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto time =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+  double n_ops = N_CLIENTS * N_OPS_PER_CLIENT;
+  cout_color(BLUE, zipfian ? "zipfian" : "uniform", ": ",
+             to_throughput(time, N_CLIENTS, N_OPS_PER_CLIENT), " ops/sec, ",
+             100 * server->get_coalesced_gets() / n_ops, "% of Gets coalesced");
+
+  server->stop();
+}
+
+int main() {
+  std::vector<std::string> addresses = make_server_addresses(2);
+
+  run_benchmark(addresses[0], true);
+  run_benchmark(addresses[1], false);
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
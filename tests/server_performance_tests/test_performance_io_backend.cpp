@@ -0,0 +1,77 @@
+#include <string>
+
+#include "net/io_engine.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_CLIENTS = 8;
+static constexpr std::size_t N_OPS_PER_CLIENT = 2'000;
+static constexpr std::size_t kRandStringLength = 10;
+
+/*
+ * Loopback benchmark comparing the worker I/O backends. N_CLIENTS clients each
+ * keep a persistent connection to the server and alternate Puts and Gets on
+ * it; we report throughput, and the number of system calls the workers issued
+ * per operation, socket reads and writes included. Both backends only report
+ * readiness, so each request still takes a recv and each response a send.
+ */
+void run_benchmark(const std::string& addr, IoBackend backend) {
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t, IoBackend&>(
+          addr, 4, backend);
+
+  std::vector<std::vector<std::string>> keys(N_CLIENTS);
+  for (std::size_t i = 0; i < N_CLIENTS; i++) {
+    keys[i] = make_rand_strs(N_OPS_PER_CLIENT / 2, kRandStringLength);
+  }
+
+  auto client = [&](std::size_t i) {
+    std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+    ASSERT(conn);
+    for (auto&& key : keys[i]) {
+      ASSERT(conn->send_request(PutRequest{key, key}));
+      auto put_res = conn->recv_response();
+      ASSERT(put_res && std::get_if<PutResponse>(&*put_res));
+
+      ASSERT(conn->send_request(GetRequest{key}));
+      auto get_res = conn->recv_response();
+      ASSERT(get_res);
+      auto* get = std::get_if<GetResponse>(&*get_res);
+      ASSERT(get);
+      ASSERT_EQ(get->value, key);
+    }
+  };
+
+  uint64_t syscalls_before = server->get_io_syscalls();
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < N_CLIENTS; i++) {
+      threads.emplace_back(client, i);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  uint64_t syscalls = server->get_io_syscalls() - syscalls_before;
+
+  double n_ops = N_CLIENTS * N_OPS_PER_CLIENT;
+  cout_color(BLUE, io_backend_name(server->get_io_backend()), ": ",
+             to_throughput(time, N_CLIENTS, N_OPS_PER_CLIENT), " ops/sec, ",
+             syscalls / n_ops, " syscalls/op");
+
+  server->stop();
+}
+
+int main() {
+  std::vector<std::string> addresses = make_server_addresses(2);
+
+  run_benchmark(addresses[0], IoBackend::EPOLL);
+  // Falls back to (and reports) epoll if io_uring isn't available
+  run_benchmark(addresses[1], IoBackend::URING);
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include <unistd.h>
+
+#include <string>
+
+#include "net/network_conn.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_ROUND_TRIPS = 20'000;
+static constexpr std::size_t kRandStringLength = 10;
+
+/*
+ * Local latency benchmark: one client does N_ROUND_TRIPS sequential Gets to a
+ * server on the same host, over TCP loopback, a Unix domain socket, and a
+ * shared-memory channel, and we report the mean round trip of each.
+ */
+void run_benchmark(const std::string& addr, const std::string& key) {
+  std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+  ASSERT(conn);
+
+  Response res;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < N_ROUND_TRIPS; i++) {
+    ASSERT(conn->send_request(GetRequest{key}));
+    ASSERT(conn->recv_response(&res));
+    auto* get_res = std::get_if<GetResponse>(&res);
+    ASSERT(get_res);
+    ASSERT_EQ(get_res->value, key);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  auto latency =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start) /
+      N_ROUND_TRIPS;
+  cout_color(BLUE, addr, ": ", latency.count() / 1000.0, " us/round trip");
+}
+
+int main() {
+  std::string tcp_addr = make_server_addresses(1)[0];
+  std::string sock_prefix = "/tmp/kvstore-test-" + std::to_string(getpid());
+  std::string unix_addr = "unix:" + sock_prefix + ".sock";
+  std::string shm_addr = "shm:" + sock_prefix + "-shm.sock";
+
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(tcp_addr, 2);
+  ASSERT(server->listen_on(unix_addr));
+  ASSERT(server->listen_on(shm_addr));
+
+  std::string key = random_string(kRandStringLength);
+  std::shared_ptr<ServerConn> conn = connect_to_server(tcp_addr);
+  ASSERT(conn);
+  ASSERT(conn->send_request(PutRequest{key, key}));
+  ASSERT(conn->recv_response());
+
+  run_benchmark(tcp_addr, key);
+  run_benchmark(unix_addr, key);
+  run_benchmark(shm_addr, key);
+
+  // A value too large for the shared-memory ring fails cleanly
+  std::shared_ptr<ServerConn> shm_conn = connect_to_server(shm_addr);
+  ASSERT(shm_conn);
+  std::string large_value(2 * ShmChannel::DEFAULT_RING_SIZE, 'v');
+  ASSERT(!shm_conn->send_request(PutRequest{key, large_value}));
+
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
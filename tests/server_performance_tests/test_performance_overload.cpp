@@ -0,0 +1,79 @@
+#include <atomic>
+#include <string>
+
+#include "client/simple_client.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_WORKERS = 2;
+static constexpr std::size_t N_KEYS = 200;
+static constexpr std::size_t kRandStringLength = 10;
+static constexpr auto LEVEL_DURATION = 1s;
+
+/*
+ * Overload benchmark. Ever more client threads issue back-to-back 200-key
+ * MultiGets (expensive enough to run as tasks) against a server with
+ * N_WORKERS workers, well past the point where it's saturated. For each level,
+ * we report goodput (MultiGets that succeeded, per second), how many requests
+ * the server shed, and how many ops the clients gave up on after backing off.
+ *
+ * With admission control, goodput should level off at saturation rather than
+ * collapse: the server turns away what it can't serve in time cheaply, and the
+ * clients back off instead of piling on.
+ */
+int main() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(
+          addr, uint64_t{N_WORKERS});
+
+  auto keys = make_rand_strs(N_KEYS, kRandStringLength);
+  auto vals = make_rand_strs(N_KEYS, kRandStringLength);
+  ASSERT(SimpleClient{addr}.MultiPut(keys, vals));
+
+  double peak_goodput = 0, last_goodput = 0;
+  for (std::size_t n_clients : {1, 2, 4, 8, 16, 32, 64}) {
+    std::atomic<uint64_t> n_ok = 0, n_failed = 0;
+    std::atomic<bool> done = false;
+    uint64_t shed_before = server->get_shed_requests();
+
+    auto client = [&]() {
+      SimpleClient client{addr};
+      while (!done) {
+        auto values = client.MultiGet(keys);
+        if (values) {
+          ASSERT_EQ_VECS(*values, vals);
+          n_ok++;
+        } else {
+          n_failed++;
+        }
+      }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < n_clients; i++) {
+      threads.emplace_back(client);
+    }
+    std::this_thread::sleep_for(LEVEL_DURATION);
+    done = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    last_goodput = n_ok / secs;
+    peak_goodput = std::max(peak_goodput, last_goodput);
+    cout_color(BLUE, n_clients, " clients: ", last_goodput,
+               " MultiGets/sec, ", server->get_shed_requests() - shed_before,
+               " shed, ", n_failed.load(), " given up");
+  }
+  cout_color(BLUE, "Goodput at the highest load is ",
+             100 * last_goodput / peak_goodput, "% of peak");
+
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <string>
+
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_SERVERS = 8;
+static constexpr std::size_t N_FINE_SHARDS = 64;
+static constexpr std::size_t N_KEYS = 10'000;
+static constexpr std::size_t N_ROUNDS = 100;
+static constexpr std::size_t kRandStringLength = 10;
+static constexpr char kShardChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// N_FINE_SHARDS shards of granularity 2, dealt round-robin to the servers
+static ShardControllerConfig make_fine_config(
+    const std::vector<std::string>& servers) {
+  std::vector<std::string> prefixes;
+  for (char a : std::string(kShardChars)) {
+    for (char b : std::string(kShardChars)) {
+      prefixes.push_back(std::string{a, b});
+    }
+  }
+  ShardControllerConfig config;
+  std::size_t per_shard = prefixes.size() / N_FINE_SHARDS;
+  for (std::size_t i = 0; i < N_FINE_SHARDS; i++) {
+    std::size_t last = i + 1 == N_FINE_SHARDS ? prefixes.size() - 1
+                                               : (i + 1) * per_shard - 1;
+    config.server_to_shards[servers[i % servers.size()]].push_back(
+        {prefixes[i * per_shard], prefixes[last]});
+  }
+  return config;
+}
+
+/*
+ * Microbenchmark of key routing: N_ROUNDS passes over N_KEYS random keys,
+ * through ShardControllerConfig::get_server and through a RoutingTable built
+ * from the same config. Reports nanoseconds per lookup for each.
+ */
+static void bench(const std::string& name, const ShardControllerConfig& config,
+                  const std::vector<std::string>& keys) {
+  RoutingTable routes(config);
+
+  // Keep a checksum of the results, so the lookups can't be optimized out
+  std::size_t checksum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (std::size_t r = 0; r < N_ROUNDS; r++) {
+    for (auto&& key : keys) {
+      std::optional<std::string> server = config.get_server(key);
+      checksum += server ? server->size() : 0;
+    }
+  }
+  auto mid = std::chrono::high_resolution_clock::now();
+  for (std::size_t r = 0; r < N_ROUNDS; r++) {
+    for (auto&& key : keys) {
+      const std::string* server = routes.get_server(key);
+      checksum -= server ? server->size() : 0;
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  ASSERT_EQ(checksum, std::size_t{0});
+
+  double n_lookups = N_ROUNDS * keys.size();
+  using nanos = std::chrono::duration<double, std::nano>;
+  double scan_ns = nanos(mid - start).count();
+  double table_ns = nanos(end - mid).count();
+  cout_color(BLUE, name, ": get_server ", scan_ns / n_lookups,
+             " ns/lookup, RoutingTable ", table_ns / n_lookups,
+             " ns/lookup (", scan_ns / table_ns, "x)");
+}
+
+/*
+ * Routing through N_SERVERS * N_FINE_SHARDS hashed shards, which has no
+ * get_server equivalent. Also reports how evenly keys sharing a prefix spread
+ * across the servers: the most keys on one server, over the mean.
+ */
+static void bench_hashed(const std::vector<std::string>& servers,
+                         const std::vector<std::string>& keys) {
+  ShardControllerConfig config;
+  std::vector<Shard> shards = split_hashed(servers.size() * N_FINE_SHARDS);
+  for (std::size_t i = 0; i < shards.size(); i++) {
+    config.server_to_shards[servers[i % servers.size()]].push_back(shards[i]);
+  }
+  RoutingTable routes(config);
+  std::vector<std::string> user_keys;
+  for (auto&& key : keys) user_keys.push_back("user_" + key);
+
+  std::vector<std::size_t> per_server(servers.size());
+  auto start = std::chrono::high_resolution_clock::now();
+  for (std::size_t r = 0; r < N_ROUNDS; r++) {
+    for (auto&& key : user_keys) {
+      uint16_t route = routes.route(key);
+      ASSERT(route != RoutingTable::NO_SERVER);
+      per_server[route]++;
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+
+  double n_lookups = N_ROUNDS * user_keys.size();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  double most = *std::max_element(per_server.begin(), per_server.end());
+  cout_color(BLUE, "hashed \"user_\" keys: RoutingTable ", ns / n_lookups,
+             " ns/lookup, max/mean load ", most * servers.size() / n_lookups);
+}
+
+int main() {
+  std::vector<std::string> servers = make_server_addresses(N_SERVERS);
+  std::vector<std::string> keys = make_rand_strs(N_KEYS, kRandStringLength);
+
+  ShardControllerConfig coarse;
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    coarse.server_to_shards[servers[i]] = {shards[i]};
+  }
+  bench("first character", coarse, keys);
+  bench("two characters", make_fine_config(servers), keys);
+  bench_hashed(servers, keys);
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
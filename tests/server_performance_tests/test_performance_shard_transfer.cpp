@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "test_utils/test_utils.hpp"
+#include "tests/server_tests/server_test.hpp"
+
+static constexpr std::size_t N_SERVERS = 4;
+static constexpr std::size_t N_WORKERS = 4;
+// Size of the shard moved, small enough for a quick run. Set
+// TRANSFER_BENCH_BYTES to raise it, e.g. to 10737418240 to move 10 GiB (which
+// needs twice that in memory, since the source and destinations share this
+// process).
+static constexpr std::size_t DEFAULT_SHARD_BYTES = std::size_t(64) << 20;
+// How long a move may take, at the least, and per GiB moved, before the
+// benchmark fails rather than wait on a migration that's stuck
+static constexpr seconds MOVE_TIMEOUT{30};
+static constexpr seconds MOVE_TIMEOUT_PER_GIB{30};
+static constexpr std::size_t VALUE_SIZE = 64 << 10;
+static constexpr std::size_t kLoadBatchSize = 64;
+static constexpr std::size_t kRandStringLength = 12;
+
+// Counts the keys in the server's store, without copying their values.
+std::size_t ServerTest::count_keys(std::shared_ptr<KvServer> server) {
+  return server->store->AllKeys().size();
+}
+
+// Moves shards from the server `source` to other servers, as given by
+// `moves` (of server address -> shards), and returns how long it took the
+// source to hand every key off, in seconds; fails if it takes longer than
+// `timeout`.
+static double time_move(
+    ServerTest& test, std::shared_ptr<Shardcontroller> sm,
+    std::shared_ptr<KvServer> source,
+    const std::vector<std::pair<std::string, std::vector<Shard>>>& moves,
+    std::chrono::steady_clock::duration timeout) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto&& [dest, shards] : moves) {
+    ASSERT(test_move(sm, dest, shards));
+  }
+  // The source deletes the keys it handed off once it has cut over. Each Move
+  // is its own config, which the source may migrate on its own, or together
+  // with the next ones
+  while (test.count_keys(source) > 0) {
+    ASSERT(std::chrono::steady_clock::now() - start < timeout);
+    std::this_thread::sleep_for(1ms);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+/*
+ * Loopback benchmark of a shard migration's bulk transfer: a server holding
+ * a shard of `shard_bytes` hands it off to one destination, then (once it has
+ * it) that destination hands it off to the three other servers at once. We
+ * report the transfer throughput of each Move.
+ */
+int main() {
+  ServerTest test;
+  std::size_t shard_bytes = DEFAULT_SHARD_BYTES;
+  if (const char* bytes = std::getenv("TRANSFER_BENCH_BYTES")) {
+    shard_bytes = std::stoull(bytes);
+  }
+
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  std::vector<std::string> addrs = make_server_addresses(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+  for (auto&& addr : addrs) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(addr, sm_addr, uint64_t{N_WORKERS}));
+  }
+  std::vector<Shard> thirds = split_into(N_SERVERS - 1);
+  ASSERT(test_move(sm, addrs[0], thirds));
+  std::this_thread::sleep_for(500ms);
+
+  // Fill server 0 with the shard
+  std::size_t n_keys = shard_bytes / VALUE_SIZE;
+  {
+    std::shared_ptr<ServerConn> conn = connect_to_server(addrs[0]);
+    ASSERT(conn);
+    std::vector<std::string> vals(kLoadBatchSize, std::string(VALUE_SIZE, 'v'));
+    for (std::size_t i = 0; i < n_keys; i += kLoadBatchSize) {
+      for (auto& val : vals) val[0] = char('a' + i % 26);
+      ASSERT(conn->send_request(
+          MultiPutRequest{make_rand_strs(kLoadBatchSize, kRandStringLength),
+                          vals}));
+      auto res = conn->recv_response();
+      ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+    }
+  }
+  std::size_t n_stored = test.count_keys(servers[0]);
+  double gib = double(n_stored * VALUE_SIZE) / (1 << 30);
+  cout_color(BLUE, "Shard: ", n_stored, " keys, ", gib, " GiB");
+  auto timeout = MOVE_TIMEOUT + std::chrono::duration_cast<seconds>(
+                                    MOVE_TIMEOUT_PER_GIB * gib);
+
+  double one = time_move(test, sm, servers[0], {{addrs[1], thirds}}, timeout);
+  ASSERT_EQ(test.count_keys(servers[1]), n_stored);
+  cout_color(BLUE, "To one server: ", one, " s, ", gib / one, " GiB/s");
+
+  double three = time_move(test, sm, servers[1],
+                           {{addrs[0], {thirds[0]}},
+                            {addrs[2], {thirds[1]}},
+                            {addrs[3], {thirds[2]}}},
+                           timeout);
+  std::size_t n_moved = 0;
+  for (std::size_t i : {0, 2, 3}) n_moved += test.count_keys(servers[i]);
+  ASSERT_EQ(n_moved, n_stored);
+  cout_color(BLUE, "To three servers: ", three, " s, ", gib / three, " GiB/s");
+
+  for (auto&& server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -12,4 +12,9 @@ class ServerTest {
                            std::string dest_addr, Shard shard,
                            std::vector<std::string> keys,
                            std::vector<std::string> values);
+  std::size_t count_get_allocations(std::shared_ptr<KvServer> server,
+                                    std::shared_ptr<ClientConn> conn,
+                                    int client_fd, const std::string& key,
+                                    const std::string& value);
+  std::size_t count_keys(std::shared_ptr<KvServer> server);
 };
@@ -0,0 +1,169 @@
+#include <sys/socket.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "server_test.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kNumKeyValPairs = 100;
+static constexpr std::size_t kRandStringLength = 5;
+// Cutover attempts the second destination fails before it recovers
+static constexpr int N_FAILED_CUTOVERS = 2;
+static constexpr std::chrono::seconds kTimeout(10);
+
+/*
+ * A source hands one shard off to a destination server and another to a
+ * stand-in destination, which acknowledges the copy but fails the source's
+ * first cutover attempts. Until every destination has all of its keys, none
+ * may be told it has them, and the source must go on serving them between
+ * its attempts.
+ */
+int ServerTest::run_test() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  std::vector<std::string> addresses = make_server_addresses(3);
+  std::shared_ptr<KvServer> source =
+      start_server<KvServer, const std::string&, const std::string&, uint64_t>(
+          addresses[0], sm_addr, 2);
+  std::shared_ptr<KvServer> dest =
+      start_server<KvServer, const std::string&, const std::string&, uint64_t>(
+          addresses[1], sm_addr, 2);
+  const std::string& flaky_addr = addresses[2];
+
+  // Configs are installed directly, at versions past the shardcontroller's,
+  // so that the servers' own config updates don't get in the way
+  Shard dest_shard{"0", "H"};
+  Shard flaky_shard{"I", "Z"};
+  ShardControllerConfig before;
+  before.server_to_shards = {{addresses[0], {dest_shard, flaky_shard}},
+                             {addresses[1], {}}};
+  ShardControllerConfig after;
+  after.server_to_shards = {{addresses[0], {}},
+                            {addresses[1], {dest_shard}},
+                            {flaky_addr, {flaky_shard}}};
+  ASSERT(source->install_config(before, 1000));
+  ASSERT(dest->install_config(before, 1000));
+
+  std::vector<std::string> dest_keys = make_rand_strs(
+      kNumKeyValPairs, kRandStringLength, "0123456789ABCDEFGH");
+  std::vector<std::string> flaky_keys = make_rand_strs(
+      kNumKeyValPairs, kRandStringLength, "IJKLMNOPQRSTUVWXYZ");
+  std::vector<std::string> vals =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::map<std::string, std::string> expected;
+  for (auto&& keys : {dest_keys, flaky_keys}) {
+    Response res = source->process_request(MultiPutRequest{keys, vals});
+    ASSERT(std::holds_alternative<MultiPutResponse>(res));
+    for (std::size_t i = 0; i < keys.size(); i++) expected[keys[i]] = vals[i];
+  }
+  // Whether `server` has been told it has all of the source's keys
+  auto told = [](std::shared_ptr<KvServer> server) {
+    for (auto&& takeover : server->config.load()->takeovers) {
+      if (!takeover->done) return false;
+    }
+    return true;
+  };
+  ASSERT(dest->install_config(after, 1001));
+
+  // The stand-in destination. It writes to one of its keys on the source
+  // during the copy, so that the cutover has it to send, then fails the
+  // cutover's chunks N_FAILED_CUTOVERS times
+  int listener_fd = open_listener_socket(flaky_addr);
+  ASSERT(listener_fd >= 0);
+  const std::string written = "written during the copy";
+  std::map<std::string, std::string> received;
+  std::atomic<int> n_failed = 0;
+  std::atomic<bool> dest_told_early = false;
+  std::atomic<bool> flaky_told = false;
+  std::thread flaky([&] {
+    int n_chunks = 0;
+    while (std::shared_ptr<ClientConn> conn = accept_client(listener_fd)) {
+      Request req;
+      while (conn->recv_request(&req)) {
+        auto& chunk = std::get<TransferRequest>(req);
+        if (chunk.last) {
+          flaky_told = true;
+        } else if (n_chunks++ == 0) {
+          Response res = source->process_request(PutRequest{flaky_keys[0],
+                                                            written});
+          ASSERT(std::holds_alternative<PutResponse>(res));
+        } else if (n_failed < N_FAILED_CUTOVERS) {
+          // The other destination mustn't have been told it has its keys
+          if (told(dest)) dest_told_early = true;
+          n_failed++;
+          conn->send_response(ErrorResponse{"destination unavailable"});
+          break;
+        }
+        for (std::size_t i = 0; i < chunk.keys.size(); i++) {
+          received[chunk.keys[i]] = chunk.values[i];
+        }
+        conn->send_response(TransferResponse{});
+      }
+    }
+  });
+
+  std::atomic<bool> migrated = false;
+  std::atomic<bool> migration_done = false;
+  std::thread migration([&] {
+    migrated = source->install_config(after, 1001);
+    migration_done = true;
+  });
+
+  // Between the failed cutover attempts, the source serves its keys again
+  auto deadline = std::chrono::steady_clock::now() + kTimeout;
+  while (n_failed == 0 && !migration_done) {
+    ASSERT(std::chrono::steady_clock::now() < deadline);
+    std::this_thread::sleep_for(1ms);
+  }
+  bool served = false;
+  while (!served && !migration_done) {
+    ASSERT(std::chrono::steady_clock::now() < deadline);
+    Response res = source->process_request(GetRequest{dest_keys[0]});
+    if (is_not_responsible(res)) break;
+    served = std::holds_alternative<GetResponse>(res);
+    std::this_thread::sleep_for(1ms);
+  }
+  migration.join();
+  ASSERT(served);
+
+  // Once every destination has all of its keys, the handoff completes
+  ASSERT(migrated);
+  ASSERT_EQ(n_failed.load(), N_FAILED_CUTOVERS);
+  ASSERT(!dest_told_early);
+  ASSERT(told(dest));
+  for (auto&& key : dest_keys) {
+    Response res = dest->process_request(GetRequest{key});
+    GetResponse* get_res = std::get_if<GetResponse>(&res);
+    ASSERT(get_res);
+    ASSERT_EQ(get_res->value, expected[key]);
+  }
+  ASSERT_EQ(this->count_keys(source), std::size_t{0});
+
+  // Close the stand-in's listener, and the source's connection to it
+  shutdown(listener_fd, SHUT_RDWR);
+  source->peers.clear();
+  flaky.join();
+  close(listener_fd);
+  ASSERT(flaky_told);
+  expected[flaky_keys[0]] = written;
+  for (auto&& key : flaky_keys) ASSERT_EQ(received[key], expected[key]);
+
+  source->stop();
+  dest->stop();
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
+
+std::size_t ServerTest::count_keys(std::shared_ptr<KvServer> server) {
+  return server->store->AllKeys().size();
+}
+
+int main() {
+  ServerTest test;
+  return test.run_test();
+}
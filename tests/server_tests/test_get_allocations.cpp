@@ -0,0 +1,110 @@
+#include <sys/socket.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "server_test.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_GETS = 1'000;
+static constexpr std::size_t N_WARMUP_GETS = 10;
+
+// Count the heap allocations made by this thread while `counting` is set
+static thread_local bool counting = false;
+static thread_local std::size_t n_allocations = 0;
+
+void* operator new(std::size_t sz) {
+  if (counting) n_allocations++;
+  if (void* ptr = std::malloc(sz ? sz : 1)) return ptr;
+  throw std::bad_alloc{};
+}
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+/*
+ * Serves N_GETS Gets for `key` over the connection, and returns how many heap
+ * allocations the server made doing so. The client's side isn't counted.
+ */
+std::size_t ServerTest::count_get_allocations(
+    std::shared_ptr<KvServer> server, std::shared_ptr<ClientConn> conn,
+    int client_fd, const std::string& key, const std::string& value) {
+  std::optional<Message> get_msg = serialize_request(GetRequest{key});
+  ASSERT(get_msg);
+  Message reply{};
+  auto client = std::make_shared<KvServer::Client>();
+  client->conn = conn;
+  Scheduler scheduler;
+  GetCoalescer gets;
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < N_WARMUP_GETS + N_GETS; i++) {
+    ASSERT(send_message(client_fd, &*get_msg));
+
+    // Each Get in a round of its own, so that it's looked up and serialized
+    // rather than served from the previous one's response
+    gets.next_round();
+    n_allocations = 0;
+    counting = true;
+    bool served = server->serve_request(client, scheduler, gets, false);
+    scheduler.run();
+    counting = false;
+    ASSERT(served);
+    // The first few requests may size the recycled buffers (and the task
+    // frame cache)
+    if (i >= N_WARMUP_GETS) total += n_allocations;
+
+    ASSERT(recv_message(client_fd, &reply));
+    std::optional<Response> get_res = deserialize_response(reply);
+    ASSERT(get_res);
+    auto* get = std::get_if<GetResponse>(&*get_res);
+    ASSERT(get);
+    ASSERT_EQ(get->value, value);
+  }
+  return total;
+}
+
+int ServerTest::run_test() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 1);
+
+  // Serve requests on one end of a socket pair, bypassing the server's
+  // workers, so that only the Get path itself is measured
+  int fds[2];
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  auto conn = std::make_shared<ClientConn>(fds[0], "socketpair");
+
+  // Keys and values long enough that they don't fit in a small string
+  std::string key = random_string(40);
+  std::string small_value = random_string(8);
+  std::string large_value(4096, 'v');
+
+  PutRequest put_req{key, small_value};
+  Response put_res = server->process_request(put_req);
+  ASSERT(std::get_if<PutResponse>(&put_res));
+  ASSERT_EQ(count_get_allocations(server, conn, fds[1], key, small_value),
+            std::size_t{0});
+
+  put_req.value = large_value;
+  put_res = server->process_request(put_req);
+  ASSERT(std::get_if<PutResponse>(&put_res));
+  ASSERT_EQ(count_get_allocations(server, conn, fds[1], key, large_value),
+            std::size_t{0});
+
+  conn->close();
+  close(fds[1]);
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
+
+int main() {
+  ServerTest test;
+  return test.run_test();
+}
@@ -0,0 +1,166 @@
+#include <string>
+
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kNumKVPairs = 256;
+static constexpr std::size_t kValueLength = 32 * 1024;
+static constexpr std::size_t kLargeValueLength = 8 * FRAME_CHUNK_SIZE + 123;
+static constexpr std::size_t kRandStringLength = 10;
+
+// A value of `len` bytes, pieced together from random strings (which are
+// capped in length)
+static std::string make_value(std::size_t len) {
+  static const std::vector<std::string> pieces = make_rand_strs(64, 62);
+  static std::size_t next_piece = 0;
+  std::string value;
+  value.reserve(len);
+  while (value.size() < len) {
+    const std::string& piece = pieces[next_piece++ * 7 % pieces.size()];
+    value.append(piece, 0, std::min(len - value.size(), piece.size()));
+  }
+  return value;
+}
+
+static std::vector<std::string> make_values(std::size_t n, std::size_t len) {
+  std::vector<std::string> values;
+  for (std::size_t i = 0; i < n; i++) {
+    values.push_back(make_value(len));
+  }
+  return values;
+}
+
+// A MultiPut larger than STREAM_PART_SIZE is split into several parts, and
+// values larger than a part into pieces, which reassemble into the original
+// request
+void test_multiput_parts() {
+  auto keys = make_rand_strs(kNumKVPairs, kRandStringLength);
+  auto vals = make_values(kNumKVPairs, kValueLength);
+  vals[kNumKVPairs / 2] = make_value(kLargeValueLength);
+  Request req = MultiPutRequest{keys, vals};
+
+  Message msg;
+  Request reassembled;
+  StreamPosition next;
+  std::size_t n_parts = 0, n_split = 0;
+  do {
+    ASSERT(serialize_request_part(req, &next, &msg));
+    ASSERT(msg.buf.size() < 2 * STREAM_PART_SIZE);
+    if (msg.flags & MESSAGE_SPLIT_VALUE) n_split++;
+    ASSERT(deserialize_request_part(msg, &reassembled, n_parts == 0));
+    n_parts++;
+  } while (msg.flags & MESSAGE_CONTINUED);
+
+  ASSERT(n_parts > 1);
+  ASSERT_EQ(n_split, std::size_t{1});
+  auto* multiput = std::get_if<MultiPutRequest>(&reassembled);
+  ASSERT(multiput);
+  ASSERT_EQ_VECS(multiput->keys, keys);
+  ASSERT_EQ_VECS(multiput->values, vals);
+}
+
+// Streamed requests and responses, and values larger than a frame chunk, make
+// it through a server intact
+void test_server_roundtrip() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 2);
+  std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+  ASSERT(conn);
+
+  auto keys = make_rand_strs(kNumKVPairs, kRandStringLength);
+  auto vals = make_values(kNumKVPairs, kValueLength);
+  ASSERT(conn->send_request(MultiPutRequest{keys, vals}));
+  auto res = conn->recv_response();
+  ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+
+  ASSERT(conn->send_request(MultiGetRequest{keys}));
+  res = conn->recv_response();
+  ASSERT(res);
+  auto* multiget = std::get_if<MultiGetResponse>(&*res);
+  ASSERT(multiget);
+  ASSERT_EQ_VECS(multiget->values, vals);
+
+  // Values larger than a part, both ways
+  std::vector<std::string> large_keys = {keys[0], keys[1], keys[2]};
+  std::vector<std::string> large_vals = {make_value(kLargeValueLength),
+                                         make_value(kValueLength),
+                                         make_value(kLargeValueLength)};
+  ASSERT(conn->send_request(MultiPutRequest{large_keys, large_vals}));
+  res = conn->recv_response();
+  ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+  ASSERT(conn->send_request(MultiGetRequest{large_keys}));
+  res = conn->recv_response();
+  ASSERT(res);
+  multiget = std::get_if<MultiGetResponse>(&*res);
+  ASSERT(multiget);
+  ASSERT(multiget->values == large_vals);
+
+  std::string key = random_string(kRandStringLength);
+  std::string large_value = make_value(kLargeValueLength);
+  ASSERT(conn->send_request(PutRequest{key, large_value}));
+  res = conn->recv_response();
+  ASSERT(res && std::get_if<PutResponse>(&*res));
+
+  ASSERT(conn->send_request(GetRequest{key}));
+  res = conn->recv_response();
+  ASSERT(res);
+  auto* get = std::get_if<GetResponse>(&*res);
+  ASSERT(get);
+  ASSERT(get->value == large_value);
+
+  conn->shutdown();
+  server->stop();
+}
+
+// The parts of a streamed MultiPut are applied as they arrive, and the server
+// grants credit for each, rather than waiting for the whole request
+void test_streamed_parts_applied() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 2);
+  int fd = connect_to_address(addr);
+  ASSERT(fd >= 0);
+
+  auto keys = make_rand_strs(kNumKVPairs, kRandStringLength);
+  auto vals = make_values(kNumKVPairs, kValueLength);
+  Request req = MultiPutRequest{keys, vals};
+  StreamPosition next;
+  Message msg;
+  ASSERT(serialize_request_part(req, &next, &msg));
+  ASSERT(msg.flags & MESSAGE_CONTINUED);
+  ASSERT(send_message(fd, &msg));
+  Message credit;
+  ASSERT(recv_message(fd, &credit));
+  ASSERT(credit.type == MessageType::CREDIT);
+
+  // The first part's keys are in before the rest has been sent
+  ASSERT(test_get(addr, keys[0], vals[0]));
+  ASSERT(test_get(addr, keys.back(), std::nullopt));
+
+  do {
+    ASSERT(serialize_request_part(req, &next, &msg));
+    ASSERT(send_message(fd, &msg));
+  } while (msg.flags & MESSAGE_CONTINUED);
+  // Then the credits for the other parts, and the response
+  while (recv_message(fd, &msg) && msg.type == MessageType::CREDIT) {
+  }
+  std::optional<Response> res = deserialize_response(msg);
+  ASSERT(res && std::get_if<MultiPutResponse>(&*res));
+  ASSERT(test_get(addr, keys.back(), vals.back()));
+
+  close(fd);
+  server->stop();
+}
+
+int main() {
+  // Send bodies as they are, so that they're as large on the wire as in memory
+  set_compression_threshold(0);
+
+  test_multiput_parts();
+  test_server_roundtrip();
+  test_streamed_parts_applied();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include <string>
+
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 5;
+static constexpr std::size_t kRandStringLength = 10;
+static constexpr std::size_t kNumKeys = 2000;
+
+// Checks that `routes` sends every key where `config` does
+void check_routes(const ShardControllerConfig& config,
+                  const RoutingTable& routes,
+                  const std::vector<std::string>& keys) {
+  for (auto&& key : keys) {
+    std::optional<std::string> expected = config.get_server(key);
+    const std::string* server = routes.get_server(key);
+    ASSERT_EQ(bool(server), bool(expected));
+    if (server) {
+      ASSERT_EQ(*server, *expected);
+      ASSERT_EQ(routes.route(key), routes.index_of(*expected));
+    }
+    // A key's shard is one of its server's, and every full-length key that
+    // has a server has one
+    uint32_t shard = routes.shard_of(key);
+    if (shard != RoutingTable::NO_SHARD) {
+      ASSERT(server);
+      ASSERT_EQ(routes.get_shard_owners()[shard], routes.route(key));
+    } else {
+      ASSERT(!server || key.size() < kRandStringLength);
+    }
+  }
+}
+
+// Keys of every first character, including ones no server is responsible
+// for, and keys shorter than the shards' bounds
+std::vector<std::string> make_keys() {
+  std::vector<std::string> keys = make_rand_strs(kNumKeys, kRandStringLength);
+  for (auto&& key : make_rand_strs(kNumKeys, 1)) {
+    keys.push_back(key);
+  }
+  keys.push_back("");
+  keys.push_back("~tilde");
+  return keys;
+}
+
+void test_first_byte_routes(const std::vector<std::string>& servers) {
+  ShardControllerConfig config;
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  // Leave the last shard unassigned, and the last server without shards
+  for (std::size_t i = 0; i < N_SERVERS - 1; i++) {
+    config.server_to_shards[servers[i]] = {shards[i]};
+  }
+  config.server_to_shards[servers[N_SERVERS - 1]] = {};
+
+  RoutingTable routes(config);
+  ASSERT_EQ(routes.get_servers().size(), N_SERVERS);
+  ASSERT_EQ(routes.index_of("not a server"), RoutingTable::NO_SERVER);
+  ASSERT(!routes.get_server("windmill"));
+  ASSERT(routes.get_server("GDPR"));
+  ASSERT_EQ(*routes.get_server("GDPR"), *config.get_server("GDPR"));
+  check_routes(config, routes, make_keys());
+}
+
+void test_sorted_routes(const std::vector<std::string>& servers) {
+  ShardControllerConfig config;
+  config.server_to_shards[servers[0]] = {{"00", "9Z"}, {"N0", "P4"}};
+  config.server_to_shards[servers[1]] = {{"A0", "MZ"}};
+  config.server_to_shards[servers[2]] = {{"P5", "SZ"}};
+
+  RoutingTable routes(config);
+  ASSERT(routes.get_server("p4p"));
+  ASSERT_EQ(*routes.get_server("p4p"), servers[0]);
+  ASSERT(routes.get_server("P5P"));
+  ASSERT_EQ(*routes.get_server("P5P"), servers[2]);
+  ASSERT(!routes.get_server("TZ"));
+  check_routes(config, routes, make_keys());
+}
+
+void test_hashed_routes(const std::vector<std::string>& servers) {
+  ShardControllerConfig config;
+  std::vector<Shard> shards = split_hashed(N_SERVERS);
+  ASSERT_EQ(shards.front().lower, std::string("#000"));
+  ASSERT_EQ(shards.back().upper, std::string("#ZZZ"));
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    config.server_to_shards[servers[i]] = {shards[i]};
+  }
+  RoutingTable routes(config);
+
+  // Keys sharing a long prefix, which would all land on one server if routed
+  // by their first character, spread evenly across the servers
+  std::vector<std::size_t> per_server(N_SERVERS);
+  for (auto&& key : make_rand_strs(kNumKeys, kRandStringLength)) {
+    uint32_t slot = RoutingTable::hash_slot("user_" + key);
+    const std::string* server = routes.get_server("user_" + key);
+    ASSERT(server);
+    // Every key goes to the server whose shard holds its slot
+    std::size_t owner = 0;
+    while (*RoutingTable::parse_slot_bound(shards[owner].upper) < slot) {
+      owner++;
+    }
+    ASSERT_EQ(*server, servers[owner]);
+    // ... which is its shard (the shards are sorted, one per server)
+    ASSERT_EQ(routes.shard_of("user_" + key), uint32_t(owner));
+    per_server[owner]++;
+  }
+  for (std::size_t count : per_server) {
+    ASSERT(count > kNumKeys / N_SERVERS * 3 / 4);
+    ASSERT(count < kNumKeys / N_SERVERS * 5 / 4);
+  }
+
+  // Slot bounds round-trip, and other bounds aren't slots
+  for (uint32_t slot : {0u, 35u, 36u, RoutingTable::HASH_SLOTS - 1}) {
+    ASSERT_EQ(*RoutingTable::parse_slot_bound(RoutingTable::slot_bound(slot)),
+              slot);
+  }
+  ASSERT(!RoutingTable::parse_slot_bound("A00"));
+  ASSERT(!RoutingTable::parse_slot_bound("#00"));
+
+  // Slots no shard covers are routed nowhere
+  config.server_to_shards[servers[0]] = {};
+  RoutingTable partial(config);
+  for (auto&& key : make_keys()) {
+    uint32_t slot = RoutingTable::hash_slot(key);
+    bool covered = slot >= *RoutingTable::parse_slot_bound(shards[1].lower);
+    ASSERT_EQ(partial.route(key) != RoutingTable::NO_SERVER, covered);
+  }
+}
+
+void test_empty_config() {
+  ShardControllerConfig config;
+  RoutingTable routes(config);
+  ASSERT(routes.get_servers().empty());
+  for (auto&& key : make_keys()) {
+    ASSERT_EQ(routes.route(key), RoutingTable::NO_SERVER);
+  }
+}
+
+int main() {
+  std::vector<std::string> servers = make_server_addresses(N_SERVERS);
+
+  test_first_byte_routes(servers);
+  test_sorted_routes(servers);
+  test_hashed_routes(servers);
+  test_empty_config();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <future>
+#include <string>
+
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t kNumKeyValPairs = 128;
+static constexpr std::size_t kRandStringLength = 10;
+// Large enough that the MultiGet's response overflows the socket's buffers
+static constexpr std::size_t kValueLength = 256 * 1024;
+static constexpr std::chrono::seconds kTimeout(2);
+
+/*
+ * A server with a single worker goes on serving its clients while one of them
+ * has sent only part of a request, and another isn't reading the (large)
+ * response to its own. Both are served in full once they catch up.
+ */
+int main() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 1);
+
+  auto keys = make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> vals;
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    vals.push_back(std::string(kValueLength, 'a' + i % 26));
+  }
+  std::shared_ptr<ServerConn> reader = connect_to_server(addr);
+  ASSERT(reader);
+  ASSERT(reader->send_request(MultiPutRequest{keys, vals}));
+  std::optional<Response> res = reader->recv_response();
+  ASSERT(res && std::holds_alternative<MultiPutResponse>(*res));
+
+  // A client that stops partway through a request's header
+  std::optional<Message> get_msg = serialize_request(GetRequest{keys[0]});
+  ASSERT(get_msg);
+  std::vector<std::byte> get_bytes(MESSAGE_HEADER_SIZE + get_msg->sz);
+  {
+    // The message's bytes, as the server receives them
+    int fds[2];
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    ASSERT(send_message(fds[0], &*get_msg));
+    ASSERT(recvall(fds[1], get_bytes.data(), get_bytes.size(), 0) ==
+           int(get_bytes.size()));
+    close(fds[0]);
+    close(fds[1]);
+  }
+  int stalled_fd = connect_to_address(addr);
+  ASSERT(stalled_fd >= 0);
+  ASSERT(sendall(stalled_fd, get_bytes.data(), 3, MSG_NOSIGNAL) == 3);
+
+  // A client that doesn't read its response
+  ASSERT(reader->send_request(MultiGetRequest{keys}));
+  std::this_thread::sleep_for(50ms);
+
+  // Neither holds up another client
+  auto served = std::async(std::launch::async, [&] {
+    std::shared_ptr<ServerConn> conn = connect_to_server(addr);
+    if (!conn || !conn->send_request(GetRequest{keys[1]})) return false;
+    std::optional<Response> get_res = conn->recv_response();
+    auto* get = get_res ? std::get_if<GetResponse>(&*get_res) : nullptr;
+    return get && get->value == vals[1];
+  });
+  ASSERT(served.wait_for(kTimeout) == std::future_status::ready);
+  ASSERT(served.get());
+
+  // Once they catch up, they get their responses
+  ASSERT(sendall(stalled_fd, get_bytes.data() + 3, get_bytes.size() - 3,
+                 MSG_NOSIGNAL) == int(get_bytes.size() - 3));
+  Message reply;
+  ASSERT(recv_message(stalled_fd, &reply));
+  std::optional<Response> get_res = deserialize_response(reply);
+  ASSERT(get_res);
+  auto* get = std::get_if<GetResponse>(&*get_res);
+  ASSERT(get);
+  ASSERT_EQ(get->value, vals[0]);
+  close(stalled_fd);
+
+  res = reader->recv_response();
+  ASSERT(res);
+  auto* multiget = std::get_if<MultiGetResponse>(&*res);
+  ASSERT(multiget);
+  ASSERT(multiget->values == vals);
+
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "shardcontroller/placement.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_SERVERS = 16;
+static constexpr std::size_t N_SHARDS = 256;
+
+using Config = std::map<std::string, std::vector<Shard>>;
+
+static double total_size(const std::vector<Shard>& shards) {
+  double size = 0;
+  for (auto&& shard : shards) size += shard_size(shard);
+  return size;
+}
+
+// Returns the most loaded server's load over its share of the keyspace
+static double imbalance(const Config& config, const PlacementPolicy& policy) {
+  double total = 0, total_weight = 0;
+  for (auto&& [server, shards] : config) {
+    total += total_size(shards);
+    total_weight += policy.weight(server);
+  }
+  double max = 0;
+  for (auto&& [server, shards] : config) {
+    double share = total * policy.weight(server) / total_weight;
+    max = std::max(max, total_size(shards) / share);
+  }
+  return max;
+}
+
+// Applies `moves` to `config`, and returns the size of the shards they moved
+static double apply_moves(Config& config,
+                          const std::vector<PlannedMove>& moves) {
+  double moved = 0;
+  for (auto&& move : moves) {
+    std::vector<Shard>& from = config[move.from];
+    auto shard = std::find(from.begin(), from.end(), move.shard);
+    ASSERT(shard != from.end());
+    from.erase(shard);
+    config[move.to].push_back(move.shard);
+    moved += shard_size(move.shard);
+  }
+  return moved;
+}
+
+// Places every shard on the server its hash picks, modulo the number of
+// servers: balanced, but most shards move whenever a server joins or leaves
+static Config place_by_modulo(const std::vector<std::string>& servers,
+                              const std::vector<Shard>& shards) {
+  Config config;
+  for (auto&& server : servers) config[server];
+  for (auto&& shard : shards) {
+    std::size_t i = std::hash<std::string>{}(shard.lower) % servers.size();
+    config[servers[i]].push_back(shard);
+  }
+  return config;
+}
+
+// Returns the size of the shards on different servers in `a` and `b`
+static double moved_between(const Config& a, const Config& b) {
+  std::map<std::string, std::string> owner;
+  for (auto&& [server, shards] : a) {
+    for (auto&& shard : shards) owner[shard.lower] = server;
+  }
+  double moved = 0;
+  for (auto&& [server, shards] : b) {
+    for (auto&& shard : shards) {
+      if (owner[shard.lower] != server) moved += shard_size(shard);
+    }
+  }
+  return moved;
+}
+
+/*
+ * Starts a cluster with all of N_SHARDS hashed shards on one server, joins
+ * servers one at a time up to `weights.size()`, then has the servers at
+ * `leaves` leave one at a time. After each join and leave, we check that the
+ * shards moved are no more than the minimum the policy's bounds allow, and
+ * that placement is even; we report the data moved, as a fraction of all
+ * data, against placing shards by their hash modulo the number of servers.
+ */
+static void simulate(const std::string& name,
+                     const std::vector<double>& weights,
+                     const std::vector<std::size_t>& leaves) {
+  std::vector<std::string> servers;
+  PlacementPolicy policy;
+  for (std::size_t i = 0; i < weights.size(); i++) {
+    servers.push_back("server" + std::to_string(i));
+    policy.weights[servers[i]] = weights[i];
+  }
+  std::vector<Shard> shards = split_hashed(N_SHARDS);
+  double total = total_size(shards);
+  double largest = 0;
+  for (auto&& shard : shards) largest = std::max(largest, shard_size(shard));
+
+  Config config = {{servers[0], shards}};
+  std::vector<std::string> live = {servers[0]};
+  Config modulo = place_by_modulo(live, shards);
+  double moved = 0, modulo_moved = 0, worst = 0;
+  auto check = [&](double event_moved) {
+    moved += event_moved;
+    Config next = place_by_modulo(live, shards);
+    modulo_moved += moved_between(modulo, next);
+    modulo = std::move(next);
+
+    double total_weight = 0;
+    for (auto&& server : live) total_weight += policy.weight(server);
+    double min_share = total;
+    for (auto&& server : live) {
+      min_share =
+          std::min(min_share, total * policy.weight(server) / total_weight);
+    }
+    // Within bounds, give or take the largest shard, which can't be split
+    double max = imbalance(config, policy);
+    ASSERT(max <= 1 + policy.slack + largest / min_share);
+    worst = std::max(worst, max);
+  };
+
+  for (std::size_t i = 1; i < servers.size(); i++) {
+    config[servers[i]];
+    live.push_back(servers[i]);
+    double joined = apply_moves(config, plan_join(config, servers[i], policy));
+    // The joining server takes its share, and no more than its bound
+    double total_weight = 0;
+    for (auto&& server : live) total_weight += policy.weight(server);
+    double share = total * policy.weight(servers[i]) / total_weight;
+    ASSERT(joined >= share - largest);
+    ASSERT(joined <= (1 + policy.slack) * share);
+    check(joined);
+  }
+  for (std::size_t i : leaves) {
+    double held = total_size(config[servers[i]]);
+    double left =
+        apply_moves(config, plan_leave(config, servers[i], policy));
+    // Only the leaving server's shards move
+    ASSERT_EQ(left, held);
+    ASSERT(config[servers[i]].empty());
+    config.erase(servers[i]);
+    live.erase(std::find(live.begin(), live.end(), servers[i]));
+    check(left);
+  }
+
+  cout_color(BLUE, name, ": moved ", moved / total, " of the data (vs ",
+             modulo_moved / total, " placing by hash modulo servers), max ",
+             "load/share ", worst);
+  ASSERT(moved * 2 < modulo_moved);
+}
+
+int main() {
+  simulate("Uniform", std::vector<double>(N_SERVERS, 1),
+           {3, 9, 0, 15, 6, 12, 1, 7});
+
+  // Servers of different capacities, weighted by it
+  std::vector<double> weights;
+  for (std::size_t i = 0; i < N_SERVERS; i++) weights.push_back(1 + i % 4);
+  simulate("Weighted", weights, {2, 5, 0, 11, 8, 14, 3, 13});
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "server/load_tracker.hpp"
+#include "shardcontroller/rebalancer.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_SERVERS = 8;
+static constexpr std::size_t N_SHARDS = 256;
+static constexpr double TOTAL_OPS = 100'000;
+static constexpr uint64_t SHARD_BYTES = 64 << 20;
+static constexpr std::size_t MAX_ROUNDS = 100;
+
+// Returns the most loaded server's load over the mean
+static double imbalance(const std::vector<ServerLoad>& servers,
+                        const RebalancePolicy& policy) {
+  double max = 0, sum = 0;
+  for (auto&& server : servers) {
+    double load = 0;
+    for (auto&& shard : server.shards) load += shard_load(shard, policy);
+    max = std::max(max, load);
+    sum += load;
+  }
+  return max / (sum / double(servers.size()));
+}
+
+// Applies `moves` to `servers`, and returns the bytes they moved
+static uint64_t apply_moves(std::vector<ServerLoad>& servers,
+                            const std::vector<PlannedMove>& moves) {
+  uint64_t moved = 0;
+  for (auto&& move : moves) {
+    auto find = [&](const std::string& name) {
+      return std::find_if(servers.begin(), servers.end(),
+                          [&](auto&& s) { return s.server == name; });
+    };
+    auto from = find(move.from);
+    auto to = find(move.to);
+    ASSERT(from != servers.end() && to != servers.end());
+    auto shard = std::find_if(
+        from->shards.begin(), from->shards.end(),
+        [&](auto&& load) { return load.shard == move.shard; });
+    ASSERT(shard != from->shards.end());
+    moved += shard->bytes;
+    to->shards.push_back(*shard);
+    from->shards.erase(shard);
+  }
+  return moved;
+}
+
+/*
+ * Runs the rebalancer on a cluster whose shard loads follow `load_of(rank)`,
+ * with the hottest shards starting out together on the first servers, until
+ * it plans no more moves. We report the imbalance (the most loaded server
+ * over the mean) before and after, and the rounds and bytes it took.
+ */
+template <typename F>
+static double simulate(const std::string& name, const RebalancePolicy& policy,
+                       F&& load_of) {
+  std::vector<Shard> shards = split_hashed(N_SHARDS);
+  std::vector<std::string> addresses = make_server_addresses(N_SERVERS);
+  std::vector<ServerLoad> servers;
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back({addresses[i], {}});
+  }
+  for (std::size_t i = 0; i < N_SHARDS; i++) {
+    servers[i * N_SERVERS / N_SHARDS].shards.push_back(
+        {shards[i], load_of(i), SHARD_BYTES, "", ""});
+  }
+
+  double before = imbalance(servers, policy);
+  uint64_t bytes_moved = 0;
+  std::size_t rounds = 0, n_moves = 0;
+  for (; rounds < MAX_ROUNDS; rounds++) {
+    std::vector<PlannedMove> moves = plan_rebalance(servers, policy);
+    if (moves.empty()) break;
+    ASSERT(moves.size() <= policy.max_moves);
+    // Each shard moves at most once a round
+    std::set<std::string> moved;
+    for (auto&& move : moves) ASSERT(moved.insert(move.shard.lower).second);
+    double previous = imbalance(servers, policy);
+    bytes_moved += apply_moves(servers, moves);
+    n_moves += moves.size();
+    // Rounds never make the most loaded server worse
+    ASSERT(imbalance(servers, policy) <= previous + 1e-9);
+  }
+  ASSERT(rounds < MAX_ROUNDS);
+  double after = imbalance(servers, policy);
+  cout_color(BLUE, name, ": max/mean ", before, " -> ", after, " in ", rounds,
+             " rounds, ", n_moves, " moves, ",
+             double(bytes_moved) / (1 << 30), " GiB moved");
+  return after;
+}
+
+// A cluster of hashed shards, as ranges of slots, each server's loaded by a
+// given per-slot load
+struct SlotCluster {
+  std::vector<double> slot_load;
+  std::vector<std::string> servers;
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> shards;
+
+  // Reports each shard's ops/sec and where to split it, as a server would
+  std::vector<ServerLoad> report() const {
+    std::vector<ServerLoad> loads;
+    for (std::size_t i = 0; i < this->servers.size(); i++) {
+      loads.push_back({this->servers[i], {}});
+      for (auto [lower, upper] : this->shards[i]) {
+        Shard shard{RoutingTable::slot_bound(lower),
+                    RoutingTable::slot_bound(upper)};
+        std::map<std::string, uint64_t> weights;
+        double ops = 0;
+        for (uint32_t slot = lower; slot <= upper; slot++) {
+          ops += this->slot_load[slot];
+          weights[RoutingTable::slot_bound(slot)] +=
+              uint64_t(this->slot_load[slot]);
+        }
+        loads.back().shards.push_back(
+            {shard, ops, 0, find_split(shard, weights), ""});
+      }
+    }
+    return loads;
+  }
+
+  // Applies a move as the shardcontroller does: cuts the moved range out of
+  // every shard, then gives it to the destination
+  void apply(const PlannedMove& move) {
+    uint32_t lower = *RoutingTable::parse_slot_bound(move.shard.lower);
+    uint32_t upper = *RoutingTable::parse_slot_bound(move.shard.upper);
+    for (auto& server_shards : this->shards) {
+      std::vector<std::pair<uint32_t, uint32_t>> rest;
+      for (auto [l, u] : server_shards) {
+        if (u < lower || l > upper) {
+          rest.push_back({l, u});
+          continue;
+        }
+        if (l < lower) rest.push_back({l, lower - 1});
+        if (u > upper) rest.push_back({upper + 1, u});
+      }
+      server_shards = std::move(rest);
+    }
+    std::size_t to = std::find(this->servers.begin(), this->servers.end(),
+                               move.to) -
+                     this->servers.begin();
+    this->shards[to].push_back({lower, upper});
+  }
+};
+
+/*
+ * Runs the rebalancer, with splitting and merging, on hashed shards where a
+ * narrow range of slots takes `hot_share` of the load. Moving whole shards
+ * can't balance that, but splitting the hot one where its load is can.
+ */
+static void simulate_hot_range(double hot_share) {
+  SlotCluster cluster;
+  cluster.slot_load.assign(RoutingTable::HASH_SLOTS, 1);
+  double uniform = RoutingTable::HASH_SLOTS;
+  // 64 hot slots, in the middle of the first server's first shard
+  double per_hot = uniform * hot_share / (1 - hot_share) / 64;
+  for (uint32_t slot = 1000; slot < 1064; slot++) {
+    cluster.slot_load[slot] = per_hot;
+  }
+  double total = uniform + per_hot * 64;
+  cluster.servers = make_server_addresses(N_SERVERS);
+  cluster.shards.resize(N_SERVERS);
+  std::vector<Shard> shards = split_hashed(N_SERVERS * 2);
+  for (std::size_t i = 0; i < shards.size(); i++) {
+    cluster.shards[i / 2].push_back(
+        {*RoutingTable::parse_slot_bound(shards[i].lower),
+         *RoutingTable::parse_slot_bound(shards[i].upper)});
+  }
+
+  RebalancePolicy policy;
+  policy.bytes_weight = 0;
+  double fair = total / N_SERVERS;
+  policy.split_ops = fair / 2;
+  policy.merge_ops = fair / 8;
+
+  double before = imbalance(cluster.report(), policy);
+  std::size_t rounds = 0, splits = 0, merges = 0, n_moves = 0;
+  for (; rounds < MAX_ROUNDS; rounds++) {
+    std::vector<ServerLoad> loads = cluster.report();
+    std::vector<PlannedMove> moves = plan_reshard(loads, policy);
+    bool reshard = !moves.empty();
+    if (!reshard) moves = plan_rebalance(loads, policy);
+    if (moves.empty()) break;
+    for (auto&& move : moves) {
+      if (reshard) {
+        // A split moves the upper part of a shard; a merge, whole shards
+        bool split = false;
+        for (auto&& load : loads) {
+          for (auto&& shard : load.shards) {
+            split = split || (shard.shard.lower < move.shard.lower &&
+                              shard.shard.upper == move.shard.upper);
+          }
+        }
+        (split ? splits : merges)++;
+      } else {
+        n_moves++;
+      }
+      cluster.apply(move);
+    }
+  }
+  ASSERT(rounds < MAX_ROUNDS);
+  std::size_t n_shards = 0;
+  for (auto&& server_shards : cluster.shards) n_shards += server_shards.size();
+  double after = imbalance(cluster.report(), policy);
+  cout_color(BLUE, "Hot range (", hot_share * 100, "% of load): max/mean ",
+             before, " -> ", after, " in ", rounds, " rounds, ", splits,
+             " splits, ", merges, " merges, ", n_moves, " moves, ", n_shards,
+             " shards");
+  ASSERT(splits > 0);
+  ASSERT(after <= 1 + policy.threshold);
+}
+
+int main() {
+  RebalancePolicy policy;
+  policy.bytes_weight = 0;
+
+  // Zipf-distributed shard loads, for a few skews
+  for (double s : {0.5, 0.8, 1.0}) {
+    double norm = 0;
+    for (std::size_t i = 0; i < N_SHARDS; i++) {
+      norm += 1 / std::pow(double(i + 1), s);
+    }
+    double hottest = TOTAL_OPS / norm / (TOTAL_OPS / N_SERVERS);
+    auto zipf = [&](std::size_t i) {
+      return TOTAL_OPS / norm / std::pow(double(i + 1), s);
+    };
+    double after = simulate("Zipf s=" + std::to_string(s), policy, zipf);
+    // Balanced to within the threshold, unless one shard is hotter than that
+    ASSERT(after <= std::max(1 + policy.threshold, hottest) + 1e-9);
+  }
+
+  // A few hot shards among uniformly loaded ones
+  {
+    std::mt19937 rng(0);
+    std::vector<double> loads(N_SHARDS, 100);
+    for (int i = 0; i < 8; i++) loads[rng() % 64] = 2'000;
+    double after = simulate("Hot shards", policy,
+                            [&](std::size_t i) { return loads[i]; });
+    ASSERT(after <= 1 + policy.threshold);
+  }
+
+  // Splitting a hot shard where its load is balances what moving whole
+  // shards can't
+  simulate_hot_range(0.3);
+  simulate_hot_range(0.6);
+
+  // Bytes count towards load too: shards move off a server holding the most
+  // data, even without any traffic
+  {
+    RebalancePolicy by_bytes;
+    by_bytes.bytes_weight = 1.0 / (1 << 20);
+    std::vector<ServerLoad> servers = {{"a", {}}, {"b", {}}};
+    std::vector<Shard> shards = split_hashed(4);
+    for (auto&& shard : shards) {
+      servers[0].shards.push_back({shard, 0, 1 << 30, "", ""});
+    }
+    std::vector<PlannedMove> moves = plan_rebalance(servers, by_bytes);
+    ASSERT_EQ(moves.size(), std::size_t{2});
+    ASSERT_EQ(moves[0].to, std::string("b"));
+  }
+
+  // A cluster within the threshold is left alone
+  {
+    std::vector<ServerLoad> servers = {{"a", {}}, {"b", {}}, {"c", {}}};
+    std::vector<Shard> shards = split_hashed(6);
+    for (std::size_t i = 0; i < shards.size(); i++) {
+      servers[i % 3].shards.push_back(
+          {shards[i], i < 2 ? 110.0 : 95.0, 0, "", ""});
+    }
+    ASSERT(plan_rebalance(servers, policy).empty());
+    // ... as is one without load
+    for (auto&& server : servers) {
+      for (auto&& shard : server.shards) shard.ops_per_sec = 0;
+    }
+    ASSERT(plan_rebalance(servers, policy).empty());
+  }
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <map>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "net/routing_table.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 4;
+// Single-slot shards moved at once
+constexpr uint32_t N_MOVED_SLOTS = 1000;
+
+static std::string bound(uint32_t slot) {
+  return RoutingTable::slot_bound(slot);
+}
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+  std::map<std::string, std::vector<Shard>> correct_config;
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_join(sm, server_addresses[i], true));
+  }
+
+  // Hashed shards move like any others
+  std::vector<Shard> shards = split_hashed(N_SERVERS);
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+    correct_config[server_addresses[i]] = {shards[i]};
+  }
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // Hashed and ordinary shards don't mix
+  ASSERT(!test_move(sm, server_addresses[0], {{"A", "B"}}));
+
+  // Cutting a range out of the middle of a shard splits it on slot bounds
+  ASSERT(test_move(sm, server_addresses[3], {{"#100", "#1ZZ"}}));
+  correct_config[server_addresses[0]] = {{"#000", "#0ZZ"},
+                                         {"#200", shards[0].upper}};
+  correct_config[server_addresses[3]] = {{"#100", "#1ZZ"}, shards[3]};
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // A range across two servers' shards
+  uint32_t boundary = *RoutingTable::parse_slot_bound(shards[1].lower);
+  ASSERT(test_move(sm, server_addresses[2],
+                   {{bound(boundary - 2), bound(boundary + 1)}}));
+  correct_config[server_addresses[0]] = {{"#000", "#0ZZ"},
+                                         {"#200", bound(boundary - 3)}};
+  correct_config[server_addresses[1]] = {{bound(boundary + 2),
+                                          shards[1].upper}};
+  correct_config[server_addresses[2]] = {
+      {bound(boundary - 2), bound(boundary + 1)}, shards[2]};
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // Many small shards moved at once, each cutting a hole in the same shard
+  uint32_t start = *RoutingTable::parse_slot_bound(shards[2].lower);
+  std::vector<Shard> moved;
+  std::vector<Shard> left;
+  for (uint32_t i = 0; i < N_MOVED_SLOTS; i++) {
+    uint32_t slot = start + 2 * i;
+    moved.push_back({bound(slot), bound(slot)});
+    if (i + 1 < N_MOVED_SLOTS) {
+      left.push_back({bound(slot + 1), bound(slot + 1)});
+    }
+  }
+  left.push_back({bound(start + 2 * N_MOVED_SLOTS - 1), shards[2].upper});
+  left.push_back({bound(boundary - 2), bound(boundary + 1)});
+
+  auto begin = std::chrono::steady_clock::now();
+  ASSERT(test_move(sm, server_addresses[0], moved));
+  auto elapsed = std::chrono::steady_clock::now() - begin;
+  cout_color(BLUE, "Moved ", N_MOVED_SLOTS, " shards in ",
+             std::chrono::duration<double, std::milli>(elapsed).count(),
+             " ms");
+
+  correct_config[server_addresses[2]] = left;
+  sort_shards(correct_config[server_addresses[2]]);
+  for (auto&& shard : moved) {
+    correct_config[server_addresses[0]].push_back(shard);
+  }
+  sort_shards(correct_config[server_addresses[0]]);
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "shardcontroller/static_shardcontroller.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 3;
+static constexpr std::size_t N_SHARDS = 12;
+
+// Returns whether every shard in `subset` is in `shards`
+static bool holds(const std::vector<Shard>& shards,
+                  const std::vector<Shard>& subset) {
+  return std::all_of(subset.begin(), subset.end(), [&](auto&& shard) {
+    return std::find(shards.begin(), shards.end(), shard) != shards.end();
+  });
+}
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  std::static_pointer_cast<StaticShardController>(sm)->set_placement_policy(
+      PlacementPolicy{});
+
+  std::vector<std::string> servers = make_server_addresses(N_SERVERS);
+  ASSERT(test_join(sm, servers[0], true));
+  std::vector<Shard> shards = split_hashed(N_SHARDS);
+  ASSERT(test_move(sm, servers[0], shards));
+
+  // Each joining server takes its share, from the servers above theirs
+  for (std::size_t i = 1; i < N_SERVERS; i++) {
+    auto before = query_config(sm);
+    ASSERT(test_join(sm, servers[i], true));
+    auto after = query_config(sm);
+    for (std::size_t j = 0; j <= i; j++) {
+      ASSERT_EQ(after[servers[j]].size(), N_SHARDS / (i + 1));
+    }
+    // ... and no other shards move
+    for (std::size_t j = 0; j < i; j++) {
+      ASSERT(holds(before[servers[j]], after[servers[j]]));
+    }
+  }
+
+  // A leaving server's shards are spread over the others, which keep theirs
+  auto before = query_config(sm);
+  ASSERT(test_leave(sm, servers[1], true));
+  auto after = query_config(sm);
+  ASSERT_EQ(after.size(), N_SERVERS - 1);
+  for (auto&& server : {servers[0], servers[2]}) {
+    ASSERT_EQ(after[server].size(), N_SHARDS / (N_SERVERS - 1));
+    ASSERT(holds(after[server], before[server]));
+  }
+
+  // Rejoining takes the same share again
+  ASSERT(test_join(sm, servers[1], true));
+  for (auto&& [server, server_shards] : query_config(sm)) {
+    ASSERT_EQ(server_shards.size(), N_SHARDS / N_SERVERS);
+  }
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
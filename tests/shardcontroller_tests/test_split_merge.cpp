@@ -0,0 +1,118 @@
+#include <map>
+#include <string>
+
+#include "common/shard.hpp"
+#include "net/routing_table.hpp"
+#include "server/load_tracker.hpp"
+#include "shardcontroller/rebalancer.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 2;
+
+// Issues planned moves through the shardcontroller, as its rebalancer does
+static void issue(std::shared_ptr<Shardcontroller> sm,
+                  const std::vector<PlannedMove>& moves) {
+  std::map<std::string, std::vector<Shard>> by_destination;
+  for (auto&& move : moves) by_destination[move.to].push_back(move.shard);
+  for (auto&& [server, shards] : by_destination) {
+    ASSERT(test_move(sm, server, shards));
+  }
+}
+
+int main() {
+  // The split point halves the weight as nearly as it can, and leaves some on
+  // both sides
+  {
+    Shard shard{"A", "F"};
+    ASSERT_EQ(find_split(shard, {{"A", 10}, {"B", 10}, {"C", 60}, {"E", 20}}),
+              std::string("C"));
+    ASSERT_EQ(find_split(shard, {{"B", 1}, {"C", 1}, {"D", 1}, {"E", 1}}),
+              std::string("D"));
+    // A single hot bound can't be split
+    ASSERT_EQ(find_split(shard, {{"C", 100}}), std::string(""));
+    ASSERT_EQ(find_split(shard, {}), std::string(""));
+  }
+
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  std::vector<std::string> servers = make_server_addresses(N_SERVERS);
+  for (auto&& server : servers) ASSERT(test_join(sm, server, true));
+  ASSERT(test_move(sm, servers[0], {{"#000", "#ZZZ"}}));
+
+  RebalancePolicy policy;
+  policy.bytes_weight = 0;
+  policy.split_ops = 1000;
+  policy.split_bytes = 1 << 30;
+  policy.merge_ops = 100;
+
+  // A shard over the ops threshold is split in place, where its server says
+  // its load is
+  std::vector<ServerLoad> loads = {
+      {servers[0], {{{"#000", "#ZZZ"}, 5000, 0, "#I00", "#200"}}},
+      {servers[1], {}}};
+  std::vector<PlannedMove> moves = plan_reshard(loads, policy);
+  ASSERT_EQ(moves.size(), std::size_t{1});
+  ASSERT_EQ(moves[0].from, servers[0]);
+  ASSERT_EQ(moves[0].to, servers[0]);
+  issue(sm, moves);
+  std::map<std::string, std::vector<Shard>> correct_config = {
+      {servers[0], {{"#000", "#HZZ"}, {"#I00", "#ZZZ"}}}, {servers[1], {}}};
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // ... after which the halves are balanced between the servers
+  loads = {{servers[0],
+            {{{"#I00", "#ZZZ"}, 2500, 0, "", ""},
+             {{"#000", "#HZZ"}, 2500, 0, "", ""}}},
+           {servers[1], {}}};
+  ASSERT(plan_reshard(loads, policy).empty());
+  moves = plan_rebalance(loads, policy);
+  ASSERT_EQ(moves.size(), std::size_t{1});
+  ASSERT_EQ(moves[0].to, servers[1]);
+  issue(sm, moves);
+  correct_config = {{servers[0], {{"#000", "#HZZ"}}},
+                    {servers[1], {{"#I00", "#ZZZ"}}}};
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // A shard over the bytes threshold is split at its bytes' midpoint
+  loads = {
+      {servers[0], {{{"#000", "#HZZ"}, 10, uint64_t(2) << 30, "", "#500"}}}};
+  moves = plan_reshard(loads, policy);
+  ASSERT_EQ(moves.size(), std::size_t{1});
+  ASSERT_EQ(moves[0].shard, (Shard{"#500", "#HZZ"}));
+
+  // Hot shards without a split point are left whole
+  loads = {{servers[0], {{{"#000", "#HZZ"}, 5000, 0, "", ""}}}};
+  ASSERT(plan_reshard(loads, policy).empty());
+
+  // Cold adjacent shards on one server are merged, but not ones with a gap
+  // between them, on different servers, or too hot together
+  ASSERT(test_move(sm, servers[0], {{"#000", "#0ZZ"}, {"#100", "#1ZZ"}}));
+  loads = {{servers[0],
+            {{{"#000", "#0ZZ"}, 10, 0, "", ""},
+             {{"#100", "#1ZZ"}, 10, 0, "", ""},
+             {{"#200", "#2ZZ"}, 95, 0, "", ""},
+             {{"#300", "#3ZZ"}, 10, 0, "", ""},
+             {{"#500", "#HZZ"}, 1, 0, "", ""}}},
+           {servers[1], {{{"#I00", "#ZZZ"}, 1, 0, "", ""}}}};
+  moves = plan_reshard(loads, policy);
+  ASSERT_EQ(moves.size(), std::size_t{1});
+  ASSERT_EQ(moves[0].shard, (Shard{"#000", "#1ZZ"}));
+  issue(sm, moves);
+  correct_config = {
+      {servers[0], {{"#000", "#1ZZ"}, {"#200", "#HZZ"}}},
+      {servers[1], {{"#I00", "#ZZZ"}}}};
+  ASSERT_EQ_CONFIGS(query_config(sm), correct_config);
+
+  // Splits and merges count towards the cap on moves
+  policy.max_moves = 2;
+  loads = {{servers[0],
+            {{{"#000", "#0ZZ"}, 5000, 0, "#0I0", ""},
+             {{"#100", "#1ZZ"}, 5000, 0, "#1I0", ""},
+             {{"#200", "#2ZZ"}, 5000, 0, "#2I0", ""}}}};
+  ASSERT_EQ(plan_reshard(loads, policy).size(), std::size_t{2});
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
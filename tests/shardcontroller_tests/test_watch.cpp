@@ -0,0 +1,119 @@
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "common/shard.hpp"
+#include "net/network_helpers.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 5;
+// More changes than the shardcontroller keeps history for
+constexpr size_t N_CHANGES = 40;
+
+// Returns the shardcontroller's config, and its version
+static std::pair<ShardControllerConfig, uint64_t> query(
+    std::shared_ptr<Shardcontroller> sm) {
+  QueryRequest req;
+  QueryResponse res;
+  ASSERT(sm->Query(&req, &res));
+  return {res.config, res.version};
+}
+
+// Returns the server_to_shards map of a config built from Watch responses,
+// with the shards sorted as query_config sorts them
+static std::map<std::string, std::vector<Shard>> sorted(
+    ShardControllerConfig config) {
+  for (auto& [_, shards] : config.server_to_shards) {
+    sort_shards(shards);
+  }
+  return config.server_to_shards;
+}
+
+static WatchResponse watch(std::shared_ptr<Shardcontroller> sm,
+                           uint64_t version, uint32_t timeout_ms = 0) {
+  WatchRequest req{version, timeout_ms};
+  WatchResponse res;
+  ASSERT(sm->Watch(&req, &res));
+  return res;
+}
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+
+  // An unchanged config times out, without changes
+  auto [config, version] = query(sm);
+  WatchResponse res = watch(sm, version, 50);
+  ASSERT_EQ(res.version, version);
+  ASSERT(res.changed.empty() && res.removed.empty());
+
+  // Each Join bumps the version, and the delta has just the new server
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_join(sm, server_addresses[i], true));
+    res = watch(sm, version);
+    ASSERT_EQ(res.version, version + 1);
+    ASSERT(!res.full);
+    ASSERT_EQ(res.changed.size(), std::size_t{1});
+    ASSERT(res.changed.count(server_addresses[i]));
+    apply_watch_response(res, &config);
+    version = res.version;
+  }
+  ASSERT_EQ_CONFIGS(sorted(config), query_config(sm));
+
+  // A failed Join doesn't change the version
+  ASSERT(test_join(sm, server_addresses[0], false));
+  ASSERT_EQ(query(sm).second, version);
+
+  // A Watch that's waiting wakes up on a Move, with only the servers that
+  // changed
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+  version = watch(sm, version).version;
+  config = query(sm).first;
+
+  std::thread mover([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT(test_move(sm, server_addresses[1], {shards[0]}));
+  });
+  auto start = std::chrono::steady_clock::now();
+  res = watch(sm, version);
+  auto waited = std::chrono::steady_clock::now() - start;
+  mover.join();
+  ASSERT(waited >= std::chrono::milliseconds(50));
+  ASSERT_EQ(res.version, version + 1);
+  ASSERT_EQ(res.changed.size(), std::size_t{2});
+  ASSERT(res.changed.count(server_addresses[0]));
+  ASSERT(res.changed.count(server_addresses[1]));
+  apply_watch_response(res, &config);
+  version = res.version;
+  ASSERT_EQ_CONFIGS(sorted(config), query_config(sm));
+
+  // A Leave shows up as a removed server
+  ASSERT(test_leave(sm, server_addresses[N_SERVERS - 1], true));
+  res = watch(sm, version);
+  ASSERT_EQ(res.removed.size(), std::size_t{1});
+  ASSERT_EQ(res.removed[0], server_addresses[N_SERVERS - 1]);
+  apply_watch_response(res, &config);
+  version = res.version;
+  ASSERT_EQ_CONFIGS(sorted(config), query_config(sm));
+
+  // A watcher too far behind gets the whole config
+  uint64_t stale_version = version;
+  ShardControllerConfig stale_config = config;
+  for (std::size_t i = 0; i < N_CHANGES; i++) {
+    ASSERT(test_move(sm, server_addresses[i % 2], {shards[2]}));
+  }
+  res = watch(sm, stale_version);
+  ASSERT(res.full);
+  ASSERT_EQ(res.version, stale_version + N_CHANGES);
+  apply_watch_response(res, &stale_config);
+  ASSERT_EQ_CONFIGS(sorted(stale_config), query_config(sm));
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
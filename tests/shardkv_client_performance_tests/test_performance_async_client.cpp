@@ -0,0 +1,72 @@
+#include <string>
+
+#include "client/async_client.hpp"
+#include "client/simple_client.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_KEYS = 1'000;
+static constexpr std::size_t N_OPS = 200'000;
+// Number of operations kept in flight at once
+static constexpr std::size_t WINDOW = 1'000;
+static constexpr std::size_t kRandStringLength = 10;
+
+/*
+ * Drives N_OPS Gets from a single thread. With AsyncClient, the thread keeps
+ * WINDOW of them in flight, pipelined over a few connections; for comparison,
+ * SimpleClient does them one at a time.
+ */
+int main() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 4);
+
+  AsyncClient client{addr};
+  ASSERT(client.connected());
+
+  std::vector<std::string> keys = make_rand_strs(N_KEYS, kRandStringLength);
+  {
+    std::vector<std::future<bool>> puts;
+    for (auto&& key : keys) {
+      puts.push_back(client.Put(key, key));
+    }
+    for (auto&& put : puts) {
+      ASSERT(put.get());
+    }
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::future<std::optional<std::string>>> gets;
+  gets.reserve(WINDOW);
+  for (std::size_t i = 0; i < N_OPS; i += WINDOW) {
+    for (std::size_t j = i; j < i + WINDOW; j++) {
+      gets.push_back(client.Get(keys[j % N_KEYS]));
+    }
+    for (std::size_t j = i; j < i + WINDOW; j++) {
+      ASSERT(gets[j - i].get() == keys[j % N_KEYS]);
+    }
+    gets.clear();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  cout_color(BLUE, "AsyncClient: ", to_throughput(time, 1, N_OPS),
+             " ops/sec from one thread");
+
+  SimpleClient sync_client{addr};
+  start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < N_OPS / 10; i++) {
+    ASSERT(sync_client.Get(keys[i % N_KEYS]) == keys[i % N_KEYS]);
+  }
+  end = std::chrono::high_resolution_clock::now();
+  time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  cout_color(BLUE, "SimpleClient: ", to_throughput(time, 1, N_OPS / 10),
+             " ops/sec from one thread");
+
+  // Ops on a missing key complete with no value rather than hanging
+  ASSERT(!client.Get("missing key").get());
+
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
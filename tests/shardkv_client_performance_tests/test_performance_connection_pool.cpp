@@ -0,0 +1,84 @@
+#include <string>
+
+#include "client/simple_client.hpp"
+#include "net/connection_pool.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+static constexpr std::size_t N_CLIENTS = 4;
+static constexpr std::size_t N_OPS_PER_CLIENT = 2'000;
+static constexpr std::size_t kRandStringLength = 10;
+
+/*
+ * N_CLIENTS threads share one SimpleClient, and alternate Puts and Gets through
+ * it. Returns throughput in ops/sec, and sets `*connects` to the number of
+ * connections the client made.
+ */
+double run_clients(const std::string& addr,
+                   std::shared_ptr<ConnectionPool> pool, uint64_t* connects) {
+  SimpleClient client{addr, pool};
+
+  std::vector<std::vector<std::string>> keys(N_CLIENTS);
+  for (std::size_t i = 0; i < N_CLIENTS; i++) {
+    keys[i] = make_rand_strs(N_OPS_PER_CLIENT / 2, kRandStringLength);
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < N_CLIENTS; i++) {
+      threads.emplace_back([&, i] {
+        for (auto&& key : keys[i]) {
+          ASSERT(client.Put(key, key));
+          ASSERT(client.Get(key) == key);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+  *connects = pool->connects();
+  return to_throughput(time, N_CLIENTS, N_OPS_PER_CLIENT);
+}
+
+int main() {
+  std::string addr = make_server_addresses(1)[0];
+  std::shared_ptr<KvServer> server =
+      start_server<KvServer, const std::string&, uint64_t>(addr, 4);
+
+  // A pool that keeps no idle connections connects for every request, as
+  // SimpleClient used to
+  uint64_t unpooled_connects;
+  double unpooled = run_clients(addr, std::make_shared<ConnectionPool>(0),
+                                &unpooled_connects);
+  cout_color(BLUE, "Without pooling: ", unpooled, " ops/sec, ",
+             unpooled_connects, " connections");
+
+  uint64_t pooled_connects;
+  double pooled = run_clients(addr, std::make_shared<ConnectionPool>(),
+                              &pooled_connects);
+  cout_color(BLUE, "With pooling: ", pooled, " ops/sec, ", pooled_connects,
+             " connections");
+
+  ASSERT_EQ(unpooled_connects, N_CLIENTS * N_OPS_PER_CLIENT);
+  // At most one connection per thread that was ever in flight at once
+  ASSERT(pooled_connects <= N_CLIENTS);
+
+  // A pooled connection the server closed is detected and replaced
+  auto pool = std::make_shared<ConnectionPool>();
+  SimpleClient client{addr, pool};
+  ASSERT(client.Put("key", "value"));
+  server->stop();
+  server = start_server<KvServer, const std::string&, uint64_t>(addr, 4);
+  ASSERT(client.Put("key", "value"));
+  ASSERT_EQ(pool->connects(), uint64_t{2});
+
+  server->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
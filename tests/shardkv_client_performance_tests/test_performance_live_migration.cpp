@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t N_CLIENTS = 8;
+static constexpr std::size_t N_KEYS = 20'000;
+static constexpr std::size_t VALUE_SIZE = 1024;
+static constexpr std::size_t kRandStringLength = 10;
+static constexpr std::size_t kLoadBatchSize = 1'000;
+static constexpr std::chrono::milliseconds kPhaseTime(1500);
+// How long the Move may take before the benchmark fails
+static constexpr std::chrono::seconds kMigrationTimeout(30);
+
+// Latencies (in microseconds) and failures of the operations in one phase
+struct Phase {
+  std::vector<double> latencies;
+  std::size_t errors = 0;
+};
+
+static void report(const std::string& name, std::vector<Phase>& phases) {
+  Phase all;
+  for (auto&& phase : phases) {
+    all.latencies.insert(all.latencies.end(), phase.latencies.begin(),
+                         phase.latencies.end());
+    all.errors += phase.errors;
+  }
+  ASSERT(!all.latencies.empty());
+  std::sort(all.latencies.begin(), all.latencies.end());
+  auto percentile = [&](double p) {
+    return all.latencies[std::size_t(p * (all.latencies.size() - 1))];
+  };
+  cout_color(BLUE, name, ": ", all.latencies.size(), " ops, ",
+             100.0 * all.errors / all.latencies.size(), "% errors, p50 ",
+             percentile(0.5), " us, p99 ", percentile(0.99), " us");
+  ASSERT_EQ(all.errors, std::size_t{0});
+}
+
+/*
+ * Cluster benchmark of a Move under load: N_CLIENTS clients issue a mix of
+ * Gets and Puts over N_KEYS keys spread across two servers, then half of the
+ * keys move from one server to the other. We report the error rate and the
+ * p50/p99 latency before the Move, and from the Move until the end. With live
+ * migration, the source keeps serving the keys while they're copied, so no
+ * request should fail, and the p99 should stay close to its steady state.
+ */
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 4));
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  std::this_thread::sleep_for(500ms);
+
+  std::vector<std::string> keys = make_rand_strs(N_KEYS, kRandStringLength);
+  {
+    ShardKvClient client(sm_addr);
+    for (std::size_t i = 0; i < N_KEYS; i += kLoadBatchSize) {
+      std::vector<std::string> batch_keys(keys.begin() + i,
+                                          keys.begin() + i + kLoadBatchSize);
+      std::vector<std::string> batch_vals(kLoadBatchSize,
+                                          std::string(VALUE_SIZE, 'v'));
+      ASSERT(client.MultiPut(batch_keys, batch_vals));
+    }
+  }
+
+  // Each client records its operations under the phase current when they
+  // started: 0 before the Move, 1 after
+  std::atomic<int> phase = 0;
+  std::atomic<bool> done = false;
+  std::vector<std::array<Phase, 2>> results(N_CLIENTS);
+  auto run_client = [&](std::size_t i) {
+    ShardKvClient client(sm_addr);
+    std::mt19937 rng(i);
+    std::string value(VALUE_SIZE, char('a' + i));
+    while (!done) {
+      const std::string& key = keys[rng() % N_KEYS];
+      Phase& stats = results[i][phase];
+      auto start = std::chrono::steady_clock::now();
+      bool ok = rng() % 2 ? client.Get(key).has_value()
+                          : client.Put(key, value);
+      auto end = std::chrono::steady_clock::now();
+      stats.latencies.push_back(
+          std::chrono::duration<double, std::micro>(end - start).count());
+      if (!ok) stats.errors++;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < N_CLIENTS; i++) {
+    threads.emplace_back(run_client, i);
+  }
+  std::this_thread::sleep_for(kPhaseTime);
+  phase = 1;
+  ASSERT(test_move(sm, server_addresses[1], {shards[0]}));
+  // The second phase lasts until the source has cut over
+  auto deadline = std::chrono::steady_clock::now() + kMigrationTimeout;
+  while (servers[0]->get_finished_migrations() == 0) {
+    ASSERT(std::chrono::steady_clock::now() < deadline);
+    std::this_thread::sleep_for(10ms);
+  }
+  done = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::vector<Phase> before, during;
+  for (auto&& client_results : results) {
+    before.push_back(std::move(client_results[0]));
+    during.push_back(std::move(client_results[1]));
+  }
+  report("Before the Move", before);
+  report("During and after the Move", during);
+  cout_color(BLUE, "Requests forwarded to the source: ",
+             servers[1]->get_forwarded_requests());
+
+  // Every key ended up on the destination
+  ASSERT_EQ(servers[0]->all_kvpairs().size(), std::size_t{0});
+  ASSERT_EQ(servers[1]->all_kvpairs().size(),
+            std::set<std::string>(keys.begin(), keys.end()).size());
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 8;
+static constexpr std::size_t kRandStringLength = 8;
+static constexpr std::size_t kKeysPerMultiGet = 64;
+static constexpr std::size_t kNumMultiGets = 200;
+
+/*
+ * Cluster benchmark for MultiGet fan-out: every MultiGet asks for the same
+ * number of keys, spread evenly over the first `n_spanned` servers. Since the
+ * per-server requests go out concurrently, latency should stay roughly flat as
+ * `n_spanned` grows, rather than growing with it.
+ */
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    std::shared_ptr<KvServer> ptr =
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 4);
+    servers.push_back(ptr);
+    JoinRequest rq{server_addresses[i]};
+    sm->Join(&rq, {});
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  std::this_thread::sleep_for(500ms);
+
+  // Sort random keys by the server they live on
+  std::optional<ShardControllerConfig> config = client->Query();
+  ASSERT(config);
+  std::map<std::string, std::vector<std::string>> server_keys;
+  while (true) {
+    std::string key = random_string(kRandStringLength);
+    std::optional<std::string> server = config->get_server(key);
+    ASSERT(server);
+    auto& keys = server_keys[*server];
+    if (keys.size() < kKeysPerMultiGet) keys.push_back(key);
+
+    bool done = server_keys.size() == N_SERVERS;
+    for (auto&& [_, keys] : server_keys) {
+      done = done && keys.size() == kKeysPerMultiGet;
+    }
+    if (done) break;
+  }
+  for (auto&& [_, keys] : server_keys) {
+    ASSERT(client->MultiPut(keys, keys));
+  }
+
+  for (std::size_t n_spanned = 1; n_spanned <= N_SERVERS; n_spanned *= 2) {
+    // Take an equal share of the keys from each of n_spanned servers
+    std::vector<std::string> keys;
+    for (std::size_t i = 0; i < n_spanned; i++) {
+      auto& from = server_keys[server_addresses[i]];
+      keys.insert(keys.end(), from.begin(),
+                  from.begin() + kKeysPerMultiGet / n_spanned);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < kNumMultiGets; i++) {
+      std::optional<std::vector<std::string>> values = client->MultiGet(keys);
+      ASSERT(values);
+      ASSERT_EQ_VECS(*values, keys);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto latency =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start) /
+        kNumMultiGets;
+    cout_color(BLUE, "MultiGet of ", keys.size(), " keys over ", n_spanned,
+               " server(s): ", latency.count(), " us");
+  }
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 4;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 40;
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    std::shared_ptr<KvServer> ptr =
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 5);
+    servers.push_back(ptr);
+    JoinRequest rq{server_addresses[i]};
+    sm->Join(&rq, {});
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+
+  std::vector<std::string> keys =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> vals =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+
+  // Sleep to allow the config to update before issuing requests
+  std::this_thread::sleep_for(500ms);
+
+  // Put every third key, so that each server is missing some of its keys
+  for (std::size_t i = 0; i < kNumKeyValPairs; i += 3) {
+    ASSERT(client->Put(keys[i], vals[i]));
+  }
+
+  // A regular MultiGet fails outright...
+  ASSERT(!client->MultiGet(keys));
+
+  // ...but a partial one merges each server's results back into key order
+  std::optional<std::vector<std::optional<std::string>>> return_val =
+      client->PartialMultiGet(keys);
+  ASSERT(return_val);
+  ASSERT_EQ(return_val->size(), kNumKeyValPairs);
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    if (i % 3 == 0) {
+      ASSERT((*return_val)[i] == vals[i]);
+    } else {
+      ASSERT(!(*return_val)[i]);
+    }
+  }
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "client/simple_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 50;
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 5));
+    servers[i]->set_proxy_mode(true);
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+
+  // Sleep to allow the config to update before issuing requests
+  std::this_thread::sleep_for(500ms);
+
+  ShardControllerConfig config;
+  config.server_to_shards = query_config(sm);
+  std::vector<std::string> keys =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> vals =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> owners, others;
+  for (auto&& key : keys) {
+    std::optional<std::string> owner = config.get_server(key);
+    ASSERT(owner);
+    owners.push_back(*owner);
+    others.push_back(*owner == server_addresses[0] ? server_addresses[1]
+                                                   : server_addresses[0]);
+  }
+
+  // Requests sent to the wrong server are relayed to the owner, and flagged
+  // as such
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    bool rerouted = false;
+    std::optional<Response> res =
+        SimpleClient{others[i]}.request(PutRequest{keys[i], vals[i]},
+                                        &rerouted);
+    ASSERT(res && std::get_if<PutResponse>(&*res));
+    ASSERT(rerouted);
+  }
+  uint64_t n_proxied = 0;
+  for (auto&& server : servers) n_proxied += server->get_proxied_requests();
+  ASSERT_EQ(n_proxied, uint64_t{kNumKeyValPairs});
+
+  // The values are on their owners, which serve them without relaying
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    bool rerouted = true;
+    std::optional<Response> res =
+        SimpleClient{owners[i]}.request(GetRequest{keys[i]}, &rerouted);
+    ASSERT(res && std::get_if<GetResponse>(&*res));
+    ASSERT_EQ(std::get<GetResponse>(*res).value, vals[i]);
+    ASSERT(!rerouted);
+  }
+
+  // A MultiGet spanning both servers can't be relayed to either
+  {
+    std::optional<Response> res =
+        SimpleClient{server_addresses[0]}.request(MultiGetRequest{keys});
+    ASSERT(res && is_not_responsible(*res));
+  }
+
+  // Without proxy mode, misrouted requests are rejected
+  for (auto&& server : servers) server->set_proxy_mode(false);
+  {
+    std::optional<Response> res =
+        SimpleClient{others[0]}.request(GetRequest{keys[0]});
+    ASSERT(res && is_not_responsible(*res));
+  }
+  for (auto&& server : servers) server->set_proxy_mode(true);
+
+  // A ShardKvClient with a fresh config routes every request to its owner
+  {
+    ShardKvClient client(sm_addr);
+    for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+      std::optional<std::string> value = client.Get(keys[i]);
+      ASSERT(value);
+      ASSERT_EQ(*value, vals[i]);
+    }
+  }
+  uint64_t n_proxied_after = 0;
+  for (auto&& server : servers) {
+    n_proxied_after += server->get_proxied_requests();
+  }
+  ASSERT_EQ(n_proxied_after, n_proxied);
+
+  // A ShardKvClient with a stale config (from a second shardcontroller, which
+  // has the shards the other way around) drops it once a request it sent is
+  // relayed
+  std::shared_ptr<Shardcontroller> stale_sm =
+      start_shardcontroller(get_host_address("8081"));
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    ASSERT(test_join(stale_sm, server_addresses[i]));
+    ASSERT(test_move(stale_sm, server_addresses[i],
+                     std::vector<Shard>{shards[N_SERVERS - 1 - i]}));
+  }
+  {
+    ShardKvClient client(get_host_address("8081"));
+    // Wait for its watch to cache the config, so that nothing else does
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (!client.get_cached_config_version()) {
+      ASSERT(std::chrono::steady_clock::now() < deadline);
+      std::this_thread::sleep_for(1ms);
+    }
+    std::optional<std::string> value = client.Get(keys[0]);
+    ASSERT(value);
+    ASSERT_EQ(*value, vals[0]);
+    ASSERT(!client.get_cached_config_version());
+  }
+  n_proxied = n_proxied_after;
+  n_proxied_after = 0;
+  for (auto&& server : servers) {
+    n_proxied_after += server->get_proxied_requests();
+  }
+  ASSERT_EQ(n_proxied_after, n_proxied + 1);
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+  stale_sm->stop();
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
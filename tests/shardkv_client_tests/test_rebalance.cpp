@@ -0,0 +1,95 @@
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "client/shardkv_client.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t N_SHARDS = 4;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 200;
+static constexpr std::chrono::seconds kDeadline(20);
+static constexpr std::chrono::seconds kSettleTime(1);
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+  RebalancePolicy policy;
+  policy.interval = 100ms;
+  policy.max_moves = 1;
+  policy.bytes_weight = 0;
+  std::static_pointer_cast<StaticShardController>(sm)->set_rebalance_policy(
+      policy);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    servers.push_back(
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 2));
+    servers[i]->set_load_report_interval(50ms);
+  }
+  // Every shard starts out on the first server
+  ASSERT(test_move(sm, server_addresses[0], split_into(N_SHARDS)));
+  std::this_thread::sleep_for(500ms);
+
+  std::vector<std::string> keys =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> vals =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  {
+    ShardKvClient client(sm_addr);
+    ASSERT(client.MultiPut(keys, vals));
+  }
+
+  // Under a steady load of Gets, the rebalancer moves shards to the idle
+  // server, one at a time, while every Get keeps succeeding
+  std::atomic<bool> done = false;
+  std::thread load([&] {
+    ShardKvClient client(sm_addr);
+    for (std::size_t i = 0; !done; i = (i + 1) % kNumKeyValPairs) {
+      std::optional<std::string> value = client.Get(keys[i]);
+      ASSERT(value);
+      ASSERT_EQ(*value, vals[i]);
+    }
+  });
+  // Wait until shards have moved, and no more have for a while
+  auto start = std::chrono::steady_clock::now();
+  auto last_move = start;
+  std::size_t most_moved = 0;
+  while (std::chrono::steady_clock::now() < start + kDeadline) {
+    auto now = std::chrono::steady_clock::now();
+    std::size_t moved = query_config(sm)[server_addresses[1]].size();
+    // No more than max_moves shards move at once
+    ASSERT(moved <= most_moved + policy.max_moves);
+    if (moved > most_moved) {
+      most_moved = moved;
+      last_move = now;
+    }
+    if (most_moved > 0 && now - last_move > kSettleTime) break;
+    std::this_thread::sleep_for(10ms);
+  }
+  done = true;
+  load.join();
+  ASSERT(most_moved > 0 && most_moved < N_SHARDS);
+  cout_color(BLUE, "Shards rebalanced to the idle server: ", most_moved);
+
+  // Every value is still readable once the moves are done
+  ShardKvClient client(sm_addr);
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    std::optional<std::string> value = client.Get(keys[i]);
+    ASSERT(value);
+    ASSERT_EQ(*value, vals[i]);
+  }
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <string>
+
+#include "client/shardkv_client.hpp"
+#include "common/config.hpp"
+#include "common/shard.hpp"
+#include "server/server.hpp"
+#include "test_utils/test_utils.hpp"
+
+constexpr size_t N_SERVERS = 2;
+static constexpr std::size_t kRandStringLength = 5;
+static constexpr std::size_t kNumKeyValPairs = 50;
+
+int main() {
+  std::string sm_addr = get_host_address("8080");
+  std::shared_ptr<Shardcontroller> sm = start_shardcontroller(sm_addr);
+
+  std::shared_ptr<ShardKvClient> client = make_shared<ShardKvClient>(sm_addr);
+
+  std::vector<std::string> server_addresses = make_server_addresses(N_SERVERS);
+
+  std::vector<Shard> shards = split_into(N_SERVERS);
+  std::vector<std::shared_ptr<KvServer>> servers;
+
+  for (std::size_t i = 0; i < N_SERVERS; i++) {
+    std::shared_ptr<KvServer> ptr =
+        start_server<KvServer, const std::string&, const std::string&,
+                     uint64_t>(server_addresses[i], sm_addr, 5);
+    servers.push_back(ptr);
+    JoinRequest rq{server_addresses[i]};
+    sm->Join(&rq, {});
+    ASSERT(test_move(sm, server_addresses[i], std::vector<Shard>{shards[i]}));
+  }
+
+  std::vector<std::string> keys =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+  std::vector<std::string> vals =
+      make_rand_strs(kNumKeyValPairs, kRandStringLength);
+
+  // Sleep to allow the config to update before issuing requests
+  std::this_thread::sleep_for(500ms);
+
+  // The client caches the config it fetches on its first request
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    ASSERT(client->Put(keys[i], vals[i]));
+  }
+
+  // Move every shard to server 1 behind the client's back, leaving its cached
+  // config stale; the servers pick up the move and transfer their keys
+  ASSERT(test_move(sm, server_addresses[1], shards));
+  std::this_thread::sleep_for(500ms);
+
+  // Requests routed to server 0 are rejected, and retried on server 1 once the
+  // client refreshes its config
+  for (std::size_t i = 0; i < kNumKeyValPairs; i++) {
+    std::optional<std::string> return_val = client->Get(keys[i]);
+    ASSERT(return_val);
+    ASSERT_EQ(*return_val, vals[i]);
+  }
+
+  for (std::shared_ptr<KvServer> server : servers) {
+    server->stop();
+  }
+
+  sm->stop();
+
+  cout_color(GREEN, "Test passed!");
+  return 0;
+}